@@ -1661,6 +1661,7 @@ function getInitializerClass() {
 				global.socket.send('coolclient ' + ProtocolVersionNumber + ' ' + ((now0 + now2) / 2) + ' ' + now1);
 
 				msg += ' accessibilityState=' + global.getAccessibilityState();
+				msg += ' tileCombine=true';
 
 				if (global.ThisIsAMobileApp) {
 					msg += ' lang=' + global.LANG;
@@ -253,6 +253,7 @@ app.definitions.Socket = L.Class.extend({
 		this._map.uiManager.initDarkBackgroundUI(darkBackground);
 
 		msg += ' accessibilityState=' + window.getAccessibilityState();
+		msg += ' tileCombine=true';
 
 		this._doSend(msg);
 		for (var i = 0; i < this._msgQueue.length; i++) {
@@ -467,6 +468,13 @@ app.definitions.Socket = L.Class.extend({
 	_slurpMessage: function(e) {
 		this._extractTextImg(e);
 
+		if (e.textMsg.startsWith('tilecombine:')) {
+			var tiles = this._splitTileCombine(e);
+			for (var i = 0; i < tiles.length; ++i)
+				this._slurpMessage(tiles[i]);
+			return;
+		}
+
 		// Some messages - we want to process & filter early.
 		var docLayer = this._map ? this._map._docLayer : undefined;
 		if (docLayer && docLayer.filterSlurpedMessage(e))
@@ -483,6 +491,34 @@ app.definitions.Socket = L.Class.extend({
 		this._queueSlurpEventEmission(delayMS);
 	},
 
+	// split a tilecombine: message into its tile: and delta: messages
+	_splitTileCombine: function(e) {
+		var tiles = [];
+		var sizes = this.getParameterValue(e.textMsg.split(' ')[1] || '');
+		if (!sizes || !e.imgBytes)
+			return tiles;
+
+		sizes = sizes.split(',');
+		var offset = e.imgIndex;
+		for (var i = 0; i < sizes.length; ++i) {
+			var size = parseInt(sizes[i]);
+			var bytes = e.imgBytes.subarray(offset, offset + size);
+			offset += size;
+
+			var index = bytes.indexOf(10);
+			if (index < 0)
+				index = bytes.length;
+
+			// Without data, these pass through _extractTextImg as they are.
+			tiles.push({
+				textMsg: String.fromCharCode.apply(null, bytes.subarray(0, index)),
+				imgBytes: bytes,
+				imgIndex: index + 1
+			});
+		}
+		return tiles;
+	},
+
 	// make profiling easier
 	_extractCopyObject: function(e) {
 		var index;
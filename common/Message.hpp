@@ -17,6 +17,7 @@
 #include <vector>
 #include <functional>
 
+#include "Common.hpp"
 #include "Protocol.hpp"
 #include "StringVector.hpp"
 #include "Log.hpp"
@@ -76,9 +77,33 @@ public:
         LOG_TRC("Message " << abbr());
     }
 
+    /// Construct a message of a header followed by blobs, which
+    /// are only referenced, to be sent without copying them.
+    /// header must include the full first-line.
+    Message(const std::string& header, std::vector<Blob> blobs, const enum Dir dir) :
+        Message(header, dir)
+    {
+        _blobs = std::move(blobs);
+    }
+
     size_t size() const { return _data.size(); }
     const std::vector<char>& data() const { return _data; }
 
+    /// The blobs following data(), if any.
+    const std::vector<Blob>& blobs() const { return _blobs; }
+
+    /// The frame header and data() as encoded, to share between its recipients.
+    Blob& frame() { return _frame; }
+
+    /// The size of data() and the blobs.
+    size_t totalSize() const
+    {
+        size_t size = _data.size();
+        for (const Blob& blob : _blobs)
+            size += blob->size();
+        return size;
+    }
+
     const StringVector& tokens() const { return _tokens; }
     const std::string& forwardToken() const { return _forwardToken; }
     std::string firstToken() const { return _tokens[0]; }
@@ -222,6 +247,8 @@ private:
 private:
     const std::string _forwardToken;
     std::vector<char> _data;
+    std::vector<Blob> _blobs;
+    Blob _frame;
     const StringVector _tokens;
     const std::string _id;
     std::string _firstLine;
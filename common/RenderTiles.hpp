@@ -12,7 +12,11 @@
 #pragma once
 
 #include <cassert>
+#include <cstring>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <numeric>
 #include <queue>
 #include <thread>
 #include <condition_variable>
@@ -20,6 +24,8 @@
 #include <unordered_map>
 #include <vector>
 
+#include <sys/mman.h>
+
 #include <LibreOfficeKit/LibreOfficeKit.hxx>
 
 #include <common/ThreadPool.hpp>
@@ -31,25 +37,190 @@
 
 namespace RenderTiles
 {
+    /// Recycles pixmaps and tile output buffers across renders, to avoid
+    /// the page faults of fresh multi-megabyte allocations for each tile
+    /// combine. Pixmaps are kept in power-of-two size classes. Only used
+    /// from the kit thread.
+    class BufferPool
+    {
+        /// The smallest class holds a single 256x256 tile.
+        static constexpr unsigned MinClassShift = 18;
+        static constexpr unsigned MaxClassShift = 32;
+        /// Enough for a combine painting while the previous one encodes.
+        static constexpr size_t MaxSparePerClass = 2;
+        /// Outputs keep their largest capacity, so bound them by bytes.
+        static constexpr size_t MaxSpareOutputBytes = 4 * 1024 * 1024;
+        static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+        std::vector<unsigned char*> _spare[MaxClassShift - MinClassShift + 1];
+        std::vector<Blob> _spareOutputs;
+        size_t _spareBytes;
+        size_t _spareOutputBytes;
+        size_t _allocated;
+        size_t _reused;
+        const bool _useHugePages;
+
+        static unsigned getClass(size_t size)
+        {
+            unsigned shift = MinClassShift;
+            while ((size_t(1) << shift) < size)
+                ++shift;
+            return shift;
+        }
+
+    public:
+        BufferPool(bool useHugePages = false)
+            : _spareBytes(0)
+            , _spareOutputBytes(0)
+            , _allocated(0)
+            , _reused(0)
+            , _useHugePages(useHugePages)
+        {
+        }
+
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        ~BufferPool() { trim(); }
+
+        /// Returns zeroed memory of at least size bytes, and its capacity,
+        /// or nullptr when size is beyond the largest class.
+        unsigned char* acquire(size_t size, size_t& capacity)
+        {
+            const unsigned shift = getClass(size);
+            if (shift > MaxClassShift)
+                return nullptr;
+
+            capacity = size_t(1) << shift;
+            std::vector<unsigned char*>& spare = _spare[shift - MinClassShift];
+            if (!spare.empty())
+            {
+                unsigned char* data = spare.back();
+                spare.pop_back();
+                _spareBytes -= capacity;
+                ++_reused;
+
+                // Cheap, compared to faulting in fresh pages.
+                std::memset(data, 0, size);
+                return data;
+            }
+
+            // Fresh anonymous pages are zeroed, and those beyond size never get touched.
+            void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                              -1, 0);
+            if (data == MAP_FAILED)
+                return nullptr;
+
+#ifdef MADV_HUGEPAGE
+            if (_useHugePages && capacity >= HugePageSize)
+                madvise(data, capacity, MADV_HUGEPAGE);
+#endif
+            ++_allocated;
+            return static_cast<unsigned char*>(data);
+        }
+
+        void release(unsigned char* data, size_t capacity)
+        {
+            std::vector<unsigned char*>& spare = _spare[getClass(capacity) - MinClassShift];
+            if (spare.size() < MaxSparePerClass)
+            {
+                spare.push_back(data);
+                _spareBytes += capacity;
+            }
+            else
+                munmap(data, capacity);
+        }
+
+        /// Returns an empty output buffer with at least size bytes reserved.
+        Blob acquireOutput(size_t size)
+        {
+            Blob output;
+            if (!_spareOutputs.empty())
+            {
+                output = std::move(_spareOutputs.back());
+                _spareOutputs.pop_back();
+                _spareOutputBytes -= output->capacity();
+            }
+            else
+                output = std::make_shared<BlobData>();
+            output->reserve(size);
+            return output;
+        }
+
+        /// Outputs still referenced, by a socket that hasn't written them yet, are left to it.
+        void releaseOutput(Blob&& output)
+        {
+            if (output && output.use_count() == 1 && output->capacity() > 0 &&
+                _spareOutputBytes + output->capacity() <= MaxSpareOutputBytes)
+            {
+                output->clear();
+                _spareOutputBytes += output->capacity();
+                _spareOutputs.push_back(std::move(output));
+            }
+        }
+
+        /// Frees all the spare buffers.
+        void trim()
+        {
+            LOG_DBG("Trimming buffer pool of " << _spareBytes << " pixmap bytes and "
+                                               << _spareOutputs.size() << " outputs of "
+                                               << _spareOutputBytes << " bytes");
+            for (unsigned shift = MinClassShift; shift <= MaxClassShift; ++shift)
+            {
+                for (unsigned char* data : _spare[shift - MinClassShift])
+                    munmap(data, size_t(1) << shift);
+                _spare[shift - MinClassShift].clear();
+            }
+            _spareBytes = 0;
+            _spareOutputs.clear();
+            _spareOutputs.shrink_to_fit();
+            _spareOutputBytes = 0;
+        }
+
+        void dumpState(std::ostream& oss) const
+        {
+            oss << "\tbufferPool:"
+                << "\n\t\thuge pages: " << _useHugePages
+                << "\n\t\tspare pixmap bytes: " << _spareBytes
+                << "\n\t\tspare outputs: " << _spareOutputs.size()
+                << "\n\t\tspare output bytes: " << _spareOutputBytes
+                << "\n\t\tpixmaps allocated: " << _allocated
+                << "\n\t\tpixmaps reused: " << _reused << '\n';
+        }
+    };
+
     struct Buffer {
         unsigned char *_data;
+        size_t _capacity;
+        BufferPool *_pool;
         Buffer()
+            : _data(nullptr)
+            , _capacity(0)
+            , _pool(nullptr)
         {
-            _data = nullptr;
         }
         Buffer(size_t x, size_t y) :
             Buffer()
         {
             allocate(x, y);
         }
-        void allocate(size_t x, size_t y)
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+        void allocate(size_t x, size_t y, BufferPool* pool = nullptr)
         {
             assert(!_data);
-            _data = static_cast<unsigned char *>(calloc(x * y, 4));
+            if (pool)
+                _data = pool->acquire(x * y * 4, _capacity);
+            if (_data)
+                _pool = pool;
+            else
+                _data = static_cast<unsigned char *>(calloc(x * y, 4));
         }
         ~Buffer()
         {
-            if (_data)
+            if (_pool)
+                _pool->release(_data, _capacity);
+            else if (_data)
                 free (_data);
         }
         unsigned char *data() { return _data; }
@@ -58,29 +229,194 @@ namespace RenderTiles
     // FIXME: we should perhaps increment only on a plausible edit
     static TileWireId getCurrentWireId(bool increment = false)
     {
-        static TileWireId nextId = 0;
+        static TileWireId nextId = RestoredTileWireId;
         if (increment)
             nextId++;
         return nextId;
     }
 
-    bool doRender(
+    /// A tile combine painted into its own pixmap, with the encoding
+    /// of its tiles queued or running on the pool, until it is sent.
+    struct PaintedTiles
+    {
+        PaintedTiles(const TileCombined& tileCombined, BufferPool* pool)
+            : _tileCombined(tileCombined)
+            , _pool(pool)
+            , _pixmapWidth(0)
+            , _pixmapHeight(0)
+            , _start(std::chrono::steady_clock::now())
+        {
+        }
+
+        // The encoding tasks refer to our members.
+        PaintedTiles(const PaintedTiles&) = delete;
+        PaintedTiles& operator=(const PaintedTiles&) = delete;
+
+        ~PaintedTiles()
+        {
+            if (_pool)
+            {
+                for (auto& encoded : _encodedTiles)
+                    _pool->releaseOutput(std::move(encoded._data));
+            }
+        }
+
+        // Each tile is compressed into its own slot, so
+        // the encoding threads never need to synchronize on output.
+        // The slots are sent as they are, without copying them together.
+        struct EncodedTile
+        {
+            Blob _data;
+            TileWireId _wireId = 0;
+            bool _encoded = false;
+        };
+
+        const TileCombined _tileCombined;
+        BufferPool* const _pool;
+        Util::Rectangle _renderArea;
+        size_t _pixmapWidth;
+        size_t _pixmapHeight;
+        Buffer _pixmap;
+        std::vector<EncodedTile> _encodedTiles;
+        std::vector<std::function<void()>> _work;
+        std::function<void(unsigned char* data, int offsetX, int offsetY, size_t pixmapWidth,
+                           size_t pixmapHeight, int pixelWidth, int pixelHeight,
+                           LibreOfficeKitTileMode mode)> _blendWatermark;
+        const std::chrono::steady_clock::time_point _start;
+    };
+
+    /// Finds the bounds of the damage to an area, in twips, since a damage
+    /// sequence number; returns false when that is not known.
+    typedef std::function<bool(uint64_t since, const Util::Rectangle& area,
+                               Util::Rectangle& damage)> DamageFn;
+
+    /// Restore the pixels of the tiles painted before, returning the area that
+    /// still needs painting: the bounds of their damage since, and of the tiles
+    /// that could not be restored.
+    Util::Rectangle restoreUndamaged(DeltaGenerator& deltaGen, const TileCombined& tileCombined,
+                                     const std::vector<Util::Rectangle>& tileRecs,
+                                     const Util::Rectangle& renderArea, Buffer& pixmap,
+                                     size_t pixmapWidth, int canonicalViewId,
+                                     uint64_t damageSeq, const DamageFn& getDamage)
+    {
+        const auto& tiles = tileCombined.getTiles();
+        const int pixelWidth = tileCombined.getWidth();
+        const int pixelHeight = tileCombined.getHeight();
+
+        Util::Rectangle paintArea;
+        for (size_t i = 0; i < tileRecs.size(); ++i)
+        {
+            const Util::Rectangle& tileRect = tileRecs[i];
+            const size_t offsetX = (tileRect.getLeft() - renderArea.getLeft()) / tileCombined.getTileWidth() * pixelWidth;
+            const size_t offsetY = (tileRect.getTop() - renderArea.getTop()) / tileCombined.getTileHeight() * pixelHeight;
+
+            uint64_t paintedSeq = 0;
+            Util::Rectangle damage = tileRect;
+            if (!tiles[i].isPreview() &&
+                deltaGen.restorePixels(TileLocation(tileRect.getLeft(), tileRect.getTop(),
+                                                    tileRect.getWidth(), tileCombined.getPart(),
+                                                    canonicalViewId),
+                                       pixmap.data(), offsetX, offsetY, pixelWidth, pixelHeight,
+                                       pixmapWidth, paintedSeq) &&
+                paintedSeq <= damageSeq && getDamage(paintedSeq, tileRect, damage))
+            {
+                if (!damage.hasSurface())
+                    continue;
+            }
+            else
+                damage = tileRect;
+
+            paintArea.extend(damage);
+        }
+
+        return paintArea;
+    }
+
+    /// Paint only paintArea, in twips, of the pixmap of renderArea. Returns
+    /// false, with the pixmap cleared, when that is not worth it.
+    bool paintDamage(const std::shared_ptr<lok::Document>& document,
+                     const TileCombined& tileCombined, const Util::Rectangle& renderArea,
+                     const Util::Rectangle& paintArea, Buffer& pixmap,
+                     size_t pixmapWidth, size_t pixmapHeight, BufferPool* pool)
+    {
+        // Widen by a few pixels for anti-aliasing, and snap to pixels that
+        // start at whole twips, for the same rendering as the whole area.
+        constexpr int64_t margin = 4;
+        const auto toPixels = [](int64_t from, int64_t to, int64_t pixels, int64_t twips,
+                                 int64_t limit, int64_t& first, int64_t& last)
+        {
+            const int64_t snap = pixels / std::gcd(pixels, twips);
+            first = std::max<int64_t>((from * pixels / twips - margin) / snap * snap, 0);
+            last = std::min<int64_t>(((to * pixels + twips - 1) / twips + margin + snap - 1) / snap * snap, limit);
+        };
+
+        int64_t x1, x2, y1, y2;
+        toPixels(paintArea.getLeft() - renderArea.getLeft(), paintArea.getRight() - renderArea.getLeft(),
+                 tileCombined.getWidth(), tileCombined.getTileWidth(), pixmapWidth, x1, x2);
+        toPixels(paintArea.getTop() - renderArea.getTop(), paintArea.getBottom() - renderArea.getTop(),
+                 tileCombined.getHeight(), tileCombined.getTileHeight(), pixmapHeight, y1, y2);
+
+        const size_t width = x2 - x1;
+        const size_t height = y2 - y1;
+        if (width * height * 4 > pixmapWidth * pixmapHeight * 3)
+        {
+            // Paint the whole area on a clean slate.
+            memset(pixmap.data(), 0, pixmapWidth * pixmapHeight * 4);
+            return false;
+        }
+
+        Buffer damaged;
+        damaged.allocate(width, height, pool);
+
+        const auto start = std::chrono::steady_clock::now();
+        document->paintPartTile(damaged.data(),
+                                tileCombined.getPart(),
+                                tileCombined.getEditMode(),
+                                width, height,
+                                renderArea.getLeft() + x1 * tileCombined.getTileWidth() / tileCombined.getWidth(),
+                                renderArea.getTop() + y1 * tileCombined.getTileHeight() / tileCombined.getHeight(),
+                                width * tileCombined.getTileWidth() / tileCombined.getWidth(),
+                                height * tileCombined.getTileHeight() / tileCombined.getHeight());
+        const auto elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        LOG_DBG("paintPartTile      damaged " << width << 'x' << height << " at (" << x1 << ", "
+                << y1 << ") of " << pixmapWidth << 'x' << pixmapHeight << " took " << elapsedUs);
+
+        for (size_t y = 0; y < height; ++y)
+            memcpy(pixmap.data() + ((y1 + y) * pixmapWidth + x1) * 4,
+                   damaged.data() + y * width * 4, width * 4);
+
+        return true;
+    }
+
+    /// Paint the area of tileCombined, preparing the encoding of each tile;
+    /// returns nullptr when there are no tiles. Buffers come from the pool,
+    /// when given. The watermark, if any, is blended into each tile by its
+    /// encoding task, so blendWatermark must be safe to call from the pool.
+    /// With getDamage, tiles painted before are restored from deltaGen and
+    /// only their damage since is repainted; damageSeq is the current one.
+    std::unique_ptr<PaintedTiles> paintTiles(
         const std::shared_ptr<lok::Document>& document, DeltaGenerator& deltaGen,
-        TileCombined& tileCombined, ThreadPool& pngPool,
+        const TileCombined& tileCombined, BufferPool* pool,
         const std::function<void(unsigned char* data, int offsetX, int offsetY, size_t pixmapWidth,
                                  size_t pixmapHeight, int pixelWidth, int pixelHeight,
                                  LibreOfficeKitTileMode mode)>& blendWatermark,
-        const std::function<void(const char* buffer, size_t length)>& outputMessage,
+        uint64_t damageSeq, const DamageFn& getDamage,
         [[maybe_unused]] unsigned mobileAppDocId, int canonicalViewId, bool dumpTiles)
     {
-        const auto& tiles = tileCombined.getTiles();
-
         // Otherwise our delta-building & threading goes badly wrong
         // external sources of tilecombine are checked at the perimeter
         assert(!tileCombined.hasDuplicates());
 
+        if (tileCombined.getTiles().empty())
+            return nullptr;
+
+        auto painted = std::make_unique<PaintedTiles>(tileCombined, pool);
+        painted->_blendWatermark = blendWatermark;
+        const auto& tiles = painted->_tileCombined.getTiles();
+
         // Calculate the area we cover
-        Util::Rectangle renderArea;
+        Util::Rectangle& renderArea = painted->_renderArea;
         std::vector<Util::Rectangle> tileRecs;
         tileRecs.reserve(tiles.size());
 
@@ -110,43 +446,55 @@ namespace RenderTiles
         assert (pixelWidth > 0 && pixelHeight > 0);
         const size_t pixmapWidth = tilesByX * pixelWidth;
         const size_t pixmapHeight = tilesByY * pixelHeight;
+        painted->_pixmapWidth = pixmapWidth;
+        painted->_pixmapHeight = pixmapHeight;
 
         if (pixmapWidth > 4096 || pixmapHeight > 4096)
             LOG_WRN("Unusual extremely large tile combine of size " << pixmapWidth << 'x' << pixmapHeight);
 
-        RenderTiles::Buffer pixmap(pixmapWidth, pixmapHeight);
+        Buffer& pixmap = painted->_pixmap;
+        pixmap.allocate(pixmapWidth, pixmapHeight, pool);
+
+        // Only paint what was damaged since the pixels we have, where we can.
+        Util::Rectangle paintArea = renderArea;
+        if (getDamage)
+            paintArea = restoreUndamaged(deltaGen, tileCombined, tileRecs, renderArea, pixmap,
+                                         pixmapWidth, canonicalViewId, damageSeq, getDamage);
 
-        // Render the whole area
-        const double area = pixmapWidth * pixmapHeight;
         const auto start = std::chrono::steady_clock::now();
-        LOG_TRC("Calling paintPartTile(" << (void*)pixmap.data() << ')');
-        document->paintPartTile(pixmap.data(),
-                                tileCombined.getPart(),
-                                tileCombined.getEditMode(),
-                                pixmapWidth, pixmapHeight,
-                                renderArea.getLeft(), renderArea.getTop(),
-                                renderArea.getWidth(), renderArea.getHeight());
-        auto duration = std::chrono::steady_clock::now() - start;
-        const auto elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(duration);
-        LOG_DBG("paintPartTile      " << tileRecs.size() << " tiles at ("
-                << renderArea.getLeft() << ", " << renderArea.getTop() << "), ("
-                << renderArea.getWidth() << ", " << renderArea.getHeight() << ") "
-                << " took " << elapsedUs << " (" << area / elapsedUs.count() << " MP/s).");
+        if (!paintArea.hasSurface())
+        {
+            LOG_DBG("Nothing damaged in " << tileRecs.size() << " tiles at ("
+                    << renderArea.getLeft() << ", " << renderArea.getTop() << ")");
+        }
+        else if (!getDamage || !paintDamage(document, tileCombined, renderArea, paintArea, pixmap,
+                                            pixmapWidth, pixmapHeight, pool))
+        {
+            // Render the whole area
+            const double area = pixmapWidth * pixmapHeight;
+            LOG_TRC("Calling paintPartTile(" << (void*)pixmap.data() << ')');
+            document->paintPartTile(pixmap.data(),
+                                    tileCombined.getPart(),
+                                    tileCombined.getEditMode(),
+                                    pixmapWidth, pixmapHeight,
+                                    renderArea.getLeft(), renderArea.getTop(),
+                                    renderArea.getWidth(), renderArea.getHeight());
+            auto duration = std::chrono::steady_clock::now() - start;
+            const auto elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(duration);
+            LOG_DBG("paintPartTile      " << tileRecs.size() << " tiles at ("
+                    << renderArea.getLeft() << ", " << renderArea.getTop() << "), ("
+                    << renderArea.getWidth() << ", " << renderArea.getHeight() << ") "
+                    << " took " << elapsedUs << " (" << area / elapsedUs.count() << " MP/s).");
+        }
 
         const auto mode = static_cast<LibreOfficeKitTileMode>(document->getTileMode());
+        const int part = tileCombined.getPart();
 
-        const size_t pixmapSize = 4 * pixmapWidth * pixmapHeight;
-        std::vector<char> output;
-        output.reserve(pixmapSize);
-
-        // Compress the area as tiles
-        TileCombinedBuilder renderedTiles;
-        std::vector<TileWireId> renderingIds;
+        std::vector<PaintedTiles::EncodedTile>& encodedTiles = painted->_encodedTiles;
+        encodedTiles.resize(tileRecs.size());
 
         size_t tileIndex = 0;
 
-        std::mutex pngMutex;
-
         for (const Util::Rectangle& tileRect : tileRecs)
         {
             const size_t positionX = (tileRect.getLeft() - renderArea.getLeft()) / tileCombined.getTileWidth();
@@ -155,12 +503,6 @@ namespace RenderTiles
             const int offsetX = positionX * pixelWidth;
             const int offsetY = positionY * pixelHeight;
 
-            // FIXME: should this be in the delta / compression thread ?
-            blendWatermark(pixmap.data(), offsetX, offsetY,
-                           pixmapWidth, pixmapHeight,
-                           pixelWidth, pixelHeight,
-                           mode);
-
             // FIXME: prettify this.
             bool forceKeyframe = tiles[tileIndex].getOldWireId() == 0;
 
@@ -170,17 +512,25 @@ namespace RenderTiles
             bool skipCompress = false;
             if (!skipCompress)
             {
-                renderingIds.push_back(wireId);
+                encodedTiles[tileIndex]._wireId = wireId;
+                encodedTiles[tileIndex]._data = pool ? pool->acquireOutput(pixelWidth * pixelHeight)
+                                                     : std::make_shared<BlobData>();
 
                 LOG_TRC("Queued encoding of tile #" << tileIndex << " at (" << positionX << ',' << positionY << ") with " <<
                         (forceKeyframe?"force keyframe" : "allow delta") << ", wireId: " << wireId);
 
-                // Queue to be executed later in parallel inside 'run'
-                pngPool.pushWork([=,&output,&pixmap,&tiles,&renderedTiles,
-                                  &pngMutex,&deltaGen]()
+                // Executed later in parallel, once queued on the pool.
+                painted->_work.emplace_back([=,&pixmap,&tiles,&encodedTiles,&deltaGen,&blend=painted->_blendWatermark]()
                     {
-                        std::vector< char > data;
-                        data.reserve(pixmapWidth * pixmapHeight * 1);
+                        BlobData& data = *encodedTiles[tileIndex]._data;
+                        data.reserve(pixelWidth * pixelHeight * 1);
+
+                        // Each tile only touches its own area of the pixmap.
+                        if (blend)
+                            blend(pixmap.data(), offsetX, offsetY,
+                                  pixmapWidth, pixmapHeight,
+                                  pixelWidth, pixelHeight,
+                                  mode);
 
                         // FIXME: don't try to store & create deltas for read-only documents.
                         if (!tiles[tileIndex].isPreview())
@@ -195,10 +545,11 @@ namespace RenderTiles
                                                          tileRect.getLeft(),
                                                          tileRect.getTop(),
                                                          tileRect.getWidth(),
-                                                         tileCombined.getPart(),
+                                                         part,
                                                          canonicalViewId
                                                          ),
-                                                     data, wireId, forceKeyframe, dumpTiles, mode);
+                                                     data, wireId, forceKeyframe, dumpTiles, mode,
+                                                     damageSeq);
                         }
                         else
                         {
@@ -215,52 +566,86 @@ namespace RenderTiles
                         }
 
                         LOG_TRC("Tile " << tileIndex << " is " << data.size() << " bytes.");
-                        std::unique_lock<std::mutex> pngLock(pngMutex);
-                        output.insert(output.end(), data.begin(), data.end());
-                        renderedTiles.pushRendered(tiles[tileIndex], wireId, data.size());
+                        encodedTiles[tileIndex]._encoded = true;
                     });
             }
             tileIndex++;
         }
 
-        pngPool.run();
+        return painted;
+    }
+
+    /// Queue the encoding of the painted tiles on the pool, to be started by
+    /// run() or runAsync(). The DeltaGenerator can only encode one combine at a
+    /// time, so the pool must have completed any previous combine.
+    void queueEncoding(PaintedTiles& painted, ThreadPool& pngPool)
+    {
+        assert(!pngPool.isRunning());
+        for (auto& work : painted._work)
+            pngPool.pushWork(work);
+        painted._work.clear();
+    }
+
+    /// The message header, followed by the encoded tiles, which are referenced rather than copied.
+    typedef std::function<void(const char* header, size_t length, const std::vector<Blob>& tiles)>
+        OutputFn;
 
-        duration = std::chrono::steady_clock::now() - start;
+    /// Send the encoded tiles, once the pool has completed their encoding.
+    bool sendTiles(const PaintedTiles& painted, DeltaGenerator& deltaGen,
+                   const OutputFn& outputMessage)
+    {
+        const TileCombined& tileCombined = painted._tileCombined;
+        const auto& tiles = tileCombined.getTiles();
+        const auto& encodedTiles = painted._encodedTiles;
+        const Util::Rectangle& renderArea = painted._renderArea;
+
+        const double area = painted._pixmapWidth * painted._pixmapHeight;
+        const auto duration = std::chrono::steady_clock::now() - painted._start;
         const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(duration);
-        LOG_DBG("paintPartTile+comp " << tileRecs.size() << " tiles at ("
+        LOG_DBG("paintPartTile+comp " << tiles.size() << " tiles at ("
                 << renderArea.getLeft() << ", " << renderArea.getTop()
                 << "), (" << renderArea.getWidth() << ", "
                 << renderArea.getHeight() << ") "
                 << " took " << elapsed << " (" << area / elapsed.count() << " MP/s).");
 
-        if (tileIndex == 0)
-            return false;
+        TileCombinedBuilder renderedTiles;
+        size_t outputSize = 0;
+        for (size_t i = 0; i < encodedTiles.size(); ++i)
+        {
+            const auto& encoded = encodedTiles[i];
+            if (encoded._encoded)
+            {
+                renderedTiles.pushRendered(tiles[i], encoded._wireId, encoded._data->size());
+                outputSize += encoded._data->size();
+            }
+        }
 
         std::string tileMsg;
         if (tileCombined.getCombined())
         {
             tileMsg = renderedTiles.serialize("tilecombine:", "\n");
 
-            LOG_TRC("Sending back painted tiles for " << tileMsg << " of size " << output.size() << " bytes) for: " << tileMsg);
+            LOG_TRC("Sending back painted tiles for " << tileMsg << " of size " << outputSize << " bytes) for: " << tileMsg);
 
-            const size_t responseSize = tileMsg.size() + output.size();
-            std::unique_ptr<char[]> response(std::make_unique<char[]>(responseSize));
-            std::copy(tileMsg.begin(), tileMsg.end(), response.get());
-            std::copy(output.begin(), output.end(), response.get() + tileMsg.size());
-            outputMessage(response.get(), responseSize);
+            std::vector<Blob> blobs;
+            blobs.reserve(encodedTiles.size());
+            for (const auto& encoded : encodedTiles)
+            {
+                if (encoded._encoded)
+                    blobs.push_back(encoded._data);
+            }
+            outputMessage(tileMsg.data(), tileMsg.size(), blobs);
         }
         else
         {
-            size_t outputOffset = 0;
-            for (const auto &i : renderedTiles.getTiles())
+            size_t renderedIndex = 0;
+            for (const auto& encoded : encodedTiles)
             {
-                tileMsg = i.serialize("tile:", "\n");
-                const size_t responseSize = tileMsg.size() + i.getImgSize();
-                std::unique_ptr<char[]> response(std::make_unique<char[]>(responseSize));
-                std::copy(tileMsg.begin(), tileMsg.end(), response.get());
-                std::copy(output.begin() + outputOffset, output.begin() + outputOffset + i.getImgSize(), response.get() + tileMsg.size());
-                outputMessage(response.get(), responseSize);
-                outputOffset += i.getImgSize();
+                if (!encoded._encoded)
+                    continue;
+
+                tileMsg = renderedTiles.getTiles()[renderedIndex++].serialize("tile:", "\n");
+                outputMessage(tileMsg.data(), tileMsg.size(), { encoded._data });
             }
         }
 
@@ -268,6 +653,26 @@ namespace RenderTiles
         deltaGen.rebalanceDeltas();
         return true;
     }
+
+    bool doRender(
+        const std::shared_ptr<lok::Document>& document, DeltaGenerator& deltaGen,
+        TileCombined& tileCombined, ThreadPool& pngPool,
+        const std::function<void(unsigned char* data, int offsetX, int offsetY, size_t pixmapWidth,
+                                 size_t pixmapHeight, int pixelWidth, int pixelHeight,
+                                 LibreOfficeKitTileMode mode)>& blendWatermark,
+        const OutputFn& outputMessage, unsigned mobileAppDocId, int canonicalViewId, bool dumpTiles)
+    {
+        std::unique_ptr<PaintedTiles> painted = paintTiles(
+            document, deltaGen, tileCombined, nullptr, blendWatermark, 0, nullptr, mobileAppDocId,
+            canonicalViewId, dumpTiles);
+        if (!painted)
+            return false;
+
+        queueEncoding(*painted, pngPool);
+        pngPool.run();
+
+        return sendTiles(*painted, deltaGen, outputMessage);
+    }
 }
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
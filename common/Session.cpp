@@ -45,6 +45,7 @@ Session::Session(const std::shared_ptr<ProtocolHandlerInterface>& protocol, cons
     , _isAdminUser(std::nullopt)
     , _watermarkOpacity(0.2)
     , _accessibilityState(false)
+    , _acceptsTileCombine(false)
     , _disableVerifyHost(false)
 {
 }
@@ -79,6 +80,25 @@ bool Session::sendBinaryFrame(const char *buffer, int length)
     return _protocol->sendBinaryMessage(buffer, length) >= length;
 }
 
+bool Session::sendBinaryFrameWithBlobs(const char* buffer, int length,
+                                       const std::vector<Blob>& blobs, Blob* frame)
+{
+    int total = length;
+    for (const Blob& blob : blobs)
+        total += blob->size();
+
+    if (!_protocol)
+    {
+        LOG_TRC("ERR - missing protocol " << getName() << ": Send: " << std::to_string(total)
+                                          << " binary bytes");
+        return false;
+    }
+
+    LOG_TRC("Send: " << std::to_string(total) << " binary bytes in " << blobs.size() + 1
+                     << " blocks");
+    return _protocol->sendBinaryMessageWithBlobs(buffer, length, blobs, frame) >= total;
+}
+
 void Session::parseDocOptions(const StringVector& tokens, int& part, std::string& timestamp, std::string& doctemplate)
 {
     // First token is the "load" command itself.
@@ -228,6 +248,11 @@ void Session::parseDocOptions(const StringVector& tokens, int& part, std::string
             _accessibilityState = value == "true";
             ++offset;
         }
+        else if (name == "tileCombine")
+        {
+            _acceptsTileCombine = value == "true";
+            ++offset;
+        }
         else if (name == "isAllowChangeComments")
         {
             _isAllowChangeComments = value == "true";
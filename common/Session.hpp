@@ -129,6 +129,11 @@ public:
     virtual bool sendBinaryFrame(const char* buffer, int length);
     virtual bool sendTextFrame(const char* buffer, const int length);
 
+    /// Send a binary frame of the buffer followed by the blobs, without copying them.
+    /// frame, if given, shares the encoded frame header between the recipients of a message.
+    bool sendBinaryFrameWithBlobs(const char* buffer, int length, const std::vector<Blob>& blobs,
+                                  Blob* frame = nullptr);
+
     /// Get notified that the underlying transports disconnected
     void onDisconnect() override { /* ignore */ }
 
@@ -282,6 +287,8 @@ public:
 
     bool getAccessibilityState() const { return _accessibilityState; }
 
+    bool acceptsTileCombine() const { return _acceptsTileCombine; }
+
     void disableSpellCheckIfReadOnly();
 
 protected:
@@ -418,6 +425,9 @@ private:
     /// Specifies whether accessibility support is enabled for this session.
     bool _accessibilityState;
 
+    /// Specifies whether the client understands tilecombine: messages.
+    bool _acceptsTileCombine;
+
     /// Specifies whether certification verification for the wopi server
     /// should be disabled in core
     bool _disableVerifyHost;
@@ -11,8 +11,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <thread>
 #include <condition_variable>
@@ -20,6 +24,15 @@
 #include <unordered_map>
 #include <vector>
 
+/// A fork/join pool: work is queued with pushWork and then
+/// executed by run(), which returns once all of it is done,
+/// or started by runAsync() and later joined with wait().
+/// All the threads, and the caller of wait(), claim the tasks of a
+/// batch in order through one shared atomic cursor, so there is no
+/// lock on the task path. There are no per-thread queues and no
+/// work-stealing: a thread that is done with its task takes the next
+/// unclaimed one. The mutex is only used to sleep and wake the
+/// threads between batches.
 class ThreadPool
 {
     friend class WhiteBoxTests;
@@ -28,16 +41,23 @@ class ThreadPool
     std::condition_variable _cond;
     std::condition_variable _complete;
     typedef std::function<void()> ThreadFn;
-    std::queue<ThreadFn> _work;
+    std::vector<ThreadFn> _work;
     std::vector<std::thread> _threads;
-    size_t _working;
+    std::atomic<size_t> _next; ///< Index of the next task to claim.
+    std::atomic<size_t> _pending; ///< Tasks not yet completed.
+    std::atomic<size_t> _working; ///< Threads inside the current batch.
+    uint64_t _batch; ///< Bumped under _mutex to wake the threads.
     int _maxConcurrency;
     bool _shutdown;
     std::atomic<bool> _running;
+    std::chrono::steady_clock::time_point _completedTime; ///< Guarded by _mutex while running.
 
 public:
     ThreadPool()
-        : _working(0)
+        : _next(0)
+        , _pending(0)
+        , _working(0)
+        , _batch(0)
         , _maxConcurrency(2)
         , _shutdown(false)
         , _running(false)
@@ -74,6 +94,7 @@ public:
     {
         {
             std::unique_lock<std::mutex> lock(_mutex);
+            assert(!_running);
             assert(_working == 0);
             _shutdown = true;
         }
@@ -83,82 +104,133 @@ public:
         _threads.clear();
     }
 
-    size_t count() const { return _work.size(); }
+    size_t count() const { return _running ? _pending.load() : _work.size(); }
 
     void pushWork(const ThreadFn& fn)
     {
-        std::unique_lock<std::mutex> lock(_mutex);
         assert(!_running);
         assert(!_shutdown);
         assert(_working == 0);
-        _work.push(fn);
+        _work.push_back(fn);
+    }
+
+    void run()
+    {
+        // Avoid notifying threads if we don't need to.
+        beginBatch(_work.size() > 1);
+        wait();
     }
 
-    void runOne(std::unique_lock<std::mutex>& lock)
+    /// Start the queued work on the pool threads and return at once,
+    /// so the caller can do something else meanwhile. wait() must be
+    /// called before more work is pushed. Without pool threads all
+    /// the work is left to wait().
+    void runAsync() { beginBatch(!_work.empty()); }
+
+    /// Help with the remaining work of the current batch and return
+    /// once all of it is done.
+    void wait()
     {
         assert(_running);
-        assert(!_work.empty());
 
-        ThreadFn fn = _work.front();
-        _work.pop();
-        _working++;
-        lock.unlock();
+        ++_working;
+        runBatch();
 
-        try
-        {
-            fn();
-        }
-        catch (...)
-        {
-            LOG_ERR("Exception in thread pool execution.");
-        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _complete.wait(lock, [this]() { return _pending == 0; });
 
-        lock.lock();
-        _working--;
-        if (_work.empty() && _working == 0)
-            _complete.notify_all();
+        // Late threads must leave before _work can change again.
+        _running = false;
+        _complete.wait(lock, [this]() { return _working == 0; });
+
+        _work.clear();
     }
 
-    void run()
+    bool isRunning() const { return _running; }
+
+    /// When the last task of the previous batch completed; valid after wait().
+    std::chrono::steady_clock::time_point getCompletedTime() const { return _completedTime; }
+
+    void dumpState(std::ostream& oss)
+    {
+        oss << "\tthreadPool:"
+            << "\n\t\tshutdown: " << _shutdown << "\n\t\tworking: " << _working
+            << "\n\t\twork count: " << count() << "\n\t\tthread count " << _threads.size() << "\n";
+    }
+
+private:
+    void beginBatch(bool notifyThreads)
     {
-        std::unique_lock<std::mutex> lock(_mutex);
         assert(!_running);
         assert(_working == 0);
 
+        _next = 0;
+        _pending = _work.size();
+        _completedTime = std::chrono::steady_clock::now();
         _running = true;
 
-        // Avoid notifying threads if we don't need to.
-        bool useThreads = _threads.size() > 1 && _work.size() > 1;
-        if (useThreads)
+        if (notifyThreads && !_threads.empty())
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            ++_batch;
             _cond.notify_all();
+        }
+    }
 
-        while (!_work.empty())
-            runOne(lock);
-
-        if (useThreads && (_working > 0 || !_work.empty()))
-            _complete.wait(lock, [this]() { return _working == 0 && _work.empty(); });
-
-        _running = false;
+    /// Claim and execute tasks of the current batch until there are none left.
+    /// The caller has counted itself in _working.
+    void runBatch()
+    {
+        if (_running)
+        {
+            for (size_t i = _next++; i < _work.size(); i = _next++)
+            {
+                try
+                {
+                    _work[i]();
+                }
+                catch (...)
+                {
+                    LOG_ERR("Exception in thread pool execution.");
+                }
+
+                if (--_pending == 0)
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _completedTime = std::chrono::steady_clock::now();
+                    _complete.notify_all();
+                }
+            }
+        }
 
-        assert(_working == 0);
-        assert(_work.empty());
+        if (--_working == 0)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _complete.notify_all();
+        }
     }
 
     void work()
     {
         std::unique_lock<std::mutex> lock(_mutex);
+        uint64_t lastBatch = _batch;
         while (!_shutdown)
         {
-            _cond.wait(lock);
-            while (!_shutdown && !_work.empty() && _running)
-                runOne(lock);
-        }
-    }
+            _cond.wait(lock, [&]() { return _shutdown || _batch != lastBatch; });
+            if (_shutdown)
+                break;
 
-    void dumpState(std::ostream& oss)
-    {
-        oss << "\tthreadPool:"
-            << "\n\t\tshutdown: " << _shutdown << "\n\t\tworking: " << _working
-            << "\n\t\twork count: " << count() << "\n\t\tthread count " << _threads.size() << "\n";
+            lastBatch = _batch;
+
+            // Woken too late: wait() has returned, and _work may be changing.
+            // _running is only cleared under _mutex, so we can't join after that.
+            if (!_running)
+                continue;
+
+            ++_working;
+            lock.unlock();
+            runBatch();
+            lock.lock();
+        }
     }
 };
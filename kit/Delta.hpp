@@ -11,6 +11,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <climits>
 #include <vector>
 #include <memory>
 #include <unordered_set>
@@ -75,11 +77,63 @@ class DeltaGenerator {
 
     static constexpr size_t _rleMaskUnits = 256 / 64;
 
+    /// Compression state kept per encoding thread, so that each
+    /// tile doesn't pay for zstd context setup and fresh buffers.
+    class CompressorState final
+    {
+        ZSTD_CCtx* _cctx;
+        std::vector<char> _compressed;
+
+    public:
+        CompressorState()
+            : _cctx(ZSTD_createCCtx())
+        {
+            if (_cctx)
+                ZSTD_CCtx_setParameter(_cctx, ZSTD_c_compressionLevel, compressionLevel);
+            else
+                LOG_ERR("Failed to create zstd compression context");
+        }
+        CompressorState(const CompressorState&) = delete;
+        CompressorState& operator=(const CompressorState&) = delete;
+
+        ~CompressorState()
+        {
+            ZSTD_freeCCtx(_cctx);
+        }
+
+        /// Returns the context ready to start a new frame, or nullptr.
+        ZSTD_CCtx* getContext()
+        {
+            if (_cctx)
+                ZSTD_CCtx_reset(_cctx, ZSTD_reset_session_only);
+            return _cctx;
+        }
+
+        /// Returns a scratch buffer of at least @size bytes to compress into.
+        /// It only ever grows, so steady-state use neither allocates nor clears.
+        char* getBuffer(size_t size)
+        {
+            if (_compressed.size() < size)
+                _compressed.resize(size);
+            return _compressed.data();
+        }
+
+        /// Uncompressed delta being built, kept to reuse its capacity.
+        std::vector<uint8_t> _delta;
+    };
+
+    static CompressorState& getCompressorState()
+    {
+        static thread_local CompressorState state;
+        return state;
+    }
+
     /// Bitmap row with a CRC for quick vertical shift detection
     class DeltaBitmapRow final {
         size_t _rleSize;
         uint64_t _rleMask[_rleMaskUnits];
         uint32_t *_rleData;
+        uint64_t _hash; // of mask and data, for matching moved rows
     public:
         class PixIterator final
         {
@@ -135,6 +189,7 @@ class DeltaGenerator {
         DeltaBitmapRow()
             : _rleSize(0)
             , _rleData(nullptr)
+            , _hash(0)
         {
             memset(_rleMask, 0, sizeof(_rleMask));
         }
@@ -183,7 +238,31 @@ class DeltaGenerator {
             return size;
         }
 
+        uint64_t getHash() const { return _hash; }
+
     private:
+        static uint64_t mixHash(uint64_t hash, uint64_t value)
+        {
+            hash ^= value;
+            hash *= 0x9e3779b97f4a7c15ULL;
+            return hash ^ (hash >> 29);
+        }
+
+        uint64_t hashRow() const
+        {
+            uint64_t hash = _rleSize;
+            for (size_t i = 0; i < _rleMaskUnits; ++i)
+                hash = mixHash(hash, _rleMask[i]);
+
+            size_t i = 0;
+            for (; i + 1 < _rleSize; i += 2)
+                hash = mixHash(hash, (uint64_t(_rleData[i]) << 32) | _rleData[i + 1]);
+            if (i < _rleSize)
+                hash = mixHash(hash, _rleData[i]);
+
+            return hash;
+        }
+
         void initPixRowCpu(const uint32_t *from, uint32_t *scratch,
                            size_t *scratchLen, uint64_t *rleMaskBlock,
                            unsigned int width)
@@ -284,11 +363,13 @@ class DeltaGenerator {
             }
             else
                 _rleData = nullptr;
+
+            _hash = hashRow();
         }
 
         bool identical(const DeltaBitmapRow &other) const
         {
-            if (_rleSize != other._rleSize)
+            if (_hash != other._hash || _rleSize != other._rleSize)
                 return false;
             if (memcmp(_rleMask, other._rleMask, sizeof(_rleMask)))
                 return false;
@@ -299,39 +380,63 @@ class DeltaGenerator {
             return !std::memcmp(_rleData, other._rleData, _rleSize * 4);
         }
 
+        /// Expand the RLE'd row back into @width pixels
+        void expand(uint32_t *pixels, int width) const
+        {
+            PixIterator it(*this);
+            for (int x = 0; x < width; ++x)
+            {
+                pixels[x] = it.getPixel();
+                it.next();
+            }
+        }
+
+        static void diffRowMaskCpu(const uint32_t *prev, const uint32_t *cur,
+                                   int width, uint64_t *sameMask)
+        {
+            memset(sameMask, 0, sizeof(uint64_t) * _rleMaskUnits);
+            for (int x = 0; x < width; ++x)
+            {
+                if (prev[x] == cur[x])
+                    sameMask[x >> 6] |= uint64_t(1) << (x & 63);
+            }
+        }
+
         // Create a diff from our state to new state in curRow
         void diffRowTo(const DeltaBitmapRow &curRow,
                        const int width, const int curY,
                        std::vector<uint8_t> &output,
                        LibreOfficeKitTileMode mode) const
         {
-            PixIterator oldPixels(*this);
-            PixIterator curPixels(curRow);
+            uint32_t oldPixels[256];
+            uint32_t curPixels[256];
+            expand(oldPixels, width);
+            curRow.expand(curPixels, width);
+
+            // bit x is set when pixel x is unchanged
+            uint64_t sameMask[_rleMaskUnits];
+            if (!simd::HasAVX2 || !simd_diffRowMask(oldPixels, curPixels, width, sameMask))
+                diffRowMaskCpu(oldPixels, curPixels, width, sameMask);
+
+            const auto isSame = [&sameMask](int x)
+            {
+                return (sameMask[x >> 6] >> (x & 63)) & 1;
+            };
+
             for (int x = 0; x < width;)
             {
                 int same;
-                for (same = 0; same + x < width &&
-                         oldPixels.identical(curPixels);)
-                {
-                    oldPixels.next();
-                    curPixels.next();
+                for (same = 0; same + x < width && isSame(x + same);)
                     same++;
-                }
 
                 x += same;
 
-                uint32_t scratch[256];
-
+                // runs of less than three same pixels are not worth splitting on.
                 int diff;
                 for (diff = 0; diff + x < width &&
-                         (!oldPixels.identical(curPixels) || diff < 3)
+                         (!isSame(x + diff) || diff < 3)
                          && diff < 254;)
-                {
-                    oldPixels.next();
-                    scratch[diff] = curPixels.getPixel();
-                    curPixels.next();
                     ++diff;
-                }
 
                 if (diff > 0)
                 {
@@ -344,7 +449,7 @@ class DeltaGenerator {
                     output.resize(dest + diff * 4);
 
                     copy_row(reinterpret_cast<unsigned char *>(&output[dest]),
-                              (const unsigned char *)(scratch),
+                              (const unsigned char *)(curPixels + x),
                               diff, mode);
 
                     LOGA_TRC(Pixel, "row " << curY << " different " << diff << "pixels");
@@ -366,6 +471,7 @@ class DeltaGenerator {
             : _loc(loc)
             , _inUse(false)
             , _wid(wid)
+            , _damageSeq(0)
             ,
             // in Pixels
             _width(width)
@@ -387,11 +493,56 @@ class DeltaGenerator {
             }
         }
 
+        /// Just a key, to look up the entry of a location.
+        explicit DeltaData(const TileLocation& loc)
+            : _loc(loc)
+            , _inUse(false)
+            , _wid(0)
+            , _damageSeq(0)
+            , _width(0)
+            , _height(0)
+            , _rows(nullptr)
+        {
+        }
+
         ~DeltaData()
         {
             delete[] _rows;
         }
 
+        /// Does the area of the pixmap hold exactly our pixels ?
+        bool isUnchanged(const unsigned char* pixmap, size_t startX, size_t startY,
+                         int width, int height, int bufferWidth) const
+        {
+            if (!_rows || width != _width || height != _height)
+                return false;
+
+            uint32_t pixels[256];
+            for (int y = 0; y < height; ++y)
+            {
+                const size_t position = ((startY + y) * bufferWidth * 4) + (startX * 4);
+                _rows[y].expand(pixels, width);
+                if (memcmp(pixels, pixmap + position, width * 4))
+                    return false;
+            }
+            return true;
+        }
+
+        /// Write our pixels into the area of the pixmap.
+        bool restore(unsigned char* pixmap, size_t startX, size_t startY,
+                     int width, int height, int bufferWidth) const
+        {
+            if (!_rows || width != _width || height != _height)
+                return false;
+
+            for (int y = 0; y < height; ++y)
+            {
+                const size_t position = ((startY + y) * bufferWidth * 4) + (startX * 4);
+                _rows[y].expand(reinterpret_cast<uint32_t *>(pixmap + position), width);
+            }
+            return true;
+        }
+
         void setWid(TileWireId wid)
         {
             _wid = wid;
@@ -402,6 +553,17 @@ class DeltaGenerator {
             return _wid;
         }
 
+        /// The damage sequence number when our pixels were painted.
+        void setDamageSeq(uint64_t damageSeq)
+        {
+            _damageSeq = damageSeq;
+        }
+
+        uint64_t getDamageSeq() const
+        {
+            return _damageSeq;
+        }
+
         void setWidth(int width)
         {
             _width = width;
@@ -444,6 +606,7 @@ class DeltaGenerator {
                 return;
             }
             _wid = repl->_wid;
+            _damageSeq = repl->_damageSeq;
             _width = repl->_width;
             _height = repl->_height;
             delete[] _rows;
@@ -468,6 +631,7 @@ class DeltaGenerator {
     private:
         std::atomic<bool> _inUse; // thread debugging check.
         TileWireId _wid;
+        uint64_t _damageSeq;
         int _width;
         int _height;
         DeltaBitmapRow *_rows;
@@ -524,6 +688,8 @@ class DeltaGenerator {
                 std::memcpy(dest, srcBytes, count * 4);
                 break;
             case LOK_TILEMODE_BGRA:
+                if (simd::HasAVX2 && simd_swapRB(dest, srcBytes, count))
+                    break;
                 std::memcpy(dest, srcBytes, count * 4);
                 for (size_t j = 0; j < count * 4; j += 4)
                     std::swap(dest[j], dest[j+2]);
@@ -548,8 +714,11 @@ class DeltaGenerator {
         LOGA_TRC(Pixel, "building delta of a " << cur.getWidth() << 'x' << cur.getHeight() << " bitmap " <<
                  "between old wid " << prev.getWid() << " and " << cur.getWid());
 
+        CompressorState& state = getCompressorState();
+
         // let's use uint8_t instead of char to avoid implicit sign extension
-        std::vector<uint8_t> output;
+        std::vector<uint8_t>& output = state._delta;
+        output.clear();
         // guestimated upper-bound delta size
         output.reserve(cur.getWidth() * (cur.getHeight() + 4) * 4);
 
@@ -558,6 +727,12 @@ class DeltaGenerator {
         // column position is a byte.
         assert (prev.getWidth() <= 256);
 
+        // Index the previous rows by hash, sorted by row within
+        // each hash, built only once we need to hunt for rows.
+        using RowHash = std::pair<uint64_t, int>;
+        RowHash rowIndex[256];
+        bool haveIndex = false;
+
         // How do the rows look against each other ?
         size_t lastMatchOffset = 0;
         size_t lastCopy = 0;
@@ -567,11 +742,32 @@ class DeltaGenerator {
             if (prev.getRow(y).identical(cur.getRow(y)))
                 continue;
 
-            // Hunt for other rows
+            if (!haveIndex)
+            {
+                for (int yp = 0; yp < prev.getHeight(); ++yp)
+                    rowIndex[yp] = RowHash(prev.getRow(yp).getHash(), yp);
+                std::sort(rowIndex, rowIndex + prev.getHeight());
+                haveIndex = true;
+            }
+
+            // Hunt for other rows with the same hash, in the order we
+            // would meet them scanning on from the last match offset.
+            const uint64_t hash = cur.getRow(y).getHash();
+            const int start = (y + lastMatchOffset) % prev.getHeight();
+            const RowHash* indexBegin = rowIndex;
+            const RowHash* indexEnd = rowIndex + prev.getHeight();
+            const RowHash* first = std::lower_bound(indexBegin, indexEnd, RowHash(hash, 0));
+            const RowHash* last = std::upper_bound(first, indexEnd, RowHash(hash, INT_MAX));
+            const RowHash* from = std::lower_bound(first, last, RowHash(hash, start));
+
             bool matched = false;
-            for (int yn = 0; yn < prev.getHeight() && !matched; ++yn)
+            for (ptrdiff_t yn = 0; yn < last - first && !matched; ++yn)
             {
-                size_t match = (y + lastMatchOffset + yn) % prev.getHeight();
+                const RowHash* candidate = from + yn;
+                if (candidate >= last)
+                    candidate -= last - first;
+
+                size_t match = candidate->second;
                 if (prev.getRow(match).identical(cur.getRow(y)))
                 {
                     // TODO: if offsets are >256 - use 16bits?
@@ -621,14 +817,16 @@ class DeltaGenerator {
         // terminating this delta so we can detect the next one.
         output.push_back('t');
 
-        // FIXME: avoid allocation & make this more efficient.
+        ZSTD_CCtx* cctx = state.getContext();
+        if (!cctx)
+            return false;
+
         size_t maxCompressed = ZSTD_COMPRESSBOUND(output.size());
-        std::unique_ptr<char, void (*)(void*)> compressed((char*)malloc(maxCompressed), free);
+        char* compressed = state.getBuffer(maxCompressed);
 
         // compress for speed, not size - and trust to deltas.
-        size_t compSize = ZSTD_compress(compressed.get(), maxCompressed,
-                                        output.data(), output.size(),
-                                        compressionLevel);
+        size_t compSize = ZSTD_compress2(cctx, compressed, maxCompressed,
+                                         output.data(), output.size());
         if (ZSTD_isError(compSize))
         {
             LOG_ERR("Failed to compress delta of size " << output.size() << " with " << ZSTD_getErrorName(compSize));
@@ -642,7 +840,7 @@ class DeltaGenerator {
         outStream.push_back('D');
         size_t oldSize = outStream.size();
         outStream.resize(oldSize + compSize);
-        memcpy(&outStream[oldSize], compressed.get(), compSize);
+        memcpy(&outStream[oldSize], compressed, compSize);
 
         return true;
     }
@@ -686,6 +884,32 @@ class DeltaGenerator {
         oss << "\tdelta generator consumes " << totalSize << " bytes\n";
     }
 
+    /// Write the cached pixels of a location into the area of the pixmap,
+    /// so that only what was damaged since needs painting. Returns false if
+    /// there are none, else the damage sequence number they were painted at.
+    /// Must not be called while tiles are being compressed.
+    bool restorePixels(const TileLocation& loc, unsigned char* pixmap,
+                       size_t startX, size_t startY, int width, int height,
+                       int bufferWidth, uint64_t& damageSeq)
+    {
+        const auto key = std::make_shared<DeltaData>(loc);
+        std::shared_ptr<DeltaData> entry;
+        {
+            // protect _deltaEntries
+            std::unique_lock<std::mutex> guard(_deltaGuard);
+            auto it = _deltaEntries.find(key);
+            if (it == _deltaEntries.end())
+                return false;
+            entry = *it;
+        }
+
+        if (!entry->restore(pixmap, startX, startY, width, height, bufferWidth))
+            return false;
+
+        damageSeq = entry->getDamageSeq();
+        return true;
+    }
+
     /**
      * Creates a delta if possible:
      *   if so - returns @true and appends the delta to @output
@@ -700,7 +924,8 @@ class DeltaGenerator {
         std::vector<char>& output,
         TileWireId wid, bool forceKeyframe,
         LibreOfficeKitTileMode mode,
-        std::shared_ptr<DeltaData> &rleData)
+        std::shared_ptr<DeltaData> &rleData,
+        uint64_t damageSeq = 0)
     {
         rleData = nullptr;
         if ((width & 0x1) != 0) // power of two - RGBA
@@ -716,26 +941,49 @@ class DeltaGenerator {
             return false;
         }
 
+        const auto key = std::make_shared<DeltaData>(loc);
+        std::shared_ptr<DeltaData> cacheEntry;
+
+        {
+            // protect _deltaEntries
+            std::unique_lock<std::mutex> guard(_deltaGuard);
+
+            auto it = _deltaEntries.find(key);
+            if (it != _deltaEntries.end())
+            {
+                cacheEntry = *it;
+                cacheEntry->use();
+            }
+        }
+
+        // Re-rendering often produces the very same pixels: tell WSD with
+        // a bare delta, without building the new rows, nor compressing.
+        if (cacheEntry && !forceKeyframe &&
+            cacheEntry->isUnchanged(pixmap, startX, startY, width, height, bufferWidth))
+        {
+            LOGA_TRC(Pixel, "Unchanged tile since wid " << cacheEntry->getWid() << " now " << wid);
+            cacheEntry->setWid(wid);
+            cacheEntry->setDamageSeq(damageSeq);
+            rleData = cacheEntry;
+            cacheEntry->unuse();
+            output.push_back('D');
+            return true;
+        }
+
         // FIXME: why duplicate this ? we could overwrite
         // as we make the delta into an existing cache entry,
         // and just do this as/when there is no entry.
         std::shared_ptr<DeltaData> update(std::make_shared<DeltaData>(
             wid, pixmap, startX, startY, width, height, loc, bufferWidth, bufferHeight));
-        std::shared_ptr<DeltaData> cacheEntry;
+        update->setDamageSeq(damageSeq);
 
+        if (!cacheEntry)
         {
             // protect _deltaEntries
             std::unique_lock<std::mutex> guard(_deltaGuard);
-
-            auto it = _deltaEntries.find(update);
-            if (it == _deltaEntries.end())
-            {
-                _deltaEntries.insert(update);
-                rleData = update;
-                return false;
-            }
-            cacheEntry = *it;
-            cacheEntry->use();
+            _deltaEntries.insert(update);
+            rleData = update;
+            return false;
         }
 
         // interestingly cacheEntry may no longer be in the cache by here.
@@ -767,7 +1015,8 @@ class DeltaGenerator {
         const TileLocation &loc,
         std::vector<char>& output,
         TileWireId wid, bool forceKeyframe,
-        bool dumpTiles, LibreOfficeKitTileMode mode)
+        bool dumpTiles, LibreOfficeKitTileMode mode,
+        uint64_t damageSeq = 0)
     {
         #if !ENABLE_DEBUG
         dumpTiles = false;
@@ -816,24 +1065,20 @@ class DeltaGenerator {
         std::shared_ptr<DeltaData> rleData;
         if (!createDelta(pixmap, startX, startY, width, height,
                          bufferWidth, bufferHeight,
-                         loc, output, wid, forceKeyframe, mode, rleData))
+                         loc, output, wid, forceKeyframe, mode, rleData, damageSeq))
         {
             assert(rleData);
             size_t maxCompressed = ZSTD_COMPRESSBOUND((size_t)width * height * 4 + spaceForBitmask);
 
-            std::unique_ptr<char, void (*)(void*)> compressed((char*)malloc(maxCompressed), free);
-            if (!compressed)
-            {
-                LOG_ERR("Failed to allocate buffer of size " << maxCompressed << " to compress into");
+            CompressorState& state = getCompressorState();
+            ZSTD_CCtx *cctx = state.getContext();
+            if (!cctx)
                 return 0;
-            }
-
-            ZSTD_CCtx *cctx = ZSTD_createCCtx();
 
-            ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, compressionLevel);
+            char* compressed = state.getBuffer(maxCompressed);
 
             ZSTD_outBuffer outb;
-            outb.dst = compressed.get();
+            outb.dst = compressed;
             outb.size = maxCompressed;
             outb.pos = 0;
 
@@ -857,13 +1102,10 @@ class DeltaGenerator {
                 if (ZSTD_isError(compSize))
                 {
                     LOG_ERR("failed to compress image: " << compSize << " is: " << ZSTD_getErrorName(compSize));
-                    ZSTD_freeCCtx(cctx);
                     return 0;
                 }
             }
 
-            ZSTD_freeCCtx(cctx);
-
             size_t compSize = outb.pos;
             LOGA_TRC(Pixel, "Compressed image of size " << (width * height * 4) << " to size " << compSize);
 //            << Util::dumpHex(std::string((char *)compressed, compSize)));
@@ -872,7 +1114,7 @@ class DeltaGenerator {
             output.push_back('Z');
             size_t oldSize = output.size();
             output.resize(oldSize + compSize);
-            memcpy(&output[oldSize], compressed.get(), compSize);
+            memcpy(&output[oldSize], compressed, compSize);
         }
         else
         {
@@ -181,4 +181,142 @@ int simd_initPixRowSimd(const uint32_t *from, uint32_t *scratch, size_t *scratch
 #endif // ENABLE_SIMD
 }
 
+// set bit x of the 256 bit sameMask where prev[x] == curr[x]
+int simd_diffRowMask(const uint32_t *prev, const uint32_t *curr, unsigned int width, uint64_t *sameMask)
+{
+#if !ENABLE_SIMD
+    // no fun.
+    (void)prev; (void)curr; (void)width; (void)sameMask;
+    return 0;
+
+#else // ENABLE_SIMD
+
+    if (width > 256 || (width & 0x7) != 0)
+        return 0;
+
+    for (unsigned int x = 0; x < 4; ++x)
+        sameMask[x] = 0;
+
+    for (unsigned int x = 0; x < width; x += 8) // 8 pixels per cycle
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i_u*)(prev + x));
+        __m256i b = _mm256_loadu_si256((const __m256i_u*)(curr + x));
+
+        sameMask[x >> 6] |= diffMask(a, b) << (x & 63);
+    }
+
+    return 1;
+#endif // ENABLE_SIMD
+}
+
+// copy pixels swapping the red and blue channels: BGRA <-> RGBA
+int simd_swapRB(unsigned char *dest, const unsigned char *src, unsigned int count)
+{
+#if !ENABLE_SIMD
+    // no fun.
+    (void)dest; (void)src; (void)count;
+    return 0;
+
+#else // ENABLE_SIMD
+
+    // byte shuffles work within each 128bit lane
+    const __m256i swap_rb = _mm256_setr_epi8(
+        2, 1, 0, 3,  6, 5, 4, 7,  10, 9, 8, 11,  14, 13, 12, 15,
+        2, 1, 0, 3,  6, 5, 4, 7,  10, 9, 8, 11,  14, 13, 12, 15);
+
+    unsigned int x = 0;
+    for (; x + 8 <= count; x += 8) // 8 pixels per cycle
+    {
+        __m256i pix = _mm256_loadu_si256((const __m256i_u*)(src + x * 4));
+        _mm256_storeu_si256((__m256i*)(dest + x * 4), _mm256_shuffle_epi8(pix, swap_rb));
+    }
+
+    for (; x < count; ++x)
+    {
+        dest[x * 4 + 0] = src[x * 4 + 2];
+        dest[x * 4 + 1] = src[x * 4 + 1];
+        dest[x * 4 + 2] = src[x * 4 + 0];
+        dest[x * 4 + 3] = src[x * 4 + 3];
+    }
+
+    return 1;
+#endif // ENABLE_SIMD
+}
+
+// blend pre-multiplied pixels from 'from' over 'to': to = from + to * (255 - from.a) / 255
+// when onlyOpaque is set, pixels of 'to' that are not fully opaque are left alone
+int simd_blendRow(unsigned char *to, const unsigned char *from, unsigned int count, int onlyOpaque)
+{
+#if !ENABLE_SIMD
+    // no fun.
+    (void)to; (void)from; (void)count; (void)onlyOpaque;
+    return 0;
+
+#else // ENABLE_SIMD
+
+    // spread each pixel's alpha over its four 16bit channels
+    const __m256i spread_alpha = _mm256_setr_epi8(
+        6, -1, 6, -1, 6, -1, 6, -1,  14, -1, 14, -1, 14, -1, 14, -1,
+        6, -1, 6, -1, 6, -1, 6, -1,  14, -1, 14, -1, 14, -1, 14, -1);
+    const __m256i alpha_mask = _mm256_set1_epi32(0xff000000);
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+
+    unsigned int x = 0;
+    for (; x + 8 <= count; x += 8) // 8 pixels per cycle
+    {
+        __m256i src = _mm256_loadu_si256((const __m256i_u*)(from + x * 4));
+        __m256i dst = _mm256_loadu_si256((const __m256i_u*)(to + x * 4));
+
+        // widen to 16 bits: 4 pixels per register, within each 128bit lane
+        __m256i srcLo = _mm256_unpacklo_epi8(src, zero);
+        __m256i srcHi = _mm256_unpackhi_epi8(src, zero);
+        __m256i dstLo = _mm256_unpacklo_epi8(dst, zero);
+        __m256i dstHi = _mm256_unpackhi_epi8(dst, zero);
+
+        __m256i invLo = _mm256_sub_epi16(full, _mm256_shuffle_epi8(srcLo, spread_alpha));
+        __m256i invHi = _mm256_sub_epi16(full, _mm256_shuffle_epi8(srcHi, spread_alpha));
+
+        // at most 255 * 255, so exact in 16 bits
+        __m256i prodLo = _mm256_mullo_epi16(dstLo, invLo);
+        __m256i prodHi = _mm256_mullo_epi16(dstHi, invHi);
+
+        // exact division by 255: (p + 1 + (p >> 8)) >> 8
+        prodLo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(prodLo, one),
+                                                    _mm256_srli_epi16(prodLo, 8)), 8);
+        prodHi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(prodHi, one),
+                                                    _mm256_srli_epi16(prodHi, 8)), 8);
+
+        __m256i res = _mm256_packus_epi16(_mm256_add_epi16(srcLo, prodLo),
+                                          _mm256_add_epi16(srcHi, prodHi));
+
+        if (onlyOpaque)
+        {
+            __m256i opaque = _mm256_cmpeq_epi32(_mm256_and_si256(dst, alpha_mask), alpha_mask);
+            res = _mm256_blendv_epi8(dst, res, opaque);
+        }
+
+        _mm256_storeu_si256((__m256i*)(to + x * 4), res);
+    }
+
+    for (; x < count; ++x)
+    {
+        unsigned char *t = to + x * 4;
+        const unsigned char *f = from + x * 4;
+        if (onlyOpaque && t[3] != 255)
+            continue;
+
+        const unsigned int inv = 255 - f[3];
+        for (int i = 0; i < 4; ++i)
+        {
+            const unsigned int val = f[i] + (t[i] * inv) / 255;
+            t[i] = val > 255 ? 255 : val;
+        }
+    }
+
+    return 1;
+#endif // ENABLE_SIMD
+}
+
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -22,6 +22,12 @@ void simd_deltaInit(void);
 
 int simd_initPixRowSimd(const uint32_t *from, uint32_t *scratch, size_t *scratchLen, uint64_t *rleMask);
 
+int simd_diffRowMask(const uint32_t *prev, const uint32_t *curr, unsigned int width, uint64_t *sameMask);
+
+int simd_swapRB(unsigned char *dest, const unsigned char *src, unsigned int count);
+
+int simd_blendRow(unsigned char *to, const unsigned char *from, unsigned int count, int onlyOpaque);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
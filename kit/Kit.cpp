@@ -705,6 +705,12 @@ Document::Document(const std::shared_ptr<lok::Office>& loKit, const std::string&
     , _docPasswordType(DocumentPasswordType::ToView)
     , _stop(false)
     , _deltaGen(new DeltaGenerator())
+    , _bufferPool(new RenderTiles::BufferPool(std::getenv("PIXMAP_HUGEPAGES") != nullptr))
+    , _pipelineRendering(std::getenv("PIPELINE_RENDERING") != nullptr)
+    , _partialRendering(std::getenv("PARTIAL_TILE_RENDERING") != nullptr)
+    , _paintTime(0)
+    , _overlappedPaintTime(0)
+    , _lastPaintOverlapPercent(-1)
     , _editorId(-1)
     , _editorChangeWarning(false)
     , _lastMemTrimTime(std::chrono::steady_clock::now())
@@ -776,6 +782,21 @@ bool Document::postMessage(const char* data, int size, const WSOpCode code) cons
     return true;
 }
 
+bool Document::postMessage(const char* data, int size, const std::vector<Blob>& blobs) const
+{
+    LOG_TRC("postMessage called with: " << getAbbreviatedMessage(data, size) << " and "
+                                        << blobs.size() << " blobs");
+    if (!_websocketHandler)
+    {
+        LOG_ERR("Child Doc: Bad socket while sending [" << getAbbreviatedMessage(data, size) << "].");
+        return false;
+    }
+
+    _websocketHandler->sendBinaryMessageWithBlobs(data, size, blobs, /*frame=*/nullptr,
+                                                  /*flush=*/true);
+    return true;
+}
+
 bool Document::createSession(const std::string& sessionId)
 {
 #if defined(BUILDING_TESTS)
@@ -893,51 +914,166 @@ void Document::setDocumentPassword(int passwordType)
     LOG_INF("setDocumentPassword returned.");
 }
 
-void Document::renderTiles(TileCombined &tileCombined)
+std::unique_ptr<RenderTiles::PaintedTiles> Document::paintTiles(const TileCombined& tileCombined)
 {
     // Find a session matching our view / render settings.
     const auto session = _sessions.findByCanonicalId(tileCombined.getNormalizedViewId());
     if (!session)
     {
         LOG_ERR("Session is not found. Maybe exited after rendering request.");
-        return;
+        return nullptr;
     }
 
     if (!_loKitDocument)
     {
         LOG_ERR("Tile rendering requested before loading document.");
-        return;
+        return nullptr;
     }
 
     if (_loKitDocument->getViewsCount() <= 0)
     {
         LOG_ERR("Tile rendering requested without views.");
-        return;
+        return nullptr;
     }
 
     // if necessary select a suitable rendering view eg. with 'show non-printing chars'
     if (tileCombined.getNormalizedViewId())
         _loKitDocument->setView(session->getViewId());
 
-    const auto blenderFunc = [&](unsigned char* data, int offsetX, int offsetY,
+    // Blended by the encoding threads, so prepare the watermark mask here.
+    std::function<void(unsigned char*, int, int, std::size_t, std::size_t, int, int,
+                       LibreOfficeKitTileMode)> blenderFunc;
+    if (session->watermark())
+    {
+        std::shared_ptr<const Watermark::TileMask> mask =
+            session->watermark()->getTileMask(tileCombined.getWidth(), tileCombined.getHeight());
+        if (mask)
+        {
+            blenderFunc = [mask](unsigned char* data, int offsetX, int offsetY,
                                  std::size_t pixmapWidth, std::size_t pixmapHeight,
-                                 int pixelWidth, int pixelHeight, LibreOfficeKitTileMode mode) {
-        if (session->watermark())
-            session->watermark()->blending(data, offsetX, offsetY, pixmapWidth, pixmapHeight,
-                                           pixelWidth, pixelHeight, mode);
-    };
+                                 int pixelWidth, int pixelHeight, LibreOfficeKitTileMode) {
+                mask->blend(data, offsetX, offsetY, pixmapWidth, pixmapHeight, pixelWidth,
+                            pixelHeight);
+            };
+        }
+    }
+
+    // The kept pixels are blended already, and may still be being encoded.
+    RenderTiles::DamageFn damageFunc;
+    if (_partialRendering && !blenderFunc && !_deltaPool.isRunning())
+    {
+        damageFunc = [this, &tileCombined](uint64_t since, const Util::Rectangle& area,
+                                           Util::Rectangle& damage) {
+            return _queue->getDamageSince(since, tileCombined.getPart(),
+                                          tileCombined.getEditMode(), area, damage);
+        };
+    }
 
-    const auto postMessageFunc = [&](const char* buffer, std::size_t length) {
-        postMessage(buffer, length, WSOpCode::Binary);
+    return RenderTiles::paintTiles(_loKitDocument, *_deltaGen, tileCombined, _bufferPool.get(),
+                                   blenderFunc, _queue->getDamageSeq(), damageFunc,
+                                   _mobileAppDocId, session->getCanonicalViewId(),
+                                   session->getDumpTiles());
+}
+
+void Document::sendTiles(const RenderTiles::PaintedTiles& painted)
+{
+    const auto postMessageFunc = [&](const char* header, std::size_t length,
+                                     const std::vector<Blob>& tiles) {
+        postMessage(header, length, tiles);
     };
 
-    if (!RenderTiles::doRender(_loKitDocument, *_deltaGen, tileCombined, _deltaPool,
-                               blenderFunc, postMessageFunc, _mobileAppDocId,
-                               session->getCanonicalViewId(), session->getDumpTiles()))
+    RenderTiles::sendTiles(painted, *_deltaGen, postMessageFunc);
+}
+
+void Document::renderTiles(TileCombined &tileCombined)
+{
+    std::unique_ptr<RenderTiles::PaintedTiles> painted = paintTiles(tileCombined);
+    if (!painted)
     {
         LOG_DBG("All tiles skipped, not producing empty tilecombine: message");
         return;
     }
+
+    RenderTiles::queueEncoding(*painted, _deltaPool);
+    _deltaPool.run();
+
+    sendTiles(*painted);
+}
+
+void Document::renderTilesPipelined(const std::vector<TileCombined>& tileRequests)
+{
+    // While the pool encodes one combine, we paint the next one into
+    // its own pixmap. Only one combine can be encoded at a time, as
+    // the DeltaGenerator expects, and they are sent in request order.
+    std::unique_ptr<RenderTiles::PaintedTiles> encoding;
+
+    // Never leave the pool working on a combine we are about to free.
+    const auto finishEncoding = [&]()
+    {
+        if (!encoding)
+            return std::chrono::steady_clock::time_point();
+
+        _deltaPool.wait();
+        sendTiles(*encoding);
+        encoding.reset();
+        return _deltaPool.getCompletedTime();
+    };
+
+    try
+    {
+        for (const TileCombined& tileCombined : tileRequests)
+        {
+            const auto paintStart = std::chrono::steady_clock::now();
+            std::unique_ptr<RenderTiles::PaintedTiles> painted = paintTiles(tileCombined);
+            const auto paintEnd = std::chrono::steady_clock::now();
+
+            const bool overlapped = encoding != nullptr;
+            const auto encodeEnd = finishEncoding();
+
+            _paintTime += paintEnd - paintStart;
+            if (overlapped && encodeEnd > paintStart)
+                _overlappedPaintTime += std::min(paintEnd, encodeEnd) - paintStart;
+
+            if (!painted)
+            {
+                LOG_DBG("All tiles skipped, not producing empty tilecombine: message");
+                continue;
+            }
+
+            RenderTiles::queueEncoding(*painted, _deltaPool);
+            _deltaPool.runAsync();
+            encoding = std::move(painted);
+        }
+
+        finishEncoding();
+    }
+    catch (...)
+    {
+        if (_deltaPool.isRunning())
+            _deltaPool.wait();
+        throw;
+    }
+
+    const double overlapRatio = getPaintOverlapRatio();
+    LOG_DBG("STATISTICS: paint/encode overlap ratio: " << overlapRatio);
+
+#if !MOBILEAPP
+    // For getMetrics; only when it changes, not for every batch of tiles.
+    const int overlapPercent = static_cast<int>(overlapRatio * 100 + 0.5);
+    if (overlapPercent != _lastPaintOverlapPercent)
+    {
+        _lastPaintOverlapPercent = overlapPercent;
+        sendTextFrame("paintstats: overlap=" + std::to_string(overlapPercent));
+    }
+#endif
+}
+
+double Document::getPaintOverlapRatio() const
+{
+    if (_paintTime.count() <= 0)
+        return 0;
+
+    return static_cast<double>(_overlappedPaintTime.count()) / _paintTime.count();
 }
 
 bool Document::sendFrame(const char* buffer, int length, WSOpCode opCode)
@@ -1002,6 +1138,7 @@ void Document::trimAfterInactivity()
         LOG_DBG("Trimming Core caches");
         SigUtil::addActivity("trimAfterInactivity");
         _loKit->trimMemory(1024);
+        _bufferPool->trim();
 
         _lastMemTrimTime = std::chrono::steady_clock::now();
     }
@@ -2368,8 +2505,15 @@ void Document::drainQueue()
             // Put requests that include tiles in the visible area to the front to handle those first
             std::partition(tileRequests.begin(), tileRequests.end(), [this](const TileCombined& req) {
                 return isTileRequestInsideVisibleArea(req); });
-            for (auto& tileCombined : tileRequests)
-                renderTiles(tileCombined);
+            if (_pipelineRendering && tileRequests.size() > 1)
+            {
+                renderTilesPipelined(tileRequests);
+            }
+            else
+            {
+                for (auto& tileCombined : tileRequests)
+                    renderTiles(tileCombined);
+            }
         }
     }
     catch (const std::exception& exc)
@@ -2551,6 +2695,11 @@ void Document::dumpState(std::ostream& oss)
     oss << '\n';
 
     _deltaPool.dumpState(oss);
+    _bufferPool->dumpState(oss);
+    oss << "\tpipelineRendering: " << _pipelineRendering
+        << "\n\t\tpaint time: " << std::chrono::duration_cast<std::chrono::milliseconds>(_paintTime)
+        << "\n\t\toverlap ratio: " << getPaintOverlapRatio()
+        << "\n\tpartialRendering: " << _partialRendering << '\n';
     _sessions.dumpState(oss);
 
     _deltaGen->dumpState(oss);
@@ -55,6 +55,11 @@ void documentViewCallback(const int type, const char* p, void* data);
 
 class Document;
 class DeltaGenerator;
+namespace RenderTiles
+{
+    struct PaintedTiles;
+    class BufferPool;
+}
 
 /// Descriptor class used to link a LOK
 /// callback to a specific view.
@@ -209,6 +214,9 @@ public:
     /// Post the message - in the unipoll world we're in the right thread anyway
     bool postMessage(const char* data, int size, const WSOpCode code) const;
 
+    /// Post a binary message of data followed by the blobs, which are sent without copying.
+    bool postMessage(const char* data, int size, const std::vector<Blob>& blobs) const;
+
     bool createSession(const std::string& sessionId);
 
     /// Purges dead connections and returns
@@ -220,6 +228,14 @@ public:
 
     void renderTiles(TileCombined& tileCombined);
 
+    /// Render the tile combines in order, painting each while
+    /// the previous one is still being encoded by the pool.
+    void renderTilesPipelined(const std::vector<TileCombined>& tileRequests);
+
+    /// The fraction of the pipelined painting time during
+    /// which the previous combine was being encoded.
+    double getPaintOverlapRatio() const;
+
 
     bool sendTextFrame(const std::string& message)
     {
@@ -439,6 +455,17 @@ private:
 
     ThreadPool _deltaPool;
     std::unique_ptr<DeltaGenerator> _deltaGen;
+    /// Pixmaps and tile outputs recycled across renders.
+    std::unique_ptr<RenderTiles::BufferPool> _bufferPool;
+
+    /// Paint the next tile combine while encoding the previous one.
+    const bool _pipelineRendering;
+    /// Repaint only the damage to tiles we have the pixels of.
+    const bool _partialRendering;
+    std::chrono::steady_clock::duration _paintTime;
+    std::chrono::steady_clock::duration _overlappedPaintTime;
+    /// The overlap ratio last sent to WSD, in percent.
+    int _lastPaintOverlapPercent;
 
     int _editorId;
     bool _editorChangeWarning;
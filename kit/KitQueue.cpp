@@ -165,10 +165,71 @@ bool extractRectangle(const StringVector& tokens, int& x, int& y, int& w, int& h
 
 void KitQueue::putCallback(int view, int type, const std::string &payload)
 {
+    if (type == LOK_CALLBACK_INVALIDATE_TILES)
+        recordDamage(payload);
+
     if (!elideDuplicateCallback(view, type, payload))
         _callbacks.emplace_back(view, type, payload);
 }
 
+void KitQueue::recordDamage(const std::string& payload)
+{
+    const StringVector tokens = StringVector::tokenize(payload);
+
+    int x, y, w, h, part, mode;
+    if (!extractRectangle(tokens, x, y, w, h, part, mode) || w == INT_MAX || h == INT_MAX)
+    {
+        // Everything, to be on the safe side.
+        x = y = 0;
+        w = h = INT_MAX;
+        part = mode = -1;
+    }
+
+    // Don't let Rectangle drop sizes that overflow.
+    w = std::min<long>(w, static_cast<long>(INT_MAX) - x);
+    h = std::min<long>(h, static_cast<long>(INT_MAX) - y);
+
+    _damage.push_back(Damage{ ++_damageSeq, part, mode, Util::Rectangle(x, y, w, h) });
+    if (_damage.size() > MaxDamage)
+    {
+        _damageForgotten = _damage.front()._seq;
+        _damage.pop_front();
+    }
+}
+
+bool KitQueue::getDamageSince(uint64_t seq, int part, int mode, const Util::Rectangle& area,
+                              Util::Rectangle& damage) const
+{
+    if (seq < _damageForgotten)
+        return false;
+
+    bool found = false;
+    for (auto it = _damage.rbegin(); it != _damage.rend() && it->_seq > seq; ++it)
+    {
+        if ((it->_part != -1 && it->_part != part) || (it->_mode != -1 && it->_mode != mode))
+            continue;
+
+        const int left = std::max(area.getLeft(), it->_rect.getLeft());
+        const int top = std::max(area.getTop(), it->_rect.getTop());
+        const int right = std::min(area.getRight(), it->_rect.getRight());
+        const int bottom = std::min(area.getBottom(), it->_rect.getBottom());
+        if (left >= right || top >= bottom)
+            continue;
+
+        Util::Rectangle hit(left, top, right - left, bottom - top);
+        if (found)
+            damage.extend(hit);
+        else
+            damage = hit;
+        found = true;
+    }
+
+    if (!found)
+        damage = Util::Rectangle(area.getLeft(), area.getTop(), 0, 0);
+
+    return true;
+}
+
 bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &payload)
 {
     const auto callbackType = static_cast<LibreOfficeKitCallbackType>(type);
@@ -753,6 +814,9 @@ void KitQueue::dumpState(std::ostream& oss)
     }
     oss << "]\n";
 
+    oss << "\tdamage: " << _damage.size() << " seq: " << _damageSeq
+        << " forgotten: " << _damageForgotten << "\n";
+
     oss << "\tQueue size: " << _queue.size() << "\n";
     size_t i = 0;
     for (Payload &it : _queue)
@@ -13,6 +13,8 @@
 
 #include <stdexcept>
 #include <algorithm>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <map>
 #include <string>
@@ -21,6 +23,7 @@
 #include "Log.hpp"
 #include "TileDesc.hpp"
 #include "Protocol.hpp"
+#include "Rectangle.hpp"
 
 /// Queue for handling the Kit's messaging needs
 class KitQueue
@@ -30,7 +33,11 @@ class KitQueue
 public:
     typedef std::vector<char> Payload;
 
-    KitQueue() { }
+    KitQueue()
+        : _damageSeq(0)
+        , _damageForgotten(0)
+    {
+    }
     ~KitQueue() { }
 
     KitQueue(const KitQueue&) = delete;
@@ -75,6 +82,14 @@ public:
     std::vector<TileCombined> popWholeTileQueue();
     size_t getTileQueueSize() const { return _tileQueue.size(); }
 
+    /// The sequence number of the latest damage, ie. tile invalidation.
+    uint64_t getDamageSeq() const { return _damageSeq; }
+
+    /// Find the bounds of the damage to area of part and mode recorded after
+    /// seq, which are empty if there is none; returns false if not known.
+    bool getDamageSince(uint64_t seq, int part, int mode, const Util::Rectangle& area,
+                        Util::Rectangle& damage) const;
+
     /// Obtain the next callback
     Callback getCallback()
     {
@@ -168,6 +183,9 @@ public:
     void removeCursorPosition(int viewId);
 
 private:
+    /// Remember the area of an invalidation, for repainting only that.
+    void recordDamage(const std::string& payload);
+
     /// Search the queue for a duplicate tile and remove it (if present).
     void removeTileDuplicate(const TileDesc &desc);
 
@@ -203,6 +221,21 @@ private:
     /// Check the views in the order of how the editing (cursor movement) has
     /// been happening (0 == oldest, size() - 1 == newest).
     std::vector<int> _viewOrder;
+
+    struct Damage
+    {
+        uint64_t _seq;
+        int _part; // -1 for all
+        int _mode; // -1 for all
+        Util::Rectangle _rect;
+    };
+
+    /// The latest invalidations, oldest first.
+    std::deque<Damage> _damage;
+    uint64_t _damageSeq;
+    /// Damage up to this sequence number is no longer known.
+    uint64_t _damageForgotten;
+    static constexpr size_t MaxDamage = 512;
 };
 
 inline std::ostream& operator<<(std::ostream& os, const KitQueue::Callback &c)
@@ -15,8 +15,12 @@
 #include <LibreOfficeKit/LibreOfficeKitInit.h>
 #include <LibreOfficeKit/LibreOfficeKit.hxx>
 #include <LibreOfficeKit/LibreOfficeKitEnums.h>
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include <Log.hpp>
+#include <Simd.hpp>
+#include <DeltaSimd.h>
 #include <cstdlib>
 #include <string>
 #include <cmath>
@@ -39,64 +43,133 @@ public:
         }
     }
 
-    void blending(unsigned char* tilePixmap,
-                   int offsetX, int offsetY,
-                   int tilesPixmapWidth, int tilesPixmapHeight,
-                   int tileWidth, int tileHeight,
-                   LibreOfficeKitTileMode /*mode*/)
+    /// The watermark of one tile size: immutable, so that it
+    /// can be blended into tiles by the encoding threads.
+    class TileMask
+    {
+    public:
+        TileMask(std::vector<unsigned char> pixmap, int width, int height, bool onlyOpaque)
+            : _pixmap(std::move(pixmap))
+            , _width(width)
+            , _height(height)
+            , _onlyOpaque(onlyOpaque)
+        {
+            // Fully transparent pixels leave the tile unchanged: trim them.
+            const uint32_t* pixels = reinterpret_cast<const uint32_t*>(_pixmap.data());
+            _spans.reserve(_height);
+            for (int y = 0; y < _height; ++y)
+            {
+                const uint32_t* row = pixels + y * _width;
+                int first = 0;
+                while (first < _width && !row[first])
+                    ++first;
+                int last = _width;
+                while (last > first && !row[last - 1])
+                    --last;
+                _spans.emplace_back(first, last);
+                if (first < last)
+                    _transparent = false;
+            }
+        }
+
+        /// Nothing to blend at all.
+        bool isTransparent() const { return _transparent; }
+
+        /// Blend, centered in the tile at offsetX/Y of the tiles pixmap.
+        void blend(unsigned char* tilesPixmap, int offsetX, int offsetY, int tilesPixmapWidth,
+                   int tilesPixmapHeight, int tileWidth, int tileHeight) const
+        {
+            if (_transparent || !tilesPixmap)
+                return;
+
+            offsetX += (tileWidth - std::min(tileWidth, _width)) / 2;
+            offsetY += (tileHeight - std::min(tileHeight, _height)) / 2;
+            for (int y = 0; y < _height && offsetY + y < tilesPixmapHeight; ++y)
+            {
+                const int first = _spans[y].first;
+                const int last = std::min(_spans[y].second, tilesPixmapWidth - offsetX);
+                if (first >= last)
+                    continue;
+
+                blendRow(tilesPixmap + 4 * ((offsetY + y) * tilesPixmapWidth + offsetX + first),
+                         _pixmap.data() + 4 * (y * _width + first), last - first, _onlyOpaque);
+            }
+        }
+
+    private:
+        const std::vector<unsigned char> _pixmap;
+        const int _width;
+        const int _height;
+        const bool _onlyOpaque;
+        bool _transparent = true;
+        /// The [first, last) pixels of each row that are not fully transparent.
+        std::vector<std::pair<int, int>> _spans;
+    };
+
+    /// Returns the watermark for the given tile size, or nullptr when there is
+    /// nothing to blend. Must be called from the kit thread, as it may render.
+    std::shared_ptr<const TileMask> getTileMask(int tileWidth, int tileHeight)
     {
         // set requested watermark size a little bit smaller than tile size
         const int width = tileWidth * 0.8;
         const int height = tileHeight * 0.8;
 
-        const std::vector<unsigned char>* pixmap = getPixmap(width, height);
+        const size_t key = width + height * 10000;
+        const auto it = _tileMasks.find(key);
+        if (it != _tileMasks.end())
+            return it->second;
 
-        if (pixmap && tilePixmap)
+        std::shared_ptr<const TileMask> mask;
+        const std::vector<unsigned char>* pixmap = getPixmap(width, height);
+        if (pixmap)
         {
-            // center watermark
-            const int maxX = std::min(tileWidth, width);
-            const int maxY = std::min(tileHeight, height);
-            offsetX += (tileWidth - maxX) / 2;
-            offsetY += (tileHeight - maxY) / 2;
-            alphaBlend(*pixmap, width, height, offsetX, offsetY, tilePixmap, tilesPixmapWidth, tilesPixmapHeight, false);
+            const bool isCalc = (_loKitDoc->getDocumentType() == LOK_DOCTYPE_SPREADSHEET);
+            mask = std::make_shared<const TileMask>(*pixmap, width, height, !isCalc);
+            if (mask->isTransparent())
+            {
+                LOG_DBG("Watermark of " << width << 'x' << height << " is fully transparent");
+                mask.reset();
+            }
+
+            // Only the mask is needed from now on.
+            _pixmaps.erase(key);
         }
+
+        _tileMasks.emplace(key, mask);
+        return mask;
     }
 
 private:
-    /// Alpha blend pixels from 'from' over the 'to'.
-    void alphaBlend(const std::vector<unsigned char>& from, int from_width, int from_height, int from_offset_x, int from_offset_y,
-            unsigned char* to, int to_width, int to_height, const bool isFontBlending)
+    /// Alpha blend count pre-multiplied pixels from 'from' over 'to',
+    /// in fixed point: to = from + to * (255 - from.a) / 255.
+    static void blendRow(unsigned char* to, const unsigned char* from, int count, bool onlyOpaque)
     {
-        bool isCalc = (_loKitDoc->getDocumentType() == LOK_DOCTYPE_SPREADSHEET);
-        for (int to_y = from_offset_y, from_y = 0; (to_y < to_height) && (from_y < from_height) ; ++to_y, ++from_y)
-            for (int to_x = from_offset_x, from_x = 0; (to_x < to_width) && (from_x < from_width); ++to_x, ++from_x)
-            {
-                unsigned char* t = to + 4 * (to_y * to_width + to_x);
+        if (simd::HasAVX2 && simd_blendRow(to, from, count, onlyOpaque))
+            return;
 
-                if (!isFontBlending && !isCalc && t[3] != 255)
-                    continue;
+        for (int x = 0; x < count; ++x, to += 4, from += 4)
+        {
+            if (onlyOpaque && to[3] != 255)
+                continue;
 
-                double dst_r = t[0];
-                double dst_g = t[1];
-                double dst_b = t[2];
-                double dst_a = t[3] / 255.0;
-
-                const unsigned char* f = from.data() + 4 * (from_y * from_width + from_x);
-                double src_r = f[0];
-                double src_g = f[1];
-                double src_b = f[2];
-                double src_a = f[3] / 255.0;
-
-                double out_a = src_a + dst_a * (1.0 - src_a);
-                unsigned char out_r = src_r + dst_r * (1.0 - src_a);
-                unsigned char out_g = src_g + dst_g * (1.0 - src_a);
-                unsigned char out_b = src_b + dst_b * (1.0 - src_a);
-
-                t[0] = out_r;
-                t[1] = out_g;
-                t[2] = out_b;
-                t[3] = static_cast<unsigned char>(out_a * 255.0);
+            const unsigned int inv = 255 - from[3];
+            for (int i = 0; i < 4; ++i)
+            {
+                const unsigned int val = from[i] + (to[i] * inv) / 255;
+                to[i] = std::min(val, 255u);
             }
+        }
+    }
+
+    /// Alpha blend pixels from 'from' over the 'to'.
+    static void alphaBlend(const std::vector<unsigned char>& from, int from_width, int from_height,
+                           int from_offset_x, int from_offset_y, unsigned char* to, int to_width,
+                           int to_height, bool onlyOpaque)
+    {
+        const int count = std::min(from_width, to_width - from_offset_x);
+        for (int to_y = from_offset_y, from_y = 0; (to_y < to_height) && (from_y < from_height) && count > 0; ++to_y, ++from_y)
+            blendRow(to + 4 * (to_y * to_width + from_offset_x),
+                     from.data() + 4 * (from_y * from_width), count, onlyOpaque);
     }
 
     /// Create bitmap that we later use as the watermark for every tile.
@@ -206,7 +279,7 @@ private:
         }
 
         // Now copy the (black) text over the (white) blur
-        alphaBlend(_rotatedText, width, height, 0, 0, _pixmap.data(), width, height, true);
+        alphaBlend(_rotatedText, width, height, 0, 0, _pixmap.data(), width, height, false);
 
         // Make the resulting pixmap semi-transparent
         for (unsigned char* p = _pixmap.data(); p < _pixmap.data() + pixel_count; p++)
@@ -223,6 +296,7 @@ private:
     const std::string _font;
     const double _alphaLevel;
     std::unordered_map<size_t, std::vector<unsigned char>> _pixmaps;
+    std::unordered_map<size_t, std::shared_ptr<const TileMask>> _tileMasks;
 };
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -12,43 +12,142 @@
 #pragma once
 
 #include <assert.h>
+#include <deque>
+#include <memory>
 #include <ostream>
 #include <vector>
 
-#include <Util.hpp>
+#include <sys/uio.h>
 
-// Blocks -> we can share from client -> server ... etc.
-// headers / and a 'writeV' etc. =)
+#include <Util.hpp>
 
 /**
  * Encapsulate data we need to write.
+ *
+ * Appended data is copied into a contiguous block, unless it is large
+ * and shared, in which case it is only referenced until written out.
+ * The data then forms a chain of blocks, to be written with writev(2).
  */
 class Buffer
 {
+    /// A block of data queued after _buffer.
+    class Segment
+    {
+        /// Keeps referenced data alive, null when we own the data.
+        std::shared_ptr<const void> _holder;
+        const char* _data; ///< The referenced data.
+        std::size_t _size; ///< The size of the referenced data.
+        std::vector<char> _owned;
+        std::size_t _offset; ///< Of the data not written yet.
+
+    public:
+        Segment(std::shared_ptr<const void> holder, const char* data, std::size_t size)
+            : _holder(std::move(holder))
+            , _data(data)
+            , _size(size)
+            , _offset(0)
+        {
+        }
+
+        Segment(const char* data, std::size_t size)
+            : _data(nullptr)
+            , _size(0)
+            , _owned(data, data + size)
+            , _offset(0)
+        {
+        }
+
+        bool isOwned() const { return !_holder; }
+        std::vector<char>& getOwned() { return _owned; }
+        std::size_t getOffset() const { return _offset; }
+
+        const char* data() const { return (_holder ? _data : _owned.data()) + _offset; }
+        std::size_t size() const { return (_holder ? _size : _owned.size()) - _offset; }
+
+        void eraseFirst(std::size_t len) { _offset += len; }
+    };
+
     std::size_t _offset;  /// offset into _buffer of data
     std::vector<char> _buffer;
 
+    /// The blocks following _buffer, if we reference any shared data.
+    std::deque<Segment> _segments;
+    std::size_t _segmentsSize; ///< The total size of _segments.
+
+    /// Shared data smaller than this is cheaper to copy than to reference.
+    static constexpr std::size_t MinSharedSize = 4096;
+
+    /// Once _buffer is written out, make the next block the current one.
+    void nextSegment()
+    {
+        assert(_offset == _buffer.size() && "The current block is not empty");
+        if (_segments.empty() || !_segments.front().isOwned())
+            return;
+
+        // Continue in _buffer, so contiguous appends stay cheap.
+        Segment& segment = _segments.front();
+        _segmentsSize -= segment.size();
+        _offset = segment.getOffset();
+        _buffer.swap(segment.getOwned());
+        _segments.pop_front();
+    }
+
 public:
-    Buffer() : _offset(0)
+    Buffer() : _offset(0), _segmentsSize(0)
     {
     }
 
     typedef std::vector<char>::iterator iterator;
     typedef std::vector<char>::const_iterator const_iterator;
 
-    std::size_t size() const { return _buffer.size() - _offset; }
-    bool empty() const { return _offset == _buffer.size(); }
+    std::size_t size() const { return _buffer.size() - _offset + _segmentsSize; }
+    bool empty() const { return _offset == _buffer.size() && _segments.empty(); }
 
+    /// The first contiguous block of data.
     const char *getBlock() const
     {
-        if (!empty())
+        if (_offset != _buffer.size())
             return &_buffer[_offset];
+        if (!_segments.empty())
+            return _segments.front().data();
         return nullptr;
     }
 
     std::size_t getBlockSize() const
     {
-        return size();
+        if (_offset != _buffer.size())
+            return _buffer.size() - _offset;
+        if (!_segments.empty())
+            return _segments.front().size();
+        return 0;
+    }
+
+    /// Fill iov with up to count blocks, of at most maxSize bytes in total,
+    /// to write out with writev(2). Returns the number of blocks filled.
+    int getIOVec(iovec* iov, int count, std::size_t maxSize) const
+    {
+        int filled = 0;
+        const auto add = [&](const char* data, std::size_t size)
+        {
+            size = std::min(size, maxSize);
+            iov[filled].iov_base = const_cast<char*>(data);
+            iov[filled].iov_len = size;
+            ++filled;
+            maxSize -= size;
+        };
+
+        if (_offset != _buffer.size() && count > 0 && maxSize > 0)
+            add(&_buffer[_offset], _buffer.size() - _offset);
+
+        for (const Segment& segment : _segments)
+        {
+            if (filled >= count || maxSize == 0)
+                break;
+
+            add(segment.data(), segment.size());
+        }
+
+        return filled;
     }
 
     void eraseFirst(std::size_t len)
@@ -56,11 +155,39 @@ public:
         if (len <= 0)
             return;
 
-        assert(_offset + len <= _buffer.size());
-        assert(_offset + size() == _buffer.size());
+        assert(len <= size());
+        assert(_offset <= _buffer.size());
 
         len = std::min(len, size()); // Avoid accidental damage.
 
+        if (!_segments.empty())
+        {
+            // Consume the blocks in turn.
+            const std::size_t first = std::min(len, _buffer.size() - _offset);
+            _offset += first;
+            len -= first;
+
+            while (len > 0)
+            {
+                Segment& segment = _segments.front();
+                const std::size_t consumed = std::min(len, segment.size());
+                segment.eraseFirst(consumed);
+                _segmentsSize -= consumed;
+                len -= consumed;
+                if (segment.size() == 0)
+                    _segments.pop_front();
+            }
+
+            if (_offset == _buffer.size())
+            {
+                _buffer.clear();
+                _offset = 0;
+                nextSegment();
+            }
+
+            return;
+        }
+
         // avoid regular shuffling down larger chunks of data
         if (_buffer.size() > 16384 && // lots of queued data
             len < size() &&           // not a complete erase
@@ -77,7 +204,37 @@ public:
 
     void append(const char *data, const int len)
     {
-        _buffer.insert(_buffer.end(), data, data + len);
+        if (_segments.empty())
+            _buffer.insert(_buffer.end(), data, data + len);
+        else
+        {
+            if (_segments.back().isOwned())
+            {
+                std::vector<char>& owned = _segments.back().getOwned();
+                owned.insert(owned.end(), data, data + len);
+            }
+            else
+                _segments.emplace_back(data, len);
+
+            _segmentsSize += len;
+        }
+    }
+
+    /// Append data kept alive by holder, without copying it when large enough.
+    /// The data must not change until written out.
+    void append(std::shared_ptr<const void> holder, const char* data, std::size_t len)
+    {
+        if (len < MinSharedSize)
+        {
+            append(data, len);
+            return;
+        }
+
+        if (empty())
+            clear(); // Start the chain afresh.
+
+        _segments.emplace_back(std::move(holder), data, len);
+        _segmentsSize += len;
     }
 
     void append(const std::string& s) { append(s.c_str(), s.size()); }
@@ -92,17 +249,22 @@ public:
     void dumpHex(std::ostream &os, const char *legend, const char *prefix) const
     {
         if (size() > 0 || _offset > 0)
-            os << prefix << "Buffer size: " << size() << " offset: " << _offset << '\n';
+            os << prefix << "Buffer size: " << size() << " offset: " << _offset
+               << " segments: " << _segments.size() << '\n';
         if (_buffer.size() > 0)
             Util::dumpHex(os, _buffer, legend, prefix);
     }
 
     // various std::vector API compatibility functions
+    // These only cover the first block, which is all there is,
+    // unless shared data is appended, as is never the case on input.
 
     void clear()
     {
         _buffer.clear();
         _offset = 0;
+        _segments.clear();
+        _segmentsSize = 0;
     }
 
     iterator begin() { return _buffer.begin() + _offset; }
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <string>
+#include <fcntl.h>
 #include <zlib.h>
 
 #include <Poco/Net/HTTPResponse.h>
@@ -48,22 +49,6 @@ void sendErrorAndShutdown(http::StatusCode errorCode, const std::shared_ptr<Stre
     socket->ignoreInput();
 }
 
-void sendUncompressedFileContent(const std::shared_ptr<StreamSocket>& socket,
-                                 const std::string& path, const int bufferSize)
-{
-    std::ifstream file(path, std::ios::binary);
-    std::unique_ptr<char[]> buf = std::make_unique<char[]>(bufferSize);
-    do
-    {
-        file.read(&buf[0], bufferSize);
-        const int size = file.gcount();
-        if (size > 0)
-            socket->send(&buf[0], size, true);
-        else
-            break;
-    } while (file);
-}
-
 void sendDeflatedFileContent(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
                              const int fileSize)
 {
@@ -93,8 +78,8 @@ void sendDeflatedFileContent(const std::shared_ptr<StreamSocket>& socket, const
 }
 
 static void sendFileImpl(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
-                         http::Response& response, const bool noCache,
-                         const bool deflate, const bool headerOnly, const bool closeSocket)
+                         http::Response& response, const bool noCache, const bool deflate,
+                         const bool headerOnly, const bool closeSocket, const std::string& range)
 {
     FileUtil::Stat st(path);
     if (st.bad())
@@ -121,25 +106,67 @@ static void sendFileImpl(const std::shared_ptr<StreamSocket>& socket, const std:
         response.header().setConnectionToken(http::Header::ConnectionToken::Close);
     }
 
-    int bufferSize = std::min<std::size_t>(st.size(), Socket::MaximumSendBufferSize);
-    if (static_cast<long>(st.size()) >= socket->getSendBufferSize())
-    {
-        socket->setSocketBufferSize(bufferSize);
-        bufferSize = socket->getSendBufferSize();
-    }
-
     // Disable deflate for now - until we can cache deflated data.
     // FIXME: IE/Edge doesn't work well with deflate, so check with
     // IE/Edge before enabling the deflate again
     if (!deflate || true)
     {
-        response.setContentLength(st.size());
+        // Encoded files are served whole.
+        uint64_t start = 0;
+        uint64_t length = st.size();
+        if (response.get("Content-Encoding").empty())
+        {
+            response.set("Accept-Ranges", "bytes");
+            if (!range.empty() && response.statusCode() == http::StatusCode::OK)
+            {
+                const http::StatusCode status =
+                    http::parseByteRange(range, st.size(), start, length);
+                if (status == http::StatusCode::RangeNotSatisfiable)
+                {
+                    LOG_DBG('#' << socket->getFD() << ": Range [" << range
+                                << "] not satisfiable for file [" << path << "] of "
+                                << st.size() << " bytes");
+                    const std::string extraHeader =
+                        "Content-Range: bytes */" + std::to_string(st.size()) + "\r\n";
+                    if (closeSocket)
+                        sendErrorAndShutdown(status, socket, std::string(), extraHeader);
+                    else
+                        sendError(status, socket, std::string(), extraHeader);
+                    return;
+                }
+
+                if (status == http::StatusCode::PartialContent)
+                {
+                    response.setStatusCode(status);
+                    response.set("Content-Range", "bytes " + std::to_string(start) + '-' +
+                                                      std::to_string(start + length - 1) + '/' +
+                                                      std::to_string(st.size()));
+                }
+            }
+        }
+
+        const int bufferSize = std::min<std::size_t>(length, Socket::MaximumSendBufferSize);
+        if (static_cast<long>(length) >= socket->getSendBufferSize())
+            socket->setSocketBufferSize(bufferSize);
+
+        // Open before sending the header, so we can still fail.
+        const int fd = headerOnly ? -1 : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (!headerOnly && fd < 0)
+        {
+            LOG_SYS('#' << socket->getFD() << ": Failed to open [" << path
+                        << "]. File will not be sent.");
+            throw Poco::FileNotFoundException("Failed to open [" + path +
+                                              "]. File will not be sent.");
+        }
+
+        response.setContentLength(length);
         LOG_TRC('#' << socket->getFD() << ": Sending " << (headerOnly ? "header for " : "")
-                    << " file [" << path << "].");
+                    << " file [" << path << "], " << length << " bytes from " << start << '.');
         socket->send(response);
 
+        // The body is streamed as the socket drains, without reading it all in memory.
         if (!headerOnly)
-            sendUncompressedFileContent(socket, path, bufferSize);
+            socket->sendFile(fd, start, length);
     }
     else
     {
@@ -158,16 +185,16 @@ static void sendFileImpl(const std::shared_ptr<StreamSocket>& socket, const std:
 
 void sendFile(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
               http::Response& response, const bool noCache,
-              const bool deflate, const bool headerOnly)
+              const bool deflate, const bool headerOnly, const std::string& range)
 {
-    sendFileImpl(socket, path, response, noCache, deflate, headerOnly, false);
+    sendFileImpl(socket, path, response, noCache, deflate, headerOnly, false, range);
 }
 
 void sendFileAndShutdown(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
                          http::Response& response, const bool noCache,
-                         const bool deflate, const bool headerOnly)
+                         const bool deflate, const bool headerOnly, const std::string& range)
 {
-    sendFileImpl(socket, path, response, noCache, deflate, headerOnly, true);
+    sendFileImpl(socket, path, response, noCache, deflate, headerOnly, true, range);
 }
 
 } // namespace HttpHelper
@@ -32,14 +32,20 @@ void sendErrorAndShutdown(http::StatusCode errorCode, const std::shared_ptr<Stre
                           const std::string& extraHeader = std::string());
 
 /// Sends file as HTTP response and shutdown the socket.
+/// The body is streamed from the file as the socket drains.
+/// When given, the value of the request's Range header selects the part to send.
 void sendFileAndShutdown(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
                          http::Response& response,
-                         const bool noCache = false, const bool deflate = false, const bool headerOnly = false);
+                         const bool noCache = false, const bool deflate = false, const bool headerOnly = false,
+                         const std::string& range = std::string());
 
 /// Sends file as HTTP response.
+/// The body is streamed from the file as the socket drains.
+/// When given, the value of the request's Range header selects the part to send.
 void sendFile(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
               http::Response& response,
-              const bool noCache = false, const bool deflate = false, const bool headerOnly = false);
+              const bool noCache = false, const bool deflate = false, const bool headerOnly = false,
+              const std::string& range = std::string());
 
 /// Verifies that the given WOPISrc is properly URI-encoded.
 /// Warns if it isn't and, in debug builds, closes the socket (if given) and returns false.
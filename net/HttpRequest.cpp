@@ -13,13 +13,12 @@
 
 #include "HttpRequest.hpp"
 
-#include <Poco/MemoryStream.h>
-#include <Poco/Net/HTTPResponse.h>
-
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <sys/types.h>
 #include <netdb.h>
 
@@ -75,31 +74,6 @@ static inline int64_t findLineBreak(const char* p, int64_t off, int64_t len)
     return len;
 }
 
-/// Finds the double CRLF that signifies the end
-/// of a block, such as a header. The second CRLF
-/// is for a blank line, and that's what we seek.
-static inline int64_t findBlankLine(const char* p, int64_t off, int64_t len)
-{
-    for (; off < len;)
-    {
-        off = findLineBreak(p, off, len);
-        // off is at the first LF, and we expect LFCRLF.
-        if (off + 2 >= len)
-        {
-            return len; // Not found.
-        }
-
-        if (p[off + 1] == '\r' && p[off + 2] == '\n')
-        {
-            return off + 2; // Return the second LF.
-        }
-
-        off += 3; // Skip over the mismatch.
-    }
-
-    return len;
-}
-
 /// Find the end of text.
 /// Returns the offset to the first whitespace or
 /// line-break character if found, otherwise, len.
@@ -114,62 +88,136 @@ static inline int64_t findEndOfToken(const char* p, int64_t off, int64_t len)
     return len;
 }
 
+/// Trims the optional whitespace around a field value (or name).
+static inline std::string_view trimOws(std::string_view text)
+{
+    while (!text.empty() && isWhitespace(text.front()))
+        text.remove_prefix(1);
+    while (!text.empty() && isWhitespace(text.back()))
+        text.remove_suffix(1);
+
+    return text;
+}
+
 int64_t Header::parse(const char* p, int64_t len)
 {
     LOG_TRC("Parsing header given " << len << " bytes: " << std::string(p, std::min<int64_t>(len, 80L)));
-    if (len < 4)
-    {
-        // Incomplete; we need at least \r\n\r\n.
-        return 0;
-    }
 
-    // Make sure we have the full header before parsing.
-    const int64_t endPos = findBlankLine(p, 0, len);
-    if (endPos == len)
+    // On failure, we leave the header as we found it.
+    const std::size_t initialSize = _headers.size();
+    const auto rollback = [&](int64_t result)
     {
-        return 0; // Incomplete.
-    }
+        _headers.resize(initialSize);
+        reindex(initialSize);
+        return result;
+    };
 
-    try
+    // The last Transfer-Encoding value; it points into the data.
+    std::string_view transferEncoding;
+
+    int64_t off = 0;
+    while (off < len)
     {
-        //FIXME: implement http header parser!
+        const int64_t eol = findLineBreak(p, off, len);
+        if (eol == len)
+        {
+            break; // Incomplete.
+        }
 
-        // Now parse to preserve folded headers and other
-        // corner cases that is conformant to the rfc,
-        // detecting any errors and/or invalid entries.
-        // NB: request.read() expects full message and will fail.
-        Poco::Net::MessageHeader msgHeader;
-        Poco::MemoryInputStream data(p, len);
-        msgHeader.read(data);
-        if (data.tellg() < 0)
+        std::string_view line(p + off, eol - off);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+
+        const bool first = (off == 0);
+        off = eol + 1;
+
+        if (line.empty())
         {
-            LOG_DBG("Failed to parse http header.");
-            return -1;
+            if (first)
+            {
+                continue; // Skip the end of a preceding line.
+            }
+
+            // The blank line ends the header.
+            const std::size_t comma = transferEncoding.rfind(',');
+            const std::string_view coding =
+                trimOws(comma == std::string_view::npos ? transferEncoding
+                                                        : transferEncoding.substr(comma + 1));
+            _chunked = Util::iequal(coding.data(), coding.size(), "chunked", 7);
+
+            LOG_TRC("Read " << off << " bytes of header. hasContentLength: " << hasContentLength()
+                            << ", contentLength: "
+                            << (hasContentLength() ? getContentLength() : -1)
+                            << ", chunked: " << getChunkedTransferEncoding());
+
+            // We consumed the full header, including the blank line.
+            return off;
         }
 
-        // Copy the header entries over to us.
-        for (const auto& pair : msgHeader)
+        if (line.front() == ' ' || line.front() == '\t')
         {
-            set(Util::trimmed(pair.first), Util::trimmed(pair.second));
+            // Obsolete line folding continues the previous value.
+            if (_headers.size() > initialSize)
+            {
+                std::string& value = _headers.back().second;
+                const std::string_view more = trimOws(line);
+                if (value.size() + more.size() + 1 > MaxValueLen)
+                {
+                    LOG_DBG("Folded http header value of [" << _headers.back().first
+                                                            << "] is too long");
+                    return rollback(-1);
+                }
+
+                value += ' ';
+                value.append(more.data(), more.size());
+            }
+
+            continue;
         }
 
-        _chunked = getTransferEncoding() == "chunked";
+        const std::size_t colon = line.find(':');
+        if (colon == std::string_view::npos)
+        {
+            // Not a field, as the status line, if we were given it.
+            continue;
+        }
 
-        LOG_TRC("Read " << data.tellg()
-                        << " bytes of header. hasContentLength: " << hasContentLength()
-                        << ", contentLength: " << (hasContentLength() ? getContentLength() : -1)
-                        << ", chunked: " << getChunkedTransferEncoding() << ":\n"
-                        << std::string(p, data.tellg()));
+        const std::string_view key = trimOws(line.substr(0, colon));
+        const std::string_view value = trimOws(line.substr(colon + 1));
+        if (key.empty() || static_cast<int64_t>(key.size()) > MaxNameLen ||
+            static_cast<int64_t>(value.size()) > MaxValueLen)
+        {
+            LOG_DBG("Invalid http header field of " << key.size() << " and " << value.size()
+                                                    << " bytes");
+            return rollback(-1);
+        }
 
-        // We consumed the full header, including the blank line.
-        return endPos + 1;
-    }
-    catch (const Poco::Exception& exc)
-    {
-        LOG_TRC("ERROR while parsing http header: " << exc.displayText());
+        if (static_cast<int64_t>(_headers.size() - initialSize) >= MaxNumberFields)
+        {
+            LOG_DBG("Too many http header fields");
+            return rollback(-1);
+        }
+
+        const int known = findWellKnown(key);
+        if (known >= 0 && WellKnownNames[known] == TRANSFER_ENCODING)
+        {
+            transferEncoding = value;
+        }
+        else if (known >= 0 && WellKnownNames[known] == CONTENT_LENGTH && _wellKnown[known] >= 0 &&
+                 _headers[_wellKnown[known]].second != value)
+        {
+            // Ambiguous framing, which smuggles requests past proxies.
+            LOG_DBG("Conflicting http Content-Length values");
+            return rollback(-1);
+        }
+
+        if (_headers.empty())
+            _headers.reserve(16);
+
+        add(std::string(key), std::string(value));
     }
 
-    return 0;
+    return rollback(0);
 }
 
 int64_t Header::getContentLength() const
@@ -190,6 +238,66 @@ int64_t Header::getContentLength() const
     }
 }
 
+/// Parses a decimal byte position, without sign or spaces.
+static bool parseBytePos(const std::string& str, uint64_t& value)
+{
+    if (str.empty() || str.size() > 19 ||
+        !std::all_of(str.begin(), str.end(), [](char ch) { return ch >= '0' && ch <= '9'; }))
+        return false;
+
+    value = std::stoull(str);
+    return true;
+}
+
+StatusCode parseByteRange(const std::string& range, uint64_t size, uint64_t& start,
+                          uint64_t& length)
+{
+    start = 0;
+    length = size;
+
+    static const std::string Unit = "bytes=";
+    if (range.compare(0, Unit.size(), Unit) != 0 || range.find(',') != std::string::npos)
+        return StatusCode::OK;
+
+    const std::string spec = Util::trimmed(range.substr(Unit.size()));
+    const std::size_t dash = spec.find('-');
+    if (dash == std::string::npos)
+        return StatusCode::OK;
+
+    const std::string first = spec.substr(0, dash);
+    const std::string last = spec.substr(dash + 1);
+    uint64_t firstPos = 0;
+    uint64_t lastPos = 0;
+    if (first.empty())
+    {
+        // The last N bytes.
+        if (!parseBytePos(last, lastPos))
+            return StatusCode::OK;
+
+        if (lastPos == 0 || size == 0)
+            return StatusCode::RangeNotSatisfiable;
+
+        length = std::min(lastPos, size);
+        start = size - length;
+        return StatusCode::PartialContent;
+    }
+
+    if (!parseBytePos(first, firstPos))
+        return StatusCode::OK;
+
+    if (last.empty())
+        lastPos = size > 0 ? size - 1 : 0;
+    else if (!parseBytePos(last, lastPos) || lastPos < firstPos)
+        return StatusCode::OK;
+
+    if (firstPos >= size)
+        return StatusCode::RangeNotSatisfiable;
+
+    start = firstPos;
+    length = std::min(lastPos, size - 1) - firstPos + 1;
+    return StatusCode::PartialContent;
+}
+
 /// Parses a Status Line.
 /// Returns the state and clobbers the len on succcess to the number of bytes read.
 FieldParseState StatusLine::parse(const char* p, int64_t& len)
@@ -301,90 +409,135 @@ FieldParseState StatusLine::parse(const char* p, int64_t& len)
     return FieldParseState::Valid;
 }
 
-int64_t Request::readData(const char* p, const int64_t len)
+int64_t Request::parseRequestLine(const char* p, const int64_t len)
 {
-    uint64_t available = len;
-    if (_stage == Stage::Header)
+    // Fix infinite loop on mobile by skipping the minimum request header
+    // length check
+    if (p == nullptr || (len < MinRequestHeaderLen && !Util::isMobileApp()))
     {
-        // First line is the status line.
-        // Fix infinite loop on mobile by skipping the minimum request header
-        // length check
-        if (p == nullptr || (len < MinRequestHeaderLen && !Util::isMobileApp()))
-        {
-            LOG_TRC("Request::readData: len < MinRequestHeaderLen");
-            return 0;
-        }
+        LOG_TRC("Request::readData: len < MinRequestHeaderLen");
+        return 0;
+    }
 
-        // Verb.
-        uint64_t off = skipSpaceAndTab(p, 0, available);
-        uint64_t end = findEndOfToken(p, off, available);
-        if (end == available)
-        {
-            // Incomplete data.
-            return 0;
-        }
+    // Verb.
+    int64_t off = skipSpaceAndTab(p, 0, len);
+    int64_t end = findEndOfToken(p, off, len);
+    if (end == len)
+    {
+        // Incomplete data.
+        return 0;
+    }
 
-        _verb = std::string(&p[off], end - off);
+    const std::string_view verb(&p[off], end - off);
 
-        // URL.
-        off = skipSpaceAndTab(p, end, available);
-        end = findEndOfToken(p, off, available);
-        if (end == available)
-        {
-            // Incomplete data.
-            return 0;
-        }
+    // URL.
+    off = skipSpaceAndTab(p, end, len);
+    end = findEndOfToken(p, off, len);
+    if (end == len)
+    {
+        // Incomplete data.
+        return 0;
+    }
 
-        _url = std::string(&p[off], end - off);
+    const std::string_view url(&p[off], end - off);
 
-        // Version.
-        off = skipSpaceAndTab(p, end, available);
-        if (off + VersionLen >= available)
-        {
-            // Incomplete data.
-            return 0;
-        }
+    // Version.
+    off = skipSpaceAndTab(p, end, len);
+    if (off + VersionLen >= len)
+    {
+        // Incomplete data.
+        return 0;
+    }
 
-        // We should have the version now.
-        assert(off + VersionLen < available && "Expected to have more data.");
-        const char* version = &p[off];
-        constexpr int VersionMajPos = sizeof("HTTP/") - 1;
-        constexpr int VersionDotPos = VersionMajPos + 1;
-        constexpr int VersionMinPos = VersionDotPos + 1;
-        constexpr int VersionBreakPos = VersionMinPos + 1; // Whitespace past the version.
-        const int versionMaj = version[VersionMajPos] - '0';
-        const int versionMin = version[VersionMinPos] - '0';
-        // Version may not be null-terminated.
-        if (!std::string(version, VersionLen).starts_with("HTTP/") ||
-            (versionMaj < 0 || versionMaj > 9) || version[VersionDotPos] != '.' ||
-            (versionMin < 0 || versionMin > 9) || !isWhitespace(version[VersionBreakPos]))
-        {
-            LOG_ERR("Request::dataRead: Invalid HTTP version [" << std::string(version, VersionLen)
-                                                                << "]");
-            return -1;
-        }
+    // We should have the version now.
+    assert(off + VersionLen < len && "Expected to have more data.");
+    const std::string_view version(&p[off], VersionLen);
+    constexpr int VersionMajPos = sizeof("HTTP/") - 1;
+    constexpr int VersionDotPos = VersionMajPos + 1;
+    constexpr int VersionMinPos = VersionDotPos + 1;
+    const int versionMaj = version[VersionMajPos] - '0';
+    const int versionMin = version[VersionMinPos] - '0';
+    // Version may not be null-terminated.
+    if (!version.starts_with("HTTP/") || (versionMaj < 0 || versionMaj > 9) ||
+        version[VersionDotPos] != '.' || (versionMin < 0 || versionMin > 9) ||
+        !isWhitespace(p[off + VersionLen]))
+    {
+        LOG_ERR("Request::dataRead: Invalid HTTP version [" << version << ']');
+        return -1;
+    }
+
+    off += VersionLen;
+    end = findLineBreak(p, off, len);
+    if (end >= len)
+    {
+        // Incomplete data.
+        return 0;
+    }
 
-        _version = std::string(version, VersionLen);
+    _verb = verb;
+    _url = url;
+    _version = version;
+
+    return end + 1; // Skip the LF character.
+}
+
+int64_t Request::parseHeader(const char* p, const int64_t len)
+{
+    // Without fields, the blank line immediately follows the request line.
+    if (len > 0 && p[0] == '\n')
+        return 1;
+
+    if (len > 0 && p[0] == '\r')
+    {
+        if (len == 1)
+            return 0; // Incomplete data.
+
+        if (p[1] == '\n')
+            return 2;
+    }
+
+    return _header.parse(p, len);
+}
 
-        off += VersionLen;
-        end = findLineBreak(p, off, available);
-        if (end >= available)
+int64_t Request::readHeader(const char* p, const int64_t len)
+{
+    const int64_t lineLen = parseRequestLine(p, len);
+    if (lineLen <= 0)
+    {
+        return lineLen;
+    }
+
+    const int64_t headerLen = parseHeader(p + lineLen, len - lineLen);
+    if (headerLen <= 0)
+    {
+        return headerLen;
+    }
+
+    _stage = Stage::Body;
+    return lineLen + headerLen;
+}
+
+int64_t Request::readData(const char* p, const int64_t len)
+{
+    int64_t available = len;
+    if (_stage == Stage::Header)
+    {
+        // First line is the status line.
+        const int64_t read = parseRequestLine(p, available);
+        if (read <= 0)
         {
-            // Incomplete data.
-            return 0;
+            return read;
         }
 
-        ++end; // Skip the LF character.
-
         // LOG_TRC("performWrites (header): " << headerStr.size() << ": " << headerStr);
         _stage = Stage::Body;
-        p += end;
-        available -= end;
+        p += read;
+        available -= read;
     }
 
     if (_stage == Stage::Body)
     {
-        const int64_t read = _header.parse(p, available);
+        const int64_t read = parseHeader(p, available);
         if (read < 0)
         {
             return read;
@@ -398,13 +551,14 @@ int64_t Request::readData(const char* p, const int64_t len)
 #ifdef DEBUG_HTTP
             LOG_TRC("After Header: "
                     << available << " bytes availble\n"
-                    << Util::dumpHex(std::string(p, std::min(available, 1 * 1024UL))));
+                    << Util::dumpHex(std::string(p, std::min(available, 1 * 1024L))));
 #endif //DEBUG_HTTP
         }
 
         if (_verb == VERB_GET)
         {
             // A payload in a GET request "has no defined semantics".
+            // Whatever follows is the next pipelined request.
             return len - available;
         }
         else
@@ -688,6 +842,67 @@ std::shared_ptr<Session> Session::create(std::string host, Protocol protocol, in
     return std::shared_ptr<Session>(new Session(std::move(host), protocol, port));
 }
 
+std::shared_ptr<Session> SessionPool::get(const std::string& host, Session::Protocol protocol,
+                                          int port, const SocketPoll& poll)
+{
+    port = (port > 0 ? port : Session::getDefaultPort(protocol));
+    const std::pair<uint64_t, std::string> key(poll.getId(),
+                                               std::string(Session::getProtocolScheme(protocol)) +
+                                                   "://" + host + ':' + std::to_string(port));
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Forget the sessions that were closed, in all polls, including those that are
+    // gone. Other polls' sessions may only be checked for being alive, they are in
+    // use on other threads.
+    for (auto it = _sessions.begin(); it != _sessions.end();)
+    {
+        std::vector<std::weak_ptr<Session>>& sessions = it->second;
+        sessions.erase(std::remove_if(sessions.begin(), sessions.end(),
+                                      [](const std::weak_ptr<Session>& weak)
+                                      { return weak.expired(); }),
+                       sessions.end());
+        it = sessions.empty() ? _sessions.erase(it) : std::next(it);
+    }
+
+    std::vector<std::weak_ptr<Session>>& sessions = _sessions[key];
+    std::size_t active = 0;
+    for (const std::weak_ptr<Session>& weak : sessions)
+    {
+        std::shared_ptr<Session> session = weak.lock();
+        if (!session)
+            continue;
+
+        if (session->isIdle())
+        {
+            if (!session->isStale())
+            {
+                LOG_DBG("Reusing connection #" << session->getFD() << " to " << key.second);
+                return session;
+            }
+
+            LOG_DBG("Closing stale connection #" << session->getFD() << " to " << key.second);
+            session->disconnect();
+            continue;
+        }
+
+        if (session->isConnected() || !session->response() || !session->response()->done())
+            ++active; // Busy or connecting.
+    }
+
+    std::shared_ptr<Session> session = Session::create(host, protocol, port);
+    if (active < _maxPerHost)
+    {
+        session->setIdleTimeout(_idleTimeout);
+        sessions.emplace_back(session);
+    }
+    else
+        LOG_DBG("Connection pool to " << key.second << " is full with " << active
+                                      << " connections, will not reuse the new one");
+
+    return session;
+}
+
 } // namespace http
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
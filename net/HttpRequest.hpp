@@ -17,13 +17,19 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 
+#include <array>
 #include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <netdb.h>
 
 #include <Common.hpp>
@@ -325,6 +331,15 @@ static inline const char* getReasonPhraseForCode(StatusCode statusCode)
 std::string getAgentString();
 std::string getServerString();
 
+/// Parses the value of a Range header for content of the given size.
+/// Only a single byte range is supported: "bytes=first-[last]" or "bytes=-suffix".
+/// Returns PartialContent and sets start and length on success,
+/// RangeNotSatisfiable when the range is past the end of the content,
+/// and OK, with start and length covering the whole content, when the
+/// header is to be ignored, i.e. it's invalid or has multiple ranges.
+StatusCode parseByteRange(const std::string& range, uint64_t size, uint64_t& start,
+                          uint64_t& length);
+
 /// The callback signature for handling IO writes.
 /// Returns the number of bytes read from the buffer,
 /// -1 for error (terminates the transfer).
@@ -380,64 +395,59 @@ public:
     ConstIterator begin() const { return _headers.begin(); }
     ConstIterator end() const { return _headers.end(); }
 
-    /// Parse the given data as an HTTP header.
-    /// Returns the number of bytes consumed (and must be removed from the input).
+    /// Parse the given data as an HTTP header, up to and including the blank line.
+    /// The fields are tokenized in a single pass over the data, without copying
+    /// anything but the fields we keep. A leading empty line is skipped.
+    /// Returns the number of bytes consumed (and must be removed from the input),
+    /// 0 if incomplete (and nothing is added), or -1 if invalid.
     int64_t parse(const char* p, int64_t len);
 
     /// Add an HTTP header field.
     void add(std::string key, std::string value)
     {
+        const int known = findWellKnown(key);
+        if (known >= 0 && _wellKnown[known] < 0)
+            _wellKnown[known] = _headers.size();
+
         _headers.emplace_back(std::move(key), std::move(value));
     }
 
     /// Set an HTTP header field, replacing an earlier value, if exists (case insensitive).
     void set(const std::string& key, std::string value)
     {
-        const Iterator e = _headers.end();
-        const Iterator it = std::find_if(_headers.begin(), e,
-                                    [&key](const Pair &pair) -> bool { return Util::iequal(pair.first, key); });
-        if( e != it ) {
-            it->second.swap(value);
-        } else {
-            _headers.emplace_back(key, std::move(value));
+        const int pos = find(key);
+        if (pos >= 0)
+        {
+            _headers[pos].second.swap(value);
+        }
+        else
+        {
+            add(key, std::move(value));
         }
     }
 
     // Returns true if the HTTP header field exists (case insensitive)
-    bool has(const std::string& key) const
-    {
-        const ConstIterator e = end();
-        return e != std::find_if(begin(), e,
-                            [&key](const Pair &pair) -> bool { return Util::iequal(pair.first, key); });
-    }
+    bool has(const std::string& key) const { return find(key) >= 0; }
 
     /// Remove the first matching HTTP header field (case insensitive), returning true if found and removed.
     bool remove(const std::string& key)
     {
-        const ConstIterator e = end();
-        const ConstIterator it = std::find_if(begin(), e,
-                                    [&key](const Pair &pair) -> bool { return Util::iequal(pair.first, key); });
-        if( e != it ) {
-            _headers.erase(it);
+        const int pos = find(key);
+        if (pos >= 0)
+        {
+            _headers.erase(_headers.begin() + pos);
+            reindex(pos);
             return true;
         }
+
         return false;
     }
 
     /// Get a header entry value by key, if found, defaulting to @def, if missing.
     std::string get(const std::string& key, const std::string& def = std::string()) const
     {
-        // There are typically half a dozen header
-        // entries, rarely much more. A map would
-        // probably not be faster but would add complexity.
-        const ConstIterator e = end();
-        const ConstIterator it = std::find_if(begin(), e,
-                                    [&key](const Pair &pair) -> bool { return Util::iequal(pair.first, key); });
-        if( e != it ) {
-            return it->second;
-        } else {
-            return def;
-        }
+        const int pos = find(key);
+        return pos >= 0 ? _headers[pos].second : def;
     }
 
     /// Set the Content-Type header.
@@ -569,10 +579,106 @@ public:
     }
 
 private:
-    /// The headers are ordered key/value pairs.
-    /// This isn't designed for lookup performance, but to preserve order.
-    //TODO: We might not need this and get away with a map.
+    /// The fields we look up all the time, found by perfect hashing rather than scanning.
+    static constexpr std::array<std::string_view, 20> WellKnownNames = {
+        "Host", "Connection", "Content-Length", "Content-Type", "Transfer-Encoding",
+        "Cookie", "Upgrade", "Expect", "Authorization", "Range",
+        "Accept-Encoding", "Origin", "User-Agent", "Sec-WebSocket-Key", "Sec-WebSocket-Version",
+        "Sec-WebSocket-Extensions", "X-Forwarded-For", "If-None-Match", "Location", "Date"
+    };
+
+    static constexpr std::size_t WellKnownTableSize = 32;
+
+    static constexpr char toLower(char c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+    /// Hashes the length and the first and last characters, which is collision-free
+    /// over the well-known names (this is checked at compile-time).
+    static constexpr std::size_t hashName(std::string_view name)
+    {
+        return (name.size() + 4 * static_cast<unsigned char>(toLower(name.front())) +
+                23 * static_cast<unsigned char>(toLower(name.back()))) %
+               WellKnownTableSize;
+    }
+
+    /// Maps the hash of a name to its index in WellKnownNames, or -1.
+    static constexpr std::array<int8_t, WellKnownTableSize> makeWellKnownTable()
+    {
+        std::array<int8_t, WellKnownTableSize> table{};
+        table.fill(-1);
+        for (std::size_t i = 0; i < WellKnownNames.size(); ++i)
+        {
+            const std::size_t hash = hashName(WellKnownNames[i]);
+            if (table[hash] >= 0)
+                throw std::logic_error("Colliding well-known header names");
+            table[hash] = static_cast<int8_t>(i);
+        }
+
+        return table;
+    }
+
+    /// Returns the index of the given name in WellKnownNames, or -1 if it isn't one.
+    static int findWellKnown(std::string_view name)
+    {
+        static constexpr std::array<int8_t, WellKnownTableSize> WellKnownTable =
+            makeWellKnownTable();
+
+        if (name.empty())
+            return -1;
+
+        const int index = WellKnownTable[hashName(name)];
+        if (index >= 0 && !Util::iequal(name.data(), name.size(), WellKnownNames[index].data(),
+                                        WellKnownNames[index].size()))
+            return -1;
+
+        return index;
+    }
+
+    /// Returns the position of the first field with the given name (case insensitive), or -1.
+    int find(std::string_view key) const
+    {
+        const int known = findWellKnown(key);
+        if (known >= 0)
+            return _wellKnown[known];
+
+        // There are typically half a dozen header
+        // entries, rarely much more. A map would
+        // probably not be faster but would add complexity.
+        for (std::size_t i = 0; i < _headers.size(); ++i)
+        {
+            if (Util::iequal(_headers[i].first.data(), _headers[i].first.size(), key.data(),
+                             key.size()))
+                return i;
+        }
+
+        return -1;
+    }
+
+    /// Rebuilds the positions of the well-known fields after removing those at or past @from.
+    void reindex(std::size_t from)
+    {
+        for (int& pos : _wellKnown)
+        {
+            if (pos >= static_cast<int>(from))
+                pos = -1;
+        }
+
+        for (std::size_t i = from; i < _headers.size(); ++i)
+        {
+            const int known = findWellKnown(_headers[i].first);
+            if (known >= 0 && _wellKnown[known] < 0)
+                _wellKnown[known] = i;
+        }
+    }
+
+    /// The headers are ordered key/value pairs, to preserve order.
     Container _headers;
+    /// The position of the first field of each of the WellKnownNames, or -1.
+    std::array<int, WellKnownNames.size()> _wellKnown = []()
+    {
+        std::array<int, WellKnownNames.size()> positions{};
+        positions.fill(-1);
+        return positions;
+    }();
     bool _chunked = false;
 };
 
@@ -602,6 +708,7 @@ public:
         , _verb(std::move(verb))
         , _version(std::move(version))
         , _bodyReaderCb([](const char*, int64_t) { return 0; })
+        , _bodyRewindCb([]() { return true; })
         , _stage(Stage::Header)
     {
     }
@@ -644,6 +751,7 @@ public:
     {
         _header.setContentLength(size);
         _bodyReaderCb = std::move(bodyReaderCb);
+        _bodyRewindCb = nullptr; // Unknown source, it can't be read again.
     }
 
     /// Set the file to send as the body of the request.
@@ -656,12 +764,18 @@ public:
         ifs->seekg(0, std::ios_base::beg);
 
         setBodySource(
-            [ ifs=std::move(ifs) ](char* buf, int64_t len) -> int64_t
+            [ ifs ](char* buf, int64_t len) -> int64_t
             {
                 ifs->read(buf, len);
                 return ifs->gcount();
             },
             size);
+
+        _bodyRewindCb = [ ifs=std::move(ifs) ]()
+        {
+            ifs->clear();
+            return !!ifs->seekg(0, std::ios_base::beg);
+        };
     }
 
     void setBody(const std::string& body, std::string contentType = "text/html;charset=utf-8")
@@ -674,16 +788,34 @@ public:
         auto iss = std::make_shared<std::istringstream>(body, std::ios::binary);
 
         setBodySource(
-            [ iss=std::move(iss) ](char* buf, int64_t len) -> int64_t
+            [ iss ](char* buf, int64_t len) -> int64_t
             {
                 iss->read(buf, len);
                 return iss->gcount();
             },
             body.size());
+
+        _bodyRewindCb = [ iss=std::move(iss) ]()
+        {
+            iss->clear();
+            return !!iss->seekg(0, std::ios_base::beg);
+        };
     }
 
     Stage stage() const { return _stage; }
 
+    /// Start over, to send the request again, say on a new connection.
+    /// Returns false when the body can't be read again, which only
+    /// those set with setBody() and setBodyFile() can.
+    bool rewind()
+    {
+        if (!_bodyRewindCb || !_bodyRewindCb())
+            return false;
+
+        _stage = Stage::Header;
+        return true;
+    }
+
     bool writeData(Buffer& out, std::size_t capacity)
     {
         const std::size_t buffered_size = out.size();
@@ -750,6 +882,12 @@ public:
     /// and/or to interrupt transmission.
     int64_t readData(const char* p, int64_t len);
 
+    /// Parses the request line and the header of any method, without consuming
+    /// anything until both are complete, so it can be retried as more data arrives.
+    /// Returns the size of the request line and header, 0 if incomplete, or -1 if invalid.
+    /// The body, if any, and then the next pipelined request, follow in the data.
+    int64_t readHeader(const char* p, int64_t len);
+
     void dumpState(std::ostream& os, const std::string& indent = "\n  ") const
     {
         os << indent << "http::Request: " << _version << ' ' << _verb << ' ' << _url;
@@ -759,11 +897,19 @@ public:
     }
 
 private:
+    /// Parses the request line, returning its size, 0 if incomplete, or -1 if invalid.
+    int64_t parseRequestLine(const char* p, int64_t len);
+
+    /// Parses the header fields following the request line, including the blank line.
+    /// Returns the number of bytes consumed, 0 if incomplete, or -1 if invalid.
+    int64_t parseHeader(const char* p, int64_t len);
+
     Header _header;
     std::string _url; //< The URL to request, without hostname.
     std::string _verb; //< Used as-is, but only POST supported.
     std::string _version; //< The protocol version, currently 1.1.
     IoReadFunc _bodyReaderCb;
+    std::function<bool()> _bodyRewindCb; //< Reads the body from the start again, if possible.
     Stage _stage;
 };
 
@@ -874,6 +1020,7 @@ public:
         : _state(State::New)
         , _parserStage(ParserStage::StatusLine)
         , _recvBodySize(0)
+        , _bodyFileFd(-1)
         , _finishedCallback(std::move(finishedCallback))
         , _fd(fd)
     {
@@ -895,6 +1042,7 @@ public:
         , _state(State::New)
         , _parserStage(ParserStage::StatusLine)
         , _recvBodySize(0)
+        , _bodyFileFd(-1)
         , _fd(fd)
     {
         _header.add("Date", Util::getHttpTimeNow());
@@ -908,6 +1056,8 @@ public:
     {
     }
 
+    ~Response() { closeBodyFile(); }
+
     /// The state of an incoming response, when parsing.
     STATE_ENUM(State,
                New, //< Valid but meaningless.
@@ -929,6 +1079,9 @@ public:
     const StatusLine& statusLine() const { return _statusLine; }
     StatusCode statusCode() const { return _statusLine.statusCode(); }
 
+    /// Replace the status of an outgoing response.
+    void setStatusCode(StatusCode statusCode) { _statusLine = StatusLine(statusCode); }
+
     Header& header() { return _header; }
     const Header& header() const { return _header; }
 
@@ -954,15 +1107,45 @@ public:
     /// If the server responds with a non-success status code (i.e. not 2xx)
     /// the body is redirected to memory to be read via getBody().
     /// Check the statusLine().statusCategory() for the status code.
+    /// The file is written as the data arrives, after reserving the
+    /// Content-Length on disk, when known, so we fail early when full.
     void saveBodyToFile(const std::string& path)
     {
-        _bodyFile.open(path, std::ios_base::out | std::ios_base::binary);
+        closeBodyFile();
+        _bodyFileFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (_bodyFileFd < 0)
+            LOG_SYS("Failed to open [" << path << "] to save the response body");
+
         _onBodyWriteCb = [this](const char* p, int64_t len)
         {
             LOG_TRC("Writing " << len << " bytes");
-            if (_bodyFile.good())
-                _bodyFile.write(p, len);
-            return _bodyFile.good() ? len : -1;
+            if (_bodyFileFd < 0)
+                return int64_t(-1);
+
+#ifdef __linux__
+            if (_recvBodySize == 0 && _header.hasContentLength() &&
+                ::fallocate(_bodyFileFd, FALLOC_FL_KEEP_SIZE, 0, _header.getContentLength()) < 0 &&
+                errno == ENOSPC)
+            {
+                LOG_ERR("No space to save the " << _header.getContentLength()
+                                                << " bytes response body");
+                return int64_t(-1);
+            }
+#endif
+
+            for (int64_t wrote = 0; wrote < len;)
+            {
+                const ssize_t size = ::write(_bodyFileFd, p + wrote, len - wrote);
+                if (size < 0 && errno != EINTR)
+                {
+                    LOG_SYS("Failed to write the response body");
+                    return int64_t(-1);
+                }
+
+                wrote += std::max<ssize_t>(size, 0);
+            }
+
+            return len;
         };
     }
 
@@ -985,6 +1168,9 @@ public:
     /// Returns the body, assuming it wasn't redirected to file or callback.
     const std::string& getBody() const { return _body; }
 
+    /// The size of the body received so far.
+    int64_t getRecvBodySize() const { return _recvBodySize; }
+
     /// Set the body to be sent to the client.
     /// Also sets Content-Length and Content-Type.
     void setBody(std::string body, std::string contentType = "text/html;charset=utf-8")
@@ -1071,13 +1257,22 @@ private:
         if (!done())
         {
             LOG_TRC("Finishing: " << name(newState));
-            _bodyFile.close();
+            closeBodyFile();
             _state = newState;
             if (_finishedCallback)
                 _finishedCallback();
         }
     }
 
+    void closeBodyFile()
+    {
+        if (_bodyFileFd >= 0)
+        {
+            ::close(_bodyFileFd);
+            _bodyFileFd = -1;
+        }
+    }
+
     /// The stage we're at in consuming the received data.
     STATE_ENUM(ParserStage, StatusLine, Header, Body, Finished);
 
@@ -1087,7 +1282,7 @@ private:
     ParserStage _parserStage; //< The parser's state.
     int64_t _recvBodySize; //< The amount of data we received (compared to the Content-Length).
     std::string _body; //< Used when _bodyHandling is InMemory.
-    std::ofstream _bodyFile; //< Used when _bodyHandling is OnDisk.
+    int _bodyFileFd; //< Used when _bodyHandling is OnDisk.
     IoWriteFunc _onBodyWriteCb; //< Used to handling body receipt in all cases.
     FinishedCallback _finishedCallback; //< Called when response is finished.
     int _fd; //< The socket file-descriptor.
@@ -1110,7 +1305,9 @@ private:
         , _fd(-1)
         , _handshakeSslVerifyFailure(0)
         , _timeout(getDefaultTimeout())
+        , _idleTimeout(std::chrono::microseconds::zero())
         , _connected(false)
+        , _retryPoll(nullptr)
     {
         assert(!_host.empty() && portNumber > 0 && !_port.empty() &&
                "Invalid hostname and portNumber for http::Sesssion");
@@ -1123,6 +1320,7 @@ private:
 #endif
     }
 
+public:
     /// Returns the given protocol's scheme.
     static const char* getProtocolScheme(Protocol protocol)
     {
@@ -1137,7 +1335,6 @@ private:
         return "";
     }
 
-public:
     /// Create a new HTTP Session to the given host.
     /// The port defaults to the protocol's default port.
     static std::shared_ptr<Session> create(std::string host, Protocol protocol, int port = 0);
@@ -1218,6 +1415,30 @@ public:
     /// Get the timeout, in microseconds.
     std::chrono::microseconds getTimeout() const { return _timeout; }
 
+    /// Set how long the connection is kept open without a request, for reuse.
+    /// Zero, the default, leaves it to the server to close it.
+    void setIdleTimeout(const std::chrono::microseconds timeout) { _idleTimeout = timeout; }
+
+    /// True when connected and no request is in progress, so it can take a new one.
+    bool isIdle() const
+    {
+        return isConnected() && (!_response || (_response->done() && _finishTime >= _startTime));
+    }
+
+    /// True when the idle connection can't take a new request after all, because
+    /// the peer has closed it, or sent something that no request asked for,
+    /// which we haven't seen yet. Must be called on the thread of the socket's poll.
+    bool isStale() const
+    {
+        std::shared_ptr<StreamSocket> socket = _socket.lock();
+        if (!socket || !socket->getInBuffer().empty())
+            return true;
+
+        char c;
+        const ssize_t len = ::recv(socket->getFD(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return len >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+
     /// The response we _got_ for our request. Do *not* use this to _send_ a response!
     const std::shared_ptr<Response>& response() const { return _response; }
     const std::string& getUrl() const { return _request.getUrl(); }
@@ -1235,6 +1456,13 @@ public:
 
     void setConnectFailHandler(ConnectFailCallback onConnectFail) { _onConnectFail = std::move(onConnectFail); }
 
+    /// The onProgress callback handler signature, with the size of the body
+    /// received so far and its Content-Length, or -1 when unknown.
+    using ProgressCallback = std::function<void(int64_t received, int64_t expected)>;
+
+    /// Called as the response body arrives, until it's done. Reset once finished.
+    void setProgressHandler(ProgressCallback onProgress) { _onProgress = std::move(onProgress); }
+
     /// Make a synchronous request to download a file to the given path.
     /// Note: when the server returns an error, the response body,
     /// if any, will be stored in memory and can be read via getBody().
@@ -1313,9 +1541,29 @@ public:
                                      << req.getUrl());
 
         newRequest(req);
+        asyncRequestImpl(req, poll);
+    }
+
+    /// Start an asynchronous request to download a file to the given path,
+    /// written as it arrives, on the given SocketPoll. See asyncRequest().
+    /// Note: when the server returns an error, the response body,
+    /// if any, will be stored in memory and can be read via getBody().
+    void asyncDownload(const Request& req, const std::string& saveToFilePath, SocketPoll& poll)
+    {
+        LOG_TRC("new asyncDownload: " << req.getVerb() << ' ' << host() << ':' << port() << ' '
+                                      << req.getUrl());
+
+        newRequest(req);
+        _response->saveBodyToFile(saveToFilePath);
+        asyncRequestImpl(req, poll);
+    }
 
+private:
+    void asyncRequestImpl(const Request& req, SocketPoll& poll)
+    {
         if (!isConnected())
         {
+            _retryPoll = nullptr;
             asyncConnect(poll);
         }
         else
@@ -1323,14 +1571,17 @@ public:
             // Technically, there is a race here. The socket can
             // get disconnected and removed right after isConnected.
             // In that case, we will timeout and no request will be sent.
+            // Likewise, the peer may have closed it meanwhile, which we retry.
+            _retryPoll = &poll;
             poll.wakeup();
         }
 
         LOG_DBG("starting asyncRequest: " << req.getVerb() << ' ' << host() << ':' << port() << ' '
                                           << req.getUrl());
-
     }
 
+public:
+
     void asyncShutdown()
     {
         LOG_TRC("asyncShutdown");
@@ -1368,6 +1619,7 @@ public:
     void disconnect()
     {
         LOG_TRC("disconnect");
+        _retryPoll = nullptr;
         std::shared_ptr<StreamSocket> socket = _socket.lock();
         if (socket)
         {
@@ -1464,6 +1716,7 @@ private:
             assert(_response->state() != Response::State::Incomplete &&
                    "Unexpected response in Incomplete state");
             assert(_response->done() && "Must have response in done state");
+            _onProgress = nullptr; // Set per request.
             if (_onFinished)
             {
                 LOG_TRC("onFinished calling client");
@@ -1491,6 +1744,9 @@ private:
                 onDisconnect();
                 assert(isConnected() == false);
             }
+
+            // Only now can we take a new request, not from within the callback.
+            _finishTime = std::chrono::steady_clock::now();
         };
 
         _response.reset();
@@ -1572,12 +1828,22 @@ private:
             LOG_TRC("HandleIncomingMessage: buffer has:\n"
                     << Util::dumpHex(std::string(data.data(), std::min<size_t>(data.size(), 256UL))));
 
+            _retryPoll = nullptr; // The response has started, the connection was fine.
+
             const int64_t read = _response->readData(data.data(), data.size());
             if (read >= 0)
             {
                 // Remove consumed data.
                 if (read)
                     data.eraseFirst(read);
+
+                if (_onProgress && !_response->done() && _response->getRecvBodySize() > 0)
+                {
+                    const Header& header = _response->header();
+                    _onProgress(_response->getRecvBodySize(),
+                                header.hasContentLength() ? header.getContentLength() : -1);
+                }
+
                 return;
             }
         }
@@ -1635,12 +1901,38 @@ private:
         }
 
         _connected = false;
+
+        // Not when the socket is gone, destroyed with its poll.
+        if (socket && retryOnNewConnection())
+            return;
+
         if (_response)
             _response->finish();
 
         _fd = -1; // No longer our socket fd.
     }
 
+    /// Send the request again, once, on a new connection, when the reused one it went
+    /// out on was closed before any of the response came, as servers close idle
+    /// connections at will. Returns true when retrying.
+    bool retryOnNewConnection()
+    {
+        SocketPoll* poll = _retryPoll;
+        _retryPoll = nullptr;
+        if (!poll || !_response || _response->state() != Response::State::New ||
+            SigUtil::getTerminationFlag() || !_request.rewind())
+        {
+            return false;
+        }
+
+        LOG_DBG("Reused connection closed before responding to [" << _request.getVerb() << ' '
+                                                                   << _host << _request.getUrl()
+                                                                   << "], retrying on a new one");
+        _fd = -1;
+        asyncConnect(*poll);
+        return true;
+    }
+
     std::shared_ptr<StreamSocket> connect()
     {
         _socket.reset(); // Reset to make sure we are disconnected.
@@ -1697,7 +1989,16 @@ private:
     void checkTimeout(std::chrono::steady_clock::time_point now) override
     {
         if (!_response || _response->done())
+        {
+            if (_response && _idleTimeout > std::chrono::microseconds::zero() && isConnected() &&
+                now - _finishTime > _idleTimeout)
+            {
+                LOG_DBG("Closing idle connection to " << _host << ':' << _port);
+                onDisconnect();
+            }
+
             return;
+        }
 
         const auto duration =
             std::chrono::duration_cast<std::chrono::milliseconds>(now - _startTime);
@@ -1727,15 +2028,49 @@ private:
     int _fd; //< The socket file-descriptor.
     long _handshakeSslVerifyFailure; //< Save SslVerityResult at onHandshakeFail
     std::chrono::microseconds _timeout;
+    std::chrono::microseconds _idleTimeout; //< Disconnect when idle for this long, if set.
     std::chrono::steady_clock::time_point _startTime;
-    bool _connected;
+    std::chrono::steady_clock::time_point _finishTime; //< When the last request finished.
+    std::atomic_bool _connected; //< Checked by pools on other threads.
+    /// The poll of a request on a reused connection, until its response starts, to retry on.
+    SocketPoll* _retryPoll;
     Request _request;
     FinishedCallback _onFinished;
     ConnectFailCallback _onConnectFail;
+    ProgressCallback _onProgress;
     std::shared_ptr<Response> _response;
     std::weak_ptr<StreamSocket> _socket; //< Must be the last member.
 };
 
+/// Keeps the Sessions of asynchronous requests, to reuse their connections
+/// for later requests to the same host from the same SocketPoll, where their
+/// sockets live. The sockets own the sessions, so only connected ones are kept,
+/// until they are idle for too long.
+class SessionPool final
+{
+public:
+    /// Keeps up to @maxPerHost connections per host and poll,
+    /// closing them once idle for @idleTimeout.
+    SessionPool(std::size_t maxPerHost, std::chrono::microseconds idleTimeout)
+        : _maxPerHost(maxPerHost)
+        , _idleTimeout(idleTimeout)
+    {
+    }
+
+    /// Returns an idle, connected Session to the host, to make an asynchronous request
+    /// on the given poll, or a new Session, kept for reuse while there's room.
+    /// Must be called on the poll's thread.
+    std::shared_ptr<Session> get(const std::string& host, Session::Protocol protocol, int port,
+                                 const SocketPoll& poll);
+
+private:
+    /// The pooled sessions, by poll, and scheme, host, and port.
+    std::map<std::pair<uint64_t, std::string>, std::vector<std::weak_ptr<Session>>> _sessions;
+    std::mutex _mutex;
+    const std::size_t _maxPerHost;
+    const std::chrono::microseconds _idleTimeout;
+};
+
 /// HTTP Get a URL synchronously.
 inline const std::shared_ptr<const http::Response>
 get(const std::string& url, std::chrono::milliseconds timeout = Session::getDefaultTimeout())
@@ -0,0 +1,333 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+
+#include <endian.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// A minimal io_uring(7) instance, through the raw system calls, to wait
+/// on many file descriptors. It only does one-shot requests: polls, which
+/// have the level-triggered semantics of poll(2), and receives and accepts
+/// on sockets. A request stays armed in the kernel until it completes, and
+/// all the requests queued and the wait for their completions go to the
+/// kernel in a single system call. Receives take the buffers provided to
+/// the kernel beforehand only once data arrives, so idle sockets need none.
+class IoUring
+{
+public:
+    IoUring()
+        : _fd(-1)
+        , _sqEntries(0)
+        , _sqTail(0)
+        , _sqMask(0)
+        , _sqKernelHead(nullptr)
+        , _sqKernelTail(nullptr)
+        , _sqArray(nullptr)
+        , _cqMask(0)
+        , _cqHead(nullptr)
+        , _cqTail(nullptr)
+        , _cqes(nullptr)
+        , _sqRing(nullptr)
+        , _sqRingSize(0)
+        , _cqRing(nullptr)
+        , _cqRingSize(0)
+        , _sqes(nullptr)
+        , _sqesSize(0)
+    {
+    }
+
+    ~IoUring()
+    {
+        if (_sqes)
+            ::munmap(_sqes, _sqesSize);
+        if (_cqRing && _cqRing != _sqRing)
+            ::munmap(_cqRing, _cqRingSize);
+        if (_sqRing)
+            ::munmap(_sqRing, _sqRingSize);
+        if (_fd >= 0)
+            ::close(_fd);
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /// Creates the rings, with room for the given number of queued requests.
+    /// Returns false on failure, including when the kernel lacks what we need.
+    bool init(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        _fd = ::syscall(__NR_io_uring_setup, entries, &params);
+        if (_fd < 0)
+            return false;
+
+        // We need to wait with a timeout (5.11) and never lose completions.
+        constexpr unsigned Features = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+        if ((params.features & Features) != Features)
+        {
+            errno = ENOSYS;
+            return false;
+        }
+
+        _sqEntries = params.sq_entries;
+        _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap)
+            _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+
+        _sqRing = map(_sqRingSize, IORING_OFF_SQ_RING);
+        if (!_sqRing)
+            return false;
+
+        _cqRing = singleMmap ? _sqRing : map(_cqRingSize, IORING_OFF_CQ_RING);
+        if (!_cqRing)
+            return false;
+
+        _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        _sqes = static_cast<io_uring_sqe*>(map(_sqesSize, IORING_OFF_SQES));
+        if (!_sqes)
+            return false;
+
+        char* sq = static_cast<char*>(_sqRing);
+        _sqKernelHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        _sqKernelTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        _sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        _sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        _sqTail = *_sqKernelTail;
+
+        char* cq = static_cast<char*>(_cqRing);
+        _cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        _cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        _cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    int getFD() const { return _fd; }
+
+    /// Queues a one-shot poll of fd for events, to complete with userData.
+    /// Errors and hang-ups are always reported, as with poll(2).
+    /// Returns false if it cannot be queued.
+    bool pollAdd(int fd, uint32_t events, uint64_t userData)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (!sqe)
+            return false;
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+        events = (events << 16) | (events >> 16);
+#endif
+        sqe->poll32_events = events;
+        sqe->user_data = userData;
+        return true;
+    }
+
+    /// Queues the cancellation of the poll armed with userData.
+    /// Its completion comes with NoUserData. Returns false if it cannot be queued.
+    bool pollRemove(uint64_t userData)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (!sqe)
+            return false;
+
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = userData;
+        sqe->user_data = NoUserData;
+        return true;
+    }
+
+    /// Queues a one-shot receive of up to len bytes from the socket fd, into
+    /// a buffer of bufferGroup that the kernel picks once there is data; see
+    /// getBufferId(). Returns false if it cannot be queued.
+    bool recv(int fd, unsigned len, uint16_t bufferGroup, uint64_t userData)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (!sqe)
+            return false;
+
+        sqe->opcode = IORING_OP_RECV;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->fd = fd;
+        sqe->len = len;
+        sqe->buf_group = bufferGroup;
+        sqe->user_data = userData;
+        return true;
+    }
+
+    /// Queues a one-shot accept(2) on the listening socket fd, completing with
+    /// the new non-blocking descriptor. Returns false if it cannot be queued.
+    bool accept(int fd, uint64_t userData)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (!sqe)
+            return false;
+
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = userData;
+        return true;
+    }
+
+    /// Queues the cancellation of the receive or accept queued with userData,
+    /// which then completes with -ECANCELED, unless it completed already.
+    /// Its own completion comes with NoUserData. Returns false if it cannot be queued.
+    bool cancel(uint64_t userData)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (!sqe)
+            return false;
+
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = userData;
+        sqe->user_data = NoUserData;
+        return true;
+    }
+
+    /// Queues handing count buffers of len bytes each, from addr on, to the
+    /// kernel for the receives of bufferGroup, with the ids from firstId on.
+    /// Its completion comes with NoUserData. Returns false if it cannot be queued.
+    bool provideBuffers(char* addr, unsigned len, unsigned count, uint16_t bufferGroup,
+                        uint16_t firstId)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (!sqe)
+            return false;
+
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = count;
+        sqe->addr = reinterpret_cast<uint64_t>(addr);
+        sqe->len = len;
+        sqe->off = firstId;
+        sqe->buf_group = bufferGroup;
+        sqe->user_data = NoUserData;
+        return true;
+    }
+
+    /// The id of the provided buffer that a completion with these flags
+    /// filled, and so handed back to us, or -1 if none.
+    static int getBufferId(uint32_t flags)
+    {
+        return (flags & IORING_CQE_F_BUFFER) ? static_cast<int>(flags >> IORING_CQE_BUFFER_SHIFT)
+                                             : -1;
+    }
+
+    /// Submits what was queued and waits up to timeoutMicroS for completions.
+    /// Returns the number of completions to reap, or -1 with errno set.
+    int submitAndWait(int64_t timeoutMicroS)
+    {
+        timeoutMicroS = std::max<int64_t>(timeoutMicroS, 0);
+        __kernel_timespec timeout;
+        timeout.tv_sec = timeoutMicroS / (1000 * 1000);
+        timeout.tv_nsec = (timeoutMicroS % (1000 * 1000)) * 1000;
+
+        io_uring_getevents_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+
+        const int rc = enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        // Completions still due for reaping or the timeout are no failures.
+        if (rc < 0 && errno != EBUSY && errno != ETIME)
+            return -1;
+
+        return __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE) - *_cqHead;
+    }
+
+    /// Calls handler(userData, result, flags) for each completion, consuming them.
+    template <typename T> void reap(T handler)
+    {
+        unsigned head = *_cqHead;
+        const unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe = _cqes[head & _cqMask];
+            handler(cqe.user_data, cqe.res, cqe.flags);
+        }
+
+        __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    /// The user data of completions to ignore.
+    static constexpr uint64_t NoUserData = 0;
+
+private:
+    void* map(std::size_t size, off_t offset)
+    {
+        void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd,
+                           offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    /// Submits the queued requests, waiting for minComplete completions.
+    int enter(unsigned minComplete, unsigned flags, const void* arg, std::size_t argSize)
+    {
+        __atomic_store_n(_sqKernelTail, _sqTail, __ATOMIC_RELEASE);
+        const unsigned toSubmit = _sqTail - __atomic_load_n(_sqKernelHead, __ATOMIC_ACQUIRE);
+        return ::syscall(__NR_io_uring_enter, _fd, toSubmit, minComplete, flags, arg, argSize);
+    }
+
+    /// Returns a cleared submission entry, submitting the queue first if full,
+    /// or nullptr if that fails.
+    io_uring_sqe* getSqe()
+    {
+        // Without a kernel polling thread, submitting consumes the whole queue.
+        if (_sqTail - __atomic_load_n(_sqKernelHead, __ATOMIC_ACQUIRE) >= _sqEntries &&
+            (enter(0, 0, nullptr, 0) < 0 ||
+             _sqTail - __atomic_load_n(_sqKernelHead, __ATOMIC_ACQUIRE) >= _sqEntries))
+            return nullptr;
+
+        const unsigned index = _sqTail & _sqMask;
+        io_uring_sqe* sqe = &_sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        _sqArray[index] = index;
+        ++_sqTail;
+        return sqe;
+    }
+
+    int _fd;
+    unsigned _sqEntries;
+    unsigned _sqTail; //< Ours, published to the kernel on submission.
+    unsigned _sqMask;
+    unsigned* _sqKernelHead;
+    unsigned* _sqKernelTail;
+    unsigned* _sqArray;
+    unsigned _cqMask;
+    unsigned* _cqHead;
+    unsigned* _cqTail;
+    io_uring_cqe* _cqes;
+
+    void* _sqRing;
+    std::size_t _sqRingSize;
+    void* _cqRing;
+    std::size_t _cqRingSize;
+    io_uring_sqe* _sqes;
+    std::size_t _sqesSize;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
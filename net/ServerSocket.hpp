@@ -32,12 +32,21 @@ public:
         Socket(type),
 #if !MOBILEAPP
         _type(type),
+        _asyncAccepted(-1),
 #endif
         _clientPoller(clientPoller),
         _sockFactory(std::move(sockFactory))
     {
     }
 
+#if !MOBILEAPP
+    ~ServerSocket() override
+    {
+        if (_asyncAccepted >= 0)
+            ::close(_asyncAccepted);
+    }
+#endif
+
     /// Control access to a bound TCP socket
     enum Type { Local, Public };
 
@@ -89,6 +98,17 @@ public:
         return POLLIN;
     }
 
+#if !MOBILEAPP
+    AsyncInput getAsyncInput() const override { return AsyncInput::Accept; }
+
+    /// Only successes come here, failures are left to accept().
+    void setAsyncInput(const char* /*data*/, int result) override
+    {
+        assert(result >= 0 && _asyncAccepted < 0 && "Unexpected asynchronous accept");
+        _asyncAccepted = result;
+    }
+#endif
+
     void dumpState(std::ostream& os) override;
 
     void handlePoll(SocketDisposition &,
@@ -97,7 +117,19 @@ public:
     {
         if (events & POLLIN)
         {
+#if !MOBILEAPP
+            // Accepted by io_uring already, when it polls us; then only the peer can fail.
+            const bool asyncAccepted = _asyncAccepted >= 0;
+#else
+            constexpr bool asyncAccepted = false;
+#endif
             std::shared_ptr<Socket> clientSocket = accept();
+            if (!clientSocket && asyncAccepted)
+            {
+                LOG_DBG("Dropped the connection accepted asynchronously");
+                return;
+            }
+
             if (!clientSocket)
             {
                 const std::string msg = "Failed to accept. (errno: ";
@@ -116,9 +148,16 @@ protected:
         return _sockFactory->create(fd, type);
     }
 
+#if !MOBILEAPP
+    /// Accepts a connection with accept4(2), or takes the one io_uring accepted
+    /// for us, with the peer address when asked. Returns -1 on failure.
+    int acceptFD(struct sockaddr* addr, socklen_t* addrLen);
+#endif
+
 private:
 #if !MOBILEAPP
     Socket::Type _type;
+    int _asyncAccepted; //< By io_uring, or -1.
 #endif
     SocketPoll& _clientPoller;
     std::shared_ptr<SocketFactory> _sockFactory;
@@ -15,6 +15,7 @@
 #include "TraceEvent.hpp"
 #include "Util.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <cstring>
 #include <cctype>
@@ -28,6 +29,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #ifdef __FreeBSD__
 #include <sys/ucred.h>
 #endif
@@ -48,6 +52,9 @@
 #include <net/SslSocket.hpp>
 #include <openssl/x509v3.h>
 #endif
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+#include <net/IoUring.hpp>
+#endif
 #include "WebSocketHandler.hpp"
 #include <net/HttpRequest.hpp>
 #include <NetUtil.hpp>
@@ -65,6 +72,8 @@ std::atomic<bool> Socket::InhibitThreadChecks(false);
 
 std::unique_ptr<Watchdog> SocketPoll::PollWatchdog;
 
+static std::atomic<uint64_t> NextSocketPollId(1);
+
 #define SOCKET_ABSTRACT_UNIX_NAME "0coolwsd-"
 
 int Socket::createSocket([[maybe_unused]] Socket::Type type)
@@ -223,7 +232,10 @@ namespace {
 
 SocketPoll::SocketPoll(std::string threadName)
     : _name(std::move(threadName)),
+      _id(NextSocketPollId++),
       _pollStartIndex(0),
+      _epollFd(-1),
+      _ioUringTag(0),
       _stop(false),
       _threadStarted(0),
       _threadFinished(false),
@@ -258,6 +270,14 @@ SocketPoll::~SocketPoll()
 
     joinThread();
 
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+    if (_ioUring)
+        releaseLeftIoUringInput();
+#endif
+
+    if (_epollFd >= 0)
+        ::close(_epollFd);
+
     removeFromWakeupArray();
 }
 
@@ -392,6 +412,12 @@ void SocketPoll::pollingThreadEntry()
     // Release sockets.
     removeSockets();
 
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+    // Nobody reaps what io_uring receives for the sockets that left from now on.
+    if (_ioUring)
+        releaseLeftIoUringInput();
+#endif
+
     _threadFinished = true;
     LOG_INF("Finished polling thread [" << _name << "].");
 }
@@ -432,18 +458,30 @@ int SocketPoll::poll(int64_t timeoutMaxMicroS)
     do
     {
 #if !MOBILEAPP
+#  if HAVE_EPOLL_CREATE1
+        if (_epollFd >= 0)
+            rc = epollWait(timeoutMaxMicroS, size);
+        else
+#  endif
+#  if HAVE_LINUX_IO_URING_H
+        if (_ioUring)
+            rc = ioUringWait(timeoutMaxMicroS, size);
+        else
+#  endif
+        {
 #  if HAVE_PPOLL
-        LOGA_TRC(Socket, "ppoll start, timeoutMicroS: " << timeoutMaxMicroS << " size " << size);
-        timeoutMaxMicroS = std::max(timeoutMaxMicroS, (int64_t)0);
-        struct timespec timeout;
-        timeout.tv_sec = timeoutMaxMicroS / (1000 * 1000);
-        timeout.tv_nsec = (timeoutMaxMicroS % (1000 * 1000)) * 1000;
-        rc = ::ppoll(&_pollFds[0], size + 1, &timeout, nullptr);
+            LOGA_TRC(Socket, "ppoll start, timeoutMicroS: " << timeoutMaxMicroS << " size " << size);
+            timeoutMaxMicroS = std::max(timeoutMaxMicroS, (int64_t)0);
+            struct timespec timeout;
+            timeout.tv_sec = timeoutMaxMicroS / (1000 * 1000);
+            timeout.tv_nsec = (timeoutMaxMicroS % (1000 * 1000)) * 1000;
+            rc = ::ppoll(&_pollFds[0], size + 1, &timeout, nullptr);
 #  else
-        int timeoutMaxMs = (timeoutMaxMicroS + 999) / 1000;
-        LOG_TRC("Legacy Poll start, timeoutMs: " << timeoutMaxMs);
-        rc = ::poll(&_pollFds[0], size + 1, std::max(timeoutMaxMs,0));
+            int timeoutMaxMs = (timeoutMaxMicroS + 999) / 1000;
+            LOG_TRC("Legacy Poll start, timeoutMs: " << timeoutMaxMs);
+            rc = ::poll(&_pollFds[0], size + 1, std::max(timeoutMaxMs,0));
 #  endif
+        }
 #else
         LOG_TRC("SocketPoll Poll");
         int timeoutMaxMs = (timeoutMaxMicroS + 999) / 1000;
@@ -566,6 +604,8 @@ int SocketPoll::poll(int64_t timeoutMaxMicroS)
                              << _pollFds[i].revents << std::dec);
 
                     _pollSockets[i]->handlePoll(disposition, newNow, _pollFds[i].revents);
+                    if (_pollFds[i].revents)
+                        _pollSockets[i]->markPollDirty(); // Handling them may change its interests.
                 }
                 catch (const std::exception& exc)
                 {
@@ -577,6 +617,7 @@ int SocketPoll::poll(int64_t timeoutMaxMicroS)
 
                 if (!disposition.isContinue())
                 {
+                    unregisterSocket(_pollSockets[i]);
                     ++itemsErased;
                     LOGA_TRC(Socket, '#' << _pollFds[i].fd << ": Removing socket (at " << i
                              << " of " << _pollSockets.size() << ") from " << _name);
@@ -616,6 +657,518 @@ int SocketPoll::poll(int64_t timeoutMaxMicroS)
     return rc;
 }
 
+#if !MOBILEAPP && HAVE_EPOLL_CREATE1
+static_assert(POLLIN == EPOLLIN && POLLPRI == EPOLLPRI && POLLOUT == EPOLLOUT &&
+                  POLLERR == EPOLLERR && POLLHUP == EPOLLHUP && POLLRDHUP == EPOLLRDHUP,
+              "poll and epoll events are used interchangeably");
+#endif
+
+bool SocketPoll::enableEpoll()
+{
+    assert(!_threadStarted && "Enable epoll before polling");
+#if !MOBILEAPP && HAVE_EPOLL_CREATE1
+    if (_epollFd >= 0)
+        return true;
+
+    _epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0)
+    {
+        LOG_SYS("Failed to create epoll for SocketPoll [" << _name << ']');
+        return false;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = _wakeup[0];
+    if (::epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeup[0], &event) < 0)
+    {
+        LOG_SYS("Failed to add the wakeup pipe to epoll for SocketPoll [" << _name << ']');
+        ::close(_epollFd);
+        _epollFd = -1;
+        return false;
+    }
+
+    LOG_DBG("SocketPoll [" << _name << "] uses epoll #" << _epollFd);
+    return true;
+#else
+    LOG_WRN("SocketPoll [" << _name << "] can't use epoll, it is not available");
+    return false;
+#endif
+}
+
+void SocketPoll::updateEpoll([[maybe_unused]] std::chrono::steady_clock::time_point now,
+                             [[maybe_unused]] int64_t& timeoutMaxMicroS,
+                             [[maybe_unused]] size_t size)
+{
+#if !MOBILEAPP && HAVE_EPOLL_CREATE1
+    // Only ask the sockets that are new, were marked dirty, had events or whose timeout
+    // is due, and only tell the kernel about what has changed since the last time.
+    for (size_t i = 0; i < size; ++i)
+    {
+        Socket* socket = _pollSockets[i].get();
+        const int fd = socket->getFD();
+
+        const auto [it, inserted] = _registered.try_emplace(fd);
+        Registration& entry = it->second;
+        entry._index = i;
+        const bool added = inserted || entry._socket != socket;
+        if (socket->takePollDirty() || added || entry._deadline <= now)
+        {
+            int64_t timeoutMicroS = DefaultPollTimeoutMicroS.count();
+            int events = socket->getPollEvents(now, timeoutMicroS);
+            assert(events >= 0 && "The events bitmask must be non-negative, where 0 means skip all events.");
+
+            if (socket->ignoringInput())
+                events &= ~POLLIN; // mask out input.
+
+            LOGA_TRC(Socket, '#' << fd << ": updateEpoll getPollEvents: 0x" << std::hex << events
+                                 << std::dec);
+
+            entry._deadline = now + std::chrono::microseconds(timeoutMicroS);
+            if (added || entry._events != static_cast<uint32_t>(events))
+            {
+                epoll_event event{};
+                event.events = events;
+                event.data.fd = fd;
+                int rc = ::epoll_ctl(_epollFd, added ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event);
+                if (rc < 0 && errno == (added ? EEXIST : ENOENT))
+                    rc = ::epoll_ctl(_epollFd, added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+                if (rc < 0)
+                    LOG_SYS('#' << fd << ": Failed to update epoll of " << _name
+                                << " with events 0x" << std::hex << events << std::dec);
+
+                entry._socket = socket;
+                entry._events = events;
+            }
+        }
+
+        timeoutMaxMicroS = std::min<int64_t>(
+            timeoutMaxMicroS,
+            std::chrono::duration_cast<std::chrono::microseconds>(entry._deadline - now).count());
+
+        _pollFds[i].fd = fd;
+        _pollFds[i].events = entry._events;
+        _pollFds[i].revents = 0;
+    }
+
+    // Forget those that left without unregisterSocket, if any.
+    if (_registered.size() > size)
+    {
+        for (auto it = _registered.begin(); it != _registered.end();)
+        {
+            const size_t index = it->second._index;
+            if (index < size && _pollFds[index].fd == it->first)
+            {
+                ++it;
+                continue;
+            }
+
+            ::epoll_ctl(_epollFd, EPOLL_CTL_DEL, it->first, nullptr);
+            it = _registered.erase(it);
+        }
+    }
+#endif
+}
+
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+/// The user data of an io_uring request, never IoUring::NoUserData.
+static inline uint64_t ioUringUserData(int fd, uint32_t tag)
+{
+    return (static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>(fd);
+}
+
+/// The buffers that io_uring receives into, shared by the sockets of a poll.
+/// As readIncomingData reads in blocks of 16KB, we use the same.
+static constexpr unsigned IoUringBufferSize = 16 * 1024;
+static constexpr unsigned IoUringBufferCount = 64;
+static constexpr uint16_t IoUringBufferGroup = 0;
+
+/// The buffer that an io_uring completion with these flags filled, if any.
+static inline char* ioUringBuffer(std::vector<char>& buffers, uint32_t flags)
+{
+    const int bufferId = IoUring::getBufferId(flags);
+    return bufferId >= 0 ? &buffers[static_cast<size_t>(bufferId) * IoUringBufferSize] : nullptr;
+}
+#endif
+
+void SocketPoll::unregisterSocket([[maybe_unused]] const std::shared_ptr<Socket>& socket)
+{
+    [[maybe_unused]] const int fd = socket->getFD();
+#if !MOBILEAPP && HAVE_EPOLL_CREATE1
+    // Still open when moved to another poll, so won't be removed on close.
+    if (_epollFd >= 0 && _registered.erase(fd))
+        ::epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+    // The pending poll holds a reference to the socket until cancelled.
+    const auto it = _registered.find(fd);
+    if (_ioUring && it != _registered.end())
+    {
+        Registration& entry = it->second;
+        if (entry._armed)
+            _ioUring->pollRemove(ioUringUserData(fd, entry._tag));
+        if (entry._inputArmed)
+        {
+            // Unless cancelled in time, it takes input that is the socket's: hand
+            // that over when it completes, with the others, rather than wait here.
+            const uint64_t userData = ioUringUserData(fd, entry._inputTag);
+            if (!entry._inputCancelled)
+                _ioUring->cancel(userData);
+
+            LeftInput& left = _ioUringLeft[userData];
+            left._socket = socket;
+            left._input = socket->getAsyncInput();
+            left._expected = socket->expectAsyncInput();
+        }
+
+        _registered.erase(it);
+    }
+#endif
+}
+
+#if !MOBILEAPP && HAVE_EPOLL_CREATE1
+int SocketPoll::epollWait(int64_t timeoutMaxMicroS, size_t size)
+{
+    const int timeoutMaxMs = std::max<int64_t>((timeoutMaxMicroS + 999) / 1000, 0);
+    LOGA_TRC(Socket, "epoll_wait start, timeoutMs: " << timeoutMaxMs << " size " << size);
+
+    _epollEvents.resize(size + 1);
+    const int rc = ::epoll_wait(_epollFd, _epollEvents.data(), _epollEvents.size(), timeoutMaxMs);
+    for (int i = 0; i < rc; ++i)
+    {
+        const int fd = _epollEvents[i].data.fd;
+        size_t index = size;
+        if (fd != _wakeup[0])
+        {
+            const auto it = _registered.find(fd);
+            if (it == _registered.end())
+                continue;
+            index = it->second._index;
+        }
+
+        if (index <= size && _pollFds[index].fd == fd)
+            _pollFds[index].revents = _epollEvents[i].events;
+    }
+
+    return rc;
+}
+#endif
+
+bool SocketPoll::enableIoUring()
+{
+    assert(!_threadStarted && "Enable io_uring before polling");
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+    if (_ioUring)
+        return true;
+
+    // Room for the interest changes of a busy spin; more get submitted early.
+    auto ring = std::make_unique<IoUring>();
+    if (!ring->init(4096))
+    {
+        LOG_SYS("Failed to create io_uring for SocketPoll [" << _name << ']');
+        return false;
+    }
+
+    // Submitted with the first wait. Without them, receives fall back to polls.
+    _ioUringBuffers.resize(IoUringBufferSize * IoUringBufferCount);
+    ring->provideBuffers(_ioUringBuffers.data(), IoUringBufferSize, IoUringBufferCount,
+                         IoUringBufferGroup, 0);
+
+    _ioUring = std::move(ring);
+    LOG_DBG("SocketPoll [" << _name << "] uses io_uring #" << _ioUring->getFD());
+    return true;
+#else
+    LOG_WRN("SocketPoll [" << _name << "] can't use io_uring, it is not available");
+    return false;
+#endif
+}
+
+void SocketPoll::updateIoUring([[maybe_unused]] size_t size)
+{
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+    const auto nextTag = [this]()
+    {
+        if (++_ioUringTag == 0)
+            ++_ioUringTag;
+        return _ioUringTag;
+    };
+
+    // The requests are one-shot, so only those that completed, or whose
+    // interest changed, are queued again. With the wakeup pipe.
+    for (size_t i = 0; i <= size; ++i)
+    {
+        Socket* socket = i < size ? _pollSockets[i].get() : nullptr;
+        const int fd = _pollFds[i].fd;
+        uint32_t events = _pollFds[i].events;
+
+        const auto [it, inserted] = _registered.try_emplace(fd);
+        Registration& entry = it->second;
+        if (!inserted && entry._socket != socket)
+        {
+            // The fd of one that left without unregisterSocket, now closed.
+            if (entry._armed)
+                _ioUring->pollRemove(ioUringUserData(fd, entry._tag));
+            if (entry._inputArmed && !entry._inputCancelled)
+                _ioUring->cancel(ioUringUserData(fd, entry._inputTag));
+            entry = Registration();
+        }
+
+        entry._socket = socket;
+        entry._index = i;
+
+        // Receive or accept for plain sockets, instead of polling for their input.
+        const Socket::AsyncInput input = socket && (events & POLLIN) && !entry._pollInput
+                                             ? socket->getAsyncInput()
+                                             : Socket::AsyncInput::None;
+        if (input != Socket::AsyncInput::None)
+        {
+            events &= ~POLLIN;
+            if (!entry._inputArmed)
+            {
+                entry._inputTag = nextTag();
+                const uint64_t userData = ioUringUserData(fd, entry._inputTag);
+                entry._inputArmed =
+                    input == Socket::AsyncInput::Receive
+                        ? _ioUring->recv(fd, IoUringBufferSize, IoUringBufferGroup, userData)
+                        : _ioUring->accept(fd, userData);
+                entry._inputCancelled = false;
+                if (!entry._inputArmed)
+                {
+                    LOG_ERR('#' << fd << ": Failed to queue io_uring " << Socket::nameShort(input)
+                                << " of " << _name);
+                    entry._pollInput = true;
+                    events |= POLLIN;
+                }
+            }
+        }
+        else if (entry._inputArmed && !entry._inputCancelled)
+        {
+            // Input is still taken if it came meanwhile, see completeIoUringInput.
+            entry._inputCancelled = _ioUring->cancel(ioUringUserData(fd, entry._inputTag));
+        }
+
+        // Poll for the rest, unless the receive or accept is all we wait for.
+        const bool poll = input == Socket::AsyncInput::None || events != 0;
+        if (entry._armed && (!poll || entry._events != events))
+        {
+            _ioUring->pollRemove(ioUringUserData(fd, entry._tag));
+            entry._armed = false;
+        }
+
+        if (poll && !entry._armed)
+        {
+            entry._events = events;
+            entry._tag = nextTag();
+            entry._armed = _ioUring->pollAdd(fd, events, ioUringUserData(fd, entry._tag));
+            if (!entry._armed)
+                LOG_ERR('#' << fd << ": Failed to queue io_uring poll of " << _name);
+        }
+    }
+
+    // Forget those that left without unregisterSocket, if any.
+    if (_registered.size() > size + 1)
+    {
+        for (auto it = _registered.begin(); it != _registered.end();)
+        {
+            const size_t index = it->second._index;
+            if (index <= size && _pollFds[index].fd == it->first)
+            {
+                ++it;
+                continue;
+            }
+
+            if (it->second._armed)
+                _ioUring->pollRemove(ioUringUserData(it->first, it->second._tag));
+            if (it->second._inputArmed && !it->second._inputCancelled)
+                _ioUring->cancel(ioUringUserData(it->first, it->second._inputTag));
+            it = _registered.erase(it);
+        }
+    }
+#endif
+}
+
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+int SocketPoll::ioUringWait(int64_t timeoutMaxMicroS, size_t size)
+{
+    LOGA_TRC(Socket, "io_uring wait start, timeoutMicroS: " << timeoutMaxMicroS << " size "
+                                                             << size);
+
+    const int rc = _ioUring->submitAndWait(timeoutMaxMicroS);
+    if (rc < 0)
+        return rc;
+
+    reapIoUring();
+
+    int count = 0;
+    for (const IoUringCompletion& completion : _ioUringCompletions)
+    {
+        if (handleIoUringCompletion(completion._userData, completion._result, completion._flags,
+                                    size))
+            ++count;
+    }
+
+    _ioUringCompletions.clear();
+    return count;
+}
+
+void SocketPoll::reapIoUring()
+{
+    _ioUring->reap([this](uint64_t userData, int result, uint32_t flags)
+                   { _ioUringCompletions.push_back({ userData, result, flags }); });
+}
+
+bool SocketPoll::handleIoUringCompletion(uint64_t userData, int result, uint32_t flags,
+                                         size_t size)
+{
+    // A buffer goes back to the kernel, once its data is taken, whatever became of its socket.
+    char* const data = ioUringBuffer(_ioUringBuffers, flags);
+
+    bool handled = false;
+    const int fd = static_cast<int>(userData & 0xffffffff);
+    const auto it = _registered.find(fd);
+    if (!_ioUringLeft.empty() && _ioUringLeft.count(userData))
+    {
+        completeLeftIoUringInput(userData, result, data);
+    }
+    else if (userData != IoUring::NoUserData && it != _registered.end())
+    {
+        Registration& entry = it->second;
+        const uint32_t tag = userData >> 32;
+        const size_t index = entry._index;
+        const bool indexed = index <= size && _pollFds[index].fd == fd;
+        if (entry._armed && tag == entry._tag)
+        {
+            entry._armed = false; // Queued again on the next spin.
+            if (result < 0)
+            {
+                LOG_DBG('#' << fd << ": io_uring poll of " << _name
+                            << " failed: " << Util::symbolicErrno(-result));
+                result = POLLERR;
+            }
+
+            // Then back to receiving or accepting.
+            if (result & POLLIN)
+                entry._pollInput = false;
+
+            if (indexed)
+            {
+                _pollFds[index].revents |= result;
+                handled = true;
+            }
+        }
+        else if (entry._inputArmed && tag == entry._inputTag)
+        {
+            if (completeIoUringInput(entry, result, data) && indexed)
+            {
+                _pollFds[index].revents |= POLLIN;
+                handled = true;
+            }
+        }
+    }
+
+    if (data)
+        _ioUring->provideBuffers(data, IoUringBufferSize, 1, IoUringBufferGroup,
+                                 IoUring::getBufferId(flags));
+
+    return handled;
+}
+
+bool SocketPoll::completeIoUringInput(Registration& entry, int result, const char* data)
+{
+    entry._inputArmed = false; // Queued again on the next spin.
+    if (result == -ECANCELED)
+        return false;
+
+    // Out of buffers, failed to accept, or the like: poll, and read or accept as usual.
+    const Socket::AsyncInput input = entry._socket->getAsyncInput();
+    if (result == -ENOBUFS || result == -EAGAIN ||
+        (result < 0 && input == Socket::AsyncInput::Accept))
+    {
+        LOG_TRC('#' << entry._socket->getFD() << ": io_uring " << Socket::nameShort(input) << " of "
+                    << _name << " failed: " << Util::symbolicErrno(-result) << ", will poll");
+        entry._pollInput = true;
+        return false;
+    }
+
+    if (entry._socket->ignoringInput())
+    {
+        LOG_DBG('#' << entry._socket->getFD() << ": Dropping " << result
+                    << " bytes received while ignoring input");
+        if (input == Socket::AsyncInput::Accept && result >= 0)
+            ::close(result);
+        return false;
+    }
+
+    entry._socket->setAsyncInput(data, result);
+    return true;
+}
+
+void SocketPoll::completeLeftIoUringInput(uint64_t userData, int result, const char* data)
+{
+    const auto it = _ioUringLeft.find(userData);
+    const LeftInput left = it->second;
+    _ioUringLeft.erase(it);
+
+    const int fd = static_cast<int>(userData & 0xffffffff);
+    const std::shared_ptr<Socket> socket = left._socket.lock();
+    if (left._input == Socket::AsyncInput::Accept)
+    {
+        // Only listening sockets accept, and they leave for good: refuse the connection.
+        if (result >= 0)
+        {
+            LOG_DBG('#' << fd << ": Closing #" << result << ", accepted by io_uring of " << _name
+                        << " after it left");
+            ::close(result);
+        }
+
+        return;
+    }
+
+    const bool received = result != -ECANCELED && result != -ENOBUFS && result != -EAGAIN;
+    if (socket && left._expected)
+    {
+        LOG_TRC('#' << fd << ": Handing over the io_uring receive of " << _name
+                    << " after it left: " << (received ? result : 0));
+        socket->handOverAsyncInput(data, received ? result : -EAGAIN);
+    }
+    else if (received)
+    {
+        LOG_DBG('#' << fd << ": Dropping the io_uring receive of " << _name << " after it "
+                    << (socket ? "left: " : "closed: ") << result);
+    }
+}
+
+void SocketPoll::releaseLeftIoUringInput()
+{
+    if (_ioUringLeft.empty())
+        return;
+
+    // Those that completed go to their sockets as usual.
+    if (_ioUring->submitAndWait(0) >= 0)
+    {
+        reapIoUring();
+        for (const IoUringCompletion& completion : _ioUringCompletions)
+        {
+            if (_ioUringLeft.count(completion._userData))
+                completeLeftIoUringInput(completion._userData, completion._result,
+                                         ioUringBuffer(_ioUringBuffers, completion._flags));
+        }
+
+        _ioUringCompletions.clear();
+    }
+
+    // The rest are cancelled with the io_uring.
+    for (const auto& pair : _ioUringLeft)
+    {
+        const std::shared_ptr<Socket> socket = pair.second._socket.lock();
+        if (socket && pair.second._expected)
+            socket->handOverAsyncInput(nullptr, -EAGAIN);
+    }
+
+    _ioUringLeft.clear();
+}
+#endif
+
 void SocketPoll::wakeupWorld()
 {
     for (const auto& fd : getWakeupsArray())
@@ -630,6 +1183,21 @@ void SocketPoll::closeAllSockets()
     // We just forked so we need to shift thread ids to this thread.
     checkAndReThread();
 
+    // Shared with the parent, so leave its interests alone.
+    if (_epollFd >= 0)
+    {
+        ::close(_epollFd);
+        _epollFd = -1;
+        _registered.clear();
+    }
+
+    if (_ioUring)
+    {
+        _ioUring.reset();
+        _registered.clear();
+        _ioUringLeft.clear();
+    }
+
     removeFromWakeupArray();
     for (std::shared_ptr<Socket> &it : _pollSockets)
     {
@@ -668,6 +1236,7 @@ void SocketPoll::takeSocket(const std::shared_ptr<SocketPoll> &fromPoll,
             // Erasing messes up the tracking of poll results in 'poll'
             // leave to be added to toErase and cleaned later.
             *it = nullptr;
+            fromPoll->unregisterSocket(socket);
         }
         else
             LOG_WRN("Trying to move socket out of the wrong poll");
@@ -729,6 +1298,7 @@ void SocketPoll::removeSockets()
         LOG_DBG("Removing socket #" << socket->getFD() << " from " << _name);
         ASSERT_CORRECT_SOCKET_THREAD(socket);
         socket->resetThreadOwner();
+        unregisterSocket(socket);
 
         _pollSockets.pop_back();
     }
@@ -744,6 +1314,30 @@ void SocketPoll::removeSockets()
     }
 }
 
+void SocketPoll::removeSocket(const std::shared_ptr<Socket>& socket)
+{
+    ASSERT_CORRECT_SOCKET_THREAD(this);
+
+    const auto it = std::find(_pollSockets.begin(), _pollSockets.end(), socket);
+    if (it != _pollSockets.end())
+    {
+        LOG_DBG("Removing socket #" << socket->getFD() << " from " << _name);
+        ASSERT_CORRECT_SOCKET_THREAD(socket);
+        socket->resetThreadOwner();
+        unregisterSocket(socket);
+        _pollSockets.erase(it);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto newIt = std::find(_newSockets.begin(), _newSockets.end(), socket);
+    if (newIt != _newSockets.end())
+    {
+        LOG_DBG("Removing socket #" << socket->getFD() << " from newSockets of " << _name);
+        _newSockets.erase(newIt);
+    }
+}
+
 #if !MOBILEAPP
 
 void SocketPoll::insertNewWebSocketSync(const Poco::URI& uri,
@@ -926,6 +1520,8 @@ void WebSocketHandler::dumpState(std::ostream& os, const std::string& /*indent*/
     os << (_shuttingDown ? "shutd " : "alive ");
 #if !MOBILEAPP
     os << std::setw(5) << _pingTimeUs/1000. << "ms ";
+    if (_deflate)
+        os << "deflate ";
 #endif
     if (_wsPayload.size() > 0)
         Util::dumpHex(os, _wsPayload, "\t\tws queued payload:\n", "\t\t");
@@ -949,6 +1545,118 @@ void StreamSocket::dumpState(std::ostream& os)
     if (_inBuffer.size() > 0)
         Util::dumpHex(os, _inBuffer, "\t\tinBuffer:\n", "\t\t");
     _outBuffer.dumpHex(os, "\t\toutBuffer:\n", "\t\t");
+    if (_outFileFD >= 0)
+        os << "\t\toutFile: #" << _outFileFD << " at " << _outFileOffset << " with "
+           << _outFileRemaining << " bytes left\n";
+}
+
+void StreamSocket::sendFile(int fd, off_t offset, std::size_t size)
+{
+    ASSERT_CORRECT_SOCKET_THREAD(this);
+    assert(_outFileFD < 0 && "Already sending a file");
+
+    if (size == 0)
+    {
+        ::close(fd);
+        return;
+    }
+
+    _outFileFD = fd;
+    _outFileOffset = offset;
+    _outFileRemaining = size;
+    _outFileUseSendFile = true;
+    markPollDirty();
+    LOGA_TRC(Socket, "Sending " << size << " bytes of file #" << fd << " from " << offset);
+
+    writeOutgoingData();
+}
+
+ssize_t StreamSocket::writeOutgoingFile()
+{
+    assert(_outFileFD >= 0 && _outBuffer.empty());
+
+    ssize_t len = -1;
+#ifdef __linux__
+    if (_outFileUseSendFile && canSendFile())
+    {
+        // Writing much more than we can absorb in the kernel causes wastage.
+        const std::size_t size =
+            std::min<std::size_t>(_outFileRemaining, std::max(getSendBufferSize(), 1));
+        do
+        {
+            len = ::sendfile(getFD(), _outFileFD, &_outFileOffset, size);
+        } while (len < 0 && errno == EINTR);
+
+        if (len >= 0 || (errno != EINVAL && errno != ENOSYS))
+        {
+            if (len > 0)
+            {
+                _bytesSent += len;
+                _outFileRemaining -= std::min<std::size_t>(len, _outFileRemaining);
+                if (_outFileRemaining == 0)
+                    closeOutFile();
+            }
+            else if (len == 0)
+            {
+                LOG_ERR("File #" << _outFileFD << " ended " << _outFileRemaining
+                                 << " bytes short, closing");
+                closeOutFile();
+                shutdown();
+                errno = EIO;
+                return -1;
+            }
+
+            return len;
+        }
+
+        LOG_DBG("Cannot sendfile from #" << _outFileFD << " (" << Util::symbolicErrno(errno)
+                                         << "), will read it instead");
+        _outFileUseSendFile = false;
+    }
+#endif
+
+    // Read only as much as a write can take, so memory stays bounded by the chunk size.
+    static constexpr std::size_t ChunkSize = 64 * 1024;
+    const std::size_t size = std::min(_outFileRemaining, ChunkSize);
+    std::shared_ptr<char> chunk(new char[size], std::default_delete<char[]>());
+    do
+    {
+        len = ::pread(_outFileFD, chunk.get(), size, _outFileOffset);
+    } while (len < 0 && errno == EINTR);
+
+    if (len <= 0)
+    {
+        if (len < 0)
+            LOG_SYS("Failed to read file #" << _outFileFD << ", closing");
+        else
+            LOG_ERR("File #" << _outFileFD << " ended " << _outFileRemaining
+                             << " bytes short, closing");
+
+        // The peer expects more data than we can send.
+        closeOutFile();
+        shutdown();
+        errno = EIO;
+        return -1;
+    }
+
+    const char* data = chunk.get();
+    _outBuffer.append(std::move(chunk), data, len);
+    _outFileOffset += len;
+    _outFileRemaining -= std::min<std::size_t>(len, _outFileRemaining);
+    if (_outFileRemaining == 0)
+        closeOutFile();
+
+    return len;
+}
+
+void StreamSocket::closeOutFile()
+{
+    if (_outFileFD >= 0)
+    {
+        ::close(_outFileFD);
+        _outFileFD = -1;
+        _outFileRemaining = 0;
+    }
 }
 
 bool StreamSocket::send(const http::Response& response)
@@ -998,7 +1706,14 @@ void SocketPoll::dumpState(std::ostream& os) const
 
     os << "\n  SocketPoll [" << name() << "] with " << pollSockets.size() << " socket"
        << (pollSockets.size() == 1 ? "" : "s") << " - wakeup rfd: " << _wakeup[0]
-       << " wfd: " << _wakeup[1] << '\n';
+       << " wfd: " << _wakeup[1];
+    if (_epollFd >= 0)
+        os << " epoll: " << _epollFd;
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+    if (_ioUring)
+        os << " io_uring: " << _ioUring->getFD();
+#endif
+    os << '\n';
     const auto callbacks = _newCallbacks.size();
     if (callbacks > 0)
         os << "\tcallbacks: " << callbacks << '\n';
@@ -1076,7 +1791,7 @@ std::shared_ptr<Socket> ServerSocket::accept()
 
     struct sockaddr_in6 clientInfo;
     socklen_t addrlen = sizeof(clientInfo);
-    const int rc = ::accept4(getFD(), (struct sockaddr *)&clientInfo, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    const int rc = acceptFD((struct sockaddr *)&clientInfo, &addrlen);
 #else
     const int rc = fakeSocketAccept4(getFD());
 #endif
@@ -1167,9 +1882,26 @@ bool Socket::isLocal() const
                 _clientAddress.rfind("127.0.0.", 0) != std::string::npos;
 }
 
+int ServerSocket::acceptFD(struct sockaddr* addr, socklen_t* addrLen)
+{
+    const int fd = _asyncAccepted;
+    if (fd < 0)
+        return ::accept4(getFD(), addr, addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    _asyncAccepted = -1;
+    if (addr && ::getpeername(fd, addr, addrLen) < 0)
+    {
+        LOG_SYS("Failed to get the peer address of accepted socket #" << fd);
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
 std::shared_ptr<Socket> LocalServerSocket::accept()
 {
-    const int rc = ::accept4(getFD(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    const int rc = acceptFD(nullptr, nullptr);
     try
     {
         LOG_DBG("Accepted prisoner socket #" << rc << ", creating socket object.");
@@ -1321,23 +2053,37 @@ bool StreamSocket::parseHeader(const char *clientName,
     std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
     std::chrono::duration<float, std::milli> delayMs = now - _lastSeenHTTPHeader;
 
-    // Find the end of the header, if any.
-    static const std::string marker("\r\n\r\n");
-    auto itBody = std::search(_inBuffer.begin(), _inBuffer.end(), marker.begin(), marker.end());
-    if (itBody == _inBuffer.end())
+    // Parse the request line and the header in a single pass over the buffer.
+    // Only this request is consumed, any pipelined ones are left for later.
+    http::Request parsed;
+    const int64_t headerSize = parsed.readHeader(_inBuffer.data(), _inBuffer.size());
+    if (headerSize == 0)
     {
         LOG_TRC("parseHeader: " << clientName << " doesn't have enough data for the header yet. delay " << delayMs.count() << "ms");
         return false;
     }
 
-    // Skip the marker.
-    itBody += marker.size();
-    map._headerSize = static_cast<size_t>(itBody - _inBuffer.begin());
+    if (headerSize < 0)
+    {
+        LOG_DBG("parseHeader: " << clientName << " sent an invalid header with "
+                                << _inBuffer.size() << " bytes, shutdown");
+        shutdown();
+        return false;
+    }
+
+    auto itBody = _inBuffer.begin() + headerSize;
+    map._headerSize = headerSize;
     map._messageSize = map._headerSize;
 
     try
     {
-        request.read(message);
+        request.setMethod(parsed.getVerb());
+        request.setURI(parsed.getUrl());
+        request.setVersion(parsed.getVersion());
+        for (const auto& pair : parsed.header())
+            request.add(pair.first, pair.second);
+
+        message.seekg(headerSize, std::ios::beg);
 
         const std::streamsize contentLength = request.getContentLength();
         const auto offset = itBody - _inBuffer.begin();
@@ -1414,10 +2160,11 @@ bool StreamSocket::parseHeader(const char *clientName,
                 {
                     map._messageSize = chunkOffset;
                     _lastSeenHTTPHeader = now;
+                    _sentHTTPContinue = false; // For the next pipelined request.
                     return true;
                 }
 
-                if (chunkLen > chunkAvailable + 2)
+                if (chunkLen + 2 > chunkAvailable)
                 {
                     LOG_DBG("parseHeader: Not enough content yet in chunk " << chunk <<
                             " starting at offset " << (chunkStart - _inBuffer.begin()) <<
@@ -1507,6 +2254,7 @@ bool StreamSocket::parseHeader(const char *clientName,
     }
 
     _lastSeenHTTPHeader = now;
+    _sentHTTPContinue = false; // For the next pipelined request.
     return true;
 }
 
@@ -1578,6 +2326,8 @@ namespace {
     };
 }
 
+WebSocketDeflate::Settings WebSocketDeflate::ServerSettings;
+
 std::string WebSocketHandler::computeAccept(const std::string &key)
 {
     return PublicComputeAccept::doComputeAccept(key);
@@ -29,8 +29,11 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <common/StateEnum.hpp>
+#include "Common.hpp"
 #include "Log.hpp"
 #include "Util.hpp"
 #include "Buffer.hpp"
@@ -38,6 +41,10 @@
 
 #include "FakeSocket.hpp"
 
+#if !MOBILEAPP && HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#endif
+
 #ifdef __linux__
 #define HAVE_ABSTRACT_UNIX_SOCKETS
 #endif
@@ -64,6 +71,7 @@ namespace Poco
     class URI;
 }
 
+class IoUring;
 class Socket;
 class Watchdog;
 class SocketPoll;
@@ -202,6 +210,26 @@ public:
     /// Do we have internally queued incoming / outgoing data ?
     virtual bool hasBuffered() const { return false; }
 
+    STATE_ENUM(AsyncInput, None, Receive, Accept);
+
+    /// What io_uring may do for us when we poll for input, instead of
+    /// waking us up to do it; see setAsyncInput().
+    virtual AsyncInput getAsyncInput() const { return AsyncInput::None; }
+
+    /// Takes the data and result of a recv(2), or the result of an accept(2),
+    /// that io_uring made for us, before handlePoll() with POLLIN.
+    virtual void setAsyncInput(const char* /*data*/, int /*result*/) {}
+
+    /// When leaving a poll while io_uring may still receive for us there:
+    /// returns true to take that input later, from handOverAsyncInput(),
+    /// and not to read meanwhile; otherwise the poll drops it.
+    virtual bool expectAsyncInput() { return false; }
+
+    /// Takes the result of the receive that expectAsyncInput() waits for,
+    /// as for setAsyncInput(), or -EAGAIN if nothing was received. Called
+    /// by the thread of the poll we left, whichever poll we are in by now.
+    virtual void handOverAsyncInput(const char* /*data*/, int /*result*/) {}
+
     /// manage latency issues around packet aggregation
     void setNoDelay()
     {
@@ -359,6 +387,20 @@ public:
     {
         LOG_TRC("Ignore further input on socket.");
         _ignoreInput = true;
+        markPollDirty();
+    }
+
+    /// Have the poll ask getPollEvents again, as what it returns may have changed
+    /// other than by handling the events of the socket, eg. by sending or closing.
+    /// The polls using epoll only ask the sockets so marked, and those with events.
+    void markPollDirty() { _pollDirty = true; }
+
+    /// Whether the socket was marked dirty, which it no longer is after this.
+    bool takePollDirty()
+    {
+        const bool dirty = _pollDirty;
+        _pollDirty = false;
+        return dirty;
     }
 protected:
     /// Construct based on an existing socket fd.
@@ -381,6 +423,7 @@ private:
             setNoDelay();
         _ignoreInput = false;
         _noShutdown = false;
+        _pollDirty = true;
         _sendBufferSize = DefaultSendBufferSize;
         _owner = std::this_thread::get_id();
         LOG_TRC("Created socket. Thread affinity set to " << Log::to_string(_owner));
@@ -404,6 +447,7 @@ private:
     // If _ignoreInput is true no more input from this socket will be processed.
     bool _ignoreInput;
     bool _noShutdown;
+    bool _pollDirty;
 
     int _sendBufferSize;
 
@@ -500,6 +544,22 @@ public:
     /// 0 for closed/invalid socket, and -1 for other errors.
     virtual int sendBinaryMessage(const char *data, const size_t len, bool flush = false) const = 0;
 
+    /// Sends a binary message of data followed by the blobs, which must not
+    /// change until sent. By default, they are copied together first.
+    /// When the same message goes to several recipients, frame holds the frame
+    /// header and data as encoded for the first, to be reused for the others.
+    virtual int sendBinaryMessageWithBlobs(const char* data, const size_t len,
+                                           const std::vector<Blob>& blobs,
+                                           [[maybe_unused]] Blob* frame = nullptr,
+                                           bool flush = false) const
+    {
+        std::vector<char> message(data, data + len);
+        for (const Blob& blob : blobs)
+            message.insert(message.end(), blob->begin(), blob->end());
+
+        return sendBinaryMessage(message.data(), message.size(), flush);
+    }
+
     /// Shutdown the socket and specify if the endpoint is going away or not (useful for WS).
     /// Optionally provide a message sent in the close frame (useful for WS).
     virtual void shutdown(bool goingAway = false,
@@ -507,6 +567,10 @@ public:
 
     virtual void getIOStats(uint64_t &sent, uint64_t &recv) = 0;
 
+    /// What getPollEvents returns changed other than by sending on the socket,
+    /// eg. messages were queued for writeQueuedMessages. See Socket::markPollDirty().
+    virtual void markPollDirty() {}
+
     void dumpState(std::ostream& os) const { dumpState(os, "\n"); }
 
     /// Append pretty printed internal state to a line
@@ -617,6 +681,9 @@ private:
 /// hundred users on same document to suffer poll(2)'s
 /// scalability limit. Meanwhile, epoll(2)'s high
 /// overhead to adding/removing sockets is not helpful.
+/// The few polls that do carry thousands of sockets, such
+/// as the web server's, can opt into epoll with enableEpoll(),
+/// or into io_uring with enableIoUring().
 class SocketPoll
 {
 public:
@@ -652,12 +719,23 @@ public:
     /// Remove all the sockets we own.
     void removeSockets();
 
+    /// Remove the given socket, if we own it, without closing it.
+    void removeSocket(const std::shared_ptr<Socket>& socket);
+
     /// After a fork - close all associated sockets without shutdown.
     void closeAllSockets();
 
     /// Setup pipes needed for cross-thread wakeups
     void createWakeups();
 
+    /// Use epoll(7) instead of poll(2), for many sockets. Must be
+    /// called before polling starts. Returns false if not available.
+    bool enableEpoll();
+
+    /// Use io_uring(7) instead of poll(2), for many sockets. Must be
+    /// called before polling starts. Returns false if not available.
+    bool enableIoUring();
+
     bool isAlive() const { return (_threadStarted && !_threadFinished) || _runOnClientThread; }
 
     /// Check if we should continue polling
@@ -797,6 +875,9 @@ public:
 
     const std::string& name() const { return _name; }
 
+    /// Unique among all the polls of the process, unlike their addresses, which get reused.
+    uint64_t getId() const { return _id; }
+
     /// Start the polling thread (if desired)
     /// Mutually exclusive with runOnClientThread().
     bool startThread();
@@ -867,6 +948,17 @@ private:
 
         _pollFds.resize(size + 1); // + wakeup pipe
 
+        // Add the read-end of the wake pipe.
+        _pollFds[size].fd = _wakeup[0];
+        _pollFds[size].events = POLLIN;
+        _pollFds[size].revents = 0;
+
+        if (_epollFd >= 0)
+        {
+            updateEpoll(now, timeoutMaxMicroS, size);
+            return;
+        }
+
         for (size_t i = 0; i < size; ++i)
         {
             int events = _pollSockets[i]->getPollEvents(now, timeoutMaxMicroS);
@@ -882,12 +974,50 @@ private:
                      << events << std::dec);
         }
 
-        // Add the read-end of the wake pipe.
-        _pollFds[size].fd = _wakeup[0];
-        _pollFds[size].events = POLLIN;
-        _pollFds[size].revents = 0;
+        if (_ioUring)
+            updateIoUring(size);
     }
 
+    /// Set up _pollFds like setupPollFds, asking getPollEvents only of the sockets
+    /// whose interests may have changed, and register those changes with epoll.
+    void updateEpoll(std::chrono::steady_clock::time_point now, int64_t& timeoutMaxMicroS,
+                     size_t size);
+
+    /// Queue polls for the sockets' changed interests, and those that fired, with io_uring.
+    void updateIoUring(size_t size);
+
+    /// Stop watching a socket leaving this poll with epoll or io_uring.
+    void unregisterSocket(const std::shared_ptr<Socket>& socket);
+
+#if !MOBILEAPP && HAVE_EPOLL_CREATE1
+    /// Wait for events with epoll, setting the revents of _pollFds.
+    int epollWait(int64_t timeoutMaxMicroS, size_t size);
+#endif
+
+#if !MOBILEAPP && HAVE_LINUX_IO_URING_H
+    struct Registration;
+
+    /// Wait for events with io_uring, setting the revents of _pollFds.
+    int ioUringWait(int64_t timeoutMaxMicroS, size_t size);
+
+    /// Consume the io_uring completions, to handle with handleIoUringCompletion.
+    void reapIoUring();
+
+    /// Handle an io_uring completion; returns true if it set revents.
+    bool handleIoUringCompletion(uint64_t userData, int result, uint32_t flags, size_t size);
+
+    /// Handle the completion of a receive or accept; returns true if it was input.
+    bool completeIoUringInput(Registration& entry, int result, const char* data);
+
+    /// Handle the completion of a receive or accept for a socket that left,
+    /// whose input it is: hand it over, or drop it.
+    void completeLeftIoUringInput(uint64_t userData, int result, const char* data);
+
+    /// Hand the completions for the sockets that left over, when nobody reaps
+    /// them anymore, and let those still pending read by themselves.
+    void releaseLeftIoUringInput();
+#endif
+
     /// The polling thread entry.
     /// Used to set the thread name and mark the thread as stopped when done.
     void pollingThreadEntry();
@@ -895,6 +1025,9 @@ private:
     /// Debug name used for logging.
     const std::string _name;
 
+    /// See getId().
+    const uint64_t _id;
+
     /// main-loop wakeup pipe
     int _wakeup[2];
     /// The sockets we're controlling
@@ -909,6 +1042,51 @@ private:
     /// The fds to poll.
     std::vector<pollfd> _pollFds;
 
+    /// The epoll instance, when used instead of poll(2), or -1.
+    int _epollFd;
+    /// The buffers that io_uring receives into, lent to the kernel.
+    /// Must outlive _ioUring.
+    std::vector<char> _ioUringBuffers;
+    /// The io_uring instance, when used instead of poll(2).
+    std::unique_ptr<IoUring> _ioUring;
+    /// Distinguishes the requests queued with io_uring, for stale completions.
+    uint32_t _ioUringTag;
+    struct IoUringCompletion
+    {
+        uint64_t _userData;
+        int _result;
+        uint32_t _flags;
+    };
+    /// The io_uring completions reaped, and not handled yet.
+    std::vector<IoUringCompletion> _ioUringCompletions;
+    struct Registration
+    {
+        Socket* _socket = nullptr;
+        uint32_t _events = 0; //< The interest registered.
+        std::chrono::steady_clock::time_point _deadline; //< Of the timeout getPollEvents set, with epoll.
+        size_t _index = 0; //< In _pollFds.
+        uint32_t _tag = 0; //< Of the io_uring poll.
+        bool _armed = false; //< Whether the io_uring poll is pending.
+        uint32_t _inputTag = 0; //< Of the io_uring receive or accept.
+        bool _inputArmed = false; //< Whether the receive or accept is pending.
+        bool _inputCancelled = false; //< Whether its cancellation is queued.
+        bool _pollInput = false; //< Poll for input instead, until it comes.
+    };
+    /// The sockets registered with epoll or io_uring, by fd.
+    std::unordered_map<int, Registration> _registered;
+    struct LeftInput
+    {
+        std::weak_ptr<Socket> _socket;
+        Socket::AsyncInput _input = Socket::AsyncInput::None;
+        bool _expected = false; //< Whether the socket takes it, see Socket::expectAsyncInput().
+    };
+    /// The sockets that left with their io_uring receive or accept pending,
+    /// by its user data, until it completes, as it may still take their input.
+    std::unordered_map<uint64_t, LeftInput> _ioUringLeft;
+#if !MOBILEAPP && HAVE_EPOLL_CREATE1
+    std::vector<epoll_event> _epollEvents;
+#endif
+
     /// Flag the thread to stop.
     std::atomic<bool> _stop;
     /// The polling thread.
@@ -951,6 +1129,9 @@ public:
         UseRecvmsgExpectFD
     };
 
+    /// The most blocks of buffered data we write in one go.
+    static constexpr int MaxIOVecCount = 64;
+
     /// Create a StreamSocket from native FD.
     StreamSocket(std::string host, const int fd, Type type, bool /* isClient */,
                  HostType hostType, ReadType readType = NormalRead) :
@@ -965,6 +1146,15 @@ public:
         _shutdownSignalled(false),
         _readType(readType),
         _inputProcessingEnabled(true),
+        _outFileFD(-1),
+        _outFileOffset(0),
+        _outFileRemaining(0),
+        _outFileUseSendFile(true),
+        _inputDeferred(false),
+        _asyncRead(false),
+        _asyncReadResult(0),
+        _handOver(HandOver::None),
+        _handedOverResult(0),
         _lastSeenHTTPHeader( std::chrono::steady_clock::now() )
     {
         LOG_TRC("StreamSocket ctor");
@@ -988,6 +1178,8 @@ public:
             _shutdownSignalled = true;
             StreamSocket::closeConnection();
         }
+
+        closeOutFile();
     }
 
     bool isClosed() const { return _closed; }
@@ -1002,6 +1194,7 @@ public:
     void shutdown() override
     {
         _shutdownSignalled = true;
+        markPollDirty();
         LOG_TRC("Async shutdown requested.");
     }
 
@@ -1023,14 +1216,31 @@ public:
         // cf. SslSocket::getPollEvents
         ASSERT_CORRECT_SOCKET_THREAD(this);
         int events = _socketHandler->getPollEvents(now, timeoutMaxMicroS);
-        if (!_outBuffer.empty() || _shutdownSignalled)
+        if (hasOutgoingData() || _shutdownSignalled)
             events |= POLLOUT;
+        else if (_inputDeferred)
+            timeoutMaxMicroS = 0; // The file body is sent, process the input that waited for it.
+
+        // Until the file is sent, what we read would only pile up deferred in _inBuffer;
+        // leave it in the kernel instead. Hang-ups and errors are reported regardless.
+        if (_outFileFD >= 0)
+            events &= ~POLLIN;
+
+        // Don't read past what the poll we left still receives for us.
+        const HandOver handOver = _handOver;
+        if (handOver != HandOver::None)
+        {
+            events &= ~POLLIN;
+            timeoutMaxMicroS = std::min<int64_t>(
+                timeoutMaxMicroS, handOver == HandOver::Ready ? 0 : HandOverCheckMicroS);
+        }
+
         return events;
     }
 
     bool hasBuffered() const override
     {
-        return !_outBuffer.empty() || !_inBuffer.empty();
+        return hasOutgoingData() || !_inBuffer.empty();
     }
 
     /// Create a pair of connected stream sockets
@@ -1044,6 +1254,7 @@ public:
         if (data != nullptr && len > 0)
         {
             _outBuffer.append(data, len);
+            markPollDirty();
             if (doFlush)
                 writeOutgoingData();
         }
@@ -1055,6 +1266,26 @@ public:
         send(str.data(), str.size(), doFlush);
     }
 
+    /// Send data kept alive by holder, which must not change
+    /// until sent. Large data is sent without being copied.
+    void send(std::shared_ptr<const void> holder, const char* data, const std::size_t len,
+              const bool doFlush = true)
+    {
+        ASSERT_CORRECT_SOCKET_THREAD(this);
+        if (data != nullptr && len > 0)
+        {
+            _outBuffer.append(std::move(holder), data, len);
+            markPollDirty();
+            if (doFlush)
+                writeOutgoingData();
+        }
+    }
+
+    /// Send size bytes of the file fd from offset, after any buffered data, taking ownership
+    /// of fd. The file is streamed as the socket drains rather than read into memory. Input
+    /// isn't processed until it's all sent, so that it's not interleaved with other responses.
+    void sendFile(int fd, off_t offset, std::size_t size);
+
     /// Send an http::Request and flush.
     /// Does not add any fields to the header.
     /// Will shutdown the socket upon error and return false.
@@ -1074,7 +1305,7 @@ public:
     /// Safely flush any outgoing data.
     inline void flush()
     {
-        if (!_outBuffer.empty())
+        if (hasOutgoingData())
             writeOutgoingData();
     }
 
@@ -1139,6 +1370,17 @@ public:
             return false; // error - close it.
         }
 
+        if (_asyncRead)
+        {
+            // Already received by io_uring, see setAsyncInput().
+            _asyncRead = false;
+            if (_asyncReadResult >= 0)
+                return _asyncReadResult;
+
+            errno = -_asyncReadResult;
+            return -1;
+        }
+
         ssize_t len = 0;
         if constexpr (!Util::isMobileApp())
         {
@@ -1214,6 +1456,51 @@ public:
         return len;
     }
 
+    /// Plain reads can be made by io_uring, unlike recvmsg(2) with descriptors.
+    AsyncInput getAsyncInput() const override
+    {
+        return _readType == NormalRead ? AsyncInput::Receive : AsyncInput::None;
+    }
+
+    void setAsyncInput(const char* data, int result) override
+    {
+        ASSERT_CORRECT_SOCKET_THREAD(this);
+
+        if (result > 0)
+        {
+            LOGA_TRC(Socket, "Received " << result << " bytes in addition to " << _inBuffer.size()
+                                         << " buffered bytes");
+            _bytesRecvd += result;
+            _inBuffer.append(data, result);
+        }
+
+        _asyncRead = true;
+        _asyncReadResult = result;
+    }
+
+    bool expectAsyncInput() override
+    {
+        ASSERT_CORRECT_SOCKET_THREAD(this);
+        assert(_handOver == HandOver::None && "Expecting input from two polls");
+        _handOver = HandOver::InFlight;
+        return true;
+    }
+
+    void handOverAsyncInput(const char* data, int result) override
+    {
+        assert(_handOver == HandOver::InFlight && "Unexpected input handed over");
+        if (result == -EAGAIN)
+        {
+            _handOver = HandOver::None;
+            return;
+        }
+
+        if (result > 0)
+            _handedOver.assign(data, data + result);
+        _handedOverResult = result;
+        _handOver = HandOver::Ready;
+    }
+
     /// Replace the existing SocketHandler with a new one.
     void setHandler(std::shared_ptr<ProtocolHandlerInterface> handler)
     {
@@ -1298,6 +1585,7 @@ public:
 
     Buffer& getOutBuffer()
     {
+        markPollDirty(); // Taken to write into.
         return _outBuffer;
     }
 
@@ -1317,6 +1605,8 @@ public:
     {
         if constexpr (Util::isMobileApp())
             return INT_MAX; // We want to always send a single record in one go
+        if (_outFileFD >= 0)
+            return 0; // Nothing may be written before the file body.
         const int capacity = getSendBufferSize();
         return std::max<int>(0, capacity - _outBuffer.size());
     }
@@ -1337,12 +1627,26 @@ protected:
     /// @events is the mask of events that triggered the wake.
     void handlePoll(SocketDisposition &disposition,
                     std::chrono::steady_clock::time_point now,
-                    const int events) override
+                    int events) override
     {
         ASSERT_CORRECT_SOCKET_THREAD(this);
 
         _socketHandler->checkTimeout(now);
 
+        // What the poll we left received for us comes before anything we read.
+        if (_handOver == HandOver::Ready)
+        {
+            LOGA_TRC(Socket, "Taking " << _handedOverResult << " received by the poll we left");
+            if (!ignoringInput())
+            {
+                setAsyncInput(_handedOver.data(), _handedOverResult);
+                events |= POLLIN;
+            }
+
+            _handedOver.clear();
+            _handOver = HandOver::None;
+        }
+
         if (!events && _inBuffer.empty())
             return;
 
@@ -1383,8 +1687,11 @@ protected:
         }
 
         // If we have data, allow the app to consume.
+        // Unless we are still sending a file, it must not be interleaved with the response.
+        _inputDeferred = _outFileFD >= 0 && !_inBuffer.empty();
         size_t oldSize = 0;
-        while (!_inBuffer.empty() && oldSize != _inBuffer.size() && processInputEnabled())
+        while (!_inputDeferred && !_inBuffer.empty() && oldSize != _inBuffer.size() &&
+               processInputEnabled())
         {
             oldSize = _inBuffer.size();
 
@@ -1419,7 +1726,7 @@ protected:
             }
 
             // perform the shutdown if we have sent everything.
-            if (_shutdownSignalled && _outBuffer.empty())
+            if (_shutdownSignalled && !hasOutgoingData())
             {
                 LOG_TRC("Shutdown Signaled. Close Connection.");
                 closeConnection();
@@ -1430,7 +1737,7 @@ protected:
             oldSize = _outBuffer.size();
 
             // Write if we can and have data to write.
-            if ((events & POLLOUT) && !_outBuffer.empty())
+            if ((events & POLLOUT) && hasOutgoingData())
             {
                 if (writeOutgoingData() < 0)
                 {
@@ -1464,19 +1771,35 @@ public:
     virtual int writeOutgoingData()
     {
         ASSERT_CORRECT_SOCKET_THREAD(this);
-        assert(!_outBuffer.empty());
+        assert(hasOutgoingData());
         ssize_t len = 0;
         int last_errno = 0;
         do
         {
+            if (_outBuffer.empty())
+            {
+                // Only the file body is left.
+                len = writeOutgoingFile();
+                if (len < 0)
+                    last_errno = errno;
+                if (len <= 0)
+                    break;
+
+                if (_outBuffer.empty())
+                    continue; // Sent directly.
+            }
+
             do
             {
                 // Writing much more than we can absorb in the kernel causes wastage.
-                const int size = std::min((int)_outBuffer.getBlockSize(), getSendBufferSize());
-                if (size == 0)
+                iovec iov[MaxIOVecCount];
+                const int count = _outBuffer.getIOVec(iov, MaxIOVecCount, getSendBufferSize());
+                if (count == 0)
                     break;
 
-                len = writeData(_outBuffer.getBlock(), size);
+                len = count == 1 ? writeData(static_cast<const char*>(iov[0].iov_base),
+                                             iov[0].iov_len)
+                                 : writeDataV(iov, count);
                 if (len < 0)
                     last_errno = errno; // Save only on error.
 
@@ -1490,7 +1813,10 @@ public:
                 else // Success.
                     LOGA_TRC(Socket, "Wrote " << len << " bytes of " << _outBuffer.size() << " buffered data"
 #ifdef LOG_SOCKET_DATA
-                            << (len ? Util::dumpHex(std::string(_outBuffer.getBlock(), len), ":\n")
+                            << (len ? Util::dumpHex(std::string(_outBuffer.getBlock(),
+                                                                std::min<std::size_t>(
+                                                                    len, _outBuffer.getBlockSize())),
+                                                    ":\n")
                                     : std::string())
 #endif
                     );
@@ -1510,7 +1836,7 @@ public:
                 break;
             }
         }
-        while (!_outBuffer.empty());
+        while (hasOutgoingData());
 
         // Restore errno from the write call.
         errno = last_errno;
@@ -1523,6 +1849,12 @@ public:
     void dumpState(std::ostream& os) override;
 
 protected:
+    /// True if data, or a file body, is waiting to be sent.
+    bool hasOutgoingData() const { return !_outBuffer.empty() || _outFileFD >= 0; }
+
+    /// Whether file bodies can be sent with sendfile(2), straight from the page cache.
+    virtual bool canSendFile() const { return !Util::isMobileApp(); }
+
     void handshakeFail()
     {
         if (_socketHandler)
@@ -1612,9 +1944,28 @@ protected:
 #endif
     }
 
+    /// Override to write a number of blocks at once, as writev(2).
+    virtual int writeDataV(const iovec* iov, const int count)
+    {
+        ASSERT_CORRECT_SOCKET_THREAD(this);
+        assert(count > 0);
+#if !MOBILEAPP
+#if ENABLE_DEBUG
+        if (simulateSocketError(false))
+            return -1;
+#endif
+        return ::writev(getFD(), iov, count);
+#else
+        (void)count;
+        return fakeSocketWrite(getFD(), static_cast<const char*>(iov[0].iov_base),
+                               iov[0].iov_len);
+#endif
+    }
+
     void setShutdownSignalled()
     {
         _shutdownSignalled = true;
+        markPollDirty();
     }
 
     bool isShutdownSignalled() const
@@ -1628,6 +1979,13 @@ protected:
 #endif
 
 private:
+    /// Sends the next part of the file body, with sendfile(2) if possible, otherwise
+    /// by reading a chunk of it into the output buffer for writeData to send.
+    /// Returns the number of bytes sent or read, or -1 on error, with errno set.
+    ssize_t writeOutgoingFile();
+
+    void closeOutFile();
+
     /// The hostname (or IP) of the peer we are connecting to.
     const std::string _hostname;
 
@@ -1658,6 +2016,34 @@ private:
     ReadType _readType;
     std::atomic_bool _inputProcessingEnabled;
 
+    /// The file body being sent after _outBuffer, if any.
+    int _outFileFD;
+    off_t _outFileOffset;
+    std::size_t _outFileRemaining;
+    bool _outFileUseSendFile; ///< Until sendfile(2) fails for the file.
+
+    /// True if input waits for the file body to be sent.
+    bool _inputDeferred;
+
+    /// True if io_uring read for us, with the result of recv(2), or -errno.
+    bool _asyncRead;
+    int _asyncReadResult;
+
+    /// Of the io_uring receive for us in the poll we left, see expectAsyncInput().
+    enum class HandOver : char
+    {
+        None,
+        InFlight,
+        Ready
+    };
+    /// Set by the thread of the poll we left, until Ready, then by ours.
+    std::atomic<HandOver> _handOver;
+    /// What it received, when Ready.
+    std::vector<char> _handedOver;
+    int _handedOverResult;
+    /// How often we look whether it completed, while in flight.
+    static constexpr int64_t HandOverCheckMicroS = 1000;
+
     // Used in parseHeader, SocketPoll::DefaultPollTimeoutMicroS acting as max delay
     std::chrono::steady_clock::time_point _lastSeenHTTPHeader;
 };
@@ -104,7 +104,8 @@ static const char* getCABundleFile()
 
 SslContext::SslContext(const std::string& certFilePath, const std::string& keyFilePath,
                        const std::string& caFilePath, const std::string& cipherList,
-                       ssl::CertificateVerification verification)
+                       ssl::CertificateVerification verification,
+                       const ssl::ContextOptions& options)
     : _ctx(nullptr)
     , _verification(verification)
 {
@@ -198,8 +199,8 @@ SslContext::SslContext(const std::string& certFilePath, const std::string& keyFi
         // The write buffer may re-allocate, and we don't mind partial writes.
         SSL_CTX_set_mode(_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
                                SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
-        SSL_CTX_set_session_cache_mode(_ctx, SSL_SESS_CACHE_OFF);
 
+        initOptions(options);
         initDH();
         initECDH();
     }
@@ -255,6 +256,43 @@ void SslContext::dynlockDestroy(struct CRYPTO_dynlock_value* lock, const char* /
     delete lock;
 }
 
+void SslContext::initOptions(const ssl::ContextOptions& options)
+{
+    if (options._ktls)
+    {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+        // Used only when the kernel has the tls module and supports the negotiated cipher,
+        // which SslStreamSocket checks after the handshake.
+        SSL_CTX_set_options(_ctx, SSL_OP_ENABLE_KTLS);
+        LOG_INF("Enabled kernel TLS offload, where supported");
+#else
+        LOG_WRN("Kernel TLS offload is not supported by this OpenSSL build");
+#endif
+    }
+
+    if (options._sessionCacheSize > 0)
+    {
+        // Clients reconnecting, e.g. after a network glitch, skip the full handshake.
+        SSL_CTX_set_session_cache_mode(_ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(_ctx, options._sessionCacheSize);
+
+        static const unsigned char SessionIdContext[] = "coolwsd";
+        SSL_CTX_set_session_id_context(_ctx, SessionIdContext, sizeof(SessionIdContext) - 1);
+    }
+    else
+        SSL_CTX_set_session_cache_mode(_ctx, SSL_SESS_CACHE_OFF);
+
+    if (!options._sessionTickets)
+        SSL_CTX_set_options(_ctx, SSL_OP_NO_TICKET);
+
+    if (options._sessionTimeoutSecs > 0)
+        SSL_CTX_set_timeout(_ctx, options._sessionTimeoutSecs);
+
+    LOG_DBG("SSL session cache size: " << options._sessionCacheSize << ", tickets: "
+                                       << (options._sessionTickets ? "enabled" : "disabled")
+                                       << ", timeout: " << options._sessionTimeoutSecs << 's');
+}
+
 void SslContext::initDH()
 {
 #ifndef OPENSSL_NO_DH
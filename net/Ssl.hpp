@@ -33,6 +33,15 @@ enum class CertificateVerification
     Disabled, //< No verification is performed or results ignored.
     Required //< Certificate must be provided and will be verified.
 };
+
+/// Optional features of a context, the defaults leave them off.
+struct ContextOptions
+{
+    bool _ktls = false; ///< Offload record encryption to the kernel, where it's supported.
+    bool _sessionTickets = true; ///< Issue tickets that clients may resume sessions with.
+    int _sessionCacheSize = 0; ///< The sessions the server caches for resumption, 0 for none.
+    int _sessionTimeoutSecs = 300; ///< How long cached sessions and tickets remain valid.
+};
 } // namespace ssl
 
 class SslContext final
@@ -40,7 +49,8 @@ class SslContext final
 public:
     SslContext(const std::string& certFilePath, const std::string& keyFilePath,
                const std::string& caFilePath, const std::string& cipherList,
-               ssl::CertificateVerification verification);
+               ssl::CertificateVerification verification,
+               const ssl::ContextOptions& options = ssl::ContextOptions());
 
     /// Returns a new SSL Context to be used with raw API.
     SSL* newSsl() { return SSL_new(_ctx); }
@@ -52,6 +62,7 @@ public:
 private:
     void initDH();
     void initECDH();
+    void initOptions(const ssl::ContextOptions& options);
     void shutdown();
 
     std::string getLastErrorMsg();
@@ -77,12 +88,13 @@ public:
                                         const std::string& keyFilePath,
                                         const std::string& caFilePath,
                                         const std::string& cipherList,
-                                        ssl::CertificateVerification verification)
+                                        ssl::CertificateVerification verification,
+                                        const ssl::ContextOptions& options = ContextOptions())
     {
         assert(!isServerContextInitialized() &&
                "Cannot initialize the server context more than once");
         ServerInstance = std::make_unique<SslContext>(certFilePath, keyFilePath, caFilePath,
-                                                      cipherList, verification);
+                                                      cipherList, verification, options);
     }
 
     static void uninitializeServerContext() { ServerInstance.reset(); }
@@ -30,6 +30,7 @@ public:
         , _ssl(nullptr)
         , _sslWantsTo(SslWantsTo::Neither)
         , _doHandshake(true)
+        , _ktlsSend(false)
     {
         LOG_TRC("SslStreamSocket ctor #" << fd);
 
@@ -133,6 +134,9 @@ public:
         Socket::shutdown();
     }
 
+    /// OpenSSL reads from the socket itself.
+    AsyncInput getAsyncInput() const override { return AsyncInput::None; }
+
     int readIncomingData() override
     {
         ASSERT_CORRECT_SOCKET_THREAD(this);
@@ -184,6 +188,10 @@ public:
 
         assert (len > 0); // Never write 0 bytes.
 
+        // The kernel makes the records.
+        if (_ktlsSend)
+            return StreamSocket::writeData(buf, len);
+
 #if ENABLE_DEBUG
         if (simulateSocketError(false))
             return -1;
@@ -191,6 +199,22 @@ public:
         return handleSslState(SSL_write(_ssl, buf, len), "write");
     }
 
+    /// TLS records are written one block at a time, unless the kernel makes them.
+    int writeDataV(const iovec* iov, const int count) override
+    {
+        assert(count > 0);
+        if (_ktlsSend)
+            return StreamSocket::writeDataV(iov, count);
+
+        return writeData(static_cast<const char*>(iov[0].iov_base), iov[0].iov_len);
+    }
+
+    /// Unless the kernel encrypts the records, files are read and sent through writeData.
+    bool canSendFile() const override { return _ktlsSend; }
+
+    /// True when the kernel encrypts what we send (kTLS).
+    bool isKtlsSend() const { return _ktlsSend; }
+
     int getPollEvents(std::chrono::steady_clock::time_point now,
                       int64_t & timeoutMaxMicroS) override
     {
@@ -220,6 +244,8 @@ public:
         int events = StreamSocket::getPollEvents(now, timeoutMaxMicroS); // Default to base.
         if (_sslWantsTo == SslWantsTo::Write) // If OpenSSL wants to write (and we don't).
             events |= POLLOUT;
+        else if (_sslWantsTo == SslWantsTo::Read && !_ktlsSend)
+            events |= POLLIN; // Writing a file through OpenSSL can need a read to progress.
 
         return events;
     }
@@ -259,10 +285,19 @@ private:
             if (rc == 1)
             {
                 // Successful handshake; TLS/SSL connection established.
-                LOG_TRC("SSL handshake completed successfully");
+                LOG_TRC("SSL handshake completed successfully"
+                        << (SSL_session_reused(_ssl) ? ", resumed session" : ""));
                 _doHandshake = false;
                 _sslWantsTo = SslWantsTo::Neither; // Reset until we are told otherwise.
 
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+                // Only when enabled in the context, and the kernel took the negotiated cipher.
+                // OpenSSL has nothing left to send then, so we can write to the socket directly.
+                _ktlsSend = BIO_get_ktls_send(SSL_get_wbio(_ssl));
+                if (_ktlsSend)
+                    LOG_DBG("Kernel TLS offload active for sending");
+#endif
+
                 if (!verifyCertificate())
                 {
                     LOG_WRN("Failed to verify the certificate of [" << hostname() << ']');
@@ -491,6 +526,8 @@ private:
     /// We must do the handshake during the first
     /// read or write in non-blocking.
     bool _doHandshake;
+    /// True when kTLS is active for sending, so we write plain data to the socket.
+    bool _ktlsSend;
 };
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,350 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include <common/StringVector.hpp>
+#include <common/Util.hpp>
+
+/// The permessage-deflate WebSocket extension (RFC 7692).
+/// Holds the compression state of one connection, allocated on
+/// first use, with windows bounded by what was negotiated.
+class WebSocketDeflate
+{
+public:
+    /// The parameters negotiated for a connection.
+    struct Params
+    {
+        int _serverMaxWindowBits = MaxWindowBits;
+        int _clientMaxWindowBits = MaxWindowBits;
+        bool _serverNoContextTakeover = false;
+        bool _clientNoContextTakeover = false;
+    };
+
+    /// Our side of the negotiation, set from the configuration.
+    struct Settings
+    {
+        bool _enabled = false;
+        int _maxWindowBits = 12; ///< The window we compress and decompress with, at most.
+        int _memLevel = 6; ///< How much memory deflate uses for its state, 1 to 9.
+    };
+
+    /// The server settings, used when accepting WebSocket upgrades.
+    static Settings ServerSettings;
+
+    static constexpr const char* Name = "permessage-deflate";
+
+    /// zlib cannot produce raw deflate streams with 8 bits windows.
+    static constexpr int MinWindowBits = 9;
+    static constexpr int MaxWindowBits = 15;
+
+    /// The RSV1 frame bit, set on the first frame of compressed messages.
+    static constexpr unsigned char Rsv1 = 0x40;
+
+    /// Smaller messages are not worth compressing.
+    static constexpr std::size_t MinCompressSize = 32;
+
+    /// We refuse to inflate messages beyond this, lest a small
+    /// message inflate to exhaust our memory.
+    static constexpr std::size_t MaxInflatedSize = 64 * 1024 * 1024;
+
+    enum class InflateResult
+    {
+        Ok,
+        Failed,
+        TooBig
+    };
+
+    WebSocketDeflate(bool isClient, const Params& params, int memLevel)
+        : _params(params)
+        , _memLevel(std::clamp(memLevel, 1, MAX_MEM_LEVEL))
+        , _isClient(isClient)
+        , _deflateInit(false)
+        , _inflateInit(false)
+    {
+    }
+
+    ~WebSocketDeflate()
+    {
+        if (_deflateInit)
+            deflateEnd(&_deflate);
+        if (_inflateInit)
+            inflateEnd(&_inflate);
+    }
+
+    WebSocketDeflate(const WebSocketDeflate&) = delete;
+    WebSocketDeflate& operator=(const WebSocketDeflate&) = delete;
+
+    const Params& getParams() const { return _params; }
+
+    /// Server side: accept the first acceptable offer in the value of the client's
+    /// Sec-WebSocket-Extensions header. Returns the response header value, or empty.
+    static std::string negotiate(const std::string& offers, const Settings& settings,
+                                 Params& params)
+    {
+        if (!settings._enabled)
+            return std::string();
+
+        const StringVector offerList = StringVector::tokenize(offers, ',');
+        for (std::size_t index = 0; index < offerList.size(); ++index)
+        {
+            const StringVector tokens = StringVector::tokenize(offerList[index], ';');
+            if (tokens.empty() || Util::trimmed(tokens[0]) != Name)
+                continue;
+
+            params = Params();
+            params._serverMaxWindowBits = settings._maxWindowBits;
+            params._clientMaxWindowBits = MaxWindowBits;
+            bool clientWindowBitsOffered = false;
+            bool valid = true;
+            for (std::size_t i = 1; i < tokens.size() && valid; ++i)
+            {
+                std::string name;
+                int value = 0;
+                valid = parseParam(tokens[i], name, value);
+                if (!valid)
+                    break;
+
+                if (name == "server_no_context_takeover")
+                    params._serverNoContextTakeover = true;
+                else if (name == "client_no_context_takeover")
+                    params._clientNoContextTakeover = true;
+                else if (name == "server_max_window_bits" && value >= MinWindowBits)
+                    params._serverMaxWindowBits = std::min(params._serverMaxWindowBits, value);
+                else if (name == "client_max_window_bits" && (value == 0 || value >= MinWindowBits))
+                {
+                    // The client lets us bound its window, and so our inflate state.
+                    clientWindowBitsOffered = true;
+                    params._clientMaxWindowBits =
+                        std::min(value > 0 ? value : MaxWindowBits, settings._maxWindowBits);
+                }
+                else
+                    valid = false;
+            }
+
+            if (!valid)
+                continue;
+
+            params._serverMaxWindowBits = std::max(params._serverMaxWindowBits, MinWindowBits);
+            params._clientMaxWindowBits = std::max(params._clientMaxWindowBits, MinWindowBits);
+
+            std::string response = Name;
+            response += "; server_max_window_bits=" + std::to_string(params._serverMaxWindowBits);
+            if (clientWindowBitsOffered)
+                response +=
+                    "; client_max_window_bits=" + std::to_string(params._clientMaxWindowBits);
+            if (params._serverNoContextTakeover)
+                response += "; server_no_context_takeover";
+            if (params._clientNoContextTakeover)
+                response += "; client_no_context_takeover";
+            return response;
+        }
+
+        return std::string();
+    }
+
+    /// The value of the Sec-WebSocket-Extensions header for clients to offer.
+    static std::string getOffer(int maxWindowBits)
+    {
+        return std::string(Name) + "; client_max_window_bits=" +
+               std::to_string(std::clamp(maxWindowBits, MinWindowBits, MaxWindowBits));
+    }
+
+    /// Client side: parse the server's response to our offer.
+    /// Returns false when it doesn't accept permessage-deflate, or is invalid.
+    static bool parseResponse(const std::string& response, int maxWindowBits, Params& params)
+    {
+        const StringVector tokens = StringVector::tokenize(response, ';');
+        if (tokens.empty() || Util::trimmed(tokens[0]) != Name)
+            return false;
+
+        params = Params();
+        params._clientMaxWindowBits = std::clamp(maxWindowBits, MinWindowBits, MaxWindowBits);
+        for (std::size_t i = 1; i < tokens.size(); ++i)
+        {
+            std::string name;
+            int value = 0;
+            if (!parseParam(tokens[i], name, value))
+                return false;
+
+            if (name == "server_no_context_takeover")
+                params._serverNoContextTakeover = true;
+            else if (name == "client_no_context_takeover")
+                params._clientNoContextTakeover = true;
+            else if (name == "server_max_window_bits" && value > 0)
+                params._serverMaxWindowBits = value;
+            else if (name == "client_max_window_bits" && value >= MinWindowBits)
+                params._clientMaxWindowBits = std::min(params._clientMaxWindowBits, value);
+            else
+                return false;
+        }
+
+        params._serverMaxWindowBits = std::max(params._serverMaxWindowBits, MinWindowBits);
+        params._clientMaxWindowBits = std::max(params._clientMaxWindowBits, MinWindowBits);
+        return true;
+    }
+
+    /// Compress a message into out. Returns false on failure.
+    bool compress(const char* data, std::size_t len, std::vector<char>& out)
+    {
+        if (!_deflateInit)
+        {
+            std::memset(&_deflate, 0, sizeof(_deflate));
+            // Favor latency, these are interactive messages.
+            if (deflateInit2(&_deflate, Z_BEST_SPEED, Z_DEFLATED, -getWindowBits(!_isClient),
+                             _memLevel, Z_DEFAULT_STRATEGY) != Z_OK)
+                return false;
+
+            _deflateInit = true;
+        }
+
+        _deflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _deflate.avail_in = len;
+
+        out.clear();
+        std::size_t size = 0;
+        do
+        {
+            out.resize(size + std::max<std::size_t>(len / 2, 256));
+            _deflate.next_out = reinterpret_cast<Bytef*>(out.data() + size);
+            _deflate.avail_out = out.size() - size;
+
+            const int rc = deflate(&_deflate, Z_SYNC_FLUSH);
+            if (rc != Z_OK && rc != Z_BUF_ERROR)
+                return false;
+
+            size = out.size() - _deflate.avail_out;
+        } while (_deflate.avail_out == 0); // Until all is flushed.
+
+        out.resize(size);
+
+        // The message ends with the empty stored block of the sync flush, minus its tail.
+        if (out.size() >= sizeof(Tail) && std::memcmp(out.data() + out.size() - sizeof(Tail), Tail,
+                                                      sizeof(Tail)) == 0)
+            out.resize(out.size() - sizeof(Tail));
+
+        if (_isClient ? _params._clientNoContextTakeover : _params._serverNoContextTakeover)
+            deflateReset(&_deflate);
+
+        return true;
+    }
+
+    /// Decompress a message of at most maxSize bytes into out.
+    InflateResult decompress(const char* data, std::size_t len, std::vector<char>& out,
+                             std::size_t maxSize = MaxInflatedSize)
+    {
+        if (!_inflateInit)
+        {
+            std::memset(&_inflate, 0, sizeof(_inflate));
+            if (inflateInit2(&_inflate, -getWindowBits(_isClient)) != Z_OK)
+                return InflateResult::Failed;
+
+            _inflateInit = true;
+        }
+
+        out.clear();
+        InflateResult result = inflateAll(data, len, out, maxSize);
+        if (result == InflateResult::Ok)
+            result = inflateAll(Tail, sizeof(Tail), out, maxSize);
+        if (result != InflateResult::Ok)
+            return result;
+
+        if (_isClient ? _params._serverNoContextTakeover : _params._clientNoContextTakeover)
+            inflateReset(&_inflate);
+
+        return InflateResult::Ok;
+    }
+
+private:
+    /// Parse a 'name[=value]' extension parameter.
+    static bool parseParam(const std::string& param, std::string& name, int& value)
+    {
+        const std::string trimmed = Util::trimmed(param);
+        const std::size_t equal = trimmed.find('=');
+        name = Util::trimmed(trimmed.substr(0, equal));
+        value = 0;
+        if (equal == std::string::npos)
+            return !name.empty();
+
+        std::string text = Util::trimmed(trimmed.substr(equal + 1));
+        if (text.size() >= 2 && text.front() == '"' && text.back() == '"')
+            text = text.substr(1, text.size() - 2);
+
+        // Only the window bits take a value.
+        if (text.empty() || text.size() > 2 ||
+            !std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; }))
+            return false;
+
+        value = std::stoi(text);
+        return value >= 8 && value <= MaxWindowBits;
+    }
+
+    /// The window of the given side's compressor.
+    int getWindowBits(bool server) const
+    {
+        return server ? _params._serverMaxWindowBits : _params._clientMaxWindowBits;
+    }
+
+    InflateResult inflateAll(const char* data, std::size_t len, std::vector<char>& out,
+                             std::size_t maxSize)
+    {
+        _inflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _inflate.avail_in = len;
+        bool full = true;
+        while (_inflate.avail_in > 0 || full)
+        {
+            const std::size_t size = out.size();
+            if (size >= maxSize)
+                return InflateResult::TooBig;
+
+            out.resize(size + std::min(std::max<std::size_t>(len * 4, 1024), maxSize - size));
+            _inflate.next_out = reinterpret_cast<Bytef*>(out.data() + size);
+            _inflate.avail_out = out.size() - size;
+
+            const int rc = inflate(&_inflate, Z_SYNC_FLUSH);
+            full = _inflate.avail_out == 0;
+            out.resize(out.size() - _inflate.avail_out);
+            if (rc == Z_STREAM_END)
+            {
+                // The peer ended the stream, the next message starts afresh.
+                inflateReset(&_inflate);
+            }
+            else if (rc == Z_BUF_ERROR)
+            {
+                // No progress possible, fine only once all is consumed.
+                return _inflate.avail_in == 0 ? InflateResult::Ok : InflateResult::Failed;
+            }
+            else if (rc != Z_OK)
+                return InflateResult::Failed;
+        }
+
+        return InflateResult::Ok;
+    }
+
+    static constexpr char Tail[4] = { 0x00, 0x00, '\xff', '\xff' };
+
+    const Params _params;
+    const int _memLevel;
+    const bool _isClient;
+    bool _deflateInit;
+    bool _inflateInit;
+    z_stream _deflate;
+    z_stream _inflate;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
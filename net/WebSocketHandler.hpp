@@ -12,6 +12,7 @@
 #pragma once
 
 #include "Socket.hpp"
+#include "WebSocketDeflate.hpp"
 #include "common/Common.hpp"
 #include "common/Log.hpp"
 #include "common/Protocol.hpp"
@@ -40,6 +41,12 @@ private:
     /// The security key. Meaningful only for clients.
     const std::string _key;
     unsigned char _lastFlags; //< The flags in the last frame.
+    bool _inCompressed; //< The message being received is compressed.
+    /// Clients: the window bits to offer permessage-deflate with, 0 not to.
+    int _deflateOfferBits;
+    /// The permessage-deflate state, when negotiated.
+    mutable std::unique_ptr<WebSocketDeflate> _deflate;
+    mutable std::vector<char> _deflated; //< Scratch for outgoing compressed messages.
 #endif
 
     std::vector<char> _wsPayload;
@@ -79,6 +86,8 @@ public:
         , _inFragmentBlock(false)
         , _key(isClient ? generateKey() : std::string())
         , _lastFlags(0)
+        , _inCompressed(false)
+        , _deflateOfferBits(0)
         ,
 #endif
         _shuttingDown(false)
@@ -132,6 +141,17 @@ public:
     /// Returns the flags of the last received WS frame.
     unsigned char lastFlags() const { return _lastFlags; }
 
+    /// Clients: offer to compress text messages with permessage-deflate,
+    /// with a window of at most maxWindowBits.
+    void requestDeflate(int maxWindowBits = WebSocketDeflate::MaxWindowBits)
+    {
+        assert(_isClient && "Only clients make offers.");
+        _deflateOfferBits = maxWindowBits;
+    }
+
+    /// Returns true if permessage-deflate was negotiated.
+    bool isDeflating() const { return _deflate != nullptr; }
+
     /// Create a WebSocket connection to the given @host
     /// and @port and add the socket to @poll.
     bool wsRequest(http::Request& req, const std::string& host, const std::string& port,
@@ -157,6 +177,8 @@ public:
         req.set("Upgrade", "websocket");
         req.set("Sec-WebSocket-Version", "13");
         req.set("Sec-WebSocket-Key", getWebSocketKey());
+        if (_deflateOfferBits > 0)
+            req.set("Sec-WebSocket-Extensions", WebSocketDeflate::getOffer(_deflateOfferBits));
 
         if (socket->send(req))
         {
@@ -237,6 +259,13 @@ protected:
         }
     }
 
+    void markPollDirty() override
+    {
+        std::shared_ptr<StreamSocket> socket = getSocket().lock();
+        if (socket)
+            socket->markPollDirty();
+    }
+
 public:
     void shutdown(const StatusCodes statusCode = StatusCodes::NORMAL_CLOSE,
                   const std::string& statusMessage = std::string(),
@@ -272,6 +301,19 @@ public:
                  true /* hard async shutdown & close */);
     }
 
+    /// Write what we can without blocking, close, and take the socket out
+    /// of the given poll, which polls it, for when it outlives us.
+    void closeSocketIn(SocketPoll& poll)
+    {
+        std::shared_ptr<StreamSocket> socket = _socket.lock();
+        if (socket)
+        {
+            socket->flush();
+            socket->closeConnection();
+            poll.removeSocket(socket);
+        }
+    }
+
     /// Returns true if the underlying socket is connected.
     bool isConnected() const {
         std::shared_ptr<StreamSocket> socket = _socket.lock();
@@ -299,6 +341,7 @@ private:
         unsigned char *p = reinterpret_cast<unsigned char*>(&socket->getInBuffer()[0]);
         _lastFlags = p[0];
         const bool fin = _lastFlags & 0x80;
+        const bool compressed = _lastFlags & WebSocketDeflate::Rsv1;
         const WSOpCode code = static_cast<WSOpCode>(_lastFlags & 0x0f);
         const bool hasMask = p[1] & 0x80;
         size_t payloadLen = p[1] & 0x7f;
@@ -442,6 +485,14 @@ private:
             return true;
         }
 
+        // Only the first frame of a message can flag it as compressed.
+        if (compressed && (!_deflate || code == WSOpCode::Continuation))
+        {
+            LOG_ERR("Unexpected compressed WebSocket frame");
+            shutdown(StatusCodes::PROTOCOL_ERROR);
+            return true;
+        }
+
         // Check data frames for errors
         if (_inFragmentBlock)
         {
@@ -460,6 +511,8 @@ private:
             shutdown(StatusCodes::PROTOCOL_ERROR);
             return true;
         }
+        else
+            _inCompressed = compressed;
 
         //Process data frame
         readPayload(data, payloadLen, mask, _wsPayload);
@@ -485,6 +538,31 @@ private:
         {
             // If is final fragment then process the accumulated message.
 
+            if (_inCompressed)
+            {
+                _inCompressed = false;
+                std::vector<char> inflated;
+                const WebSocketDeflate::InflateResult result =
+                    _deflate->decompress(_wsPayload.data(), _wsPayload.size(), inflated);
+                if (result == WebSocketDeflate::InflateResult::TooBig)
+                {
+                    LOG_ERR("WebSocket message of " << _wsPayload.size()
+                                                    << " bytes inflates beyond "
+                                                    << WebSocketDeflate::MaxInflatedSize);
+                    shutdown(StatusCodes::PAYLOAD_TOO_BIG);
+                    return true;
+                }
+                else if (result != WebSocketDeflate::InflateResult::Ok)
+                {
+                    LOG_ERR("Failed to decompress WebSocket message of " << _wsPayload.size()
+                                                                         << " bytes");
+                    shutdown(StatusCodes::MALFORMED_PAYLOAD);
+                    return true;
+                }
+
+                _wsPayload.swap(inflated);
+            }
+
             try
             {
                 handleMessage(_wsPayload);
@@ -679,6 +757,30 @@ public:
         return sendMessage(data, len, WSOpCode::Binary, flush);
     }
 
+    /// Implementation of the ProtocolHandlerInterface.
+    /// The blobs go to the socket by reference, without copying.
+    int sendBinaryMessageWithBlobs(const char* data, const size_t len,
+                                   const std::vector<Blob>& blobs, Blob* frame = nullptr,
+                                   bool flush = false) const override
+    {
+        if (UnitBase::isUnitTesting() && !Util::isFuzzing())
+        {
+            // Unit tests see the whole message, which is still sent as in production.
+            std::vector<char> message(data, data + len);
+            for (const Blob& blob : blobs)
+                message.insert(message.end(), blob->begin(), blob->end());
+
+            int unitReturn = -1;
+            if (_unit->filterSendWebSocketMessage(message.data(), message.size(), WSOpCode::Binary,
+                                                  flush, unitReturn))
+                return unitReturn;
+        }
+
+        return sendFrame(_socket.lock(), data, len, blobs,
+                         WSFrameMask::Fin | static_cast<unsigned char>(WSOpCode::Binary), flush,
+                         frame);
+    }
+
     /// Sends a WebSocket message of WPOpCode type.
     /// Returns the number of bytes written (including frame overhead) on success,
     /// 0 for closed socket, and -1 for other errors.
@@ -694,6 +796,29 @@ public:
         //TODO: Support fragmented messages.
 
         std::shared_ptr<StreamSocket> socket = _socket.lock();
+
+#if !MOBILEAPP
+        // Binary messages are tiles, already compressed.
+        if (_deflate && code == WSOpCode::Text && len >= WebSocketDeflate::MinCompressSize &&
+            socket && !socket->isClosed())
+        {
+            ASSERT_CORRECT_SOCKET_THREAD(socket);
+            if (!_deflate->compress(data, len, _deflated))
+            {
+                LOG_ERR("Failed to compress WebSocket message of " << len << " bytes");
+                return -1;
+            }
+
+            const int size = sendFrame(socket, _deflated.data(), _deflated.size(),
+                                       WSFrameMask::Fin | WebSocketDeflate::Rsv1 |
+                                           static_cast<unsigned char>(code),
+                                       flush);
+
+            // Account for the message, not what it was compressed to.
+            return size > 0 ? static_cast<int>(size - _deflated.size() + len) : size;
+        }
+#endif
+
         return sendFrame(socket, data, len, WSFrameMask::Fin | static_cast<unsigned char>(code), flush);
     }
 
@@ -716,10 +841,26 @@ public:
 protected:
 
 #if !MOBILEAPP
-    /// Builds a websocket frame based on data and flags received as parameters.
-    /// The frame is output in 'out' parameter
-    void buildFrame(const char* data, const uint64_t len, unsigned char flags, Buffer &out) const
+    /// Builds a websocket frame based on data, followed by the blobs, and flags
+    /// received as parameters. The frame is output in 'out' parameter
+    /// With frame, the frame header and data are kept there encoded to share,
+    /// or taken from there; the blobs are referenced either way.
+    void buildFrame(const char* data, const uint64_t dataLen, const std::vector<Blob>& blobs,
+                    unsigned char flags, Buffer& out, Blob* frame = nullptr) const
     {
+        if (frame && *frame && !_isMasking)
+        {
+            // Already encoded for another recipient.
+            out.append(*frame, (*frame)->data(), (*frame)->size());
+            for (const Blob& blob : blobs)
+                out.append(blob, blob->data(), blob->size());
+            return;
+        }
+
+        uint64_t len = dataLen;
+        for (const Blob& blob : blobs)
+            len += blob->size();
+
         int slen = 0;
         char scratch[16];
 
@@ -751,6 +892,22 @@ protected:
         }
 
         assert(slen <= static_cast<int>(sizeof(scratch)));
+
+        if (frame && !_isMasking)
+        {
+            // Encode the headers once for all the recipients.
+            auto encoded = std::make_shared<BlobData>();
+            encoded->reserve(slen + dataLen);
+            encoded->insert(encoded->end(), scratch, scratch + slen);
+            encoded->insert(encoded->end(), data, data + dataLen);
+            *frame = std::move(encoded);
+
+            out.append(*frame, (*frame)->data(), (*frame)->size());
+            for (const Blob& blob : blobs)
+                out.append(blob, blob->data(), blob->size());
+            return;
+        }
+
         out.append(scratch, slen);
 
         if (_isMasking)
@@ -764,22 +921,34 @@ protected:
             out.append(mask, 4);
 
             // copy and mask the data
-            char copy[16384];
-            ssize_t i = 0, toSend;
-            while (true)
-            {
-                toSend = std::min(sizeof(copy), len - i);
-                if (toSend == 0)
-                    break;
-                for (ssize_t j = 0; j < toSend; ++j, ++i)
-                    copy[j] = data[i] ^ mask[i%4];
-                out.append(copy, toSend);
-            }
+            uint64_t masked = 0;
+            appendMasked(data, dataLen, mask, masked, out);
+            for (const Blob& blob : blobs)
+                appendMasked(blob->data(), blob->size(), mask, masked, out);
         }
         else
         {
-            // Copy the data.
-            out.append(data, len);
+            // Copy the data, and reference the blobs.
+            out.append(data, dataLen);
+            for (const Blob& blob : blobs)
+                out.append(blob, blob->data(), blob->size());
+        }
+    }
+
+    /// Append data masked, continuing after the given count of masked bytes.
+    static void appendMasked(const char* data, const uint64_t len, const char (&mask)[4],
+                             uint64_t& masked, Buffer& out)
+    {
+        char copy[16384];
+        uint64_t i = 0;
+        while (true)
+        {
+            const uint64_t toSend = std::min<uint64_t>(sizeof(copy), len - i);
+            if (toSend == 0)
+                break;
+            for (uint64_t j = 0; j < toSend; ++j, ++i, ++masked)
+                copy[j] = data[i] ^ mask[masked % 4];
+            out.append(copy, toSend);
         }
     }
 #endif
@@ -788,7 +957,16 @@ protected:
     /// Returns the number of bytes written (including frame overhead) on success,
     /// 0 for closed/invalid socket, and -1 for other errors.
     int sendFrame(const std::shared_ptr<StreamSocket>& socket, const char* data, const uint64_t len,
-                  [[maybe_unused]] unsigned char flags, bool flush = true) const
+                  unsigned char flags, bool flush = true) const
+    {
+        return sendFrame(socket, data, len, std::vector<Blob>(), flags, flush);
+    }
+
+    /// Sends a WebSocket frame of the data followed by the blobs, which are
+    /// referenced by the socket buffer rather than copied, when large enough.
+    int sendFrame(const std::shared_ptr<StreamSocket>& socket, const char* data, const uint64_t len,
+                  const std::vector<Blob>& blobs, [[maybe_unused]] unsigned char flags,
+                  bool flush = true, [[maybe_unused]] Blob* frame = nullptr) const
     {
         if (!socket || data == nullptr || len == 0)
         {
@@ -810,7 +988,7 @@ protected:
                  << " bytes buffered");
 
 #if ENABLE_DEBUG
-        if ((flags & 0xf) == (int)WSOpCode::Text) // utf8 validate
+        if ((flags & 0xf) == (int)WSOpCode::Text && !(flags & WebSocketDeflate::Rsv1)) // utf8 validate
         {
             size_t offset = Util::isValidUtf8((unsigned char*)data, len);
             if (offset < len)
@@ -852,7 +1030,7 @@ protected:
 #if !MOBILEAPP
         const size_t oldSize = out.size();
 
-        buildFrame(data, len, flags, out);
+        buildFrame(data, len, blobs, flags, out, frame);
 
         // Return the number of bytes we wrote to the *buffer*.
         const size_t size = out.size() - oldSize;
@@ -861,6 +1039,8 @@ protected:
         // WebSocket framing, we put the messages as such into the FakeSocket queue.
         flush = true;
         out.append(data, len);
+        for (const Blob& blob : blobs)
+            out.append(blob->data(), blob->size());
         const size_t size = out.size();
 #endif
 
@@ -987,6 +1167,18 @@ protected:
         httpResponse.set("Upgrade", "websocket");
         httpResponse.header().setConnectionToken(http::Header::ConnectionToken::Upgrade);
         httpResponse.set("Sec-WebSocket-Accept", computeAccept(wsKey));
+
+        WebSocketDeflate::Params deflateParams;
+        const std::string extensions =
+            WebSocketDeflate::negotiate(req.get("Sec-WebSocket-Extensions", ""),
+                                        WebSocketDeflate::ServerSettings, deflateParams);
+        if (!extensions.empty())
+        {
+            httpResponse.set("Sec-WebSocket-Extensions", extensions);
+            _deflate = std::make_unique<WebSocketDeflate>(
+                /*isClient=*/false, deflateParams, WebSocketDeflate::ServerSettings._memLevel);
+        }
+
         LOGA_TRC(WebSocket, "Sending WS Upgrade response: " << httpResponse.header().toString());
         socket->send(httpResponse);
 #endif
@@ -1015,6 +1207,25 @@ protected:
                     response.get("Sec-WebSocket-Accept", "") == computeAccept(_key))
                 {
                     LOGA_TRC(WebSocket, "Accepted incoming websocket response");
+
+                    const std::string extensions = response.get("Sec-WebSocket-Extensions", "");
+                    WebSocketDeflate::Params params;
+                    if (!extensions.empty())
+                    {
+                        if (_deflateOfferBits <= 0 ||
+                            !WebSocketDeflate::parseResponse(extensions, _deflateOfferBits,
+                                                             params))
+                        {
+                            LOG_ERR("Server accepted unexpected extensions ["
+                                    << extensions << "]. Disconnecting");
+                            socket->shutdown();
+                            return;
+                        }
+
+                        _deflate = std::make_unique<WebSocketDeflate>(
+                            /*isClient=*/true, params, WebSocketDeflate::Settings()._memLevel);
+                    }
+
                     setWebSocket(socket);
                 }
                 else
@@ -32,6 +32,8 @@ class DeltaTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testDeltaSequence);
     CPPUNIT_TEST(testRandomDeltas);
     CPPUNIT_TEST(testDeltaCopyOutOfBounds);
+    CPPUNIT_TEST(testDeltaScroll);
+    CPPUNIT_TEST(testDeltaUnchanged);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -41,6 +43,8 @@ class DeltaTests : public CPPUNIT_NS::TestFixture
     void testDeltaSequence();
     void testRandomDeltas();
     void testDeltaCopyOutOfBounds();
+    void testDeltaScroll();
+    void testDeltaUnchanged();
 
     std::vector<char> applyDelta(
         const std::vector<char> &pixmap,
@@ -463,6 +467,118 @@ void DeltaTests::testDeltaCopyOutOfBounds()
     assertEqual(reText2, text2, width, height, testname);
 }
 
+void DeltaTests::testDeltaScroll()
+{
+    constexpr auto testname = __func__;
+
+    uint32_t height, width, rowBytes;
+    std::vector<char> text =
+        Png::loadPng(TDOC "/delta-text.png", height, width, rowBytes);
+    LOK_ASSERT(height == 256 && width == 256 && rowBytes == 256*4);
+
+    std::vector<char> text2 =
+        Png::loadPng(TDOC "/delta-text2.png", height, width, rowBytes);
+    LOK_ASSERT(height == 256 && width == 256 && rowBytes == 256*4);
+
+    // Scroll by arbitrary offsets, exposing new content at the bottom.
+    for (const uint32_t scroll : { 1u, 7u, 37u, 100u, 201u })
+    {
+        DeltaGenerator gen;
+
+        std::vector<char> scrolled(text.size());
+        const size_t kept = (height - scroll) * width * 4;
+        std::memcpy(scrolled.data(), text.data() + scroll * width * 4, kept);
+        std::memcpy(scrolled.data() + kept, text2.data() + kept, text.size() - kept);
+
+        std::vector<char> delta;
+        std::shared_ptr<DeltaGenerator::DeltaData> rleData;
+
+        // Stash it in the cache
+        LOK_ASSERT(gen.createDelta(
+                       reinterpret_cast<unsigned char *>(&text[0]),
+                       0, 0, width, height, width, height,
+                       TileLocation(1, 2, 3, 0, 1), delta, 1, false, LOK_TILEMODE_RGBA, rleData) == false);
+        LOK_ASSERT(delta.empty());
+
+        LOK_ASSERT(gen.createDelta(
+                       reinterpret_cast<unsigned char *>(&scrolled[0]),
+                       0, 0, width, height, width, height,
+                       TileLocation(1, 2, 3, 0, 1), delta, 2, false, LOK_TILEMODE_RGBA, rleData) == true);
+        checkzDelta(delta, "scrolled");
+
+        std::vector<char> reScrolled = applyDelta(text, width, height, delta, testname);
+        assertEqual(reScrolled, scrolled, width, height, testname);
+
+        // Moved rows should be copied, not sent as new pixels.
+        std::vector<char> raw(1024*1024*4);
+        size_t rawSize = ZSTD_decompress(raw.data(), raw.size(), delta.data() + 1, delta.size() - 1);
+        LOK_ASSERT_EQUAL(ZSTD_isError(rawSize), (unsigned)false);
+        for (size_t i = 0; i < rawSize && raw[i] != 't';)
+        {
+            if (raw[i] == 'c')
+                i += 4;
+            else
+            {
+                LOK_ASSERT_EQUAL('d', raw[i]);
+                const uint32_t destRow = static_cast<uint8_t>(raw[i + 1]);
+                LOK_ASSERT_MESSAGE("scrolled row sent as new pixels", destRow >= height - scroll);
+                i += 4 + static_cast<uint8_t>(raw[i + 3]) * 4;
+            }
+        }
+    }
+}
+
+void DeltaTests::testDeltaUnchanged()
+{
+    constexpr auto testname = __func__;
+
+    DeltaGenerator gen;
+
+    uint32_t height, width, rowBytes;
+    std::vector<char> text =
+        Png::loadPng(TDOC "/delta-text.png", height, width, rowBytes);
+    LOK_ASSERT(height == 256 && width == 256 && rowBytes == 256*4);
+
+    // The tile on the right of a two tile wide pixmap.
+    const uint32_t pixmapWidth = width * 2;
+    std::vector<char> pixmap(pixmapWidth * height * 4);
+    for (uint32_t y = 0; y < height; ++y)
+        std::copy(text.begin() + y * rowBytes, text.begin() + (y + 1) * rowBytes,
+                  pixmap.begin() + (y * pixmapWidth + width) * 4);
+
+    const TileLocation loc(256, 0, 256, 0, 1);
+    unsigned char* data = reinterpret_cast<unsigned char*>(pixmap.data());
+
+    std::vector<char> delta;
+    std::shared_ptr<DeltaGenerator::DeltaData> rleData;
+
+    // Stash it in the cache
+    LOK_ASSERT(gen.createDelta(data, width, 0, width, height, pixmapWidth, height,
+                               loc, delta, 1, false, LOK_TILEMODE_RGBA, rleData) == false);
+    LOK_ASSERT(delta.empty());
+
+    // Re-rendered without any change: a bare delta, advancing the wid.
+    LOK_ASSERT(gen.createDelta(data, width, 0, width, height, pixmapWidth, height,
+                               loc, delta, 2, false, LOK_TILEMODE_RGBA, rleData) == true);
+    LOK_ASSERT_EQUAL(size_t(1), delta.size());
+    LOK_ASSERT_EQUAL('D', delta[0]);
+    LOK_ASSERT_EQUAL(TileWireId(2), rleData->getWid());
+
+    // A single changed pixel, in the last row, is a real delta.
+    pixmap[(height * pixmapWidth - 1) * 4] ^= 0x7f;
+    delta.clear();
+    LOK_ASSERT(gen.createDelta(data, width, 0, width, height, pixmapWidth, height,
+                               loc, delta, 3, false, LOK_TILEMODE_RGBA, rleData) == true);
+    checkzDelta(delta, "last pixel");
+    LOK_ASSERT_EQUAL(TileWireId(3), rleData->getWid());
+
+    // Unless a keyframe is forced.
+    delta.clear();
+    LOK_ASSERT(gen.createDelta(data, width, 0, width, height, pixmapWidth, height,
+                               loc, delta, 4, true, LOK_TILEMODE_RGBA, rleData) == false);
+    LOK_ASSERT(delta.empty());
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(DeltaTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
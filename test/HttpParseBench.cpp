@@ -0,0 +1,160 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+/*
+ * Benchmark parsing HTTP request headers, with the native http::Request
+ * parser and with Poco::Net::HTTPRequest, including pipelined requests.
+ */
+
+#include <config.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Poco/MemoryStream.h>
+#include <Poco/Net/HTTPRequest.h>
+
+#include <Log.hpp>
+#include <net/HttpRequest.hpp>
+
+namespace
+{
+const std::string MinimalRequest = "GET / HTTP/1.1\r\n"
+                                   "Host: localhost:9980\r\n"
+                                   "\r\n";
+
+const std::string BrowserRequest =
+    "GET /browser/dist/cool.js HTTP/1.1\r\n"
+    "Host: localhost:9980\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+    "Accept: */*\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Referer: http://localhost:9980/browser/dist/cool.html?WOPISrc=http%3A%2F%2Flocalhost\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: jwt=eyJhbGciOiJIUzI1NiJ9.eyJzdWIiOiIxMjM0NTY3ODkwIn0.abcdef; lang=en\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "If-None-Match: \"5f3e1a2b\"\r\n"
+    "Priority: u=2\r\n"
+    "\r\n";
+
+const std::string UpgradeRequest =
+    "GET /cool/http%3A%2F%2Flocalhost%2Fwopi%2Ffiles%2F1/ws?WOPISrc=1&compat=/ws HTTP/1.1\r\n"
+    "Host: localhost:9980\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: websocket\r\n"
+    "Origin: http://localhost:9980\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n"
+    "\r\n";
+
+/// Returns the nanoseconds per request to parse all the requests in data.
+double timeNative(const std::string& data, std::size_t count, std::size_t iterations)
+{
+    std::size_t parsed = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        int64_t off = 0;
+        while (off < static_cast<int64_t>(data.size()))
+        {
+            http::Request request;
+            const int64_t read = request.readHeader(data.data() + off, data.size() - off);
+            if (read <= 0)
+                return -1;
+
+            off += read;
+            parsed += request.header().has("Host");
+        }
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (parsed != count * iterations)
+        return -1;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / parsed;
+}
+
+/// Returns the nanoseconds per request to parse all the requests in data.
+double timePoco(const std::string& data, std::size_t count, std::size_t iterations)
+{
+    std::size_t parsed = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        Poco::MemoryInputStream message(data.data(), data.size());
+        while (message.tellg() < static_cast<std::streamoff>(data.size()))
+        {
+            Poco::Net::HTTPRequest request;
+            try
+            {
+                request.read(message);
+            }
+            catch (const Poco::Exception&)
+            {
+                return -1;
+            }
+
+            parsed += request.has("Host");
+        }
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (parsed != count * iterations)
+        return -1;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / parsed;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 100000;
+
+    Log::initialize("HttpParseBench", "error", false, false,
+                    std::map<std::string, std::string>());
+
+    std::string pipelined;
+    for (int i = 0; i < 4; ++i)
+        pipelined += BrowserRequest + UpgradeRequest;
+
+    const std::vector<std::pair<std::string, std::pair<std::string, std::size_t>>> cases = {
+        { "minimal", { MinimalRequest, 1 } },
+        { "browser", { BrowserRequest, 1 } },
+        { "upgrade", { UpgradeRequest, 1 } },
+        { "pipelined x8", { pipelined, 8 } },
+    };
+
+    std::cout << "request\tnative ns/req\tpoco ns/req\n";
+    for (const auto& [name, test] : cases)
+    {
+        std::cout << name;
+        for (const double ns : { timeNative(test.first, test.second, iterations),
+                                 timePoco(test.first, test.second, iterations) })
+        {
+            std::cout << '\t';
+            if (ns < 0)
+                std::cout << "failed";
+            else
+                std::cout << ns;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -23,8 +23,11 @@
 
 #include <chrono>
 #include <condition_variable>
+#include <fstream>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <test/lokassert.hpp>
 
 #if ENABLE_SSL
@@ -66,6 +69,11 @@ class HttpRequestTests final : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testTimeout);
     CPPUNIT_TEST(testOnFinished_Complete);
     CPPUNIT_TEST(testOnFinished_Timeout);
+    CPPUNIT_TEST(testKtlsSend);
+    CPPUNIT_TEST(testSessionPoolReuse);
+    CPPUNIT_TEST(testSessionPoolMaxPerHost);
+    CPPUNIT_TEST(testSessionPoolIdleTimeout);
+    CPPUNIT_TEST(testSessionPoolRetry);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -82,6 +90,11 @@ class HttpRequestTests final : public CPPUNIT_NS::TestFixture
     void testTimeout();
     void testOnFinished_Complete();
     void testOnFinished_Timeout();
+    void testKtlsSend();
+    void testSessionPoolReuse();
+    void testSessionPoolMaxPerHost();
+    void testSessionPoolIdleTimeout();
+    void testSessionPoolRetry();
 
     static constexpr std::chrono::seconds DefTimeoutSeconds{ 5 };
 
@@ -92,6 +105,12 @@ class HttpRequestTests final : public CPPUNIT_NS::TestFixture
 
     static const int SimulatedLatencyMs = 0;
 
+#if ENABLE_SSL
+    /// The server socket of the last connection, to check how it sent.
+    static std::mutex LastSslSocketMutex;
+    static std::weak_ptr<SslStreamSocket> LastSslSocket;
+#endif
+
 public:
     HttpRequestTests()
         : _pollServerThread("HttpServerPoll")
@@ -130,8 +149,13 @@ public:
 #endif
 #if ENABLE_SSL
             if (helpers::haveSsl())
-                return StreamSocket::create<SslStreamSocket>(
+            {
+                auto socket = StreamSocket::create<SslStreamSocket>(
                     std::string(), fd, type, false, HostType::Other, std::make_shared<ServerRequestHandler>());
+                std::lock_guard<std::mutex> lock(LastSslSocketMutex);
+                LastSslSocket = socket;
+                return socket;
+            }
             else
                 return StreamSocket::create<StreamSocket>(std::string(), fd, type, false, HostType::Other,
                                                           std::make_shared<ServerRequestHandler>());
@@ -172,6 +196,36 @@ public:
         _pollServerThread.stop();
         _socket.reset();
     }
+
+    /// Gets a session to our server from the pool, for the given poll.
+    std::shared_ptr<http::Session> getPooled(http::SessionPool& pool, const SocketPoll& poll)
+    {
+        return pool.get("127.0.0.1",
+                        helpers::haveSsl() ? http::Session::Protocol::HttpSsl
+                                           : http::Session::Protocol::HttpUnencrypted,
+                        _port, poll);
+    }
+
+    /// Polls the given poll, which runs on our thread, until the condition holds, or times out.
+    template <typename T> static bool pollUntil(SocketPoll& poll, T condition)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + DefTimeoutSeconds;
+        while (!condition() && std::chrono::steady_clock::now() < deadline)
+            poll.poll(std::chrono::milliseconds(5));
+
+        return condition();
+    }
+
+    /// Makes an asynchronous request with the session, returning when it's finished.
+    static bool asyncRequest(const std::shared_ptr<http::Session>& session, const std::string& url,
+                             SocketPoll& poll)
+    {
+        session->setTimeout(DefTimeoutSeconds);
+        session->asyncRequest(http::Request(url), poll);
+        return pollUntil(poll, [&session] { return session->response()->done(); }) &&
+               session->response()->state() == http::Response::State::Complete &&
+               session->response()->statusLine().statusCode() == http::StatusCode::OK;
+    }
 };
 
 constexpr std::chrono::seconds HttpRequestTests::DefTimeoutSeconds;
@@ -721,6 +775,187 @@ void HttpRequestTests::testOnFinished_Timeout()
     LOK_ASSERT(httpResponse->state() == http::Response::State::Timeout);
 }
 
+#if ENABLE_SSL
+std::mutex HttpRequestTests::LastSslSocketMutex;
+std::weak_ptr<SslStreamSocket> HttpRequestTests::LastSslSocket;
+
+/// True if the kernel has its TLS module loaded, for OpenSSL to offload to.
+static bool haveKtls()
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    std::ifstream ulps("/proc/sys/net/ipv4/tcp_available_ulp");
+    std::string ulp;
+    while (ulps >> ulp)
+    {
+        if (ulp == "tls")
+            return true;
+    }
+#endif
+
+    return false;
+}
+#endif
+
+void HttpRequestTests::testKtlsSend()
+{
+    constexpr auto testname = __func__;
+
+#if ENABLE_SSL
+    if (!helpers::haveSsl())
+    {
+        TST_LOG("SSL is not available, skipping");
+        return;
+    }
+
+    // Many times the socket buffer, for the body to take many writes, and writev.
+    constexpr std::size_t Size = 4 * 1024 * 1024;
+    http::Request httpRequest("/large/" + std::to_string(Size));
+
+    auto httpSession = http::Session::create(_localUri);
+    httpSession->setTimeout(std::chrono::seconds(10));
+
+    const std::shared_ptr<const http::Response> httpResponse
+        = httpSession->syncRequest(httpRequest);
+    LOK_ASSERT(httpResponse->state() == http::Response::State::Complete);
+    LOK_ASSERT_EQUAL(http::StatusCode::OK, httpResponse->statusLine().statusCode());
+    LOK_ASSERT_EQUAL(Size, httpResponse->getBody().size());
+    LOK_ASSERT(ServerRequestHandler::largeBody(Size) == httpResponse->getBody());
+
+    // The server context enables kTLS, see test.cpp; without it, SSL_write sent the above.
+    std::shared_ptr<SslStreamSocket> socket;
+    {
+        std::lock_guard<std::mutex> lock(LastSslSocketMutex);
+        socket = LastSslSocket.lock();
+    }
+
+    LOK_ASSERT(socket);
+    if (haveKtls())
+        LOK_ASSERT_MESSAGE("Expected the kernel to encrypt what the server sent",
+                           socket->isKtlsSend());
+    else
+        TST_LOG("The kernel has no TLS offload, the server sent with SSL_write");
+#else
+    TST_LOG("SSL is unsupported in this build, skipping");
+#endif
+}
+
+void HttpRequestTests::testSessionPoolReuse()
+{
+    constexpr auto testname = __func__;
+
+    SocketPoll poll("SessionPoolPoll");
+    poll.runOnClientThread();
+    http::SessionPool pool(2, std::chrono::seconds(10));
+
+    const std::shared_ptr<http::Session> session = getPooled(pool, poll);
+    LOK_ASSERT(asyncRequest(session, "/", poll));
+    const int fd = session->getFD();
+    LOK_ASSERT(session->isIdle());
+
+    // The next request to the same host on the same poll reuses the connection.
+    LOK_ASSERT(getPooled(pool, poll) == session);
+    LOK_ASSERT(asyncRequest(session, "/echo/again", poll));
+    LOK_ASSERT_EQUAL(std::string("again"), session->response()->getBody());
+    LOK_ASSERT_EQUAL(fd, session->getFD());
+
+    // But not on another poll, where the socket isn't.
+    SocketPoll other("SessionPoolOther");
+    other.runOnClientThread();
+    LOK_ASSERT(getPooled(pool, other) != session);
+
+    // Nor once the server closed it, whether we saw that yet or not.
+    const std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    LOK_ASSERT(getPooled(pool, poll) == session);
+    LOK_ASSERT(asyncRequest(
+        session,
+        "/inject/" + Util::bytesToHexString(response.data(), response.size()),
+        poll));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // Without polling.
+    LOK_ASSERT(getPooled(pool, poll) != session);
+}
+
+void HttpRequestTests::testSessionPoolMaxPerHost()
+{
+    constexpr auto testname = __func__;
+
+    SocketPoll poll("SessionPoolPoll");
+    poll.runOnClientThread();
+    http::SessionPool pool(2, std::chrono::seconds(10));
+
+    // Three requests at once, of which only the first two connections are kept.
+    std::vector<std::shared_ptr<http::Session>> sessions;
+    for (int i = 0; i < 3; ++i)
+    {
+        sessions.push_back(getPooled(pool, poll));
+        sessions.back()->asyncRequest(http::Request("/"), poll);
+    }
+
+    LOK_ASSERT(sessions[0] != sessions[1] && sessions[1] != sessions[2] &&
+               sessions[0] != sessions[2]);
+    LOK_ASSERT(pollUntil(poll,
+                         [&sessions]
+                         {
+                             return sessions[0]->isIdle() && sessions[1]->isIdle() &&
+                                    sessions[2]->isIdle();
+                         }));
+
+    // Again, now reusing the two, and not the third.
+    std::vector<std::shared_ptr<http::Session>> reused;
+    for (int i = 0; i < 3; ++i)
+    {
+        reused.push_back(getPooled(pool, poll));
+        reused.back()->asyncRequest(http::Request("/"), poll);
+    }
+
+    LOK_ASSERT(reused[0] == sessions[0]);
+    LOK_ASSERT(reused[1] == sessions[1]);
+    LOK_ASSERT(reused[2] != sessions[2]);
+    LOK_ASSERT(pollUntil(poll,
+                         [&reused]
+                         {
+                             return reused[0]->response()->done() &&
+                                    reused[1]->response()->done() &&
+                                    reused[2]->response()->done();
+                         }));
+}
+
+void HttpRequestTests::testSessionPoolIdleTimeout()
+{
+    constexpr auto testname = __func__;
+
+    SocketPoll poll("SessionPoolPoll");
+    poll.runOnClientThread();
+    http::SessionPool pool(2, std::chrono::milliseconds(200));
+
+    const std::shared_ptr<http::Session> session = getPooled(pool, poll);
+    LOK_ASSERT(asyncRequest(session, "/", poll));
+    LOK_ASSERT(session->isConnected());
+
+    // Closed once idle for long enough, and so not reused.
+    const auto start = std::chrono::steady_clock::now();
+    LOK_ASSERT(pollUntil(poll, [&session] { return !session->isConnected(); }));
+    LOK_ASSERT(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(200));
+    LOK_ASSERT(getPooled(pool, poll) != session);
+}
+
+void HttpRequestTests::testSessionPoolRetry()
+{
+    constexpr auto testname = __func__;
+
+    SocketPoll poll("SessionPoolPoll");
+    poll.runOnClientThread();
+    http::SessionPool pool(2, std::chrono::seconds(10));
+
+    const std::shared_ptr<http::Session> session = getPooled(pool, poll);
+    LOK_ASSERT(asyncRequest(session, "/", poll));
+
+    // The server closes the reused connection, without responding, so we send it again.
+    LOK_ASSERT(getPooled(pool, poll) == session);
+    LOK_ASSERT(asyncRequest(session, "/drop", poll));
+    LOK_ASSERT_EQUAL(std::string("You have reached HttpTestServer /drop"),
+                     session->response()->getBody());
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(HttpRequestTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
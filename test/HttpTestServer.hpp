@@ -22,6 +22,21 @@
 /// Handles incoming connections and dispatches to the appropriate handler.
 class ServerRequestHandler final : public SimpleSocketHandler
 {
+public:
+    ServerRequestHandler()
+        : _requests(0)
+    {
+    }
+
+    /// The body that /large/<size> sends back: size bytes of the alphabet, over and over.
+    static std::string largeBody(std::size_t size)
+    {
+        std::string body(size, '\0');
+        for (std::size_t i = 0; i < size; ++i)
+            body[i] = 'a' + i % 26;
+        return body;
+    }
+
 private:
     /// Set the socket associated with this ResponseClient.
     void onConnect(const std::shared_ptr<StreamSocket>& socket) override
@@ -74,6 +89,7 @@ private:
 
         // Remove consumed data.
         data.eraseFirst(read);
+        ++_requests;
 
         const int fd = socket->getFD();
         LOG_TRC("HandleIncomingMessage: removed " << read << " bytes to have " << data.size()
@@ -112,10 +128,24 @@ private:
 
                 socket->send(response);
             }
+            else if (request.getUrl().starts_with("/large/"))
+            {
+                // /large/<size> sends back a body of size bytes, see largeBody().
+                const auto size = Util::i32FromString(request.getUrl().substr(sizeof("/large")));
+                http::Response response(http::StatusCode::OK, fd);
+                response.setBody(largeBody(size.first));
+                socket->send(response);
+            }
             else if (request.getUrl() == "/timeout")
             {
                 // Don't send anything back.
             }
+            else if (request.getUrl() == "/drop" && _requests > 1)
+            {
+                // Close a reused connection without responding, as if it
+                // had been idle for too long; new ones get a response.
+                socket->shutdown();
+            }
             else if (request.getUrl().starts_with("/inject"))
             {
                 // /inject/<hex data> sends back the data (in binary form)
@@ -192,6 +222,8 @@ private:
 private:
     // The socket that owns us (we can't own it).
     std::weak_ptr<StreamSocket> _socket;
+    /// The number of requests received on the connection.
+    std::size_t _requests;
 };
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -31,10 +31,13 @@ class HttpWhiteBoxTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testStatusLineSerialize);
 
     CPPUNIT_TEST(testHeader);
+    CPPUNIT_TEST(testHeaderParser);
 
     CPPUNIT_TEST(testRequestParserValidComplete);
     CPPUNIT_TEST(testRequestParserValidIncomplete);
+    CPPUNIT_TEST(testRequestParserPipelined);
     CPPUNIT_TEST(testClipboardIsOwnFormat);
+    CPPUNIT_TEST(testParseByteRange);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -43,9 +46,12 @@ class HttpWhiteBoxTests : public CPPUNIT_NS::TestFixture
     void testStatusLineParserValidIncomplete();
     void testStatusLineSerialize();
     void testHeader();
+    void testHeaderParser();
     void testRequestParserValidComplete();
     void testRequestParserValidIncomplete();
+    void testRequestParserPipelined();
     void testClipboardIsOwnFormat();
+    void testParseByteRange();
 };
 
 void HttpWhiteBoxTests::testStatusLineParserValidComplete()
@@ -159,6 +165,52 @@ void HttpWhiteBoxTests::testHeader()
     LOK_ASSERT_EQUAL(8L, header.parse(data.c_str(), data.size()));
 }
 
+void HttpWhiteBoxTests::testHeaderParser()
+{
+    constexpr auto testname = __func__;
+
+    const std::string data = "content-length: 42\r\n"
+                             "X-Custom:  folded \r\n"
+                             "\tvalue\r\n"
+                             "Transfer-Encoding: gzip, Chunked\r\n"
+                             "Cookie: a=1\r\n"
+                             "cookie: b=2\r\n"
+                             "\r\n";
+
+    http::Header header;
+
+    // Nothing is kept until the header is complete.
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        LOK_ASSERT_EQUAL_MESSAGE("i = " << i, 0L, header.parse(data.c_str(), i));
+        LOK_ASSERT(header.begin() == header.end());
+    }
+
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(data.size()), header.parse(data.c_str(), data.size()));
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(42), header.getContentLength());
+    LOK_ASSERT_EQUAL(std::string("folded value"), header.get("x-custom"));
+    LOK_ASSERT(header.getChunkedTransferEncoding());
+    LOK_ASSERT_EQUAL(std::string("a=1"), header.get("COOKIE"));
+
+    // The well-known fields are still found after removing others.
+    LOK_ASSERT(header.remove("Cookie"));
+    LOK_ASSERT_EQUAL(std::string("b=2"), header.get("Cookie"));
+    LOK_ASSERT(header.remove("Content-Length"));
+    LOK_ASSERT(!header.hasContentLength());
+    LOK_ASSERT_EQUAL(std::string("gzip, Chunked"), header.getTransferEncoding());
+    header.set("Host", "localhost");
+    LOK_ASSERT_EQUAL(std::string("localhost"), header.get("host"));
+
+    // Conflicting lengths are rejected.
+    const std::string conflicting = "Content-Length: 1\r\nContent-Length: 2\r\n\r\n";
+    http::Header invalid;
+    LOK_ASSERT_EQUAL(-1L, invalid.parse(conflicting.c_str(), conflicting.size()));
+    LOK_ASSERT(invalid.begin() == invalid.end());
+
+    const std::string longName = std::string(http::Header::MaxNameLen + 1, 'x') + ": y\r\n\r\n";
+    LOK_ASSERT_EQUAL(-1L, invalid.parse(longName.c_str(), longName.size()));
+}
+
 void HttpWhiteBoxTests::testRequestParserValidComplete()
 {
     constexpr auto testname = __func__;
@@ -226,6 +278,31 @@ void HttpWhiteBoxTests::testRequestParserValidIncomplete()
     LOK_ASSERT_EQUAL(expHost, req.header().get("Host"));
 }
 
+void HttpWhiteBoxTests::testRequestParserPipelined()
+{
+    constexpr auto testname = __func__;
+
+    const std::string first = "GET /first HTTP/1.1\r\nHost: localhost.com\r\n\r\n";
+    const std::string second = "POST /second HTTP/1.1\r\n\r\n";
+    const std::string data = first + second + "GET /third";
+
+    http::Request req;
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(first.size()), req.readHeader(data.c_str(), data.size()));
+    LOK_ASSERT_EQUAL(std::string("/first"), req.getUrl());
+    LOK_ASSERT_EQUAL(std::string("localhost.com"), req.header().get("Host"));
+
+    // The next request follows, whatever its method, and without fields.
+    http::Request next;
+    const std::string rest = data.substr(first.size());
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(second.size()), next.readHeader(rest.c_str(), rest.size()));
+    LOK_ASSERT_EQUAL(std::string("POST"), next.getVerb());
+    LOK_ASSERT_EQUAL(std::string("/second"), next.getUrl());
+
+    // The last one is incomplete, so nothing is consumed.
+    http::Request last;
+    LOK_ASSERT_EQUAL(0L, last.readHeader(rest.c_str() + second.size(), rest.size() - second.size()));
+}
+
 void HttpWhiteBoxTests::testClipboardIsOwnFormat()
 {
     constexpr auto testname = __func__;
@@ -249,6 +326,60 @@ PK)x";
     }
 }
 
+void HttpWhiteBoxTests::testParseByteRange()
+{
+    constexpr auto testname = __func__;
+
+    uint64_t start = 0;
+    uint64_t length = 0;
+
+    LOK_ASSERT_EQUAL(http::StatusCode::PartialContent,
+                     http::parseByteRange("bytes=0-99", 1000, start, length));
+    LOK_ASSERT_EQUAL(uint64_t(0), start);
+    LOK_ASSERT_EQUAL(uint64_t(100), length);
+
+    // Open ended.
+    LOK_ASSERT_EQUAL(http::StatusCode::PartialContent,
+                     http::parseByteRange("bytes=900-", 1000, start, length));
+    LOK_ASSERT_EQUAL(uint64_t(900), start);
+    LOK_ASSERT_EQUAL(uint64_t(100), length);
+
+    // The last position is clamped to the size.
+    LOK_ASSERT_EQUAL(http::StatusCode::PartialContent,
+                     http::parseByteRange("bytes=500-5000", 1000, start, length));
+    LOK_ASSERT_EQUAL(uint64_t(500), start);
+    LOK_ASSERT_EQUAL(uint64_t(500), length);
+
+    // Suffix.
+    LOK_ASSERT_EQUAL(http::StatusCode::PartialContent,
+                     http::parseByteRange("bytes=-10", 1000, start, length));
+    LOK_ASSERT_EQUAL(uint64_t(990), start);
+    LOK_ASSERT_EQUAL(uint64_t(10), length);
+
+    LOK_ASSERT_EQUAL(http::StatusCode::PartialContent,
+                     http::parseByteRange("bytes=-5000", 1000, start, length));
+    LOK_ASSERT_EQUAL(uint64_t(0), start);
+    LOK_ASSERT_EQUAL(uint64_t(1000), length);
+
+    // Past the end.
+    LOK_ASSERT_EQUAL(http::StatusCode::RangeNotSatisfiable,
+                     http::parseByteRange("bytes=1000-", 1000, start, length));
+    LOK_ASSERT_EQUAL(http::StatusCode::RangeNotSatisfiable,
+                     http::parseByteRange("bytes=-0", 1000, start, length));
+    LOK_ASSERT_EQUAL(http::StatusCode::RangeNotSatisfiable,
+                     http::parseByteRange("bytes=0-", 0, start, length));
+
+    // Ignored, the whole content is sent.
+    for (const char* range : { "", "items=0-1", "bytes=0-1,5-6", "bytes=5-1", "bytes=a-b",
+                               "bytes=-", "bytes=10" })
+    {
+        LOK_ASSERT_EQUAL_MESSAGE(range, http::StatusCode::OK,
+                                 http::parseByteRange(range, 1000, start, length));
+        LOK_ASSERT_EQUAL(uint64_t(0), start);
+        LOK_ASSERT_EQUAL(uint64_t(1000), length);
+    }
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(HttpWhiteBoxTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -38,6 +38,7 @@ class KitQueueTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testInvalidateViewCursorDeduplication);
     CPPUNIT_TEST(testCallbackModifiedStatusIsSkipped);
     CPPUNIT_TEST(testCallbackInvalidation);
+    CPPUNIT_TEST(testDamageSince);
     CPPUNIT_TEST(testCallbackIndicatorValue);
     CPPUNIT_TEST(testCallbackPageSize);
 
@@ -54,6 +55,7 @@ class KitQueueTests : public CPPUNIT_NS::TestFixture
     void testInvalidateViewCursorDeduplication();
     void testCallbackModifiedStatusIsSkipped();
     void testCallbackInvalidation();
+    void testDamageSince();
     void testCallbackIndicatorValue();
     void testCallbackPageSize();
 
@@ -530,6 +532,60 @@ void KitQueueTests::testCallbackInvalidation()
     LOK_ASSERT_EQUAL_STR("EMPTY, 0", item._payload);
 }
 
+void KitQueueTests::testDamageSince()
+{
+    constexpr auto testname = __func__;
+
+    KitQueue queue;
+    Util::Rectangle damage;
+    const Util::Rectangle tile(3840, 0, 3840, 3840);
+
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(0), queue.getDamageSeq());
+    LOK_ASSERT(queue.getDamageSince(0, 0, 0, tile, damage));
+    LOK_ASSERT(!damage.hasSurface());
+
+    // Clipped to the area, other parts and areas ignored.
+    putCallback(queue, "callback all 0 284, 1418, 11105, 275, 0");
+    putCallback(queue, "callback all 0 4299, 1418, 7090, 275, 1");
+    putCallback(queue, "callback all 0 284, 10418, 1000, 275, 0");
+    const uint64_t seq = queue.getDamageSeq();
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(3), seq);
+
+    LOK_ASSERT(queue.getDamageSince(0, 0, 0, tile, damage));
+    LOK_ASSERT_EQUAL(3840, damage.getLeft());
+    LOK_ASSERT_EQUAL(1418, damage.getTop());
+    LOK_ASSERT_EQUAL(7680, damage.getRight());
+    LOK_ASSERT_EQUAL(1693, damage.getBottom());
+
+    LOK_ASSERT(queue.getDamageSince(seq, 0, 0, tile, damage));
+    LOK_ASSERT(!damage.hasSurface());
+
+    // Extended by later damage.
+    putCallback(queue, "callback all 0 5000, 3000, 100, 100, 0");
+    LOK_ASSERT(queue.getDamageSince(queue.getDamageSeq(), 0, 0, tile, damage));
+    LOK_ASSERT(!damage.hasSurface());
+    LOK_ASSERT(queue.getDamageSince(0, 0, 0, tile, damage));
+    LOK_ASSERT_EQUAL(3840, damage.getLeft());
+    LOK_ASSERT_EQUAL(1418, damage.getTop());
+    LOK_ASSERT_EQUAL(7680, damage.getRight());
+    LOK_ASSERT_EQUAL(3100, damage.getBottom());
+    LOK_ASSERT(queue.getDamageSince(seq, 0, 0, tile, damage));
+    LOK_ASSERT_EQUAL(5000, damage.getLeft());
+    LOK_ASSERT_EQUAL(3000, damage.getTop());
+
+    // Everything, for any part.
+    putCallback(queue, "callback all 0 EMPTY, 2");
+    LOK_ASSERT(queue.getDamageSince(queue.getDamageSeq() - 1, 1, 0, tile, damage));
+    LOK_ASSERT_EQUAL(tile.getLeft(), damage.getLeft());
+    LOK_ASSERT_EQUAL(tile.getBottom(), damage.getBottom());
+
+    // Unknown once forgotten.
+    for (int i = 0; i < 1000; ++i)
+        putCallback(queue, "callback all 0 0, 0, 10, 10, 0");
+    LOK_ASSERT(!queue.getDamageSince(seq, 0, 0, tile, damage));
+    LOK_ASSERT(queue.getDamageSince(queue.getDamageSeq(), 0, 0, tile, damage));
+}
+
 void KitQueueTests::testCallbackIndicatorValue()
 {
     constexpr auto testname = __func__;
@@ -0,0 +1,352 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <net/ServerSocket.hpp>
+#include <net/Socket.hpp>
+
+#include <test/lokassert.hpp>
+#include <test/testlog.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/// SocketPoll unit-tests, of its io_uring receives and accepts, which
+/// only happen when it is available, and so are skipped otherwise.
+class SocketPollTests : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SocketPollTests);
+
+    CPPUNIT_TEST(testIoUringAccept);
+    CPPUNIT_TEST(testIoUringReceiveLarge);
+    CPPUNIT_TEST(testIoUringOutOfBuffers);
+    CPPUNIT_TEST(testIoUringHandOver);
+    CPPUNIT_TEST(testIoUringDisconnect);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void testIoUringAccept();
+    void testIoUringReceiveLarge();
+    void testIoUringOutOfBuffers();
+    void testIoUringHandOver();
+    void testIoUringDisconnect();
+
+    /// Collects all that its socket receives.
+    class SinkHandler final : public SimpleSocketHandler
+    {
+    public:
+        SinkHandler()
+            : _disconnected(false)
+        {
+        }
+
+        const std::string& data() const { return _data; }
+        bool isDisconnected() const { return _disconnected; }
+
+    private:
+        void onConnect(const std::shared_ptr<StreamSocket>& socket) override { _socket = socket; }
+
+        void handleIncomingMessage(SocketDisposition&) override
+        {
+            std::shared_ptr<StreamSocket> socket = _socket.lock();
+            _data.append(socket->getInBuffer().data(), socket->getInBuffer().size());
+            socket->getInBuffer().clear();
+        }
+
+        int getPollEvents(std::chrono::steady_clock::time_point, int64_t&) override
+        {
+            return POLLIN;
+        }
+
+        void performWrites(std::size_t) override {}
+
+        void onDisconnect() override { _disconnected = true; }
+
+        std::weak_ptr<StreamSocket> _socket;
+        std::string _data;
+        bool _disconnected;
+    };
+
+    /// Keeps the handlers and sockets of the accepted connections, in order.
+    class SinkFactory final : public SocketFactory
+    {
+    public:
+        std::vector<std::shared_ptr<SinkHandler>> _handlers;
+        std::vector<std::shared_ptr<StreamSocket>> _sockets;
+
+    private:
+        std::shared_ptr<Socket> create(const int fd, Socket::Type type) override
+        {
+            auto handler = std::make_shared<SinkHandler>();
+            auto socket = StreamSocket::create<StreamSocket>(std::string(), fd, type, false,
+                                                             HostType::Other, handler);
+            _handlers.push_back(handler);
+            _sockets.push_back(socket);
+            return socket;
+        }
+    };
+
+    std::unique_ptr<SocketPoll> _poll;
+    std::shared_ptr<SinkFactory> _factory;
+    std::shared_ptr<ServerSocket> _server;
+    std::vector<int> _clients;
+    int _port;
+
+public:
+    SocketPollTests()
+        : _port(0)
+    {
+    }
+
+    void setUp()
+    {
+        constexpr auto testname = "SocketPollTests::setUp";
+
+        // Polled by the test itself, so always in the same order.
+        _poll = std::make_unique<SocketPoll>("SocketPollTests");
+        _poll->runOnClientThread();
+        if (!_poll->enableIoUring())
+        {
+            _poll.reset();
+            return;
+        }
+
+        _factory = std::make_shared<SinkFactory>();
+        _port = 9890;
+        for (int i = 0; i < 40; ++i, ++_port)
+        {
+            _server = ServerSocket::create(ServerSocket::Type::Local, _port, Socket::Type::IPv4,
+                                           *_poll, _factory);
+            if (_server)
+                break;
+        }
+
+        LOK_ASSERT_MESSAGE("Failed to listen", _server != nullptr);
+        _poll->insertNewSocket(_server);
+    }
+
+    void tearDown()
+    {
+        for (const int fd : _clients)
+            ::close(fd);
+        _clients.clear();
+
+        if (_poll)
+            _poll->removeSockets();
+        _server.reset();
+        _factory.reset();
+        _poll.reset();
+    }
+
+    /// Connects to our server, returning the client's end.
+    int connect()
+    {
+        constexpr auto testname = __func__;
+        const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        LOK_ASSERT(fd >= 0);
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(_port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        LOK_ASSERT_EQUAL(0, ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+
+        _clients.push_back(fd);
+        return fd;
+    }
+
+    static void write(int fd, const std::string& data)
+    {
+        constexpr auto testname = __func__;
+        for (std::size_t offset = 0; offset < data.size();)
+        {
+            const ssize_t wrote = ::write(fd, data.data() + offset, data.size() - offset);
+            LOK_ASSERT(wrote > 0);
+            offset += wrote;
+        }
+    }
+
+    /// Polls the given polls until the condition holds, for up to 10 seconds.
+    template <typename T>
+    static bool pollUntil(const std::vector<SocketPoll*>& polls, T condition)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!condition() && std::chrono::steady_clock::now() < deadline)
+        {
+            for (SocketPoll* poll : polls)
+                poll->poll(std::chrono::milliseconds(polls.size() > 1 ? 0 : 5));
+        }
+
+        return condition();
+    }
+
+    template <typename T> bool pollUntil(T condition) { return pollUntil({ _poll.get() }, condition); }
+};
+
+void SocketPollTests::testIoUringAccept()
+{
+    constexpr auto testname = __func__;
+    if (!_poll)
+    {
+        TST_LOG("io_uring is not available, skipping");
+        return;
+    }
+
+    write(connect(), "hello");
+    LOK_ASSERT(pollUntil([this]
+                         { return _factory->_handlers.size() == 1 &&
+                                  _factory->_handlers[0]->data() == "hello"; }));
+    LOK_ASSERT_EQUAL(std::string("127.0.0.1"), _factory->_sockets[0]->clientAddress());
+}
+
+void SocketPollTests::testIoUringReceiveLarge()
+{
+    constexpr auto testname = __func__;
+    if (!_poll)
+    {
+        TST_LOG("io_uring is not available, skipping");
+        return;
+    }
+
+    // Many times the size of the buffers that io_uring receives into.
+    std::string data;
+    for (int i = 0; i < 3 * 1024 * 1024; ++i)
+        data.push_back('a' + i % 26);
+
+    const int fd = connect();
+    std::thread writer([fd, &data] { write(fd, data); });
+    const bool received = pollUntil(
+        [this, &data]
+        {
+            return _factory->_handlers.size() == 1 &&
+                   _factory->_handlers[0]->data().size() == data.size();
+        });
+    writer.join();
+
+    LOK_ASSERT(received);
+    LOK_ASSERT(_factory->_handlers[0]->data() == data);
+}
+
+void SocketPollTests::testIoUringOutOfBuffers()
+{
+    constexpr auto testname = __func__;
+    if (!_poll)
+    {
+        TST_LOG("io_uring is not available, skipping");
+        return;
+    }
+
+    // More than all the buffers at once, so some receives find none and poll instead.
+    constexpr int Count = 100;
+    for (int i = 0; i < Count; ++i)
+    {
+        connect();
+        _poll->poll(std::chrono::milliseconds(0)); // Accept as we go, for the backlog.
+    }
+
+    LOK_ASSERT(pollUntil([this] { return _factory->_handlers.size() == Count; }));
+
+    std::string data(20 * 1024, 'z');
+    for (int i = 0; i < Count; ++i)
+    {
+        data[0] = 'A' + i % 26;
+        write(_clients[i], data);
+    }
+
+    LOK_ASSERT(pollUntil(
+        [this, &data]
+        {
+            for (const auto& handler : _factory->_handlers)
+            {
+                if (handler->data().size() != data.size())
+                    return false;
+            }
+
+            return true;
+        }));
+
+    for (int i = 0; i < Count; ++i)
+    {
+        data[0] = 'A' + i % 26;
+        LOK_ASSERT_MESSAGE("Unexpected data of connection #" + std::to_string(i),
+                           _factory->_handlers[i]->data() == data);
+    }
+}
+
+void SocketPollTests::testIoUringHandOver()
+{
+    constexpr auto testname = __func__;
+    if (!_poll)
+    {
+        TST_LOG("io_uring is not available, skipping");
+        return;
+    }
+
+    SocketPoll other("SocketPollTestsOther");
+    other.runOnClientThread();
+    LOK_ASSERT(other.enableIoUring());
+
+    const int fd = connect();
+    LOK_ASSERT(pollUntil([this] { return _factory->_handlers.size() == 1; }));
+    const std::shared_ptr<StreamSocket> socket = _factory->_sockets[0];
+    const std::shared_ptr<SinkHandler> handler = _factory->_handlers[0];
+
+    // With the receive pending, the socket leaves, and it takes what comes meanwhile.
+    _poll->poll(std::chrono::milliseconds(0)); // Inserts the socket.
+    _poll->poll(std::chrono::milliseconds(0)); // Queues its receive.
+    write(fd, "first");
+    _poll->removeSocket(socket);
+    write(fd, "second");
+    other.insertNewSocket(socket);
+
+    // Which the other poll must not read past, until it is handed over.
+    for (int i = 0; i < 5; ++i)
+        other.poll(std::chrono::milliseconds(0));
+    LOK_ASSERT_EQUAL(std::string(), handler->data());
+
+    LOK_ASSERT(pollUntil({ _poll.get(), &other },
+                         [&handler] { return handler->data().size() >= 11; }));
+    LOK_ASSERT_EQUAL(std::string("firstsecond"), handler->data());
+
+    other.removeSockets();
+}
+
+void SocketPollTests::testIoUringDisconnect()
+{
+    constexpr auto testname = __func__;
+    if (!_poll)
+    {
+        TST_LOG("io_uring is not available, skipping");
+        return;
+    }
+
+    const int fd = connect();
+    LOK_ASSERT(pollUntil([this] { return _factory->_handlers.size() == 1; }));
+
+    ::close(fd);
+    _clients.clear();
+    LOK_ASSERT(pollUntil([this] { return _factory->_handlers[0]->isDisconnected(); }));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SocketPollTests);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
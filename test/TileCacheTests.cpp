@@ -26,9 +26,11 @@
 #include <random>
 
 #include <Common.hpp>
+#include <FileUtil.hpp>
 #include <Protocol.hpp>
 #include <Png.hpp>
 #include <TileCache.hpp>
+#include <wsd/ClientSession.hpp>
 #include <kit/Delta.hpp>
 #include <Unit.hpp>
 #include <Util.hpp>
@@ -71,6 +73,11 @@ class TileCacheTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testSimpleCombine);
     CPPUNIT_TEST(testTileSubscription);
     CPPUNIT_TEST(testSize);
+    CPPUNIT_TEST(testInvalidateScaling);
+    CPPUNIT_TEST(testPersistentCache);
+    CPPUNIT_TEST(testEvictionPolicy);
+    CPPUNIT_TEST(testTileBroadcast);
+    CPPUNIT_TEST(testTileCombineOnFly);
     CPPUNIT_TEST(testDisconnectMultiView);
     CPPUNIT_TEST(testUnresponsiveClient);
     CPPUNIT_TEST(testImpressTiles);
@@ -109,6 +116,11 @@ class TileCacheTests : public CPPUNIT_NS::TestFixture
     void testSimpleCombine();
     void testTileSubscription();
     void testSize();
+    void testInvalidateScaling();
+    void testPersistentCache();
+    void testEvictionPolicy();
+    void testTileBroadcast();
+    void testTileCombineOnFly();
     void testDisconnectMultiView();
     void testUnresponsiveClient();
     void testImpressTiles();
@@ -251,7 +263,8 @@ void TileCacheTests::testSimple()
     // Find Tile
     tileData = tc.lookupTile(tile);
     LOK_ASSERT_MESSAGE("tile not found when expected", tileData && tileData->isValid());
-    const BlobData &keyframe = tileData->data();
+    LOK_ASSERT_EQUAL(std::size_t(1), tileData->_blobs.size());
+    const BlobData &keyframe = *tileData->_blobs[0];
     LOK_ASSERT_MESSAGE("cached tile corrupted", keyframe.size() == data.size() - 1 /* dropped Z */);
     for (size_t i = 0; i < data.size() - 1; ++i)
         LOK_ASSERT_MESSAGE("cached tile data", data[i+1] == keyframe[i]);
@@ -445,6 +458,380 @@ void TileCacheTests::testSize()
     LOK_ASSERT_MESSAGE("tile cache too big", tc.getMemorySize() < maxSize);
 }
 
+void TileCacheTests::testInvalidateScaling()
+{
+    constexpr auto testname = __func__;
+
+    const int nviewid = 0;
+    const int mode = 0;
+    const int tileSize = 3840;
+    const int columns = 50;
+    std::vector<char> data = genRandomData(64);
+    data[0] = 'Z'; // compressed pixels.
+
+    // Time small-area invalidations, as when typing in a cell, against
+    // caches of growing size; the cost should not grow with the cache.
+    size_t firstVisits = 0;
+    for (const int rows : { 20, 200, 800 })
+    {
+        TileCache tc("doc.ods", std::chrono::system_clock::time_point());
+        tc.setMaxCacheSize(1024 * 1024 * 1024);
+
+        TileWireId id = 0;
+        for (int part = 0; part < 2; ++part)
+        {
+            for (int row = 0; row < rows; ++row)
+            {
+                for (int col = 0; col < columns; ++col)
+                {
+                    TileDesc tile(nviewid, part, mode, 256, 256, col * tileSize, row * tileSize,
+                                  tileSize, tileSize, -1, 0, -1);
+                    tile.setWireId(++id);
+                    tc.saveTileAndNotify(tile, data.data(), data.size());
+                }
+            }
+        }
+
+        constexpr int iterations = 1000;
+        const size_t visitsBefore = tc._invalidationVisits;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            const int x = (i % columns) * tileSize + 100;
+            const int y = (i % rows) * tileSize + 100;
+            tc.invalidateTiles("invalidatetiles: part=1 mode=0 x=" + std::to_string(x) +
+                                   " y=" + std::to_string(y) + " width=200 height=200 wid=" +
+                                   std::to_string(i),
+                               nviewid);
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+
+        const size_t visits = tc._invalidationVisits - visitsBefore;
+        TST_LOG("Invalidation of " << iterations << " small areas with " << 2 * rows * columns
+                                   << " cached tiles took " << elapsed.count() << "us, visiting "
+                                   << visits << " tiles");
+
+        // Each area is within a single bucket of the grid, of 4x4 tiles.
+        LOK_ASSERT_MESSAGE("invalidation visited too many tiles", visits <= iterations * 16);
+        if (firstVisits == 0)
+            firstVisits = visits;
+        LOK_ASSERT_MESSAGE("invalidation cost grows with the cache", visits <= firstVisits * 2);
+
+        // Only the tile under the last invalidated area is affected.
+        const int lastCol = (iterations - 1) % columns;
+        const int lastRow = (iterations - 1) % rows;
+        TileDesc hit(nviewid, 1, mode, 256, 256, lastCol * tileSize, lastRow * tileSize, tileSize,
+                     tileSize, -1, 0, -1);
+        Tile tileData = tc.lookupTile(hit);
+        LOK_ASSERT_MESSAGE("invalidated tile still valid", tileData && !tileData->isValid());
+
+        TileDesc otherPart(nviewid, 0, mode, 256, 256, lastCol * tileSize, lastRow * tileSize,
+                           tileSize, tileSize, -1, 0, -1);
+        tileData = tc.lookupTile(otherPart);
+        LOK_ASSERT_MESSAGE("tile of another part invalidated", tileData && tileData->isValid());
+
+        // Whole document invalidation still reaches every part.
+        tc.invalidateTiles("invalidatetiles: EMPTY", nviewid);
+        tileData = tc.lookupTile(otherPart);
+        LOK_ASSERT_MESSAGE("tile not invalidated by EMPTY", tileData && !tileData->isValid());
+    }
+}
+
+void TileCacheTests::testPersistentCache()
+{
+    constexpr auto testname = __func__;
+
+    const std::string path = FileUtil::createRandomTmpDir();
+    TileCache::initPersistentCache(path, 1024 * 1024, 16 * 1024 * 1024);
+
+    const int mode = 0;
+    const int tileSize = 3840;
+    std::vector<char> data = genRandomData(4096);
+    data[0] = 'Z'; // compressed pixels.
+
+    const auto tileAt = [&](int nviewid, int col)
+    {
+        return TileDesc(nviewid, 0, mode, 256, 256, col * tileSize, 0, tileSize, tileSize, -1, 0,
+                        -1);
+    };
+
+    {
+        TileCache tc("doc.ods", std::chrono::system_clock::time_point());
+        tc.openPersistentCache("version1");
+        tc.setViewRenderState(1000, "Empty");
+        tc.setViewRenderState(1001, std::string()); // Eg. with a watermark.
+        for (int col = 0; col < 3; ++col)
+        {
+            TileDesc tile = tileAt(1000, col);
+            tile.setWireId(10 + col);
+            tc.saveTileAndNotify(tile, data.data(), data.size());
+
+            TileDesc watermarked = tileAt(1001, col + 3);
+            watermarked.setWireId(20 + col);
+            tc.saveTileAndNotify(watermarked, data.data(), data.size());
+        }
+
+        tc.invalidateTiles("invalidatetiles: part=0 mode=0 x=" + std::to_string(tileSize + 100) +
+                               " y=100 width=200 height=200 wid=30",
+                           1000);
+
+        // Closing the document keeps the valid tiles.
+        tc.clear();
+    }
+
+    const uint64_t hits = TileCache::PersistentHits;
+    {
+        // Another kit may have other view ids for the same rendering state.
+        TileCache tc("doc.ods", std::chrono::system_clock::time_point());
+        tc.openPersistentCache("version1");
+        tc.setViewRenderState(1002, "Empty");
+
+        Tile tileData = tc.lookupTile(tileAt(1002, 0));
+        LOK_ASSERT_MESSAGE("persisted tile not found", tileData && tileData->isValid());
+        LOK_ASSERT_EQUAL(RestoredTileWireId, tileData->_wids[0]);
+        std::vector<char> restored;
+        tileData->appendChangesSince(restored, 0);
+        LOK_ASSERT_MESSAGE("persisted tile differs",
+                           restored == std::vector<char>(data.begin() + 1, data.end()));
+        LOK_ASSERT_EQUAL(hits + 1, TileCache::PersistentHits.load());
+
+        LOK_ASSERT_MESSAGE("invalidated tile persisted", !tc.lookupTile(tileAt(1002, 1)));
+        LOK_ASSERT_MESSAGE("persisted tile not found", tc.lookupTile(tileAt(1002, 2)));
+        LOK_ASSERT_MESSAGE("watermarked tile persisted", !tc.lookupTile(tileAt(1002, 3)));
+
+        // Now in memory.
+        LOK_ASSERT_EQUAL(tileData, tc.lookupTile(tileAt(1002, 0)));
+        LOK_ASSERT_EQUAL(hits + 2, TileCache::PersistentHits.load());
+
+        // Invalidations are persisted too.
+        tc.invalidateTiles("invalidatetiles: part=0 mode=0 x=" +
+                               std::to_string(2 * tileSize + 100) +
+                               " y=100 width=200 height=200 wid=30",
+                           1002);
+    }
+
+    {
+        TileCache tc("doc.ods", std::chrono::system_clock::time_point());
+        tc.openPersistentCache("version1");
+        tc.setViewRenderState(1000, "Empty");
+        LOK_ASSERT_MESSAGE("persisted tile not found", tc.lookupTile(tileAt(1000, 0)));
+        LOK_ASSERT_MESSAGE("invalidated tile persisted", !tc.lookupTile(tileAt(1000, 2)));
+    }
+
+    {
+        // Once modified in storage, the tiles are of no use.
+        TileCache tc("doc.ods", std::chrono::system_clock::time_point());
+        tc.openPersistentCache("version2");
+        tc.setViewRenderState(1000, "Empty");
+        LOK_ASSERT_MESSAGE("tile of another version found", !tc.lookupTile(tileAt(1000, 0)));
+    }
+
+    TileCache::initPersistentCache(std::string(), 0, 0);
+    FileUtil::removeFile(path, true);
+}
+
+void TileCacheTests::testEvictionPolicy()
+{
+    constexpr auto testname = __func__;
+
+    TileCache tc("doc.ods", std::chrono::system_clock::time_point());
+
+    const int tileSize = 3840;
+    std::vector<char> data = genRandomData(4096);
+    data[0] = 'Z'; // compressed pixels.
+
+    const auto tileAt = [&](int row)
+    {
+        return TileDesc(0, 0, 0, 256, 256, 0, row * tileSize, tileSize, tileSize, -1, 0, -1);
+    };
+
+    // Only the first row is on screen.
+    tc.setVisibilityCheck([](const TileDesc& desc) { return desc.getTilePosY() == 0; });
+    tc.setMaxCacheSize((data.size() + sizeof(TileDesc)) * 10);
+
+    TileWireId id = 0;
+    for (int row = 0; row < 100; ++row)
+    {
+        TileDesc tile = tileAt(row);
+        tile.setWireId(++id);
+        tc.saveTileAndNotify(tile, data.data(), data.size());
+
+        // Keep using the second row.
+        LOK_ASSERT_MESSAGE("tile in use evicted", row < 1 || tc.lookupTile(tileAt(1)));
+    }
+
+    LOK_ASSERT_MESSAGE("visible tile evicted", tc.lookupTile(tileAt(0)));
+    LOK_ASSERT_MESSAGE("unused tile kept", !tc.lookupTile(tileAt(2)));
+    LOK_ASSERT_MESSAGE("last tile evicted", tc.lookupTile(tileAt(99)));
+}
+
+namespace
+{
+/// Exposes how WebSocket frames are built.
+class FrameBuilder : public WebSocketHandler
+{
+public:
+    FrameBuilder()
+        : WebSocketHandler(/*isClient=*/false, /*isMasking=*/false)
+    {
+    }
+
+    using WebSocketHandler::buildFrame;
+};
+
+std::string flatten(const Buffer& buffer, std::vector<iovec>& iov)
+{
+    iov.resize(16);
+    iov.resize(buffer.getIOVec(iov.data(), static_cast<int>(iov.size()), buffer.size()));
+    std::string bytes;
+    for (const iovec& block : iov)
+        bytes.append(static_cast<const char*>(block.iov_base), block.iov_len);
+    return bytes;
+}
+} // namespace
+
+void TileCacheTests::testTileBroadcast()
+{
+    constexpr auto testname = __func__;
+
+    std::vector<char> keyframe = genRandomData(8192);
+    keyframe[0] = 'Z'; // compressed pixels.
+    std::vector<char> delta = genRandomData(64);
+    delta[0] = 'D';
+
+    TileDesc desc(0, 0, 0, 256, 256, 0, 0, 3840, 3840, -1, 0, -1);
+    desc.setWireId(11);
+    Tile tile = std::make_shared<TileData>(10, keyframe.data(), keyframe.size());
+    tile->appendBlob(11, delta.data(), delta.size());
+
+    // Recipients that got nothing yet, or the keyframe only.
+    const std::vector<TileWireId> lastSentIds = { 0, 10, 0, 10, 0 };
+    const std::vector<std::shared_ptr<Message>> messages =
+        ClientSession::getTileMessages(desc, tile, lastSentIds);
+
+    LOK_ASSERT_EQUAL(lastSentIds.size(), messages.size());
+    LOK_ASSERT(messages[0] == messages[2] && messages[0] == messages[4]);
+    LOK_ASSERT(messages[1] == messages[3]);
+    LOK_ASSERT(messages[0] != messages[1]);
+
+    LOK_ASSERT(messages[0]->firstTokenMatches("tile:"));
+    LOK_ASSERT_EQUAL(std::size_t(2), messages[0]->blobs().size());
+    LOK_ASSERT(messages[0]->blobs()[0] == tile->_blobs[0]);
+    LOK_ASSERT(messages[1]->firstTokenMatches("delta:"));
+    LOK_ASSERT_EQUAL(std::size_t(1), messages[1]->blobs().size());
+    LOK_ASSERT(messages[1]->blobs()[0] == tile->_blobs[1]);
+
+    // The recipients of a message share its frame header, and the blobs are referenced.
+    Message& message = *messages[0];
+    std::string payload(message.data().begin(), message.data().end());
+    for (const Blob& blob : message.blobs())
+        payload.append(blob->data(), blob->size());
+
+    std::string expected;
+    expected += static_cast<char>(0x80 | static_cast<unsigned char>(WSOpCode::Binary));
+    expected += static_cast<char>(126);
+    expected += static_cast<char>(payload.size() >> 8);
+    expected += static_cast<char>(payload.size() & 0xff);
+    expected += payload;
+
+    FrameBuilder first;
+    FrameBuilder second;
+    const unsigned char flags = static_cast<unsigned char>(WSOpCode::Binary);
+    for (FrameBuilder* builder : { &first, &second })
+    {
+        Buffer out;
+        builder->buildFrame(message.data().data(), message.data().size(), message.blobs(), flags,
+                            out, &message.frame());
+        LOK_ASSERT(message.frame());
+        LOK_ASSERT_EQUAL(4 + message.data().size(), message.frame()->size());
+
+        std::vector<iovec> iov;
+        LOK_ASSERT_EQUAL(expected, flatten(out, iov));
+        LOK_ASSERT(std::any_of(iov.begin(), iov.end(),
+                               [&](const iovec& block)
+                               { return block.iov_base == message.blobs()[0]->data(); }));
+    }
+}
+
+void TileCacheTests::testTileCombineOnFly()
+{
+    constexpr auto testname = __func__;
+
+    std::vector<char> keyframe = genRandomData(8192);
+    keyframe[0] = 'Z';
+    std::vector<char> delta = genRandomData(64);
+    delta[0] = 'D';
+
+    TileDesc first(0, 0, 0, 256, 256, 0, 0, 3840, 3840, -1, 0, -1);
+    first.setWireId(11);
+    Tile firstTile = std::make_shared<TileData>(10, keyframe.data(), keyframe.size());
+    firstTile->appendBlob(11, delta.data(), delta.size());
+
+    TileDesc second(0, 0, 0, 256, 256, 3840, 0, 3840, 3840, -1, 0, -1);
+    second.setWireId(20);
+    Tile secondTile = std::make_shared<TileData>(20, keyframe.data(), keyframe.size());
+
+    // The client has the keyframe of the first tile only.
+    const std::vector<std::pair<TileDesc, Tile>> tiles = { { first, firstTile },
+                                                           { second, secondTile } };
+    const std::shared_ptr<Message> message =
+        ClientSession::getTileCombineMessage(tiles, { 10, 0 });
+    LOK_ASSERT(message->firstTokenMatches("tilecombine:"));
+
+    // Split it as the client does: the sizes give where each tile message starts.
+    std::string sizes;
+    LOK_ASSERT(COOLProtocol::getTokenString(message->tokens(), "sizes", sizes));
+    const StringVector tokens = StringVector::tokenize(sizes, ',');
+    LOK_ASSERT_EQUAL(tiles.size(), tokens.size());
+
+    const std::string header(message->data().begin(), message->data().end());
+    LOK_ASSERT_EQUAL(message->firstLine() + '\n', header);
+    std::string payload;
+    for (const Blob& blob : message->blobs())
+        payload.append(blob->data(), blob->size());
+
+    const std::vector<std::string> expected = {
+        first.serialize("delta:", "\n") + std::string(delta.begin(), delta.end()),
+        second.serialize("tile:", "\n") + std::string(keyframe.begin(), keyframe.end())
+    };
+
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        const std::size_t size = std::stoul(tokens[i]);
+        LOK_ASSERT(offset + size <= payload.size());
+        LOK_ASSERT_EQUAL(expected[i], payload.substr(offset, size));
+        offset += size;
+    }
+
+    LOK_ASSERT_EQUAL(payload.size(), offset);
+
+    // The tile data is referenced, not copied.
+    LOK_ASSERT(std::find(message->blobs().begin(), message->blobs().end(),
+                         firstTile->_blobs[1]) != message->blobs().end());
+    LOK_ASSERT(std::find(message->blobs().begin(), message->blobs().end(),
+                         secondTile->_blobs[0]) != message->blobs().end());
+
+    // Every combined tile is on fly once queued, as when sent alone.
+    const std::vector<TileDesc> onFly = ClientSession::getTilesInMessage(*message);
+    LOK_ASSERT_EQUAL(tiles.size(), onFly.size());
+    for (std::size_t i = 0; i < tiles.size(); ++i)
+    {
+        LOK_ASSERT(tiles[i].first == onFly[i]);
+        LOK_ASSERT_EQUAL(tiles[i].first.getWireId(), onFly[i].getWireId());
+    }
+
+    const std::vector<std::shared_ptr<Message>> single =
+        ClientSession::getTileMessages(first, firstTile, { 0 });
+    const std::vector<TileDesc> singleOnFly = ClientSession::getTilesInMessage(*single[0]);
+    LOK_ASSERT_EQUAL(std::size_t(1), singleOnFly.size());
+    LOK_ASSERT_EQUAL(first.getWireId(), singleOnFly[0].getWireId());
+
+    Message text("invalidatecursor: {}", Message::Dir::Out);
+    LOK_ASSERT(ClientSession::getTilesInMessage(text).empty());
+}
+
 
 void TileCacheTests::testDisconnectMultiView()
 {
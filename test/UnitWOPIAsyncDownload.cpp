@@ -0,0 +1,321 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include "lokassert.hpp"
+#include "Unit.hpp"
+#include <WopiTestServer.hpp>
+#include <Log.hpp>
+#include <helpers.hpp>
+#include <net/HttpRequest.hpp>
+#include <wsd/COOLWSD.hpp>
+
+#include <Poco/Net/HTTPRequest.h>
+
+#include <memory>
+#include <string>
+
+/// Test that a slow GetFile doesn't hold up the clients of the document.
+/// We send half of the document and wait for the progress, then send
+/// commands, which must reach the kit only once the rest is downloaded,
+/// after the load and in the order they were sent.
+class UnitWOPIAsyncDownloadSlow : public WopiTestServer
+{
+    STATE_ENUM(Phase, Load, WaitProgress, Queue, WaitQueued, WaitKitLoad, WaitKitStatus,
+               WaitKitStatusUpdate, WaitLoaded, Done)
+    _phase;
+
+    /// The connection of the GetFile request, with the rest of the document to send.
+    std::shared_ptr<StreamSocket> _getFileSocket;
+    std::string _rest;
+
+public:
+    UnitWOPIAsyncDownloadSlow()
+        : WopiTestServer("UnitWOPIAsyncDownloadSlow")
+        , _phase(Phase::Load)
+    {
+    }
+
+    bool handleGetFileRequest(const Poco::Net::HTTPRequest& request,
+                              std::shared_ptr<StreamSocket>& socket) override
+    {
+        LOG_TST("GetFile request for [" << Poco::URI(request.getURI()).getPath() << "] in "
+                                        << name(_phase) << ", sending half of it");
+        LOK_ASSERT_STATE(_phase, Phase::WaitProgress);
+
+        const std::string& content = getFileContent();
+        const std::size_t half = content.size() / 2;
+
+        http::Response httpResponse(http::StatusCode::OK);
+        httpResponse.set("Last-Modified", Util::getHttpTime(getFileLastModifiedTime()));
+        httpResponse.setBody(content.substr(0, half), "application/octet-stream");
+        httpResponse.setContentLength(content.size());
+        socket->send(httpResponse);
+
+        _getFileSocket = socket;
+        _rest = content.substr(half);
+        return true;
+    }
+
+    bool onFilterSendWebSocketMessage(const char* data, const std::size_t len,
+                                      const WSOpCode /* code */, const bool /* flush */,
+                                      int& /*unitReturn*/) override
+    {
+        const std::string message(data, len);
+
+        if (message.starts_with("progress: { \"id\":\"setvalue\""))
+        {
+            LOG_TST("Progress in " << name(_phase) << ": " << message);
+            if (_phase == Phase::WaitProgress)
+                TRANSITION_STATE(_phase, Phase::Queue);
+        }
+        else if (message.starts_with("pong "))
+        {
+            // The commands before the ping have been handled, and must have been queued.
+            LOK_ASSERT_STATE(_phase, Phase::WaitQueued);
+            TRANSITION_STATE(_phase, Phase::WaitKitLoad);
+
+            LOG_TST("Sending the rest of the document");
+            COOLWSD::getWebServerPoll()->addCallback(
+                [socket = _getFileSocket, rest = _rest]()
+                {
+                    socket->send(rest);
+                    socket->shutdown();
+                });
+            _getFileSocket.reset();
+        }
+        else if (message.starts_with("child-"))
+        {
+            // Drop the session id.
+            const std::size_t space = message.find(' ');
+            const std::string command =
+                space == std::string::npos ? std::string() : message.substr(space + 1);
+            LOG_TST("To the kit in " << name(_phase) << ": "
+                                     << COOLProtocol::getAbbreviatedMessage(command));
+
+            switch (_phase)
+            {
+                case Phase::WaitKitLoad:
+                    LOK_ASSERT_MESSAGE("Expected the load first: " + command,
+                                       command.starts_with("load "));
+                    TRANSITION_STATE(_phase, Phase::WaitKitStatus);
+                    break;
+                case Phase::WaitKitStatus:
+                    LOK_ASSERT_EQUAL(std::string("status"), command);
+                    TRANSITION_STATE(_phase, Phase::WaitKitStatusUpdate);
+                    break;
+                case Phase::WaitKitStatusUpdate:
+                    LOK_ASSERT_EQUAL(std::string("statusupdate"), command);
+                    TRANSITION_STATE(_phase, Phase::WaitLoaded);
+                    break;
+                case Phase::WaitLoaded:
+                case Phase::Done:
+                    break;
+                default:
+                    LOK_ASSERT_FAIL("Unexpected message to the kit before it was downloaded: " +
+                                    command);
+                    break;
+            }
+        }
+
+        return false;
+    }
+
+    bool onDocumentLoaded(const std::string& message) override
+    {
+        LOG_TST("Loaded in " << name(_phase) << ": " << message);
+        LOK_ASSERT_STATE(_phase, Phase::WaitLoaded);
+
+        TRANSITION_STATE(_phase, Phase::Done);
+        passTest("Forwarded the queued commands in order after downloading");
+        return true;
+    }
+
+    void invokeWSDTest() override
+    {
+        switch (_phase)
+        {
+            case Phase::Load:
+            {
+                TRANSITION_STATE(_phase, Phase::WaitProgress);
+
+                initWebsocket("/wopi/files/0?access_token=anything");
+                WSD_CMD("load url=" + getWopiSrc());
+                break;
+            }
+            case Phase::Queue:
+            {
+                TRANSITION_STATE(_phase, Phase::WaitQueued);
+
+                LOG_TST("Sending commands while downloading");
+                WSD_CMD("status");
+                WSD_CMD("statusupdate");
+                WSD_CMD("ping");
+                break;
+            }
+            case Phase::WaitProgress:
+            case Phase::WaitQueued:
+            case Phase::WaitKitLoad:
+            case Phase::WaitKitStatus:
+            case Phase::WaitKitStatusUpdate:
+            case Phase::WaitLoaded:
+            case Phase::Done:
+                break;
+        }
+    }
+};
+
+/// Test that a GetFile redirect is followed when downloading asynchronously.
+class UnitWOPIAsyncDownloadRedirect : public WopiTestServer
+{
+    STATE_ENUM(Phase, Load, WaitLoad, Done) _phase;
+
+public:
+    UnitWOPIAsyncDownloadRedirect()
+        : WopiTestServer("UnitWOPIAsyncDownloadRedirect")
+        , _phase(Phase::Load)
+    {
+    }
+
+    std::unique_ptr<http::Response>
+    assertGetFileRequest(const Poco::Net::HTTPRequest& request) override
+    {
+        const Poco::URI uriReq(request.getURI());
+        if (uriReq.getPath() == "/wopi/files/1/contents")
+            return nullptr; // Redirected here.
+
+        LOG_TST("Redirecting GetFile of [" << uriReq.getPath() << ']');
+        auto httpResponse = std::make_unique<http::Response>(http::StatusCode::Found);
+        httpResponse->set("Location", helpers::getTestServerURI() +
+                                          "/wopi/files/1/contents?access_token=anything");
+        return httpResponse;
+    }
+
+    bool onDocumentLoaded(const std::string& message) override
+    {
+        LOG_TST("Loaded: " << message);
+        LOK_ASSERT_STATE(_phase, Phase::WaitLoad);
+        LOK_ASSERT_EQUAL(static_cast<std::size_t>(2), getCountGetFile());
+
+        TRANSITION_STATE(_phase, Phase::Done);
+        passTest("Loaded the document from the redirected GetFile");
+        return true;
+    }
+
+    bool onDocumentError(const std::string& message) override
+    {
+        LOK_ASSERT_FAIL("Unexpected error: " + message);
+        return false;
+    }
+
+    void invokeWSDTest() override
+    {
+        switch (_phase)
+        {
+            case Phase::Load:
+            {
+                TRANSITION_STATE(_phase, Phase::WaitLoad);
+
+                initWebsocket("/wopi/files/0?access_token=anything");
+                WSD_CMD("load url=" + getWopiSrc());
+                break;
+            }
+            case Phase::WaitLoad:
+            case Phase::Done:
+                break;
+        }
+    }
+};
+
+/// Test that a failed GetFile, or one redirected too many times,
+/// fails the load with the same error as a synchronous download.
+class UnitWOPIAsyncDownloadFail : public WopiTestServer
+{
+    STATE_ENUM(Phase, Load, WaitError, Done) _phase;
+
+    /// Redirect to itself, rather than fail outright.
+    const bool _redirectLoop;
+
+public:
+    UnitWOPIAsyncDownloadFail(const std::string& testname, bool redirectLoop)
+        : WopiTestServer(testname)
+        , _phase(Phase::Load)
+        , _redirectLoop(redirectLoop)
+    {
+    }
+
+    std::unique_ptr<http::Response>
+    assertGetFileRequest(const Poco::Net::HTTPRequest& request) override
+    {
+        LOG_TST("Failing GetFile #" << getCountGetFile() << " of ["
+                                    << Poco::URI(request.getURI()).getPath() << ']');
+        if (!_redirectLoop)
+            return std::make_unique<http::Response>(http::StatusCode::NotFound);
+
+        auto httpResponse = std::make_unique<http::Response>(http::StatusCode::Found);
+        httpResponse->set("Location", helpers::getTestServerURI() +
+                                          "/wopi/files/0/contents?access_token=anything");
+        return httpResponse;
+    }
+
+    bool onDocumentLoaded(const std::string& message) override
+    {
+        LOK_ASSERT_FAIL("Unexpected load: " + message);
+        return false;
+    }
+
+    bool onDocumentError(const std::string& message) override
+    {
+        LOG_TST("Error in " << name(_phase) << ": " << message);
+        if (_phase != Phase::WaitError)
+            return false; // The rest follow from the failure.
+
+        LOK_ASSERT_EQUAL(std::string("error: cmd=storage kind=loadfailed"), message);
+        if (_redirectLoop)
+            LOK_ASSERT_EQUAL(static_cast<std::size_t>(HTTP_REDIRECTION_LIMIT + 1),
+                             getCountGetFile());
+
+        TRANSITION_STATE(_phase, Phase::Done);
+        passTest("Failed to load the document as expected");
+        return true;
+    }
+
+    void invokeWSDTest() override
+    {
+        switch (_phase)
+        {
+            case Phase::Load:
+            {
+                TRANSITION_STATE(_phase, Phase::WaitError);
+
+                initWebsocket("/wopi/files/0?access_token=anything");
+                WSD_CMD("load url=" + getWopiSrc());
+                break;
+            }
+            case Phase::WaitError:
+            case Phase::Done:
+                break;
+        }
+    }
+};
+
+UnitBase** unit_create_wsd_multi(void)
+{
+    return new UnitBase* [5]
+    {
+        new UnitWOPIAsyncDownloadSlow(), new UnitWOPIAsyncDownloadRedirect(),
+            new UnitWOPIAsyncDownloadFail("UnitWOPIAsyncDownloadNotFound", false),
+            new UnitWOPIAsyncDownloadFail("UnitWOPIAsyncDownloadRedirectLoop", true), nullptr
+    };
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,140 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include "lokassert.hpp"
+#include "Unit.hpp"
+#include <WopiTestServer.hpp>
+#include <Log.hpp>
+#include <helpers.hpp>
+#include <wsd/ClientSession.hpp>
+
+#include <Poco/Net/HTTPRequest.h>
+#include <Poco/Util/LayeredConfiguration.h>
+
+#include <chrono>
+
+/// Test that documents sharing a poll thread don't wait for each other's storage.
+/// With a single shared thread, we load a document whose WOPI Lock request we
+/// never answer, then a second document, which must load all the same.
+class UnitWOPISharedPoll : public WopiTestServer
+{
+    STATE_ENUM(Phase, Load, WaitLock, LoadSecond, WaitSecondLoad, Done) _phase;
+
+    /// The DocKey of the document with the stalled storage.
+    std::string _stalledDocKey;
+
+    /// The connection of the Lock request we sit on.
+    std::shared_ptr<StreamSocket> _stalledLock;
+
+public:
+    UnitWOPISharedPoll()
+        : WopiTestServer("UnitWOPISharedPoll")
+        , _phase(Phase::Load)
+    {
+        // Shorter than the storage timeout, so waiting for the lock fails the test.
+        setTimeout(std::chrono::seconds(30));
+    }
+
+    void configure(Poco::Util::LayeredConfiguration& config) override
+    {
+        WopiTestServer::configure(config);
+
+        config.setUInt("per_document.shared_poll_threads", 1);
+        config.setInt("net.connection_timeout_secs", 60);
+    }
+
+    void configCheckFileInfo(const Poco::Net::HTTPRequest& request,
+                             Poco::JSON::Object::Ptr& fileInfo) override
+    {
+        // Only the first document is locked.
+        const std::string filename =
+            extractFilenameFromWopiUri(Poco::URI(request.getURI()).getPath());
+        fileInfo->set("SupportsLocks", filename == "1" ? "true" : "false");
+    }
+
+    bool handleHttpPostRequest(const Poco::Net::HTTPRequest& request,
+                               Poco::MemoryInputStream& message,
+                               std::shared_ptr<StreamSocket>& socket) override
+    {
+        const Poco::URI uriReq(request.getURI());
+        if (isWopiInfoRequest(uriReq.getPath()) &&
+            request.get("X-WOPI-Override", std::string()) == "LOCK")
+        {
+            LOG_TST("Lock request for [" << uriReq.getPath() << "] in " << name(_phase)
+                                         << ", not answering");
+            LOK_ASSERT_STATE(_phase, Phase::WaitLock);
+            LOK_ASSERT_EQUAL(std::string("1"), extractFilenameFromWopiUri(uriReq.getPath()));
+
+            _stalledLock = socket;
+            TRANSITION_STATE(_phase, Phase::LoadSecond);
+            return true;
+        }
+
+        return WopiTestServer::handleHttpPostRequest(request, message, socket);
+    }
+
+    void onDocBrokerCreate(const std::string& docKey) override
+    {
+        if (_stalledDocKey.empty())
+            _stalledDocKey = docKey;
+    }
+
+    void onDocBrokerViewLoaded(const std::string& docKey,
+                               const std::shared_ptr<ClientSession>& session) override
+    {
+        LOG_TST("View [" << session->getName() << "] of [" << docKey << "] loaded in "
+                         << name(_phase));
+
+        if (docKey == _stalledDocKey)
+            return; // Loading doesn't wait for the lock either; fine.
+
+        LOK_ASSERT_STATE(_phase, Phase::WaitSecondLoad);
+        LOK_ASSERT_MESSAGE("Expected the lock to be still pending", _stalledLock != nullptr);
+
+        TRANSITION_STATE(_phase, Phase::Done);
+        passTest("Loaded a document while the storage of the other one stalled");
+    }
+
+    void invokeWSDTest() override
+    {
+        switch (_phase)
+        {
+            case Phase::Load:
+            {
+                TRANSITION_STATE(_phase, Phase::WaitLock);
+
+                LOG_TST("Loading the document with the stalled storage");
+                initWebsocket("/wopi/files/1?access_token=anything");
+                WSD_CMD_BY_CONNECTION_INDEX(0, "load url=" + getWopiSrc());
+                break;
+            }
+            case Phase::LoadSecond:
+            {
+                TRANSITION_STATE(_phase, Phase::WaitSecondLoad);
+
+                LOG_TST("Loading a second document on the same thread");
+                const std::string wopiSrc = addWebSocket("/wopi/files/2?access_token=anything");
+                WSD_CMD_BY_CONNECTION_INDEX(1, "load url=" + wopiSrc);
+                break;
+            }
+            case Phase::WaitLock:
+            case Phase::WaitSecondLoad:
+            case Phase::Done:
+                break;
+        }
+    }
+};
+
+UnitBase* unit_create_wsd(void) { return new UnitWOPISharedPoll(); }
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
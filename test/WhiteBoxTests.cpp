@@ -29,6 +29,7 @@
 #include <common/ThreadPool.hpp>
 #include <wsd/FileServer.hpp>
 #include <net/Buffer.hpp>
+#include <net/WebSocketDeflate.hpp>
 #include <net/NetUtil.hpp>
 
 #include <chrono>
@@ -57,6 +58,8 @@ class WhiteBoxTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testIso8601Time);
     CPPUNIT_TEST(testClockAsString);
     CPPUNIT_TEST(testBufferClass);
+    CPPUNIT_TEST(testBufferSegments);
+    CPPUNIT_TEST(testWebSocketDeflate);
     CPPUNIT_TEST(testStat);
     CPPUNIT_TEST(testStringCompare);
     CPPUNIT_TEST(testParseUri);
@@ -66,6 +69,7 @@ class WhiteBoxTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testJsonUtilEscapeJSONValue);
     CPPUNIT_TEST(testFindInVector);
     CPPUNIT_TEST(testThreadPool);
+    CPPUNIT_TEST(testThreadPoolRun);
     CPPUNIT_TEST_SUITE_END();
 
     void testCOOLProtocolFunctions();
@@ -85,6 +89,8 @@ class WhiteBoxTests : public CPPUNIT_NS::TestFixture
     void testIso8601Time();
     void testClockAsString();
     void testBufferClass();
+    void testBufferSegments();
+    void testWebSocketDeflate();
     void testStat();
     void testStringCompare();
     void testParseUri();
@@ -94,6 +100,7 @@ class WhiteBoxTests : public CPPUNIT_NS::TestFixture
     void testJsonUtilEscapeJSONValue();
     void testFindInVector();
     void testThreadPool();
+    void testThreadPoolRun();
 
     size_t waitForThreads(size_t count);
 };
@@ -630,6 +637,21 @@ void WhiteBoxTests::testTileData()
     LOK_ASSERT_EQUAL(data.appendChangesSince(out, 43), true);
     LOK_ASSERT_EQUAL(std::string("baabaz"), Util::toString(out));
 
+    // the blobs are shared, to send without copying
+    std::vector<Blob> blobs;
+    LOK_ASSERT_EQUAL(data.appendChangesSince(blobs, 43), true);
+    LOK_ASSERT_EQUAL(size_t(2), blobs.size());
+    LOK_ASSERT_EQUAL(std::string("baa"), Util::toString(*blobs[0]));
+    LOK_ASSERT(blobs[1] == data._blobs.back());
+
+    // a new keyframe leaves the blobs being sent intact
+    data.appendBlob(48, "Zqux", 4);
+    LOK_ASSERT_EQUAL(size_t(3), data.size());
+    LOK_ASSERT_EQUAL(std::string("baz"), Util::toString(*blobs[1]));
+    data.appendBlob(49, "Dbaa", 4);
+    data.appendBlob(50, "Dbaz", 4);
+    LOK_ASSERT_EQUAL(size_t(9), data.size());
+
     // append an empty delta
     data.appendBlob(52, "D", 1);
     LOK_ASSERT_EQUAL(data.size(), size_t(9));
@@ -963,6 +985,149 @@ void WhiteBoxTests::testBufferClass()
     LOK_ASSERT_EQUAL(true, buf.empty());
 }
 
+void WhiteBoxTests::testBufferSegments()
+{
+    constexpr auto testname = __func__;
+
+    const auto shared = std::make_shared<std::string>(64 * 1024, 's');
+    const std::string header = "header";
+    const std::string trailer = "trailer";
+
+    Buffer buf;
+    buf.append(header);
+    buf.append(shared, shared->data(), shared->size());
+    buf.append(trailer);
+    LOK_ASSERT_EQUAL(header.size() + shared->size() + trailer.size(), buf.size());
+
+    // The shared data is referenced, not copied.
+    iovec iov[4];
+    LOK_ASSERT_EQUAL(3, buf.getIOVec(iov, 4, buf.size()));
+    LOK_ASSERT_EQUAL(header.size(), iov[0].iov_len);
+    LOK_ASSERT(iov[1].iov_base == shared->data());
+    LOK_ASSERT_EQUAL(shared->size(), iov[1].iov_len);
+    LOK_ASSERT_EQUAL(0, memcmp(iov[2].iov_base, trailer.data(), trailer.size()));
+
+    // Limited by count and size.
+    LOK_ASSERT_EQUAL(2, buf.getIOVec(iov, 2, buf.size()));
+    LOK_ASSERT_EQUAL(2, buf.getIOVec(iov, 4, header.size() + 10));
+    LOK_ASSERT_EQUAL(10UL, iov[1].iov_len);
+
+    // Write out across the blocks.
+    buf.eraseFirst(header.size() + 10);
+    LOK_ASSERT_EQUAL(shared->size() - 10, buf.getBlockSize());
+    LOK_ASSERT(buf.getBlock() == shared->data() + 10);
+
+    buf.eraseFirst(shared->size() - 10 + 2);
+    LOK_ASSERT_EQUAL(trailer.size() - 2, buf.size());
+    LOK_ASSERT_EQUAL(trailer.size() - 2, buf.getBlockSize());
+    LOK_ASSERT_EQUAL(0, memcmp(buf.getBlock(), trailer.data() + 2, buf.size()));
+
+    // Appending continues the last block.
+    buf.append(header);
+    LOK_ASSERT_EQUAL(trailer.size() - 2 + header.size(), buf.getBlockSize());
+
+    buf.eraseFirst(buf.size());
+    LOK_ASSERT_EQUAL(true, buf.empty());
+    LOK_ASSERT(buf.getBlock() == nullptr);
+
+    // Small shared data is copied.
+    buf.append(shared, shared->data(), 16);
+    LOK_ASSERT(buf.getBlock() != shared->data());
+    LOK_ASSERT_EQUAL(16UL, buf.getBlockSize());
+}
+
+void WhiteBoxTests::testWebSocketDeflate()
+{
+    constexpr auto testname = __func__;
+
+    WebSocketDeflate::Settings settings;
+    WebSocketDeflate::Params serverParams;
+    LOK_ASSERT(WebSocketDeflate::negotiate("permessage-deflate", settings, serverParams).empty());
+
+    settings._enabled = true;
+    settings._maxWindowBits = 12;
+
+    // Unknown extensions and parameters are declined.
+    LOK_ASSERT(WebSocketDeflate::negotiate("permessage-deflate; foo", settings, serverParams).empty());
+    LOK_ASSERT(WebSocketDeflate::negotiate("permessage-deflate; server_max_window_bits=8",
+                                           settings, serverParams)
+                   .empty());
+    LOK_ASSERT_EQUAL(std::string("permessage-deflate; server_max_window_bits=10; "
+                                 "server_no_context_takeover"),
+                     WebSocketDeflate::negotiate("x-webkit-deflate-frame, permessage-deflate; "
+                                                 "server_max_window_bits=10; "
+                                                 "server_no_context_takeover",
+                                                 settings, serverParams));
+
+    // Our window bounds the client's, when it lets us.
+    const std::string response =
+        WebSocketDeflate::negotiate(WebSocketDeflate::getOffer(15), settings, serverParams);
+    LOK_ASSERT_EQUAL(std::string("permessage-deflate; server_max_window_bits=12; "
+                                 "client_max_window_bits=12"),
+                     response);
+
+    WebSocketDeflate::Params clientParams;
+    LOK_ASSERT(WebSocketDeflate::parseResponse(response, 15, clientParams));
+    LOK_ASSERT_EQUAL(12, clientParams._serverMaxWindowBits);
+    LOK_ASSERT_EQUAL(12, clientParams._clientMaxWindowBits);
+    LOK_ASSERT(!WebSocketDeflate::parseResponse("x-webkit-deflate-frame", 15, clientParams));
+
+    // Round-trip both ways, with context takeover.
+    WebSocketDeflate server(/*isClient=*/false, serverParams, settings._memLevel);
+    WebSocketDeflate client(/*isClient=*/true, clientParams, settings._memLevel);
+    std::vector<char> compressed;
+    std::vector<char> decompressed;
+    std::size_t lastSize = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        const std::string message = "invalidatetiles: part=0 mode=0 x=0 y=" + std::to_string(i) +
+                                    " width=1024 height=1024 wid=0";
+
+        LOK_ASSERT(server.compress(message.data(), message.size(), compressed));
+        LOK_ASSERT(WebSocketDeflate::InflateResult::Ok ==
+                   client.decompress(compressed.data(), compressed.size(), decompressed));
+        LOK_ASSERT_EQUAL(message, std::string(decompressed.begin(), decompressed.end()));
+
+        // Repeated messages compress to next to nothing.
+        if (i > 0)
+            LOK_ASSERT(compressed.size() < message.size() / 2);
+        lastSize = compressed.size();
+
+        LOK_ASSERT(client.compress(message.data(), message.size(), compressed));
+        LOK_ASSERT(WebSocketDeflate::InflateResult::Ok ==
+                   server.decompress(compressed.data(), compressed.size(), decompressed));
+        LOK_ASSERT_EQUAL(message, std::string(decompressed.begin(), decompressed.end()));
+    }
+
+    LOK_ASSERT(lastSize > 0);
+
+    // Larger than any buffer.
+    std::string large(1024 * 1024, 'a');
+    for (std::size_t i = 0; i < large.size(); i += 7)
+        large[i] = 'a' + i % 13;
+
+    LOK_ASSERT(server.compress(large.data(), large.size(), compressed));
+    LOK_ASSERT(WebSocketDeflate::InflateResult::Ok ==
+               client.decompress(compressed.data(), compressed.size(), decompressed));
+    LOK_ASSERT(large == std::string(decompressed.begin(), decompressed.end()));
+
+    // Garbage is rejected.
+    WebSocketDeflate fresh(/*isClient=*/false, serverParams, settings._memLevel);
+    const char garbage[] = "\xff\xff\xff\xff";
+    LOK_ASSERT(WebSocketDeflate::InflateResult::Failed ==
+               fresh.decompress(garbage, sizeof(garbage) - 1, decompressed));
+
+    // A small message inflating beyond the limit is refused, without
+    // growing the output past it.
+    const std::string bomb(16 * 1024 * 1024, '\0');
+    LOK_ASSERT(server.compress(bomb.data(), bomb.size(), compressed));
+    LOK_ASSERT(compressed.size() < bomb.size() / 100);
+    LOK_ASSERT(WebSocketDeflate::InflateResult::TooBig ==
+               client.decompress(compressed.data(), compressed.size(), decompressed,
+                                 1024 * 1024));
+    LOK_ASSERT(decompressed.size() <= 1024 * 1024);
+}
+
 void WhiteBoxTests::testStat()
 {
     constexpr auto testname = __func__;
@@ -1299,6 +1464,47 @@ void WhiteBoxTests::testThreadPool()
 //    LOK_ASSERT_EQUAL(size_t(7 + existingUnrelatedThreads), waitForThreads(8 + existingUnrelatedThreads));
 }
 
+void WhiteBoxTests::testThreadPoolRun()
+{
+    constexpr auto testname = __func__;
+
+    // coverity[tainted_data_argument : FALSE] - we trust this variable in tests
+    setenv("MAX_CONCURRENCY","4",1);
+    ThreadPool pool;
+
+    // Every task of every batch runs exactly once, into its own slot.
+    for (size_t batch = 0; batch < 200; ++batch)
+    {
+        const size_t tasks = batch % 17;
+        std::vector<int> slots(tasks, 0);
+        for (size_t i = 0; i < tasks; ++i)
+            pool.pushWork([&slots, i]() { slots[i]++; });
+
+        // Alternate with batches the caller only joins later.
+        if (batch % 2)
+        {
+            pool.runAsync();
+            LOK_ASSERT(pool.isRunning());
+            pool.wait();
+        }
+        else
+            pool.run();
+
+        LOK_ASSERT(!pool.isRunning());
+
+        LOK_ASSERT_EQUAL(size_t(0), pool.count());
+        for (size_t i = 0; i < tasks; ++i)
+            LOK_ASSERT_EQUAL(1, slots[i]);
+
+        // As around forkToSave.
+        if (batch % 50 == 49)
+        {
+            pool.stop();
+            pool.start();
+        }
+    }
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(WhiteBoxTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
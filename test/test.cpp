@@ -109,10 +109,13 @@ int main(int argc, char** argv)
         const std::string ssl_ca_file_path = cert_path + "/ca-chain.cert.pem";
         const std::string ssl_cipher_list = "ALL:!ADH:!LOW:!EXP:!MD5:@STRENGTH";
 
-        // Initialize the non-blocking socket SSL.
+        // Initialize the non-blocking socket SSL. Where the kernel supports
+        // it, test servers send with kTLS, for the tests to cover that too.
+        ssl::ContextOptions options;
+        options._ktls = true;
         ssl::Manager::initializeServerContext(ssl_cert_file_path, ssl_key_file_path,
                                               ssl_ca_file_path, ssl_cipher_list,
-                                              ssl::CertificateVerification::Disabled);
+                                              ssl::CertificateVerification::Disabled, options);
 
         ssl::Manager::initializeClientContext(ssl_cert_file_path, ssl_key_file_path,
                                               ssl_ca_file_path, ssl_cipher_list,
@@ -10,6 +10,9 @@
  */
 /*
  * Benchmark various bits of cool code.
+ *
+ * Pass 256x256 tile PNGs, eg. from test/data:
+ *   coolbench delta-graphic.png delta-graphic2.png delta-text.png delta-text2.png
  */
 
 #include "config.h"
@@ -62,6 +65,124 @@ public:
         std::cout << "time/rle: " <<
             (1.0*std::chrono::duration_cast<std::chrono::microseconds>(end - start).count())/deltas << "us\n";
     }
+
+    static void timeDiff(const char *description)
+    {
+        std::cout << "Benchmark " << description << "\n";
+
+        // pairs of consecutive pixmaps give us row differences.
+        std::vector<std::unique_ptr<DeltaGenerator::DeltaData>> rows;
+        TileLocation loc = { 0, 0, 0, 0, 0 };
+        for (Pixmap &pix : pixmaps)
+            rows.emplace_back(new DeltaGenerator::DeltaData(
+                1 /*wid*/, reinterpret_cast<unsigned char *>(pix.data()),
+                0, 0, 256, 256, loc, 256, 256));
+
+        std::vector<uint8_t> output;
+        output.reserve(256 * 256 * 8);
+        int diffs = 0;
+        const auto start = std::chrono::steady_clock::now();
+
+        int maxIters = (500 + rows.size() - 1) / rows.size();
+        for (int it = 0; it < maxIters; ++it)
+        {
+            for (size_t i = 0; i < rows.size(); ++i)
+            {
+                const DeltaGenerator::DeltaData &prev = *rows[i];
+                const DeltaGenerator::DeltaData &cur = *rows[(i + 1) % rows.size()];
+                output.clear();
+                for (int y = 0; y < 256; ++y)
+                    prev.getRow(y).diffRowTo(cur.getRow(y), 256, y, output, LOK_TILEMODE_RGBA);
+                diffs += 256;
+            }
+        }
+
+        const auto end = std::chrono::steady_clock::now();
+
+        std::cout << "took: " <<
+            std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms - ";
+
+        assert(diffs && "div by zero otherwise");
+
+        std::cout << "time/row diff: " <<
+            (1.0*std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count())/diffs << "ns\n";
+    }
+
+    static void timeSwap(const char *description)
+    {
+        std::cout << "Benchmark " << description << "\n";
+
+        std::vector<unsigned char> dest(256 * 4);
+        int rows = 0;
+        const auto start = std::chrono::steady_clock::now();
+
+        int maxIters = (50000 + pixmaps.size() - 1) / pixmaps.size();
+        for (int it = 0; it < maxIters; ++it)
+        {
+            for (Pixmap &pix : pixmaps)
+            {
+                for (int y = 0; y < 256; y += 16)
+                {
+                    DeltaGenerator::copy_row(
+                        dest.data(), reinterpret_cast<unsigned char *>(pix.data()) + y * 256 * 4,
+                        256, LOK_TILEMODE_BGRA);
+                    rows++;
+                }
+            }
+        }
+
+        const auto end = std::chrono::steady_clock::now();
+
+        std::cout << "took: " <<
+            std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms - ";
+
+        assert(rows && "div by zero otherwise");
+
+        std::cout << "time/row swap: " <<
+            (1.0*std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count())/rows << "ns\n";
+    }
+
+    static void timeCompress(const char *description, bool forceKeyframe)
+    {
+        std::cout << "Benchmark " << description << "\n";
+
+        DeltaGenerator gen;
+        gen.setSessionCount(1);
+
+        TileLocation loc = { 0, 0, 0, 0, 0 };
+        TileWireId wid = 0;
+        size_t tiles = 0;
+        size_t bytes = 0;
+        std::vector<char> output;
+        output.reserve(256 * 256 * 4);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        // consecutive pixmaps at the same location give us deltas.
+        int maxIters = (5000 + pixmaps.size() - 1) / pixmaps.size();
+        for (int it = 0; it < maxIters; ++it)
+        {
+            for (Pixmap &pix : pixmaps)
+            {
+                output.clear();
+                bytes += gen.compressOrDelta(reinterpret_cast<unsigned char *>(pix.data()),
+                                             0, 0, 256, 256, 256, 256, loc, output, ++wid,
+                                             forceKeyframe, false, LOK_TILEMODE_RGBA);
+                tiles++;
+            }
+        }
+
+        const auto end = std::chrono::steady_clock::now();
+
+        std::cout << "took: " <<
+            std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms - ";
+
+        assert(tiles && "div by zero otherwise");
+
+        std::cout << "time/tile: " <<
+            (1.0*std::chrono::duration_cast<std::chrono::microseconds>(end - start).count())/tiles << "us "
+                  << "bytes/tile: " << bytes / tiles << "\n";
+    }
 };
 
 int main (int argc, char **argv)
@@ -75,10 +196,19 @@ int main (int argc, char **argv)
     }
 
     DeltaTests::timeRLE("CPU");
+    DeltaTests::timeDiff("CPU row diff");
+    DeltaTests::timeSwap("CPU channel swap");
 
-    simd::init();
+    if (simd::init())
+        simd_deltaInit();
 
     DeltaTests::timeRLE("SIMD");
+    DeltaTests::timeDiff("SIMD row diff");
+    DeltaTests::timeSwap("SIMD channel swap");
+
+    DeltaTests::timeCompress("keyframe compression", true);
+
+    DeltaTests::timeCompress("delta compression", false);
 
     return 0;
 }
@@ -0,0 +1,157 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+/*
+ * Benchmark the cost of a SocketPoll wakeup with many mostly idle
+ * connections, as with poll(2), with epoll(7) and with io_uring(7).
+ */
+
+#include <config.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include <sys/resource.h>
+
+#include <Log.hpp>
+#include <net/Socket.hpp>
+
+namespace
+{
+/// Counts and discards whatever arrives.
+class BenchHandler final : public SimpleSocketHandler
+{
+public:
+    explicit BenchHandler(size_t& received)
+        : _received(received)
+    {
+    }
+
+    void onConnect(const std::shared_ptr<StreamSocket>& socket) override { _socket = socket; }
+
+    void handleIncomingMessage(SocketDisposition&) override
+    {
+        std::shared_ptr<StreamSocket> socket = _socket.lock();
+        if (socket)
+        {
+            _received += socket->getInBuffer().size();
+            socket->getInBuffer().clear();
+        }
+    }
+
+    int getPollEvents(std::chrono::steady_clock::time_point, int64_t&) override { return POLLIN; }
+
+    void performWrites(std::size_t) override {}
+
+private:
+    std::weak_ptr<StreamSocket> _socket;
+    size_t& _received;
+};
+
+enum class Backend
+{
+    Poll,
+    Epoll,
+    IoUring
+};
+
+/// Returns the microseconds per wakeup with count connections, or a negative value.
+double timeWakeups(size_t count, Backend backend, size_t iterations)
+{
+    SocketPoll poll("bench_poll");
+    poll.runOnClientThread();
+    if ((backend == Backend::Epoll && !poll.enableEpoll()) ||
+        (backend == Backend::IoUring && !poll.enableIoUring()))
+        return -1;
+
+    size_t received = 0;
+    std::vector<int> peers;
+    peers.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        int pair[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair) == -1)
+        {
+            std::cerr << "Failed to create socket pair " << i << ": " << strerror(errno) << '\n';
+            break;
+        }
+
+        peers.push_back(pair[1]);
+        poll.insertNewSocket(StreamSocket::create<StreamSocket>(
+            std::string(), pair[0], Socket::Type::Unix, false, HostType::LocalHost,
+            std::make_shared<BenchHandler>(received)));
+    }
+
+    double result = -1;
+    if (peers.size() == count)
+    {
+        // Take in the new sockets.
+        poll.poll(std::chrono::milliseconds(0));
+
+        std::mt19937 random(count);
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            const size_t expected = received + 1;
+            if (::write(peers[random() % count], "x", 1) != 1)
+                break;
+
+            while (received < expected)
+                poll.poll(std::chrono::seconds(1));
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        if (received == iterations)
+            result = std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+    }
+
+    poll.removeSockets();
+    for (const int fd : peers)
+        ::close(fd);
+
+    return result;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const size_t iterations = argc > 1 ? std::stoul(argv[1]) : 2000;
+
+    Log::initialize("PollBench", "error", false, false, std::map<std::string, std::string>());
+
+    // Each connection takes two descriptors.
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    std::cout << "connections\tpoll us/wakeup\tepoll us/wakeup\tio_uring us/wakeup\n";
+    for (const size_t count : { 100, 500, 1000, 2000, 5000, 10000, 20000 })
+    {
+        std::cout << count;
+        for (const Backend backend : { Backend::Poll, Backend::Epoll, Backend::IoUring })
+        {
+            const double us = timeWakeups(count, backend, iterations);
+            std::cout << '\t';
+            if (us < 0)
+                std::cout << "n/a";
+            else
+                std::cout << us;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -130,6 +130,8 @@ struct Stats {
         _start(std::chrono::steady_clock::now()),
         _bytesSent(0),
         _bytesRecvd(0),
+        _wireSent(0),
+        _wireRecvd(0),
         _tileCount(0),
         _connections(0)
     {
@@ -141,6 +143,8 @@ struct Stats {
     std::unique_ptr<Util::SysStopwatch> _timer;
     size_t _bytesSent;
     size_t _bytesRecvd;
+    size_t _wireSent; ///< Including framing, after any compression.
+    size_t _wireRecvd;
     size_t _tileCount;
     size_t _connections;
     Histogram _pingLatency;
@@ -210,6 +214,12 @@ struct Stats {
         accumulate(_sent, std::string(msg, std::min(i, size_t(len))), len);
     }
 
+    void accumulateWire(size_t sent, size_t recvd)
+    {
+        _wireSent += sent;
+        _wireRecvd += recvd;
+    }
+
     void addConnection() { _connections++; }
 
     void dumpMap(std::unordered_map<std::string, MessageStat> &map)
@@ -251,6 +261,8 @@ struct Stats {
             " (" << sentKbps << " kB/s) " <<
             " server sent " << Util::getHumanizedBytes(_bytesRecvd) <<
             " (" << recvKbps << " kB/s) to " << _connections << " connections.\n";
+        std::cout << "  on the wire we sent " << Util::getHumanizedBytes(_wireSent) <<
+            " server sent " << Util::getHumanizedBytes(_wireRecvd) << "\n";
 
 
        endPhase(Log::Phase::Edit);
@@ -380,22 +392,31 @@ class StressSocketHandler : public WebSocketHandler
 
     std::shared_ptr<Stats> _stats;
     std::chrono::steady_clock::time_point _lastTile;
+    bool _requestDeflate;
+    uint64_t _wireSent;
+    uint64_t _wireRecvd;
 
 public:
     StressSocketHandler(SocketPoll &poll, /* bad style */
                         const std::shared_ptr<Stats> stats,
                         const std::string &uri, const std::string &trace,
-                        const int delayMs = 0) :
+                        const int delayMs = 0, const bool requestDeflate = false) :
         WebSocketHandler(true, true),
         _poll(poll),
         _reader(trace),
         _connecting(true),
         _uri(uri),
         _trace(trace),
-        _stats(stats)
+        _stats(stats),
+        _requestDeflate(requestDeflate),
+        _wireSent(0),
+        _wireRecvd(0)
     {
         assert(_stats && "stats must be provided");
 
+        if (_requestDeflate)
+            requestDeflate();
+
         static std::atomic<int> number;
         _logPre = "[" + std::to_string(++number) + "] ";
         std::cerr << "Attempt connect to " << uri << " for trace " << _trace << "\n";
@@ -552,6 +573,16 @@ public:
 
         _stats->accumulateRecv(tokens[0], data.size());
 
+        std::shared_ptr<StreamSocket> socket = getSocket().lock();
+        if (socket)
+        {
+            uint64_t sent = 0, recvd = 0;
+            socket->getIOStats(sent, recvd);
+            _stats->accumulateWire(sent - _wireSent, recvd - _wireRecvd);
+            _wireSent = sent;
+            _wireRecvd = recvd;
+        }
+
         if (tokens.equals(0, "tile:")) {
             // accumulate latencies
             _stats->_tileLatency.addTime(std::chrono::duration_cast<std::chrono::milliseconds>(now - _lastTile).count());
@@ -588,7 +619,7 @@ public:
             {
                 shutdown(true, "bye");
                 auto handler = std::make_shared<StressSocketHandler>(
-                    _poll, _stats, _uri, _trace, 1000 /* delay 1 second */);
+                    _poll, _stats, _uri, _trace, 1000 /* delay 1 second */, _requestDeflate);
                 _poll.insertNewWebSocketSync(Poco::URI(_uri), handler);
                 return;
             }
@@ -609,7 +640,8 @@ public:
 
     static void addPollFor(SocketPoll &poll, const std::string &server,
                            const std::string &filePath, const std::string &tracePath,
-                           const std::shared_ptr<Stats> &optStats)
+                           const std::shared_ptr<Stats> &optStats,
+                           const bool requestDeflate = false)
     {
         assert(optStats && "optStats must be provided");
 
@@ -619,7 +651,8 @@ public:
         Poco::URI::encode(file, ":/?", wrap); // double encode.
         std::string uri = server + "/cool/" + wrap + "/ws";
 
-        auto handler = std::make_shared<StressSocketHandler>(poll, optStats, file, tracePath);
+        auto handler = std::make_shared<StressSocketHandler>(poll, optStats, file, tracePath,
+                                                             0, requestDeflate);
         poll.insertNewWebSocketSync(Poco::URI(uri), handler);
 
         optStats->addConnection();
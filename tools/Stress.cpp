@@ -24,8 +24,10 @@ int ClientPortNumber = DEFAULT_CLIENT_PORT_NUMBER;
 /// Stress testing and performance/scalability benchmarking tool.
 class Stress: public Poco::Util::Application
 {
+    bool _deflate;
+
 public:
-    Stress() {}
+    Stress() : _deflate(false) {}
 protected:
     void defineOptions(Poco::Util::OptionSet& options) override;
     void printHelp();
@@ -39,6 +41,8 @@ void Stress::defineOptions(Poco::Util::OptionSet& optionSet)
 
     optionSet.addOption(Poco::Util::Option("help", "", "Display help information on command line arguments.")
                         .required(false).repeatable(false));
+    optionSet.addOption(Poco::Util::Option("deflate", "", "Offer permessage-deflate compression to the server.")
+                        .required(false).repeatable(false));
 }
 
 void Stress::handleOption(const std::string& optionName,
@@ -51,6 +55,8 @@ void Stress::handleOption(const std::string& optionName,
         printHelp();
         Util::forcedExit(EX_OK);
     }
+    else if (optionName == "deflate")
+        _deflate = true;
     else
     {
         std::cout << "Unknown option: " << optionName << std::endl;
@@ -60,7 +66,7 @@ void Stress::handleOption(const std::string& optionName,
 
 void Stress::printHelp()
 {
-    std::cerr << "Usage: coolstress wss://localhost:9980 <test-document-path> <trace-path> " << std::endl;
+    std::cerr << "Usage: coolstress [--deflate] wss://localhost:9980 <test-document-path> <trace-path> " << std::endl;
     std::cerr << "       Trace files may be plain text or gzipped (with .gz extension)." << std::endl;
     std::cerr << "       --help for full arguments list." << std::endl;
 }
@@ -101,7 +107,7 @@ int Stress::main(const std::vector<std::string>& args)
 
     std::cerr << "Connect to " << server << "\n";
     for (size_t i = 1; i < args.size() - 1; i += 2)
-        StressSocketHandler::addPollFor(poll, server, args[i], args[i+1], stats);
+        StressSocketHandler::addPollFor(poll, server, args[i], args[i+1], stats, _deflate);
 
     do {
         poll.poll(TerminatingPoll::DefaultPollTimeoutMicroS);
@@ -964,6 +964,11 @@ void Admin::setDocWopiUploadDuration(const std::string& docKey, const std::chron
     addCallback([this, docKey, uploadDuration]{ _model.setDocWopiUploadDuration(docKey, uploadDuration); });
 }
 
+void Admin::setDocPaintOverlap(const std::string& docKey, unsigned paintOverlapPercent)
+{
+    addCallback([this, docKey, paintOverlapPercent]{ _model.setDocPaintOverlap(docKey, paintOverlapPercent); });
+}
+
 void Admin::addSegFaultCount(unsigned segFaultCount)
 {
     addCallback([this, segFaultCount]{ _model.addSegFaultCount(segFaultCount); });
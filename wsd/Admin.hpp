@@ -168,6 +168,7 @@ public:
     void setViewLoadDuration(const std::string& docKey, const std::string& sessionId, std::chrono::milliseconds viewLoadDuration);
     void setDocWopiDownloadDuration(const std::string& docKey, std::chrono::milliseconds wopiDownloadDuration);
     void setDocWopiUploadDuration(const std::string& docKey, const std::chrono::milliseconds uploadDuration);
+    void setDocPaintOverlap(const std::string& docKey, unsigned paintOverlapPercent);
     void addSegFaultCount(unsigned segFaultCount);
     void addLostKitsTerminated(unsigned lostKitsTerminated);
 
@@ -27,6 +27,7 @@
 #include <Util.hpp>
 #include <wsd/COOLWSD.hpp>
 #include <wsd/Exceptions.hpp>
+#include <wsd/TileCache.hpp>
 
 #include <fnmatch.h>
 #include <dirent.h>
@@ -869,6 +870,13 @@ void AdminModel::setDocWopiDownloadDuration(const std::string& docKey, std::chro
         it->second->setWopiDownloadDuration(wopiDownloadDuration);
 }
 
+void AdminModel::setDocPaintOverlap(const std::string& docKey, unsigned paintOverlapPercent)
+{
+    auto it = _documents.find(docKey);
+    if (it != _documents.end())
+        it->second->setPaintOverlapPercent(paintOverlapPercent);
+}
+
 void AdminModel::setDocWopiUploadDuration(const std::string& docKey, const std::chrono::milliseconds wopiUploadDuration)
 {
     auto it = _documents.find(docKey);
@@ -1183,6 +1191,11 @@ void AdminModel::getMetrics(std::ostringstream &oss)
     oss << "error_parse_error " << ParseError::count << "\n";
     oss << std::endl;
 
+    oss << "tile_cache_persistent_hit_count " << TileCache::PersistentHits << "\n";
+    oss << "tile_cache_persistent_miss_count " << TileCache::PersistentMisses << "\n";
+    oss << "tile_cache_persistent_store_count " << TileCache::PersistentStores << "\n";
+    oss << std::endl;
+
     int tick_per_sec = sysconf(_SC_CLK_TCK);
     // dump document data
     for (const auto& it : _documents)
@@ -1207,6 +1220,7 @@ void AdminModel::getMetrics(std::ostringstream &oss)
         oss << "doc_idle_time_seconds" << suffix << doc.getIdleTime() << "\n";
         oss << "doc_download_time_seconds" << suffix << ((double)doc.getWopiDownloadDuration().count() / 1000) << "\n";
         oss << "doc_upload_time_seconds" << suffix << ((double)doc.getWopiUploadDuration().count() / 1000) << "\n";
+        oss << "doc_paint_overlap_ratio" << suffix << ((double)doc.getPaintOverlapPercent() / 100) << "\n";
         oss << std::endl;
     }
 }
@@ -177,6 +177,7 @@ public:
         , _recvBytes(0)
         , _wopiDownloadDuration(0)
         , _wopiUploadDuration(0)
+        , _paintOverlapPercent(0)
         , _procSMaps(nullptr)
         , _lastTimeSMapsRead(0)
         , _isModified(false)
@@ -249,6 +250,8 @@ public:
     std::chrono::milliseconds getWopiDownloadDuration() const { return _wopiDownloadDuration; }
     void setWopiUploadDuration(const std::chrono::milliseconds wopiUploadDuration) { _wopiUploadDuration = wopiUploadDuration; }
     std::chrono::milliseconds getWopiUploadDuration() const { return _wopiUploadDuration; }
+    void setPaintOverlapPercent(unsigned paintOverlapPercent) { _paintOverlapPercent = paintOverlapPercent; }
+    unsigned getPaintOverlapPercent() const { return _paintOverlapPercent; }
     void setProcSMapsFD(const int smapsFD) { _procSMaps = fdopen(smapsFD, "r"); }
     bool hasMemDirtyChanged() const { return _hasMemDirtyChanged; }
     void setMemDirtyChanged(bool changeStatus) { _hasMemDirtyChanged = changeStatus; }
@@ -289,6 +292,9 @@ private:
     std::chrono::milliseconds _wopiDownloadDuration;
     std::chrono::milliseconds _wopiUploadDuration;
 
+    /// How much of the painting of tiles the Kit overlapped with encoding.
+    unsigned _paintOverlapPercent;
+
     FILE* _procSMaps;
     std::time_t _lastTimeSMapsRead;
 
@@ -412,6 +418,7 @@ public:
     void setViewLoadDuration(const std::string& docKey, const std::string& sessionId, std::chrono::milliseconds viewLoadDuration);
     void setDocWopiDownloadDuration(const std::string& docKey, std::chrono::milliseconds wopiDownloadDuration);
     void setDocWopiUploadDuration(const std::string& docKey, const std::chrono::milliseconds wopiUploadDuration);
+    void setDocPaintOverlap(const std::string& docKey, unsigned paintOverlapPercent);
     void addSegFaultCount(unsigned segFaultCount);
     void setForKitPid(pid_t pid) { _forKitPid = pid; }
     void addLostKitsTerminated(unsigned lostKitsTerminated);
@@ -138,6 +138,7 @@ using Poco::Net::PartHandler;
 #endif
 #include "Storage.hpp"
 #include <wsd/wopi/StorageConnectionManager.hpp>
+#include "TileCache.hpp"
 #include "TraceFile.hpp"
 #include <Unit.hpp>
 #include <Util.hpp>
@@ -824,7 +825,10 @@ std::mutex COOLWSD::lokit_main_mutex;
 #endif
 #endif
 
-std::shared_ptr<ChildProcess> getNewChild_Blocks(SocketPoll &destPoll, unsigned mobileAppDocId)
+/// Take a new child for destPoll, requesting more to be spawned, and waiting
+/// a while for one if wait is set.
+static std::shared_ptr<ChildProcess> getNewChild(SocketPoll &destPoll, unsigned mobileAppDocId,
+                                                 bool wait)
 {
     (void)mobileAppDocId;
     const auto startTime = std::chrono::steady_clock::now();
@@ -847,9 +851,11 @@ std::shared_ptr<ChildProcess> getNewChild_Blocks(SocketPoll &destPoll, unsigned
         return nullptr;
     }
 
-    const auto timeout = std::chrono::milliseconds(ChildSpawnTimeoutMs / 2);
+    const auto timeout = wait ? std::chrono::milliseconds(ChildSpawnTimeoutMs / 2)
+                              : std::chrono::milliseconds::zero();
     LOG_TRC("Waiting for a new child for a max of " << timeout);
 #else // MOBILEAPP
+    assert(wait && "Unexpected to poll for children in the mobile build");
     const auto timeout = std::chrono::hours(100);
 
 #ifdef IOS
@@ -909,13 +915,25 @@ std::shared_ptr<ChildProcess> getNewChild_Blocks(SocketPoll &destPoll, unsigned
     else
     {
         LOG_TRC("NewChildrenCV wait failed");
-        LOG_WRN("getNewChild: No child available. Sending spawn request to forkit and failing.");
+        if (wait)
+            LOG_WRN("getNewChild: No child available. Sending spawn request to forkit and "
+                    "failing.");
     }
 
     LOG_DBG("getNewChild: Timed out while waiting for new child.");
     return nullptr;
 }
 
+std::shared_ptr<ChildProcess> getNewChild_Blocks(SocketPoll &destPoll, unsigned mobileAppDocId)
+{
+    return getNewChild(destPoll, mobileAppDocId, /*wait=*/true);
+}
+
+std::shared_ptr<ChildProcess> getNewChild_NoWait(SocketPoll &destPoll)
+{
+    return getNewChild(destPoll, /*mobileAppDocId=*/0, /*wait=*/false);
+}
+
 #ifdef __linux__
 #if !MOBILEAPP
 class InotifySocket : public Socket
@@ -2021,6 +2039,17 @@ void COOLWSD::setupChildRoot(const bool UseMountNamespaces)
 
 #endif
 
+/// Moves a poll carrying many connections off poll(2), as configured:
+/// to io_uring, or else to epoll, when enabled and available.
+static void enableScalablePolling(SocketPoll& poll, bool useIoUring, bool useEpoll)
+{
+    if (useIoUring && poll.enableIoUring())
+        return;
+
+    if (useEpoll)
+        poll.enableEpoll();
+}
+
 void COOLWSD::innerInitialize(Application& self)
 {
     if (!Util::isMobileApp() && geteuid() == 0 && CheckCoolUser)
@@ -2080,8 +2109,13 @@ void COOLWSD::innerInitialize(Application& self)
         { "browser_logging", "false" },
         { "mount_jail_tree", "true" },
         { "net.connection_timeout_secs", "30" },
+        { "net.epoll", "false" },
+        { "net.io_uring", "false" },
         { "net.listen", "any" },
         { "net.proto", "all" },
+        { "net.websocket_deflate[@enable]", "false" },
+        { "net.websocket_deflate.window_bits", "12" },
+        { "net.websocket_deflate.mem_level", "6" },
         { "net.service_root", "" },
         { "net.proxy_prefix", "false" },
         { "net.content_security_policy", "" },
@@ -2106,6 +2140,10 @@ void COOLWSD::innerInitialize(Application& self)
         { "per_document.limit_stack_mem_kb", "8000" },
         { "per_document.limit_virt_mem_mb", "0" },
         { "per_document.max_concurrency", "4" },
+        { "per_document.pipeline_rendering", "false" },
+        { "per_document.pixmap_hugepages", "false" },
+        { "per_document.partial_tile_rendering", "false" },
+        { "per_document.shared_poll_threads", "0" },
         { "per_document.min_time_between_saves_ms", "500" },
         { "per_document.min_time_between_uploads_ms", "5000" },
         { "per_document.batch_priority", "5" },
@@ -2128,6 +2166,10 @@ void COOLWSD::innerInitialize(Application& self)
         { "ssl.hpkp.report_uri[@enable]", "false" },
         { "ssl.hpkp[@enable]", "false" },
         { "ssl.hpkp[@report_only]", "false" },
+        { "ssl.ktls", "false" },
+        { "ssl.session_cache_size", "0" },
+        { "ssl.session_tickets", "true" },
+        { "ssl.session_timeout_secs", "300" },
         { "ssl.sts.enabled", "false" },
         { "ssl.sts.max_age", "31536000" },
         { "ssl.key_file_path", COOLWSD_CONFIGDIR "/key.pem" },
@@ -2146,6 +2188,9 @@ void COOLWSD::innerInitialize(Application& self)
         { "storage.wopi[@allow]", "true" },
         { "storage.wopi.locking.refresh", "900" },
         { "storage.wopi.is_legacy_server", "false" },
+        { "storage.wopi.connection_pool[@enable]", "true" },
+        { "storage.wopi.connection_pool.max_per_host", "8" },
+        { "storage.wopi.connection_pool.idle_timeout_secs", "4" },
         { "sys_template_path", "systemplate" },
         { "trace_event[@enable]", "false" },
         { "trace.path[@compress]", "true" },
@@ -2182,6 +2227,10 @@ void COOLWSD::innerInitialize(Application& self)
         { "quarantine_files.max_versions_to_maintain", "5" },
         { "quarantine_files.path", "quarantine" },
         { "quarantine_files.expiry_min", "3000" },
+        { "tile_cache_persistent[@enable]", "false" },
+        { "tile_cache_persistent.path", "tilecache" },
+        { "tile_cache_persistent.max_file_size_mb", "64" },
+        { "tile_cache_persistent.limit_dir_size_mb", "1024" },
         { "remote_config.remote_url", "" },
         { "storage.wopi.alias_groups[@mode]", "first" },
         { "languagetool.base_url", "" },
@@ -2705,6 +2754,44 @@ void COOLWSD::innerInitialize(Application& self)
         LOG_INF("Quarantine is disabled in config");
     }
 
+#if !MOBILEAPP
+    if (getConfigValue<bool>(conf, "tile_cache_persistent[@enable]", false))
+    {
+        std::string path = Util::trimmed(getPathFromConfig("tile_cache_persistent.path"));
+        if (!path.empty() && path.back() == '/')
+            path.pop_back();
+
+        try
+        {
+            if (!path.empty())
+                Poco::File(path).createDirectories();
+        }
+        catch (const std::exception& ex)
+        {
+            LOG_WRN("Failed to create the persistent tile cache directory [" << path
+                                                                             << "]: " << ex.what());
+        }
+
+        if (path.empty() || !FileUtil::isWritable(path))
+        {
+            LOG_WRN("The persistent tile cache is enabled, but its path ["
+                    << path << "] is not a writable directory. Disabling it");
+        }
+        else
+        {
+            const size_t maxFileSize =
+                getConfigValue<size_t>(conf, "tile_cache_persistent.max_file_size_mb", 64) * 1024 *
+                1024;
+            const size_t maxDirSize =
+                getConfigValue<size_t>(conf, "tile_cache_persistent.limit_dir_size_mb", 1024) *
+                1024 * 1024;
+            LOG_INF("Persistent tile cache at [" << path << "], of up to " << maxDirSize
+                                                 << " bytes");
+            TileCache::initPersistentCache(path, maxFileSize, maxDirSize);
+        }
+    }
+#endif
+
     NumPreSpawnedChildren = getConfigValue<int>(conf, "num_prespawn_children", 1);
     if (NumPreSpawnedChildren < 1)
     {
@@ -2737,6 +2824,21 @@ void COOLWSD::innerInitialize(Application& self)
     }
     LOG_INF("MAX_CONCURRENCY set to " << maxConcurrency << '.');
 
+    if (maxConcurrency > 1 && getConfigValue<bool>(conf, "per_document.pipeline_rendering", false))
+    {
+        setenv("PIPELINE_RENDERING", "1", 1);
+        LOG_INF("Pipelined tile rendering enabled.");
+    }
+
+    if (getConfigValue<bool>(conf, "per_document.pixmap_hugepages", false))
+        setenv("PIXMAP_HUGEPAGES", "1", 1);
+
+    if (getConfigValue<bool>(conf, "per_document.partial_tile_rendering", false))
+    {
+        setenv("PARTIAL_TILE_RENDERING", "1", 1);
+        LOG_INF("Partial tile rendering enabled.");
+    }
+
     // It is worth avoiding configuring with a large number of under-weight
     // containers / VMs - better to have fewer, stronger ones.
     if (nThreads < 4)
@@ -2957,7 +3059,20 @@ void COOLWSD::innerInitialize(Application& self)
         std::make_unique<FileServerRequestHandler>(COOLWSD::FileServerRoot);
 #endif
 
+    WebSocketDeflate::ServerSettings._enabled =
+        getConfigValue<bool>(conf, "net.websocket_deflate[@enable]", false);
+    WebSocketDeflate::ServerSettings._maxWindowBits =
+        std::clamp(getConfigValue<int>(conf, "net.websocket_deflate.window_bits", 12),
+                   WebSocketDeflate::MinWindowBits, WebSocketDeflate::MaxWindowBits);
+    WebSocketDeflate::ServerSettings._memLevel =
+        std::clamp(getConfigValue<int>(conf, "net.websocket_deflate.mem_level", 6), 1, 9);
+
+    // These carry most of the connections, so can do with epoll or io_uring.
+    const bool useEpoll = getConfigValue<bool>(conf, "net.epoll", false);
+    const bool useIoUring = getConfigValue<bool>(conf, "net.io_uring", false);
+
     WebServerPoll = std::make_unique<TerminatingPoll>("websrv_poll");
+    enableScalablePolling(*WebServerPoll, useIoUring, useEpoll);
 
 #if !MOBILEAPP
     net::AsyncDNS::startAsyncDNS();
@@ -2967,8 +3082,9 @@ void COOLWSD::innerInitialize(Application& self)
 #endif
 
     PrisonerPoll = std::make_unique<PrisonPoll>();
+    enableScalablePolling(*PrisonerPoll, useIoUring, useEpoll);
 
-    Server = std::make_unique<COOLWSDServer>();
+    Server = std::make_unique<COOLWSDServer>(useIoUring, useEpoll);
 
     LOG_TRC("Initialize StorageBase");
     StorageBase::initialize();
@@ -3036,9 +3152,16 @@ void COOLWSD::initializeSSL()
             ssl_cipher_list = DEFAULT_CIPHER_SET;
     LOG_INF("SSL Cipher list: " << ssl_cipher_list);
 
+    ssl::ContextOptions options;
+    options._ktls = getConfigValue<bool>("ssl.ktls", false);
+    options._sessionCacheSize = getConfigValue<int>("ssl.session_cache_size", 0);
+    options._sessionTickets = getConfigValue<bool>("ssl.session_tickets", true);
+    options._sessionTimeoutSecs = getConfigValue<int>("ssl.session_timeout_secs", 300);
+
     // Initialize the non-blocking server socket SSL context.
     ssl::Manager::initializeServerContext(ssl_cert_file_path, ssl_key_file_path, ssl_ca_file_path,
-                                          ssl_cipher_list, ssl::CertificateVerification::Disabled);
+                                          ssl_cipher_list, ssl::CertificateVerification::Disabled,
+                                          options);
 
     if (!ssl::Manager::isServerContextInitialized())
         LOG_ERR("Failed to initialize Server SSL.");
@@ -3775,9 +3898,10 @@ private:
 #endif
 
         // Consume the incoming data by parsing and processing the body.
+        // Nothing is consumed until the whole header is in.
         http::Request request;
 #if !MOBILEAPP
-        const int64_t read = request.readData(data.data(), data.size());
+        const int64_t read = request.readHeader(data.data(), data.size());
         if (read < 0)
         {
             LOG_ERR("Error parsing prisoner socket data");
@@ -4003,12 +4127,13 @@ class COOLWSDServer
     // allocate port & hold temporarily.
     std::shared_ptr<ServerSocket> _serverSocket;
 public:
-    COOLWSDServer()
+    COOLWSDServer(bool useIoUring, bool useEpoll)
         : _acceptPoll("accept_poll")
 #if !MOBILEAPP
         , _admin(Admin::instance())
 #endif
     {
+        enableScalablePolling(_acceptPoll, useIoUring, useEpoll);
     }
 
     ~COOLWSDServer()
@@ -4701,6 +4826,9 @@ int COOLWSD::innerMain()
         DocBrokers.clear();
     }
 
+    // All DocumentBrokers are done, stop any poll threads they shared.
+    DocumentBroker::stopSharedPolls();
+
     SigUtil::addActivity("save traces");
 
     if (TraceEventFile != NULL)
@@ -42,6 +42,9 @@ class FileServerRequestHandler;
 
 std::shared_ptr<ChildProcess> getNewChild_Blocks(SocketPoll &destPoll, unsigned mobileAppDocId);
 
+/// Take a spare child, if there is one, without waiting for more to spawn.
+std::shared_ptr<ChildProcess> getNewChild_NoWait(SocketPoll &destPoll);
+
 // A WSProcess object in the WSD process represents a descendant process, either the direct child
 // process ForKit or a grandchild Kit process, with which the WSD process communicates through a
 // WebSocket.
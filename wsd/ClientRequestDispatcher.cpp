@@ -1719,7 +1719,8 @@ bool ClientRequestDispatcher::handlePostRequest(const RequestDetails& requestDet
 
             try
             {
-                HttpHelper::sendFile(socket, filePath.toString(), response);
+                HttpHelper::sendFile(socket, filePath.toString(), response, false, false,
+                                     false, request.get("Range", std::string()));
             }
             catch (const Poco::Exception& exc)
             {
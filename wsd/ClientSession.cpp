@@ -13,6 +13,7 @@
 
 #include "ClientSession.hpp"
 
+#include <cstring>
 #include <ios>
 #include <sstream>
 #include <string>
@@ -1674,10 +1675,16 @@ void ClientSession::writeQueuedMessages(std::size_t capacity)
         while (capacity > wrote && _senderQueue.dequeue(item) && item)
         {
             const std::vector<char>& data = item->data();
-            const auto size = data.size();
+            const auto size = item->totalSize();
             assert(size && "Zero-sized messages must never be queued for sending.");
 
-            if (item->isBinary())
+            if (!item->blobs().empty())
+            {
+                // Encode it once, if other sessions send it too.
+                Blob* frame = item.use_count() > 1 || item->frame() ? &item->frame() : nullptr;
+                Session::sendBinaryFrameWithBlobs(data.data(), data.size(), item->blobs(), frame);
+            }
+            else if (item->isBinary())
             {
                 Session::sendBinaryFrame(data.data(), size);
             }
@@ -2233,6 +2240,15 @@ bool ClientSession::handleKitToClientMessage(const std::shared_ptr<Message>& pay
             getTokenInteger(tokens[2], "canonicalid", canonicalId))
         {
             _canonicalViewId = canonicalId;
+
+            // Identifies the view's tiles across kits, unless they are watermarked.
+            std::string state;
+            if (tokens.size() > 3 && getTokenString(tokens[3], "viewrenderedstate", state) &&
+                docBroker->hasTileCache())
+            {
+                docBroker->tileCache().setViewRenderState(
+                    canonicalId, getWatermarkText().empty() ? state : std::string());
+            }
         }
     }
 #if ENABLE_FEATURE_LOCK || ENABLE_FEATURE_RESTRICTION
@@ -2601,6 +2617,201 @@ bool ClientSession::forwardToClient(const std::shared_ptr<Message>& payload)
     return true;
 }
 
+std::string ClientSession::getTileMessage(const TileDesc& desc, const Tile& tile,
+                                          std::vector<Blob>& blobs)
+{
+    return getTileMessage(desc, tile, _tracker.updateTileSeq(desc), blobs);
+}
+
+std::string ClientSession::getTileMessage(const TileDesc& desc, const Tile& tile,
+                                          TileWireId lastSentId, std::vector<Blob>& blobs)
+{
+    std::string header;
+    if (tile->needsKeyframe(lastSentId) || tile->isPng())
+        header = desc.serialize("tile:", "\n");
+    else
+        header = desc.serialize("delta:", "\n");
+
+    const bool hasContent = tile->appendChangesSince(blobs, tile->isPng() ? 0 : lastSentId);
+    LOG_TRC("Sending tile message: " << header << " lastSendId " << lastSentId << " content "
+                                     << hasContent);
+    return header;
+}
+
+void ClientSession::broadcastTileNow(const TileDesc& desc, const Tile& tile,
+                                     const std::vector<std::shared_ptr<ClientSession>>& sessions)
+{
+    std::vector<std::shared_ptr<ClientSession>> recipients;
+    std::vector<TileWireId> lastSentIds;
+    for (const auto& session : sessions)
+    {
+        if (session->isCloseFrame())
+            continue;
+
+        recipients.push_back(session);
+        lastSentIds.push_back(session->_tracker.updateTileSeq(desc));
+    }
+
+    // Each session queues and acknowledges it at its own pace.
+    const std::vector<std::shared_ptr<Message>> messages =
+        getTileMessages(desc, tile, lastSentIds);
+    for (std::size_t i = 0; i < recipients.size(); ++i)
+        recipients[i]->enqueueSendMessage(messages[i]);
+}
+
+std::vector<std::shared_ptr<Message>>
+ClientSession::getTileMessages(const TileDesc& desc, const Tile& tile,
+                               const std::vector<TileWireId>& lastSentIds)
+{
+    // The message only depends on what each recipient got of the tile last.
+    std::unordered_map<TileWireId, std::shared_ptr<Message>> distinct;
+    std::vector<std::shared_ptr<Message>> messages;
+    messages.reserve(lastSentIds.size());
+    for (const TileWireId lastSentId : lastSentIds)
+    {
+        std::shared_ptr<Message>& message = distinct[tile->isPng() ? 0 : lastSentId];
+        if (!message)
+        {
+            std::vector<Blob> blobs;
+            const std::string header = getTileMessage(desc, tile, lastSentId, blobs);
+            message = std::make_shared<Message>(header, std::move(blobs), Message::Dir::Out);
+        }
+
+        messages.push_back(message);
+    }
+
+    LOG_TRC("Tile " << desc.getWireId() << " for " << lastSentIds.size() << " recipients in "
+                    << distinct.size() << " distinct messages");
+    return messages;
+}
+
+bool ClientSession::sendTilesNow(const std::vector<std::pair<TileDesc, Tile>>& tiles)
+{
+    if (tiles.size() == 1 || !acceptsTileCombine())
+    {
+        bool sent = true;
+        for (const auto& [desc, tile] : tiles)
+            sent &= sendTileNow(desc, tile);
+
+        return sent;
+    }
+
+    if (isCloseFrame())
+        return false;
+
+    std::vector<TileWireId> lastSentIds;
+    lastSentIds.reserve(tiles.size());
+    for (const auto& pair : tiles)
+        lastSentIds.push_back(_tracker.updateTileSeq(pair.first));
+
+    enqueueSendMessage(getTileCombineMessage(tiles, lastSentIds));
+    return true;
+}
+
+std::shared_ptr<Message>
+ClientSession::getTileCombineMessage(const std::vector<std::pair<TileDesc, Tile>>& tiles,
+                                     const std::vector<TileWireId>& lastSentIds)
+{
+    // Each tile message is its header, as a small blob, followed by its data.
+    std::vector<Blob> blobs;
+    std::string header = "tilecombine: sizes=";
+    for (std::size_t i = 0; i < tiles.size(); ++i)
+    {
+        const std::size_t first = blobs.size();
+        blobs.emplace_back();
+        const std::string tileHeader =
+            getTileMessage(tiles[i].first, tiles[i].second, lastSentIds[i], blobs);
+        blobs[first] = std::make_shared<BlobData>(tileHeader.begin(), tileHeader.end());
+
+        std::size_t size = 0;
+        for (std::size_t j = first; j < blobs.size(); ++j)
+            size += blobs[j]->size();
+
+        if (i)
+            header += ',';
+        header += std::to_string(size);
+    }
+
+    header += '\n';
+
+    LOG_TRC("Combined " << tiles.size() << " tiles in " << blobs.size() << " blobs");
+    return std::make_shared<Message>(header, std::move(blobs), Message::Dir::Out);
+}
+
+std::vector<TileDesc> ClientSession::getTilesInMessage(Message& message)
+{
+    std::vector<TileDesc> tiles;
+    if (message.firstTokenMatches("tile:") || message.firstTokenMatches("delta:"))
+    {
+        tiles.push_back(TileDesc::parse(message.firstLine()));
+        return tiles;
+    }
+
+    std::string sizes;
+    if (!message.firstTokenMatches("tilecombine:") ||
+        !COOLProtocol::getTokenString(message.tokens(), "sizes", sizes))
+        return tiles;
+
+    // The tile messages follow the first line, in data() and then the blobs.
+    std::vector<std::pair<const char*, std::size_t>> spans;
+    const std::vector<char>& data = message.data();
+    const std::size_t lineEnd = message.firstLine().size() + 1;
+    if (lineEnd < data.size())
+        spans.emplace_back(data.data() + lineEnd, data.size() - lineEnd);
+    for (const Blob& blob : message.blobs())
+        spans.emplace_back(blob->data(), blob->size());
+
+    std::size_t span = 0;
+    std::size_t offset = 0;
+    const StringVector tokens = StringVector::tokenize(sizes, ',');
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        const auto [size, ok] = Util::u64FromString(tokens[i]);
+        if (!ok || size == 0)
+        {
+            LOG_ERR("Invalid tile size [" << tokens[i] << "] in " << message.abbr());
+            return std::vector<TileDesc>();
+        }
+
+        // Each tile message starts with its own first line.
+        std::string header;
+        bool haveHeader = false;
+        std::size_t remaining = size;
+        while (remaining && span < spans.size())
+        {
+            const char* start = spans[span].first + offset;
+            const std::size_t len = std::min(remaining, spans[span].second - offset);
+            if (!haveHeader)
+            {
+                const char* end = static_cast<const char*>(std::memchr(start, '\n', len));
+                header.append(start, end ? end - start : len);
+                haveHeader = end != nullptr;
+            }
+
+            remaining -= len;
+            offset += len;
+            if (offset == spans[span].second)
+            {
+                ++span;
+                offset = 0;
+            }
+        }
+
+        if (remaining || !haveHeader)
+        {
+            LOG_ERR("Tile " << i << " overruns " << message.abbr());
+            return std::vector<TileDesc>();
+        }
+
+        tiles.push_back(TileDesc::parse(header));
+    }
+
+    if (span != spans.size())
+        LOG_ERR("Trailing data after " << tiles.size() << " tiles in " << message.abbr());
+
+    return tiles;
+}
+
 void ClientSession::enqueueSendMessage(const std::shared_ptr<Message>& data)
 {
     if (isCloseFrame())
@@ -2613,22 +2824,21 @@ void ClientSession::enqueueSendMessage(const std::shared_ptr<Message>& data)
     LOG_CHECK_RET(docBroker && "Null DocumentBroker instance", );
     docBroker->ASSERT_CORRECT_THREAD();
 
-    std::unique_ptr<TileDesc> tile;
-    if (data->firstTokenMatches("tile:") ||
-        data->firstTokenMatches("delta:"))
-    {
-        // Avoid sending tile or delta if it has the same wireID as the
-        // previously sent tile
-        tile = std::make_unique<TileDesc>(TileDesc::parse(data->firstLine()));
-    }
+    // Each tile counts until the client reports it processed, combined or not.
+    const std::vector<TileDesc> tiles = getTilesInMessage(*data);
 
     LOG_TRC("Enqueueing client message " << data->id());
     std::size_t sizeBefore = _senderQueue.size();
     std::size_t newSize = _senderQueue.enqueue(data);
+    if (_protocol)
+        _protocol->markPollDirty(); // To poll for writing them.
 
-    // Track sent tile
-    if (tile && sizeBefore != newSize)
-        addTileOnFly(tile->getWireId());
+    // Track sent tiles
+    if (sizeBefore != newSize)
+    {
+        for (const TileDesc& tile : tiles)
+            addTileOnFly(tile.getWireId());
+    }
 }
 
 void ClientSession::addTileOnFly(TileWireId wireId)
@@ -113,36 +113,51 @@ public:
 
     bool sendTileNow(const TileDesc &desc, const Tile &tile)
     {
-        TileWireId lastSentId = _tracker.updateTileSeq(desc);
+        std::vector<Blob> blobs;
+        const std::string header = getTileMessage(desc, tile, blobs);
+        return enqueueBinaryFrameWithBlobs(header, std::move(blobs));
+    }
 
-        std::string header;
-        if (tile->needsKeyframe(lastSentId) || tile->isPng())
-            header = desc.serialize("tile:", "\n");
-        else
-            header = desc.serialize("delta:", "\n");
+    /// Send the given tiles in one tilecombine: message, if the client accepts it.
+    bool sendTilesNow(const std::vector<std::pair<TileDesc, Tile>>& tiles);
 
-        // FIXME: performance - optimize away this copy ...
-        std::vector<char> output;
+    /// Send the tile to the sessions, with one message, encoded once, shared
+    /// by all the sessions that last got the same version of the tile.
+    static void broadcastTileNow(const TileDesc& desc, const Tile& tile,
+                                 const std::vector<std::shared_ptr<ClientSession>>& sessions);
 
-        // copy in the header
-        output.resize(header.size());
-        std::memcpy(output.data(), header.data(), header.size());
+    /// The messages of the tile for recipients that last got the given versions of it,
+    /// in the same order. Recipients that got the same version share a message.
+    static std::vector<std::shared_ptr<Message>>
+    getTileMessages(const TileDesc& desc, const Tile& tile,
+                    const std::vector<TileWireId>& lastSentIds);
 
-        bool hasContent = tile->appendChangesSince(output, tile->isPng() ? 0 : lastSentId);
-        LOG_TRC("Sending tile message: " << header << " lastSendId " << lastSentId << " content " << hasContent);
-        return sendBinaryFrame(output.data(), output.size());
-    }
+    /// The tilecombine: message of the tiles, for a recipient that last got the
+    /// given versions of them, in the same order.
+    static std::shared_ptr<Message>
+    getTileCombineMessage(const std::vector<std::pair<TileDesc, Tile>>& tiles,
+                          const std::vector<TileWireId>& lastSentIds);
+
+    /// The tiles a tile:, delta: or tilecombine: message carries, which are
+    /// on fly once it is queued. Empty for any other message.
+    static std::vector<TileDesc> getTilesInMessage(Message& message);
 
     bool sendBlob(const std::string &header, const Blob &blob)
     {
-        // FIXME: performance - optimize away this copy ...
-        std::vector<char> output;
+        return enqueueBinaryFrameWithBlobs(header, { blob });
+    }
 
-        output.resize(header.size() + blob->size());
-        std::memcpy(output.data(), header.data(), header.size());
-        std::memcpy(output.data() + header.size(), blob->data(), blob->size());
+    /// Queue a binary frame of the header followed by the blobs, which are not copied.
+    bool enqueueBinaryFrameWithBlobs(const std::string& header, std::vector<Blob> blobs)
+    {
+        if (!isCloseFrame())
+        {
+            enqueueSendMessage(
+                std::make_shared<Message>(header, std::move(blobs), Message::Dir::Out));
+            return true;
+        }
 
-        return sendBinaryFrame(output.data(), output.size());
+        return false;
     }
 
     bool sendTextFrame(const char* buffer, const int length) override
@@ -197,6 +212,7 @@ public:
     void onTileProcessed(TileWireId wireId);
 
     Util::Rectangle getVisibleArea() const { return _clientVisibleArea; }
+    int getSelectedPart() const { return _clientSelectedPart; }
     /// Visible area can have negative value as position, but we have tiles only in the positive range
     Util::Rectangle getNormalizedVisibleArea() const;
 
@@ -314,6 +330,14 @@ private:
 
     bool forwardToClient(const std::shared_ptr<Message>& payload);
 
+    /// Get the tile: or delta: message for the tile, updating what was sent.
+    /// Returns its header, the blobs of data to follow are appended to blobs.
+    std::string getTileMessage(const TileDesc& desc, const Tile& tile, std::vector<Blob>& blobs);
+
+    /// Get the tile: or delta: message for the tile, to a client which got lastSentId.
+    static std::string getTileMessage(const TileDesc& desc, const Tile& tile,
+                                      TileWireId lastSentId, std::vector<Blob>& blobs);
+
     /// Returns true if given message from the client should be allowed or not
     /// Eg. in readonly mode only few messages should be allowed
     bool filterMessage(const std::string& msg) const;
@@ -148,6 +148,172 @@ public:
     }
 };
 
+/// A poll thread shared by a number of DocumentBrokers.
+/// Each DocumentBroker is pinned to a single SharedPoll for its
+/// lifetime, so its thread-affinity is the same as with a
+/// dedicated DocumentBrokerPoll.
+class DocumentBroker::SharedPoll final : public TerminatingPoll
+{
+    /// The DocumentBrokers we poll for. Only touched in our thread.
+    std::vector<DocumentBroker*> _docBrokers;
+
+    /// The DocumentBrokers waiting for a child before they can be polled.
+    /// Only touched in our thread.
+    std::vector<DocumentBroker*> _starting;
+
+    /// The number of DocumentBrokers added and not yet finished.
+    std::atomic<std::size_t> _count;
+
+public:
+    SharedPoll(const std::string& threadName)
+        : TerminatingPoll(threadName)
+        , _count(0)
+    {
+    }
+
+    std::size_t getDocBrokerCount() const { return _count; }
+
+    /// Start polling for the given DocumentBroker in our thread.
+    void addDocBroker(DocumentBroker* docBroker)
+    {
+        ++_count;
+        startThread();
+        addCallback([this, docBroker]() { _starting.push_back(docBroker); });
+    }
+
+    void pollingThread() override
+    {
+        while (continuePolling() && !SigUtil::getTerminationFlag())
+        {
+            std::chrono::microseconds timeout = SocketPoll::DefaultPollTimeoutMicroS;
+            for (const DocumentBroker* docBroker : _docBrokers)
+                timeout = std::min(timeout, docBroker->getPollTimeout());
+
+            const auto now = std::chrono::steady_clock::now();
+            for (const DocumentBroker* docBroker : _starting)
+            {
+                timeout = std::min(timeout,
+                                   std::max(std::chrono::microseconds::zero(),
+                                            std::chrono::duration_cast<std::chrono::microseconds>(
+                                                docBroker->getStartRetryTime() - now)));
+            }
+
+            poll(timeout);
+
+            // Only polled once started, each at its own pace.
+            for (auto it = _starting.begin(); it != _starting.end();)
+            {
+                DocumentBroker* docBroker = *it;
+                const StartState state =
+                    docBroker->continueStarting(std::chrono::steady_clock::now());
+                if (state == StartState::Waiting)
+                {
+                    ++it;
+                    continue;
+                }
+
+                it = _starting.erase(it);
+                if (state == StartState::Ready)
+                {
+                    _docBrokers.push_back(docBroker);
+                }
+                else
+                {
+                    --_count;
+                    docBroker->setPollFinished();
+                }
+            }
+
+            // Process each DocumentBroker, as its own loop would after polling.
+            for (auto it = _docBrokers.begin(); it != _docBrokers.end();)
+            {
+                DocumentBroker* docBroker = *it;
+                if (docBroker->continuePolling())
+                    docBroker->processPollEvents();
+
+                if (docBroker->continuePolling())
+                {
+                    ++it;
+                    continue;
+                }
+
+                it = _docBrokers.erase(it);
+                finish(docBroker);
+            }
+        }
+
+        for (DocumentBroker* docBroker : _docBrokers)
+            finish(docBroker);
+
+        _docBrokers.clear();
+
+        // Never started, nothing to clean up.
+        for (DocumentBroker* docBroker : _starting)
+        {
+            --_count;
+            docBroker->setPollFinished();
+        }
+
+        _starting.clear();
+    }
+
+private:
+    void finish(DocumentBroker* docBroker)
+    {
+        docBroker->finishPolling();
+        --_count;
+
+        // The DocumentBroker may be destroyed as soon as this is set.
+        docBroker->setPollFinished();
+    }
+};
+
+std::mutex DocumentBroker::SharedPollsMutex;
+std::vector<std::shared_ptr<DocumentBroker::SharedPoll>> DocumentBroker::SharedPolls;
+
+std::shared_ptr<DocumentBroker::SharedPoll>
+DocumentBroker::getSharedPoll(const Poco::URI& uriPublic)
+{
+    static const std::size_t SharedPollThreads =
+        COOLWSD::getConfigValue<unsigned>("per_document.shared_poll_threads", 0);
+    if (Util::isMobileApp() || SharedPollThreads == 0)
+        return nullptr;
+
+    // As StorageBase::validate() tells files from WOPI.
+    if (uriPublic.isRelative() || uriPublic.getScheme() == "file")
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(SharedPollsMutex);
+
+    if (SharedPolls.empty())
+    {
+        LOG_INF("Sharing " << SharedPollThreads << " poll threads between all documents");
+        for (std::size_t i = 0; i < SharedPollThreads; ++i)
+            SharedPolls.push_back(std::make_shared<SharedPoll>(
+                "doc" SHARED_DOC_THREADNAME_SUFFIX "s" + std::to_string(i)));
+    }
+
+    // Pin to the least loaded thread.
+    std::shared_ptr<SharedPoll> best = SharedPolls[0];
+    for (const auto& sharedPoll : SharedPolls)
+    {
+        if (sharedPoll->getDocBrokerCount() < best->getDocBrokerCount())
+            best = sharedPoll;
+    }
+
+    return best;
+}
+
+void DocumentBroker::stopSharedPolls()
+{
+    std::lock_guard<std::mutex> lock(SharedPollsMutex);
+
+    for (const auto& sharedPoll : SharedPolls)
+        sharedPoll->joinThread();
+
+    SharedPolls.clear();
+}
+
 std::atomic<unsigned> DocumentBroker::DocBrokerId(1);
 
 DocumentBroker::DocumentBroker(ChildType type, const std::string& uri, const Poco::URI& uriPublic,
@@ -178,14 +344,28 @@ DocumentBroker::DocumentBroker(ChildType type, const std::string& uri, const Poc
     , _cursorPosY(0)
     , _cursorWidth(0)
     , _cursorHeight(0)
-    , _poll(
-          std::make_shared<DocumentBrokerPoll>("doc" SHARED_DOC_THREADNAME_SUFFIX + _docId, *this))
+    , _sharedPoll(getSharedPoll(_uriPublic))
+    , _pollStarted(false)
+    , _pollFinished(false)
+    , _started(false)
+    , _sharedPolling(std::make_shared<bool>(true))
+    , _poll(_sharedPoll ? std::static_pointer_cast<TerminatingPoll>(_sharedPoll)
+                        : std::make_shared<DocumentBrokerPoll>(
+                              "doc" SHARED_DOC_THREADNAME_SUFFIX + _docId, *this))
     , _stop(false)
     , _lockCtx(std::make_unique<LockContext>())
     , _tileVersion(0)
     , _debugRenderedTileCount(0)
+#if !MOBILEAPP
+    , _adminSent(0)
+    , _adminRecv(0)
+    , _limitLoadSecs(0)
+#endif
+    , _limitStoreFailures(0)
+    , _waitingForMigrationMsg(false)
     , _loadDuration(0)
     , _wopiDownloadDuration(0)
+    , _asyncDownloading(false)
     , _mobileAppDocId(mobileAppDocId)
     , _alwaysSaveOnExit(COOLWSD::getConfigValue<bool>("per_document.always_save_on_exit", false))
     , _backgroundAutoSave(COOLWSD::getConfigValue<bool>("per_document.background_autosave", true))
@@ -218,7 +398,7 @@ DocumentBroker::DocumentBroker(ChildType type, const std::string& uri, const Poc
     if (_initialWopiFileInfo)
     {
         LOG_DBG("Starting DocBrokerPoll thread");
-        _poll->startThread();
+        startThread();
     }
 }
 
@@ -236,7 +416,25 @@ void DocumentBroker::setupPriorities()
 void DocumentBroker::setupTransfer(SocketDisposition &disposition,
                                    SocketDisposition::MoveFunction transferFn)
 {
-    disposition.setTransfer(*_poll, std::move(transferFn));
+    if (!_sharedPoll)
+    {
+        disposition.setTransfer(*_poll, std::move(transferFn));
+        return;
+    }
+
+    // The socket waits with our other callbacks until we started; the
+    // closure keeps us alive, as with setTransfer().
+    disposition.setMove(
+        [this, transferFn = std::move(transferFn)](const std::shared_ptr<Socket>& socket)
+        {
+            startThread();
+            addCallback(
+                [this, socket, transferFn]()
+                {
+                    _poll->insertNewSocket(socket);
+                    transferFn(socket);
+                });
+        });
 }
 
 void DocumentBroker::setupTransfer(const std::shared_ptr<StreamSocket>& socket,
@@ -245,8 +443,8 @@ void DocumentBroker::setupTransfer(const std::shared_ptr<StreamSocket>& socket,
     // Drop pretentions of ownership before _socketMove.
     socket->resetThreadOwner();
 
-    _poll->startThread();
-    _poll->addCallback(
+    startThread();
+    addCallback(
         [this, socket, transferFn]()
         {
             _poll->insertNewSocket(socket);
@@ -254,13 +452,38 @@ void DocumentBroker::setupTransfer(const std::shared_ptr<StreamSocket>& socket,
         });
 }
 
+void DocumentBroker::startThread()
+{
+    if (!_sharedPoll)
+        _poll->startThread();
+    else if (!_pollStarted.exchange(true))
+        _sharedPoll->addDocBroker(this);
+}
+
 void DocumentBroker::assertCorrectThread(const char* filename, int line) const
 {
-    _poll->assertCorrectThread(filename, line);
+    // A shared poll thread is ours only while it polls for us.
+    if (!_sharedPoll || (_pollStarted && !_pollFinished))
+        _poll->assertCorrectThread(filename, line);
 }
 
 // The inner heart of the DocumentBroker - our poll loop.
 void DocumentBroker::pollThread()
+{
+    if (!startPolling())
+        return;
+
+    // Main polling loop goodness.
+    while (continuePolling())
+    {
+        _poll->poll(getPollTimeout());
+        processPollEvents();
+    }
+
+    finishPolling();
+}
+
+bool DocumentBroker::startPolling()
 {
     _threadStart = std::chrono::steady_clock::now();
 
@@ -281,6 +504,60 @@ void DocumentBroker::pollThread()
         std::this_thread::sleep_for(std::chrono::milliseconds(CHILD_REBALANCE_INTERVAL_MS / 10));
     } while (!_stop && _poll->continuePolling() && !SigUtil::getShutdownRequestFlag());
 
+    return startWithChild();
+}
+
+DocumentBroker::StartState
+DocumentBroker::continueStarting(std::chrono::steady_clock::time_point now)
+{
+    if (_startRetryTime == std::chrono::steady_clock::time_point())
+    {
+        _threadStart = now;
+        LOG_INF("Starting docBroker polling for docKey [" << _docKey << "] in a shared thread");
+    }
+    else if (now < _startRetryTime)
+        return StartState::Waiting;
+
+    // Take a spare child, or try again later, instead of waiting for one to
+    // spawn while the other documents of this thread wait for us.
+    static constexpr std::chrono::milliseconds timeoutMs(COMMAND_TIMEOUT_MS * 5);
+    _childProcess = getNewChild_NoWait(*_poll);
+    if (!_childProcess && now - _threadStart <= timeoutMs && !_stop &&
+        _poll->continuePolling() && !SigUtil::getShutdownRequestFlag())
+    {
+        _startRetryTime = now + std::chrono::milliseconds(CHILD_REBALANCE_INTERVAL_MS / 10);
+        return StartState::Waiting;
+    }
+
+    const bool started = startWithChild();
+    runStartCallbacks();
+    return started ? StartState::Ready : StartState::Failed;
+}
+
+void DocumentBroker::setPollFinished()
+{
+    *_sharedPolling = false;
+
+    // Notify under the lock, as the waiter may destroy us once woken.
+    std::lock_guard<std::mutex> lock(_pollFinishedMutex);
+    _pollFinished = true;
+    _pollFinishedCV.notify_all();
+}
+
+void DocumentBroker::runStartCallbacks()
+{
+    // Under the lock, lest a new callback overtake the deferred ones.
+    std::lock_guard<std::mutex> lock(_startMutex);
+
+    _started = true;
+    for (const SocketPoll::CallbackFn& fn : _startCallbacks)
+        _poll->addCallback(fn);
+
+    _startCallbacks.clear();
+}
+
+bool DocumentBroker::startWithChild()
+{
     if (!_childProcess)
     {
         // Let the client know we can't serve now.
@@ -297,13 +574,14 @@ void DocumentBroker::pollThread()
         stop("Failed to get new child.");
 
         // Stop to mark it done and cleanup.
-        _poll->stop();
+        if (!_sharedPoll)
+            _poll->stop();
 
         // Async cleanup.
         COOLWSD::doHousekeeping();
 
         LOG_INF("Finished docBroker polling thread for docKey [" << _docKey << "].");
-        return;
+        return false;
     }
 
     // We have a child process.
@@ -326,27 +604,23 @@ void DocumentBroker::pollThread()
             stop("advance download failed");
 
             // Stop to mark it done and cleanup.
-            _poll->stop();
+            if (!_sharedPoll)
+                _poll->stop();
 
             // Async cleanup.
             COOLWSD::doHousekeeping();
 
-            return;
+            return false;
         }
     }
 
-
 #if !MOBILEAPP
-    CONFIG_STATIC const std::size_t IdleDocTimeoutSecs =
-        COOLWSD::getConfigValue<int>("per_document.idle_timeout_secs", 3600);
+    _adminSent = 0;
+    _adminRecv = 0;
+    _lastBWUpdateTime = std::chrono::steady_clock::now();
+    _lastClipboardHashUpdateTime = std::chrono::steady_clock::now();
 
-    // Used to accumulate B/W deltas.
-    uint64_t adminSent = 0;
-    uint64_t adminRecv = 0;
-    auto lastBWUpdateTime = std::chrono::steady_clock::now();
-    auto lastClipboardHashUpdateTime = std::chrono::steady_clock::now();
-
-    const int limit_load_secs =
+    _limitLoadSecs =
 #if ENABLE_DEBUG
         // paused waiting for a debugger to attach
         // ignore load time out
@@ -354,297 +628,317 @@ void DocumentBroker::pollThread()
 #endif
         COOLWSD::getConfigValue<int>("per_document.limit_load_secs", 100);
 
-    auto loadDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(limit_load_secs);
+    _loadDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(_limitLoadSecs);
 #endif
 
-    const auto limStoreFailures =
-        COOLWSD::getConfigValue<int>("per_document.limit_store_failures", 5);
+    _limitStoreFailures = COOLWSD::getConfigValue<int>("per_document.limit_store_failures", 5);
+
+    _waitingForMigrationMsg = false;
+
+    return true;
+}
+
+bool DocumentBroker::continuePolling() const
+{
+    return !_stop && _poll->continuePolling() && !SigUtil::getTerminationFlag();
+}
+
+std::chrono::microseconds DocumentBroker::getPollTimeout() const
+{
+    // Poll more frequently while unloading to cleanup sooner.
+    const bool unloading = isMarkedToDestroy() || _docState.isUnloadRequested();
+    return unloading ? SocketPoll::DefaultPollTimeoutMicroS / 16
+                     : SocketPoll::DefaultPollTimeoutMicroS;
+}
+
+void DocumentBroker::processPollEvents()
+{
+#if !MOBILEAPP
+    CONFIG_STATIC const std::size_t IdleDocTimeoutSecs =
+        COOLWSD::getConfigValue<int>("per_document.idle_timeout_secs", 3600);
+#endif
 
-    bool waitingForMigrationMsg = false;
-    std::chrono::time_point<std::chrono::steady_clock> migrationMsgStartTime;
     static const std::chrono::microseconds migrationMsgTimeout = std::chrono::seconds(
         COOLWSD::getConfigValue<int>("indirection_endpoint.migration_timeout_secs", 180));
 
-    // Main polling loop goodness.
-    while (!_stop && _poll->continuePolling() && !SigUtil::getTerminationFlag())
-    {
-        // Poll more frequently while unloading to cleanup sooner.
-        const bool unloading = isMarkedToDestroy() || _docState.isUnloadRequested();
-        _poll->poll(unloading ? SocketPoll::DefaultPollTimeoutMicroS / 16
-                              : SocketPoll::DefaultPollTimeoutMicroS);
+    // Consolidate updates across multiple processed events.
+    processBatchUpdates();
 
-        // Consolidate updates across multiple processed events.
-        processBatchUpdates();
+    // Write the tiles evicted while handling the events, all at once.
+    if (_tileCache)
+        _tileCache->flushPersistentCache();
 
-        if (_stop)
-        {
-            LOG_DBG("Doc [" << _docKey << "] is flagged to stop after returning from poll.");
-            break;
-        }
+    if (_stop)
+    {
+        LOG_DBG("Doc [" << _docKey << "] is flagged to stop after returning from poll.");
+        return;
+    }
 
-        if (_unitWsd && _unitWsd->isFinished())
-        {
-            stop("UnitTestFinished");
-            break;
-        }
+    if (_unitWsd && _unitWsd->isFinished())
+    {
+        stop("UnitTestFinished");
+        return;
+    }
 
 #if !MOBILEAPP
-        const auto now = std::chrono::steady_clock::now();
+    const auto now = std::chrono::steady_clock::now();
 
-        // a tile's data is ~8k, a 4k screen is ~256 256x256 tiles -
-        // so double that - 4Mb per view.
-        if (_tileCache)
-            _tileCache->setMaxCacheSize(8 * 1024 * 256 * 2 * _sessions.size());
+    // a tile's data is ~8k, a 4k screen is ~256 256x256 tiles -
+    // so double that - 4Mb per view.
+    if (_tileCache)
+        _tileCache->setMaxCacheSize(8 * 1024 * 256 * 2 * _sessions.size());
 
-        if (isInteractive())
+    if (isInteractive())
+    {
+        // It is possible to dismiss the interactive dialog,
+        // exit the Kit process, or even crash. We would deadlock.
+        if (isUnloading())
         {
-            // It is possible to dismiss the interactive dialog,
-            // exit the Kit process, or even crash. We would deadlock.
-            if (isUnloading())
-            {
-                // We expect to have either isMarkedToDestroy() or
-                // isCloseRequested() in that case.
-                stop("abortedinteractive");
-            }
-
-            // Extend the deadline while we are interactiving with the user.
-            loadDeadline = now + std::chrono::seconds(limit_load_secs);
-            continue;
+            // We expect to have either isMarkedToDestroy() or
+            // isCloseRequested() in that case.
+            stop("abortedinteractive");
         }
 
-        if (!isLoaded() && (limit_load_secs > 0) && (now > loadDeadline))
-        {
-            LOG_ERR("Doc [" << _docKey << "] is taking too long to load. Will kill process ["
-                    << _childProcess->getPid() << "]. per_document.limit_load_secs set to "
-                    << limit_load_secs << " secs.");
-            broadcastMessage("error: cmd=load kind=docloadtimeout");
+        // Extend the deadline while we are interactiving with the user.
+        _loadDeadline = now + std::chrono::seconds(_limitLoadSecs);
+        return;
+    }
 
-            // Brutal but effective.
-            if (_childProcess)
-                _childProcess->terminate();
+    if (!isLoaded() && (_limitLoadSecs > 0) && (now > _loadDeadline))
+    {
+        LOG_ERR("Doc [" << _docKey << "] is taking too long to load. Will kill process ["
+                << _childProcess->getPid() << "]. per_document.limit_load_secs set to "
+                << _limitLoadSecs << " secs.");
+        broadcastMessage("error: cmd=load kind=docloadtimeout");
 
-            stop("Doc lifetime expired");
-            continue;
-        }
+        // Brutal but effective.
+        if (_childProcess)
+            _childProcess->terminate();
 
-        // Check if we had a sunset time and expired.
-        if (_limitLifeSeconds > std::chrono::seconds::zero()
-            && std::chrono::duration_cast<std::chrono::seconds>(now - _threadStart)
-                   > _limitLifeSeconds)
-        {
-            LOG_WRN("Doc [" << _docKey << "] is taking too long to convert. Will kill process ["
-                            << _childProcess->getPid()
-                            << "]. per_document.limit_convert_secs set to "
-                            << _limitLifeSeconds.count() << " secs.");
-            broadcastMessage("error: cmd=load kind=docexpired");
-
-            // Brutal but effective.
-            if (_childProcess)
-                _childProcess->terminate();
-
-            stop("Convert-to timed out");
-            continue;
-        }
+        stop("Doc lifetime expired");
+        return;
+    }
 
-        if (std::chrono::duration_cast<std::chrono::milliseconds>
-                    (now - lastBWUpdateTime).count() >= COMMAND_TIMEOUT_MS)
-        {
-            lastBWUpdateTime = now;
-            uint64_t sent = 0, recv = 0;
-            getIOStats(sent, recv);
+    // Check if we had a sunset time and expired.
+    if (_limitLifeSeconds > std::chrono::seconds::zero()
+        && std::chrono::duration_cast<std::chrono::seconds>(now - _threadStart)
+               > _limitLifeSeconds)
+    {
+        LOG_WRN("Doc [" << _docKey << "] is taking too long to convert. Will kill process ["
+                        << _childProcess->getPid()
+                        << "]. per_document.limit_convert_secs set to "
+                        << _limitLifeSeconds.count() << " secs.");
+        broadcastMessage("error: cmd=load kind=docexpired");
 
-            uint64_t deltaSent = 0, deltaRecv = 0;
+        // Brutal but effective.
+        if (_childProcess)
+            _childProcess->terminate();
 
-            // connection drop transiently reduces this.
-            if (sent > adminSent)
-            {
-                deltaSent = sent - adminSent;
-                adminSent = sent;
-            }
-            if (recv > deltaRecv)
-            {
-                deltaRecv = recv - adminRecv;
-                adminRecv = recv;
-            }
-            LOG_TRC("Doc [" << _docKey << "] added stats sent: +" << deltaSent << ", recv: +" << deltaRecv << " bytes to totals.");
+        stop("Convert-to timed out");
+        return;
+    }
 
-            // send change since last notification.
-            _admin.addBytes(getDocKey(), deltaSent, deltaRecv);
-        }
+    if (std::chrono::duration_cast<std::chrono::milliseconds>
+                (now - _lastBWUpdateTime).count() >= COMMAND_TIMEOUT_MS)
+    {
+        _lastBWUpdateTime = now;
+        uint64_t sent = 0, recv = 0;
+        getIOStats(sent, recv);
 
-        if (_storage && !_lockStateUpdateRequest && _lockCtx->needsRefresh(now))
+        uint64_t deltaSent = 0, deltaRecv = 0;
+
+        // connection drop transiently reduces this.
+        if (sent > _adminSent)
         {
-            refreshLock();
+            deltaSent = sent - _adminSent;
+            _adminSent = sent;
         }
+        if (recv > deltaRecv)
+        {
+            deltaRecv = recv - _adminRecv;
+            _adminRecv = recv;
+        }
+        LOG_TRC("Doc [" << _docKey << "] added stats sent: +" << deltaSent << ", recv: +" << deltaRecv << " bytes to totals.");
+
+        // send change since last notification.
+        _admin.addBytes(getDocKey(), deltaSent, deltaRecv);
+    }
+
+    if (_storage && !_lockStateUpdateRequest && _lockCtx->needsRefresh(now))
+    {
+        refreshLock();
+    }
 #endif
 
-        LOG_TRC("Poll: current activity: " << DocumentState::name(_docState.activity()));
-        switch (_docState.activity())
+    LOG_TRC("Poll: current activity: " << DocumentState::name(_docState.activity()));
+    switch (_docState.activity())
+    {
+        case DocumentState::Activity::None:
         {
-            case DocumentState::Activity::None:
+            // Check if there are queued activities.
+            if (!_renameFilename.empty() && !_renameSessionId.empty())
             {
-                // Check if there are queued activities.
-                if (!_renameFilename.empty() && !_renameSessionId.empty())
-                {
-                    startRenameFileCommand();
-                    // Nothing more to do until the save is complete.
-                    continue;
-                }
+                startRenameFileCommand();
+                // Nothing more to do until the save is complete.
+                return;
+            }
 
 #if !MOBILEAPP
-                // Remove idle documents after 1 hour.
-                if (isLoaded() && getIdleTimeSecs() >= IdleDocTimeoutSecs)
-                {
-                    autoSaveAndStop("idle");
-                }
-                else
+            // Remove idle documents after 1 hour.
+            if (isLoaded() && getIdleTimeSecs() >= IdleDocTimeoutSecs)
+            {
+                autoSaveAndStop("idle");
+            }
+            else
 #endif
-                if (_sessions.empty() && (isLoaded() || _docState.isMarkedToDestroy()))
+            if (_sessions.empty() && (isLoaded() || _docState.isMarkedToDestroy()))
+            {
+                if (!isLoaded())
                 {
-                    if (!isLoaded())
-                    {
-                        // Nothing to do; no sessions, not loaded, marked to destroy.
-                        stop("dead");
-                    }
-                    else if (_saveManager.isSaving() || isAsyncUploading())
-                    {
-                        LOG_DBG("Don't terminate dead DocumentBroker: async saving in progress for "
-                                "docKey ["
-                                << getDocKey() << "].");
-                        continue;
-                    }
-
-                    autoSaveAndStop("dead");
+                    // Nothing to do; no sessions, not loaded, marked to destroy.
+                    stop("dead");
                 }
-                else if (COOLWSD::IndirectionServerEnabled && SigUtil::getShutdownRequestFlag() &&
-                         !_migrateMsgReceived)
+                else if (_saveManager.isSaving() || isAsyncUploading())
                 {
-                    if (!waitingForMigrationMsg)
-                    {
-                        migrationMsgStartTime = std::chrono::steady_clock::now();
-                        waitingForMigrationMsg = true;
-                        break;
-                    }
-
-                    const auto timeNow = std::chrono::steady_clock::now();
-                    const auto elapsedMicroS =
-                        std::chrono::duration_cast<std::chrono::microseconds>(
-                            timeNow - migrationMsgStartTime);
-                    if (elapsedMicroS > migrationMsgTimeout)
-                    {
-                        LOG_WRN("Timeout waiting for migration message for docKey[" << _docKey
-                                                                                    << ']');
-                        _migrateMsgReceived = true;
-                        break;
-                    }
-                    LOG_DBG("Waiting for migration message to arrive before closing the document "
-                            "for docKey["
-                            << _docKey << ']');
+                    LOG_DBG("Don't terminate dead DocumentBroker: async saving in progress for "
+                            "docKey ["
+                            << getDocKey() << "].");
+                    return;
                 }
-                else if (_docState.isUnloadRequested() || SigUtil::getShutdownRequestFlag() ||
-                         _docState.isCloseRequested())
-                {
-                    if (limStoreFailures > 0 && (_saveManager.saveFailureCount() >=
-                                                     static_cast<std::size_t>(limStoreFailures) ||
-                                                 _storageManager.uploadFailureCount() >=
-                                                     static_cast<std::size_t>(limStoreFailures)))
-                    {
-                        LOG_ERR(
-                            "Failed to store the document and reached maximum retry count of "
-                            << limStoreFailures
-                            << "Save failures: " << _saveManager.saveFailureCount()
-                            << ", Upload failures: " << _storageManager.uploadFailureCount()
-#if !MOBILEAPP
-                            << ". Giving up"
-                            << (_storage && _quarantine && _quarantine->isEnabled()
-                                    ? ". The document should be recoverable from the quarantine. "
-                                    : ", but Quarantine is disabled. ")
-#endif // !MOBILEAPP
-                        );
-                        stop("storefailed");
-                        continue;
-                    }
 
-                    const std::string reason =
-                        SigUtil::getShutdownRequestFlag()
-                            ? "recycling"
-                            : (!_closeReason.empty() ? _closeReason : "unloading");
-                    autoSaveAndStop(reason);
-                }
-                else if (!_stop && _saveManager.needAutoSaveCheck())
+                autoSaveAndStop("dead");
+            }
+            else if (COOLWSD::IndirectionServerEnabled && SigUtil::getShutdownRequestFlag() &&
+                     !_migrateMsgReceived)
+            {
+                if (!_waitingForMigrationMsg)
                 {
-                    LOG_TRC("Triggering an autosave by timer");
-                    autoSave(/*force=*/false, /*dontSaveIfUnmodified=*/true);
+                    _migrationMsgStartTime = std::chrono::steady_clock::now();
+                    _waitingForMigrationMsg = true;
+                    break;
                 }
-                else if (!isAsyncUploading() && !_storageManager.lastUploadSuccessful() &&
-                         needToUploadToStorage() != NeedToUpload::No)
+
+                const auto timeNow = std::chrono::steady_clock::now();
+                const auto elapsedMicroS =
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        timeNow - _migrationMsgStartTime);
+                if (elapsedMicroS > migrationMsgTimeout)
                 {
-                    // Retry uploading, if the last one failed and we can try again.
-                    const auto session = getWriteableSession();
-                    if (session && !session->getAuthorization().isExpired())
-                    {
-                        checkAndUploadToStorage(session, /*justSaved=*/false);
-                    }
+                    LOG_WRN("Timeout waiting for migration message for docKey[" << _docKey
+                                                                                << ']');
+                    _migrateMsgReceived = true;
+                    break;
                 }
+                LOG_DBG("Waiting for migration message to arrive before closing the document "
+                        "for docKey["
+                        << _docKey << ']');
             }
-            break;
-
-            case DocumentState::Activity::Save:
-            case DocumentState::Activity::SaveAs:
+            else if (_docState.isUnloadRequested() || SigUtil::getShutdownRequestFlag() ||
+                     _docState.isCloseRequested())
             {
-                if (_docState.isDisconnected())
+                if (_limitStoreFailures > 0 && (_saveManager.saveFailureCount() >=
+                                                 static_cast<std::size_t>(_limitStoreFailures) ||
+                                             _storageManager.uploadFailureCount() >=
+                                                 static_cast<std::size_t>(_limitStoreFailures)))
                 {
-                    // We will never save. No need to wait for timeout.
-                    LOG_DBG("Doc disconnected while saving. Ending save activity.");
-                    _saveManager.setLastSaveResult(/*success=*/false, /*newVersion=*/false);
-                    endActivity();
+                    LOG_ERR(
+                        "Failed to store the document and reached maximum retry count of "
+                        << _limitStoreFailures
+                        << "Save failures: " << _saveManager.saveFailureCount()
+                        << ", Upload failures: " << _storageManager.uploadFailureCount()
+#if !MOBILEAPP
+                        << ". Giving up"
+                        << (_storage && _quarantine && _quarantine->isEnabled()
+                                ? ". The document should be recoverable from the quarantine. "
+                                : ", but Quarantine is disabled. ")
+#endif // !MOBILEAPP
+                    );
+                    stop("storefailed");
+                    return;
                 }
-                else
-                if (_saveManager.hasSavingTimedOut())
+
+                const std::string reason =
+                    SigUtil::getShutdownRequestFlag()
+                        ? "recycling"
+                        : (!_closeReason.empty() ? _closeReason : "unloading");
+                autoSaveAndStop(reason);
+            }
+            else if (!_stop && _saveManager.needAutoSaveCheck())
+            {
+                LOG_TRC("Triggering an autosave by timer");
+                autoSave(/*force=*/false, /*dontSaveIfUnmodified=*/true);
+            }
+            else if (!isAsyncUploading() && !_storageManager.lastUploadSuccessful() &&
+                     needToUploadToStorage() != NeedToUpload::No)
+            {
+                // Retry uploading, if the last one failed and we can try again.
+                const auto session = getWriteableSession();
+                if (session && !session->getAuthorization().isExpired())
                 {
-                    LOG_DBG("Saving timedout. Ending save activity.");
-                    _saveManager.setLastSaveResult(/*success=*/false, /*newVersion=*/false);
-                    endActivity();
+                    checkAndUploadToStorage(session, /*justSaved=*/false);
                 }
             }
-            break;
+        }
+        break;
 
-            // We have some activity ongoing.
-            default:
+        case DocumentState::Activity::Save:
+        case DocumentState::Activity::SaveAs:
+        {
+            if (_docState.isDisconnected())
             {
-                constexpr std::chrono::seconds postponeAutosaveDuration(30);
-                LOG_TRC("Postponing autosave check by " << postponeAutosaveDuration);
-                _saveManager.postponeAutosave(postponeAutosaveDuration);
+                // We will never save. No need to wait for timeout.
+                LOG_DBG("Doc disconnected while saving. Ending save activity.");
+                _saveManager.setLastSaveResult(/*success=*/false, /*newVersion=*/false);
+                endActivity();
+            }
+            else
+            if (_saveManager.hasSavingTimedOut())
+            {
+                LOG_DBG("Saving timedout. Ending save activity.");
+                _saveManager.setLastSaveResult(/*success=*/false, /*newVersion=*/false);
+                endActivity();
             }
-            break;
         }
+        break;
+
+        // We have some activity ongoing.
+        default:
+        {
+            constexpr std::chrono::seconds postponeAutosaveDuration(30);
+            LOG_TRC("Postponing autosave check by " << postponeAutosaveDuration);
+            _saveManager.postponeAutosave(postponeAutosaveDuration);
+        }
+        break;
+    }
 
 #if !MOBILEAPP
-        if (std::chrono::duration_cast<std::chrono::minutes>(now - lastClipboardHashUpdateTime).count() >= 2)
+    if (std::chrono::duration_cast<std::chrono::minutes>(now - _lastClipboardHashUpdateTime).count() >= 2)
+    {
+        for (const auto& it : _sessions)
         {
-            for (const auto& it : _sessions)
+            if (it.second->staleWaitDisconnect(now))
             {
-                if (it.second->staleWaitDisconnect(now))
-                {
-                    LOG_WRN("Unusual, Kit session " << it.second->getId()
-                                                    << " failed its disconnect handshake, killing");
-                    finalRemoveSession(it.second);
-                    break; // it invalid.
-                }
+                LOG_WRN("Unusual, Kit session " << it.second->getId()
+                                                << " failed its disconnect handshake, killing");
+                finalRemoveSession(it.second);
+                break; // it invalid.
             }
         }
+    }
 
-        if (std::chrono::duration_cast<std::chrono::minutes>(now - lastClipboardHashUpdateTime).count() >= 5)
-        {
-            LOG_TRC("Rotating clipboard keys");
-            for (const auto& it : _sessions)
-                it.second->rotateClipboardKey(true);
+    if (std::chrono::duration_cast<std::chrono::minutes>(now - _lastClipboardHashUpdateTime).count() >= 5)
+    {
+        LOG_TRC("Rotating clipboard keys");
+        for (const auto& it : _sessions)
+            it.second->rotateClipboardKey(true);
 
-            lastClipboardHashUpdateTime = now;
-        }
-#endif
+        _lastClipboardHashUpdateTime = now;
     }
+#endif
+}
 
+void DocumentBroker::finishPolling()
+{
     LOG_INF("Finished polling doc ["
             << _docKey << "]. stop: " << _stop << ", continuePolling: " << _poll->continuePolling()
             << ", CloseReason: [" << _closeReason << ']'
@@ -694,8 +988,25 @@ void DocumentBroker::pollThread()
         LOG_WRN(state.str());
     }
 
+    // The client sockets to take out of a shared poll, which outlives us.
+    // Collected before terminating, which removes the sessions.
+    std::vector<std::shared_ptr<WebSocketHandler>> clients;
+    if (_sharedPoll)
+    {
+        for (const auto& pair : _sessions)
+        {
+            if (auto handler =
+                    std::dynamic_pointer_cast<WebSocketHandler>(pair.second->getProtocol()))
+                clients.push_back(std::move(handler));
+        }
+
+        // Nothing in flight may call us back once we are gone.
+        if (_storage)
+            _storage->cancelAsyncRequests();
+    }
+
     // Flush socket data first, if any.
-    if (_poll->getSocketCount())
+    if (!_sharedPoll && _poll->getSocketCount())
     {
         constexpr std::chrono::microseconds flushTimeoutMicroS(std::chrono::seconds(2));
         LOG_INF("Flushing " << _poll->getSocketCount() << " sockets for doc [" << _docKey
@@ -729,7 +1040,19 @@ void DocumentBroker::pollThread()
     terminateChild(_closeReason);
 
     // Stop to mark it done and cleanup.
-    _poll->stop();
+    if (!_sharedPoll)
+        _poll->stop();
+    else
+    {
+        // Flush what we can without holding up the other documents, and close.
+        LOG_INF("Flushing and closing " << clients.size() << " client sockets for doc ["
+                                        << _docKey << "] in the shared poll");
+        for (const std::shared_ptr<WebSocketHandler>& client : clients)
+            client->closeSocketIn(*_poll);
+
+        if (_childProcess)
+            _childProcess->closeSocketIn(*_poll);
+    }
 
 #if !MOBILEAPP
     if (dataLoss || _docState.disconnected() == DocumentState::Disconnected::Unexpected)
@@ -777,9 +1100,10 @@ void DocumentBroker::pollThread()
     LOG_INF("Finished docBroker polling thread for docKey [" << _docKey << ']');
 }
 
+
 bool DocumentBroker::isAlive() const
 {
-    if (!_stop || _poll->isAlive())
+    if (!_stop || (_sharedPoll ? _pollStarted && !_pollFinished : _poll->isAlive()))
         return true; // Polling thread not started or still running.
 
     // Shouldn't have live child process outside of the polling thread.
@@ -794,7 +1118,7 @@ DocumentBroker::~DocumentBroker()
                                 << " sessions left");
 
     // Do this early - to avoid operating on _childProcess from two threads.
-    _poll->joinThread();
+    joinThread();
 
     for (const auto& sessionIt : _sessions)
     {
@@ -824,7 +1148,15 @@ DocumentBroker::~DocumentBroker()
 
 void DocumentBroker::joinThread()
 {
-    _poll->joinThread();
+    if (!_sharedPoll)
+    {
+        _poll->joinThread();
+        return;
+    }
+
+    // The shared poll outlives us; wait for it to be done with us instead.
+    std::unique_lock<std::mutex> lock(_pollFinishedMutex);
+    _pollFinishedCV.wait(lock, [this]() { return !_pollStarted || _pollFinished; });
 }
 
 void DocumentBroker::stop(const std::string& reason)
@@ -946,6 +1278,13 @@ bool DocumentBroker::download(
     {
         LOG_DBG("CheckFileInfo for docKey [" << _docKey << "] "
                                              << (wopiFileInfo ? "already exists" : "is missing"));
+        if (!wopiFileInfo && _sharedPoll)
+        {
+            // Waiting would hold up the other documents of the thread, see checkFileInfoAsync.
+            throw std::runtime_error("Missing CheckFileInfo while adding session #" +
+                                     sessionId + " on a shared poll");
+        }
+
         if (!wopiFileInfo)
         {
             std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
@@ -1064,13 +1403,21 @@ bool DocumentBroker::download(
     lockIfEditing(session, uriPublic, userCanWrite);
 
     // Let's download the document now, if not downloaded.
+    // When downloading asynchronously, the document is loaded once downloaded.
     std::chrono::milliseconds getFileCallDurationMs = std::chrono::milliseconds::zero();
-    if (!_storage->isDownloaded())
+    bool downloading = _asyncDownloading;
+    if (downloading)
+    {
+        LOG_DBG("Document [" << _docKey << "] is being downloaded for session [" << sessionId
+                             << ']');
+    }
+    else if (!_storage->isDownloaded())
     {
         const Authorization auth =
             session ? session->getAuthorization() : Authorization::create(uriPublic);
-        if (!doDownloadDocument(auth, templateSource, fileInfo.getFilename(),
-                                getFileCallDurationMs))
+        downloading = downloadDocumentAsync(auth, templateSource, fileInfo.getFilename());
+        if (!downloading && !doDownloadDocument(auth, templateSource, fileInfo.getFilename(),
+                                                getFileCallDurationMs))
         {
             LOG_DBG("Failed to download or process downloaded document");
             return false;
@@ -1085,7 +1432,7 @@ bool DocumentBroker::download(
     {
         // Add the time taken to load the file from storage and to check file info.
         _wopiDownloadDuration += getFileCallDurationMs + checkFileInfoCallDurationMs;
-        if (session)
+        if (session && !downloading)
         {
             const auto downloadSecs = _wopiDownloadDuration.count() / 1000.;
             const std::string msg =
@@ -1098,6 +1445,33 @@ bool DocumentBroker::download(
     return true;
 }
 
+#if !MOBILEAPP
+void DocumentBroker::checkFileInfoAsync(
+    const Poco::URI& uriPublic,
+    std::function<void(std::unique_ptr<WopiStorage::WOPIFileInfo>)> onFinish)
+{
+    assert(_sharedPoll && "Only a shared poll can't wait for CheckFileInfo");
+
+    // The request owns itself until it finishes, and goes later from the poll.
+    auto checkFileInfo = std::make_shared<std::unique_ptr<CheckFileInfo>>();
+    *checkFileInfo = std::make_unique<CheckFileInfo>(
+        _poll, uriPublic,
+        [this, polling = _sharedPolling, poll = _poll, checkFileInfo, uriPublic,
+         onFinish = std::move(onFinish)](CheckFileInfo& request)
+        {
+            poll->addCallback([checkFileInfo]() { checkFileInfo->reset(); });
+            if (!*polling)
+                return; // We are done, and may be gone.
+
+            LOG_DBG("Async CheckFileInfo for docKey [" << _docKey << "] finished: "
+                                                       << CheckFileInfo::name(request.state()));
+            onFinish(request.wopiFileInfo(uriPublic));
+        });
+
+    (*checkFileInfo)->checkFileInfo(HTTP_REDIRECTION_LIMIT);
+}
+#endif
+
 void DocumentBroker::lockIfEditing(const std::shared_ptr<ClientSession>& session,
                                    const Poco::URI& uriPublic, bool userCanWrite)
 {
@@ -1115,7 +1489,20 @@ void DocumentBroker::lockIfEditing(const std::shared_ptr<ClientSession>& session
         {
             LOG_DBG("Locking docKey [" << _docKey << "], which is editable");
             std::string error;
-            if (!updateStorageLockState(*session, StorageBase::LockState::LOCK, error))
+            if (_sharedPoll)
+            {
+                // Don't hold up the other documents of the thread. A failure makes the
+                // session read-only later, see updateStorageLockStateAsync.
+                if (!_lockStateUpdateRequest &&
+                    !updateStorageLockStateAsync(session, StorageBase::LockState::LOCK, error))
+                {
+                    LOG_ERR("Failed to lock docKey [" << _docKey << "] with session ["
+                                                      << session->getId()
+                                                      << "]. Session will be read-only: " << error);
+                    session->setWritable(false);
+                }
+            }
+            else if (!updateStorageLockState(*session, StorageBase::LockState::LOCK, error))
             {
                 LOG_ERR("Failed to lock docKey ["
                         << _docKey << "] with session [" << session->getId()
@@ -1132,7 +1519,9 @@ void DocumentBroker::lockIfEditing(const std::shared_ptr<ClientSession>& session
     // See if we have permission-override from the UI.
     // Primarily used by mobile, which starts in read-only
     // mode until the user clicks on the "edit" button.
-    if (userCanWrite && !_isViewFileExtension && !Uri::hasReadonlyPermission(uriPublic.toString()))
+    // A shared poll mustn't wait for the storage; the first editing session locks.
+    if (!_sharedPoll && userCanWrite && !_isViewFileExtension &&
+        !Uri::hasReadonlyPermission(uriPublic.toString()))
     {
         LOG_DBG("Locking docKey [" << _docKey << "], which is editable");
         std::string error;
@@ -1149,6 +1538,7 @@ bool DocumentBroker::doDownloadDocument(const Authorization& auth,
                                         std::chrono::milliseconds& getFileCallDurationMs)
 {
     assert(_storage && !_storage->isDownloaded());
+    assert(!_sharedPoll && "Only storage that downloads asynchronously shares a poll");
 
     LOG_DBG("Download file for docKey [" << _docKey << ']');
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
@@ -1161,6 +1551,139 @@ bool DocumentBroker::doDownloadDocument(const Authorization& auth,
     getFileCallDurationMs = std::chrono::duration_cast<std::chrono::milliseconds>(
         std::chrono::steady_clock::now() - start);
 
+    return processDownloadedDocument(localPath, templateSource, filename);
+}
+
+bool DocumentBroker::downloadDocumentAsync(const Authorization& auth,
+                                           const std::string& templateSource,
+                                           const std::string& filename)
+{
+    assert(_storage && !_storage->isDownloaded());
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    StorageBase::AsyncDownloadCallback asyncDownloadCallback =
+        [this, start, templateSource, filename](const StorageBase::AsyncDownload& asyncDown)
+    {
+        switch (asyncDown.state())
+        {
+            case StorageBase::AsyncDownload::State::Running:
+            {
+                // Let the clients show the progress of large downloads.
+                const StorageBase::DownloadResult& result = asyncDown.result();
+                if (result.getExpected() > 0)
+                {
+                    const int64_t percent = result.getReceived() * 100 / result.getExpected();
+                    broadcastMessage("progress: { \"id\":\"setvalue\", \"value\": " +
+                                     std::to_string(percent) + " }");
+                }
+                return;
+            }
+
+            case StorageBase::AsyncDownload::State::Complete:
+            {
+                _asyncDownloading = false;
+                const auto getFileCallDurationMs =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start);
+                handleDownloadComplete(asyncDown.result().getLocalPath(), templateSource,
+                                       filename, getFileCallDurationMs);
+                return;
+            }
+
+            case StorageBase::AsyncDownload::State::None:
+            case StorageBase::AsyncDownload::State::Error:
+            {
+                _asyncDownloading = false;
+
+                // We may fail before the session is added, so notify from the poll.
+                const StorageBase::DownloadResult result = asyncDown.result();
+                addCallback([docBroker = shared_from_this(), result]()
+                            { docBroker->handleDownloadFailed(result); });
+                return;
+            }
+        }
+    };
+
+    _asyncDownloading = true;
+    if (!_storage->downloadStorageFileToLocalAsync(auth, *_lockCtx, templateSource, *_poll,
+                                                   asyncDownloadCallback))
+    {
+        _asyncDownloading = false;
+        return false;
+    }
+
+    LOG_DBG("Downloading docKey [" << _docKey << "] asynchronously");
+    return true;
+}
+
+void DocumentBroker::handleDownloadComplete(const std::string& localPath,
+                                            const std::string& templateSource,
+                                            const std::string& filename,
+                                            std::chrono::milliseconds getFileCallDurationMs)
+{
+    ASSERT_CORRECT_THREAD();
+
+    try
+    {
+        if (!processDownloadedDocument(localPath, templateSource, filename))
+        {
+            handleDownloadFailed(StorageBase::DownloadResult(
+                StorageBase::DownloadResult::Result::FAILED, "Failed to process the document."));
+            return;
+        }
+    }
+    catch (const std::exception& exc)
+    {
+        handleDownloadFailed(
+            StorageBase::DownloadResult(StorageBase::DownloadResult::Result::FAILED, exc.what()));
+        return;
+    }
+
+#if !MOBILEAPP
+    _wopiDownloadDuration += getFileCallDurationMs;
+    _admin.setDocWopiDownloadDuration(_docKey, _wopiDownloadDuration);
+
+    const auto downloadSecs = _wopiDownloadDuration.count() / 1000.;
+    broadcastMessage("stats: wopiloadduration " + std::to_string(downloadSecs)); // In seconds.
+#else
+    (void)getFileCallDurationMs;
+#endif
+
+    // Now the kit can load the document, in the order the clients asked.
+    std::vector<std::tuple<std::string, std::string, bool>> messages;
+    std::swap(messages, _messagesPendingDownload);
+    LOG_DBG("Downloaded docKey [" << _docKey << "], forwarding " << messages.size()
+                                  << " pending messages to the child");
+    for (const auto& [sessionId, message, binary] : messages)
+    {
+        const auto it = _sessions.find(sessionId);
+        if (it != _sessions.end())
+            forwardToChild(it->second, message, binary);
+    }
+}
+
+void DocumentBroker::handleDownloadFailed(const StorageBase::DownloadResult& result)
+{
+    ASSERT_CORRECT_THREAD();
+
+    LOG_ERR("Failed to download docKey [" << _docKey << "]: " << result.getReason());
+    _messagesPendingDownload.clear();
+
+    // As when the download of a new session fails, but for all that are waiting.
+    const bool diskFull = result.getResult() == StorageBase::DownloadResult::Result::DISKFULL;
+    const std::string msg =
+        diskFull ? "error: cmd=internal kind=diskfull" : "error: cmd=storage kind=loadfailed";
+    for (const auto& pair : _sessions)
+        pair.second->sendTextFrameAndLogError(msg);
+
+    shutdownClients(diskFull ? "diskfull" : "loadfailed");
+    stop("download failed");
+}
+
+bool DocumentBroker::processDownloadedDocument(std::string localPath,
+                                               const std::string& templateSource,
+                                               const std::string& filename)
+{
     _docState.setStatus(DocumentState::Status::Loading); // Done downloading.
 
 #if !MOBILEAPP
@@ -1213,6 +1736,26 @@ bool DocumentBroker::doDownloadDocument(const Authorization& auth,
     _tileCache = std::make_unique<TileCache>(_storage->getUri().toString(),
                                              _saveManager.getLastModifiedTime(), dontUseCache);
     _tileCache->setThreadOwner(std::this_thread::get_id());
+    // Tiles on screen are the last to leave the cache.
+    _tileCache->setVisibilityCheck(
+        [this](const TileDesc& desc)
+        {
+            for (const auto& it : _sessions)
+            {
+                const std::shared_ptr<ClientSession>& session = it.second;
+                if (session->getCanonicalViewId() == desc.getNormalizedViewId() &&
+                    session->getTileWidthInTwips() == desc.getTileWidth() &&
+                    (session->getSelectedPart() < 0 ||
+                     session->getSelectedPart() == desc.getPart()) &&
+                    session->isTileInsideVisibleArea(desc))
+                    return true;
+            }
+            return false;
+        });
+
+    // Tiles of this very version in storage can be reused.
+    if (!isConvertTo() && templateSource.empty() && _storage->isLastModifiedTimeSafe())
+        _tileCache->openPersistentCache(_storage->getLastModifiedTime());
 
     return true;
 }
@@ -1673,7 +2216,17 @@ bool DocumentBroker::updateStorageLockStateAsync(const std::shared_ptr<ClientSes
 
         // We have some result, look at the result status.
         const StorageBase::LockState requestedLock = asyncLock.result().requestedLockState();
-        switch (asyncLock.result().getStatus())
+        const StorageBase::LockUpdateResult::Status status = asyncLock.result().getStatus();
+        if (!requestingSession && status != StorageBase::LockUpdateResult::Status::OK &&
+            status != StorageBase::LockUpdateResult::Status::UNSUPPORTED)
+        {
+            LOG_ERR("Failed to " << StorageBase::name(requestedLock) << " docKey [" << _docKey
+                                 << "] after the requesting session left: "
+                                 << asyncLock.result().getReason());
+            return;
+        }
+
+        switch (status)
         {
             case StorageBase::LockUpdateResult::Status::UNSUPPORTED:
                 LOG_DBG("Locks on docKey [" << _docKey << "] are unsupported while trying to "
@@ -3460,6 +4013,26 @@ std::shared_ptr<ClientSession> DocumentBroker::createNewClientSession(
 
 void DocumentBroker::addCallback(const SocketPoll::CallbackFn& fn)
 {
+    if (_sharedPoll)
+    {
+        // The shared poll outlives us, and doesn't drop our callbacks when we finish.
+        SocketPoll::CallbackFn callback = [polling = _sharedPolling, fn]()
+        {
+            if (*polling)
+                fn();
+        };
+
+        std::lock_guard<std::mutex> lock(_startMutex);
+        if (!_started)
+        {
+            _startCallbacks.push_back(std::move(callback));
+            return;
+        }
+
+        _poll->addCallback(callback);
+        return;
+    }
+
     _poll->addCallback(fn);
 }
 
@@ -3603,6 +4176,20 @@ bool DocumentBroker::handleInput(const std::shared_ptr<Message>& message)
                                                       message->size() - firstLine.size() - 1);
             }
         }
+#if !MOBILEAPP
+        else if (message->firstTokenMatches("paintstats:"))
+        {
+            int overlap = 0;
+            if (message->tokens().size() > 1 &&
+                COOLProtocol::getTokenInteger((*message)[1], "overlap", overlap) &&
+                overlap >= 0 && overlap <= 100)
+            {
+                _admin.setDocPaintOverlap(_docKey, overlap);
+            }
+            else
+                LOG_WRN("Invalid paintstats message: [" << message->abbr() << ']');
+        }
+#endif
 #if ENABLE_DEBUG
         else if (message->firstTokenMatches("unitresult:"))
         {
@@ -3632,6 +4219,12 @@ void DocumentBroker::handleTileRequest(const StringVector &tokens, bool forceKey
 {
     ASSERT_CORRECT_THREAD();
 
+    if (!hasTileCache())
+    {
+        LOG_DBG("Ignoring tile request before the document is downloaded");
+        return;
+    }
+
     TileDesc tile = TileDesc::parse(tokens);
     tile.setNormalizedViewId(session->getCanonicalViewId());
 
@@ -3690,6 +4283,12 @@ void DocumentBroker::handleTileCombinedRequest(TileCombined& tileCombined, bool
 {
     ASSERT_CORRECT_THREAD();
 
+    if (!hasTileCache())
+    {
+        LOG_DBG("Ignoring tile request before the document is downloaded");
+        return;
+    }
+
     assert(!tileCombined.hasDuplicates());
 
     LOG_TRC("TileCombined request for " << tileCombined.serialize() << " from " <<
@@ -3910,9 +4509,10 @@ void DocumentBroker::sendRequestedTiles(const std::shared_ptr<ClientSession>& se
     if (!requestedTiles.empty() && hasTileCache())
     {
         std::vector<TileDesc> tilesNeedsRendering;
+        std::vector<std::pair<TileDesc, Tile>> cachedTiles;
         bool allSamePartAndSize = true;
         while (!requestedTiles.empty() &&
-               session->getTilesOnFlyCount() < tilesOnFlyUpperLimit)
+               session->getTilesOnFlyCount() + cachedTiles.size() < tilesOnFlyUpperLimit)
         {
             TileDesc& tile = *(requestedTiles.begin());
 
@@ -3930,8 +4530,8 @@ void DocumentBroker::sendRequestedTiles(const std::shared_ptr<ClientSession>& se
                 if (tile.getWireId() == 0)
                     tile.setWireId(cachedTile->_wids.back());
 
-                // TODO: Combine the response to reduce latency.
-                session->sendTileNow(tile, cachedTile);
+                // Sent together, below.
+                cachedTiles.emplace_back(tile, std::move(cachedTile));
             }
             else
             {
@@ -3954,6 +4554,10 @@ void DocumentBroker::sendRequestedTiles(const std::shared_ptr<ClientSession>& se
             requestedTiles.pop_front();
         }
 
+        // Reply with the cached tiles in one message, to reduce latency.
+        if (!cachedTiles.empty())
+            session->sendTilesNow(cachedTiles);
+
         // Send rendering request for those tiles which were not prerendered
         if (!tilesNeedsRendering.empty())
         {
@@ -4108,6 +4712,10 @@ void DocumentBroker::setModified(const bool value)
 
     LOG_DBG("Modified state set to " << value << " for Doc [" << _docId << ']');
     _isModified = value;
+
+    // Tiles rendered from now on are not of the version in storage.
+    if (value && _tileCache)
+        _tileCache->closePersistentCache();
 }
 
 bool DocumentBroker::isInitialSettingSet(const std::string& name) const
@@ -4154,6 +4762,15 @@ bool DocumentBroker::forwardToChild(const std::shared_ptr<ClientSession>& sessio
         return true;
     }
 
+    // The kit can't load the document before we have it, keep the order until then.
+    if (_asyncDownloading)
+    {
+        LOG_TRC("Queueing payload for child [" << session->getId() << "] until downloaded: "
+                                               << getAbbreviatedMessage(message));
+        _messagesPendingDownload.emplace_back(session->getId(), message, binary);
+        return true;
+    }
+
     const std::string viewId = session->getId();
 
     // Should not get through; we have our own save command.
@@ -4416,6 +5033,9 @@ void DocumentBroker::dumpState(std::ostream& os)
     os << "\n  doc id: " << _docId;
     os << "\n  num sessions: " << _sessions.size();
     os << "\n  thread start: " << Util::getTimeForLog(now, _threadStart);
+    os << "\n  shared poll: " << (_sharedPoll ? _sharedPoll->name() : "none");
+    os << "\n  async downloading: " << _asyncDownloading << " (" << _messagesPendingDownload.size()
+       << " pending messages)";
     os << "\n  stop: " << _stop;
     os << "\n  closeReason: " << _closeReason;
     os << "\n  modified?: " << isModified();
@@ -13,13 +13,16 @@
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 #include <Poco/SharedPtr.h>
 #include <Poco/URI.h>
@@ -143,6 +146,13 @@ public:
     void setSMapsFD(int smapsFD) { _smapsFD = smapsFD;}
     int getSMapsFD(){ return _smapsFD; }
 
+    /// Close our socket and take it out of the given poll, which polls it.
+    void closeSocketIn(SocketPoll& poll)
+    {
+        if (const std::shared_ptr<WebSocketHandler> ws = getWSHandler())
+            ws->closeSocketIn(poll);
+    }
+
     void moveSocketFromTo(const std::shared_ptr<SocketPoll> &from, SocketPoll &to)
     {
         to.takeSocket(from, getSocket());
@@ -296,6 +306,7 @@ class ClientSession;
 class DocumentBroker : public std::enable_shared_from_this<DocumentBroker>
 {
     class DocumentBrokerPoll;
+    class SharedPoll;
 
     void setupPriorities();
 
@@ -357,6 +368,9 @@ public:
     /// Thread safe termination of this broker if it has a lingering thread
     void joinThread();
 
+    /// Stop the poll threads shared by documents, once they are all done.
+    static void stopSharedPolls();
+
     /// Notify that the load has completed
     virtual void setLoaded();
 
@@ -539,6 +553,11 @@ public:
     void updateLastModifyingActivityTime()
     {
         _lastModifyActivityTime = std::chrono::steady_clock::now();
+
+        // Tiles rendered from now on may not be of the version in storage,
+        // and the kit only reports the modification once it is done.
+        if (_tileCache)
+            _tileCache->closePersistentCache();
     }
 
     /// This updates the editing sessionId which is used for auto-saving.
@@ -636,6 +655,24 @@ private:
                             const std::string& filename,
                             std::chrono::milliseconds& getFileCallDurationMs);
 
+    /// Starts downloading the document without blocking our poll, if the storage supports it.
+    /// Messages to the child are queued until it's downloaded and processed.
+    /// Returns false when unsupported, to use doDownloadDocument instead.
+    bool downloadDocumentAsync(const Authorization& auth, const std::string& templateSource,
+                               const std::string& filename);
+
+    /// Processes the downloaded document and forwards the queued messages to the child.
+    void handleDownloadComplete(const std::string& localPath, const std::string& templateSource,
+                                const std::string& filename,
+                                std::chrono::milliseconds getFileCallDurationMs);
+
+    /// Fails all the sessions waiting for the document to be downloaded.
+    void handleDownloadFailed(const StorageBase::DownloadResult& result);
+
+    /// Post-download processing, preparing to load the document at localPath.
+    bool processDownloadedDocument(std::string localPath, const std::string& templateSource,
+                                   const std::string& filename);
+
 #if !MOBILEAPP
     /// Updates the Session with the wopiFileInfo given.
     /// Returns the templateSource, if any.
@@ -859,6 +896,19 @@ private:
     std::size_t addSessionInternal(const std::shared_ptr<ClientSession>& session,
                                    std::unique_ptr<WopiStorage::WOPIFileInfo> wopiFileInfo);
 
+    /// Adds the session of a PHP proxy "open" request and replies with its id.
+    void openProxySession(const std::shared_ptr<ClientSession>& session,
+                          std::unique_ptr<WopiStorage::WOPIFileInfo> wopiFileInfo,
+                          const std::shared_ptr<StreamSocket>& socket);
+
+#if !MOBILEAPP
+    /// Runs CheckFileInfo for a new session without waiting for it, then calls
+    /// onFinish with the file info, or with nullptr on failure, unless we stopped.
+    void checkFileInfoAsync(
+        const Poco::URI& uriPublic,
+        std::function<void(std::unique_ptr<WopiStorage::WOPIFileInfo>)> onFinish);
+#endif
+
     /// Starts the Kit <-> DocumentBroker shutdown handshake
     void disconnectSessionInternal(const std::shared_ptr<ClientSession>& session);
 
@@ -869,6 +919,49 @@ private:
     /// associated with this document.
     void pollThread();
 
+    /// Get a child process and start loading, before polling.
+    /// Returns false, having cleaned up, if that failed.
+    bool startPolling();
+
+    STATE_ENUM(StartState, Waiting, Ready, Failed);
+
+    /// Start polling in the shared poll without holding it up: while there
+    /// is no spare child, returns Waiting, to be called again after
+    /// getStartRetryTime(). Once started, runs the callbacks deferred until then.
+    StartState continueStarting(std::chrono::steady_clock::time_point now);
+
+    std::chrono::steady_clock::time_point getStartRetryTime() const { return _startRetryTime; }
+
+    /// Attach the child process, if we got one, and start loading.
+    /// Returns false, having cleaned up, if that failed.
+    bool startWithChild();
+
+    /// Queue the callbacks deferred while starting in the shared poll, and stop deferring.
+    void runStartCallbacks();
+
+    /// Done in the shared poll: drop our callbacks still queued there, and let us go.
+    void setPollFinished();
+
+    /// Process the events of the last poll, and our timers.
+    void processPollEvents();
+
+    /// Whether to poll and process events again.
+    bool continuePolling() const;
+
+    /// How long to poll for at most.
+    std::chrono::microseconds getPollTimeout() const;
+
+    /// Cleanup once polling is over, whatever the reason.
+    void finishPolling();
+
+    /// Start polling in our own thread or in a shared one.
+    void startThread();
+
+    /// Pick the least busy shared poll, if configured to share them.
+    /// Only documents in WOPI storage, which we talk to asynchronously, share;
+    /// the others may wait for their storage, and so get their own thread.
+    static std::shared_ptr<SharedPoll> getSharedPoll(const Poco::URI& uriPublic);
+
     /// Sum the I/O stats from all connected sessions
     void getIOStats(uint64_t &sent, uint64_t &recv);
 
@@ -1494,7 +1587,7 @@ private:
         /// Upon error, intermediary states may be skipped.
         STATE_ENUM(Status,
                    None, //< Doesn't exist, pending downloading.
-                   Downloading, //< Download from Storage to disk. Synchronous.
+                   Downloading, //< Download from Storage to disk. Possibly asynchronous.
                    Loading, //< Loading the document in Core.
                    Live, //< General availability for viewing/editing.
                    Destroying, //< End-of-life, marked to destroy.
@@ -1702,7 +1795,28 @@ private:
     int _cursorPosY;
     int _cursorWidth;
     int _cursorHeight;
-    std::shared_ptr<DocumentBrokerPoll> _poll;
+    /// Set when polling in a thread shared with other documents.
+    std::shared_ptr<SharedPoll> _sharedPoll;
+    std::atomic<bool> _pollStarted;
+    std::atomic<bool> _pollFinished;
+
+    /// While starting in the shared poll: when to look for a child again,
+    /// and the callbacks and sockets for us, which wait until we started.
+    std::chrono::steady_clock::time_point _startRetryTime;
+    std::mutex _startMutex;
+    std::vector<SocketPoll::CallbackFn> _startCallbacks;
+    bool _started;
+
+    /// Signalled when the shared poll is done with us.
+    std::mutex _pollFinishedMutex;
+    std::condition_variable _pollFinishedCV;
+
+    /// Whether our callbacks queued in the shared poll may run, which only
+    /// changes in its thread. Shared with them, as they may outlive us.
+    std::shared_ptr<bool> _sharedPolling;
+
+    /// Our own DocumentBrokerPoll, or the shared one.
+    std::shared_ptr<TerminatingPoll> _poll;
     std::atomic<bool> _stop;
     std::string _closeReason;
     std::unique_ptr<LockContext> _lockCtx;
@@ -1725,9 +1839,31 @@ private:
     std::chrono::steady_clock::time_point _lastModifyActivityTime;
 
     std::chrono::steady_clock::time_point _threadStart;
+
+    /// Polling state, kept across processPollEvents calls.
+#if !MOBILEAPP
+    uint64_t _adminSent;
+    uint64_t _adminRecv;
+    std::chrono::steady_clock::time_point _lastBWUpdateTime;
+    std::chrono::steady_clock::time_point _lastClipboardHashUpdateTime;
+    int _limitLoadSecs;
+    std::chrono::steady_clock::time_point _loadDeadline;
+#endif
+    int _limitStoreFailures;
+    bool _waitingForMigrationMsg;
+    std::chrono::steady_clock::time_point _migrationMsgStartTime;
+
+    static std::mutex SharedPollsMutex;
+    static std::vector<std::shared_ptr<SharedPoll>> SharedPolls;
+
     std::chrono::milliseconds _loadDuration;
     std::chrono::milliseconds _wopiDownloadDuration;
 
+    /// True while the document is downloaded asynchronously.
+    bool _asyncDownloading;
+    /// The messages to the child, by session id, held until the document is downloaded.
+    std::vector<std::tuple<std::string, std::string, bool>> _messagesPendingDownload;
+
     /// Unique DocBroker ID for tracing and debugging.
     static std::atomic<unsigned> DocBrokerId;
 
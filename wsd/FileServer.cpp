@@ -731,7 +731,8 @@ void FileServerRequestHandler::handleRequest(const HTTPRequest& request,
                     response.set("Content-Encoding", "br");
                 }
 
-                HttpHelper::sendFile(socket, filePath, response, noCache);
+                HttpHelper::sendFile(socket, filePath, response, noCache, false, false,
+                                     request.get("Range", std::string()));
                 return;
             }
 #endif
@@ -25,6 +25,7 @@
 #include "ProxyProtocol.hpp"
 #include "Exceptions.hpp"
 #include "COOLWSD.hpp"
+#include <net/HttpHelper.hpp>
 #include <Socket.hpp>
 
 #include <atomic>
@@ -49,25 +50,30 @@ void DocumentBroker::handleProxyRequest(
         clientSession = createNewClientSession(
                 std::make_shared<ProxyProtocolHandler>(),
                 id, uriPublic, isReadOnly, requestDetails);
-        addSession(clientSession);
-        COOLWSD::checkDiskSpaceAndWarnClients(true);
-        COOLWSD::checkSessionLimitsAndWarnClients();
-
-        const std::string &sessionId = clientSession->getOrCreateProxyAccess();
-        LOG_TRC("proxy: Returning sessionId " << sessionId);
-
-        std::ostringstream oss;
-        oss << "HTTP/1.1 200 OK\r\n"
-            "Last-Modified: " << Util::getHttpTimeNow() << "\r\n"
-            "User-Agent: " << http::getAgentString() << "\r\n"
-            "Content-Length: " << sessionId.size() << "\r\n"
-            "Content-Type: application/json; charset=utf-8\r\n"
-            "X-Content-Type-Options: nosniff\r\n"
-            "Connection: close\r\n"
-            "\r\n" << sessionId;
-
-        socket->send(oss.str());
-        socket->shutdown();
+#if !MOBILEAPP
+        if (_sharedPoll)
+        {
+            // Don't hold up the other documents of the thread with CheckFileInfo.
+            checkFileInfoAsync(
+                uriPublic,
+                [this, clientSession,
+                 socket](std::unique_ptr<WopiStorage::WOPIFileInfo> wopiFileInfo)
+                {
+                    try
+                    {
+                        openProxySession(clientSession, std::move(wopiFileInfo), socket);
+                    }
+                    catch (const std::exception& exc)
+                    {
+                        LOG_ERR("proxy: Error while starting session on " << _docKey << ": "
+                                                                         << exc.what());
+                        HttpHelper::sendErrorAndShutdown(http::StatusCode::BadRequest, socket);
+                    }
+                });
+            return;
+        }
+#endif
+        openProxySession(clientSession, nullptr, socket);
         return;
     }
     else
@@ -108,6 +114,31 @@ void DocumentBroker::handleProxyRequest(
     proxy->handleRequest(isWaiting, socket);
 }
 
+void DocumentBroker::openProxySession(const std::shared_ptr<ClientSession>& session,
+                                      std::unique_ptr<WopiStorage::WOPIFileInfo> wopiFileInfo,
+                                      const std::shared_ptr<StreamSocket>& socket)
+{
+    addSession(session, std::move(wopiFileInfo));
+    COOLWSD::checkDiskSpaceAndWarnClients(true);
+    COOLWSD::checkSessionLimitsAndWarnClients();
+
+    const std::string &sessionId = session->getOrCreateProxyAccess();
+    LOG_TRC("proxy: Returning sessionId " << sessionId);
+
+    std::ostringstream oss;
+    oss << "HTTP/1.1 200 OK\r\n"
+        "Last-Modified: " << Util::getHttpTimeNow() << "\r\n"
+        "User-Agent: " << http::getAgentString() << "\r\n"
+        "Content-Length: " << sessionId.size() << "\r\n"
+        "Content-Type: application/json; charset=utf-8\r\n"
+        "X-Content-Type-Options: nosniff\r\n"
+        "Connection: close\r\n"
+        "\r\n" << sessionId;
+
+    socket->send(oss.str());
+    socket->shutdown();
+}
+
 bool ProxyProtocolHandler::parseEmitIncoming(
     const std::shared_ptr<StreamSocket> &socket)
 {
@@ -280,6 +311,16 @@ void ProxyProtocolHandler::getIOStats(uint64_t &sent, uint64_t &recv)
     sent = recv = 0;
 }
 
+void ProxyProtocolHandler::markPollDirty()
+{
+    for (const auto& it : _outSockets)
+    {
+        auto sock = it.lock();
+        if (sock)
+            sock->markPollDirty();
+    }
+}
+
 void ProxyProtocolHandler::dumpProxyState(std::ostream& os)
 {
     os << "proxy protocol sockets: " << _outSockets.size() << " writeQueue: " << _writeQueue.size() << ":\n";
@@ -59,6 +59,7 @@ public:
     int sendBinaryMessage(const char *data, const size_t len, bool flush = false) const override;
     void shutdown(bool goingAway = false, const std::string &statusMessage = "") override;
     void getIOStats(uint64_t &sent, uint64_t &recv) override;
+    void markPollDirty() override;
     // don't duplicate ourselves for every socket
     void dumpState(std::ostream&, const std::string&) const override {}
     // instead do it centrally.
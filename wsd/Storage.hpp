@@ -263,6 +263,60 @@ public:
     /// The state of an asynchronous Upload request.
     using AsyncUpload = AsyncRequest<UploadResult>;
 
+    /// Represents the download request result or progress, with a Result code,
+    /// the local path of the document on success and a reason message on failure.
+    class DownloadResult final
+    {
+    public:
+        STATE_ENUM(Result,
+                   OK = 0, //< Downloaded successfully, or in progress.
+                   DISKFULL, //< Not enough space for the document.
+                   FAILED);
+
+        explicit DownloadResult(Result result)
+            : _result(result)
+            , _received(0)
+            , _expected(-1)
+        {
+        }
+
+        DownloadResult(Result result, std::string reason)
+            : _result(result)
+            , _reason(std::move(reason))
+            , _received(0)
+            , _expected(-1)
+        {
+        }
+
+        Result getResult() const { return _result; }
+
+        /// The local path of the document, as returned by downloadStorageFileToLocal.
+        void setLocalPath(const std::string& localPath) { _localPath = localPath; }
+        const std::string& getLocalPath() const { return _localPath; }
+
+        const std::string& getReason() const { return _reason; }
+
+        /// The bytes received so far, and expected in total, or -1 when unknown.
+        void setProgress(int64_t received, int64_t expected)
+        {
+            _received = received;
+            _expected = expected;
+        }
+
+        int64_t getReceived() const { return _received; }
+        int64_t getExpected() const { return _expected; }
+
+    private:
+        Result _result;
+        std::string _localPath;
+        std::string _reason;
+        int64_t _received;
+        int64_t _expected;
+    };
+
+    /// The state of an asynchronous Download request.
+    using AsyncDownload = AsyncRequest<DownloadResult>;
+
     STATE_ENUM(LockState,
                LOCK, //< Lock the document.
                UNLOCK, //< Unlock the document .
@@ -400,6 +454,20 @@ public:
     virtual std::string downloadStorageFileToLocal(const Authorization& auth, LockContext& lockCtx,
                                                    const std::string& templateUri) = 0;
 
+    /// The asynchronous download progress and completion callback function.
+    using AsyncDownloadCallback = std::function<void(const AsyncDownload&)>;
+
+    /// Downloads the file locally asynchronously, if supported, reporting the progress
+    /// (State::Running) and the local path or failure via asyncDownloadCallback.
+    /// @returns False when unsupported, in which case use downloadStorageFileToLocal.
+    virtual bool downloadStorageFileToLocalAsync(const Authorization& /*auth*/,
+                                                 LockContext& /*lockCtx*/,
+                                                 const std::string& /*templateUri*/, SocketPoll&,
+                                                 const AsyncDownloadCallback& /*asyncDownloadCallback*/)
+    {
+        return false;
+    }
+
     /// The asynchronous upload completion callback function.
     using AsyncUploadCallback = std::function<void(const AsyncUpload&)>;
 
@@ -426,6 +494,12 @@ public:
         // By default, nothing to do.
     }
 
+    /// Abandons all the asynchronous requests in flight, without calling back.
+    virtual void cancelAsyncRequests()
+    {
+        // By default, nothing to do.
+    }
+
     /// Must be called at startup to configure.
     static void initialize();
 
@@ -13,10 +13,12 @@
 
 #include "TileCache.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <climits>
 #include <cstddef>
 #include <cstdio>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <memory>
@@ -25,9 +27,16 @@
 #include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
 #include "ClientSession.hpp"
 #include <Common.hpp>
 #include <Protocol.hpp>
+#include <SpookyV2.h>
 #include <StringVector.hpp>
 #include <Unit.hpp>
 #include <Util.hpp>
@@ -35,12 +44,524 @@
 
 using namespace COOLProtocol;
 
+std::atomic<uint64_t> TileCache::PersistentHits;
+std::atomic<uint64_t> TileCache::PersistentMisses;
+std::atomic<uint64_t> TileCache::PersistentStores;
+std::string TileCache::PersistentCachePath;
+size_t TileCache::PersistentCacheMaxFileSize = 0;
+size_t TileCache::PersistentCacheMaxDirSize = 0;
+
+namespace
+{
+/// Identifies the files of persistent tile caches, and their format.
+constexpr char PersistentMagic[8] = { 'C', 'O', 'O', 'L', 'T', 'I', 'L', '1' };
+constexpr const char* PersistentSuffix = ".tiles";
+
+/// Precedes each tile in the file, followed by the view rendering state
+/// and then the tile data, a keyframe as sent by the kit.
+struct PersistentRecord
+{
+    int32_t _part;
+    int32_t _mode;
+    int32_t _width;
+    int32_t _height;
+    int32_t _tilePosX;
+    int32_t _tilePosY;
+    int32_t _tileWidth;
+    int32_t _tileHeight;
+    uint32_t _stateSize;
+    uint32_t _dataSize;
+};
+
+/// Removes the least recently used files once the directory grows too large.
+void prunePersistentCache(const std::string& path, size_t maxDirSize)
+{
+    std::vector<std::pair<std::chrono::system_clock::time_point, std::string>> files;
+    std::map<std::string, size_t> sizes;
+    size_t total = 0;
+    for (const std::string& name : FileUtil::getDirEntries(path))
+    {
+        if (!name.ends_with(PersistentSuffix))
+            continue;
+
+        const std::string filePath = path + '/' + name;
+        const FileUtil::Stat stat(filePath);
+        if (!stat.isFile())
+            continue;
+
+        files.emplace_back(stat.modifiedTimepoint(), filePath);
+        sizes[filePath] = stat.size();
+        total += stat.size();
+    }
+
+    std::sort(files.begin(), files.end());
+    for (const auto& file : files)
+    {
+        if (total <= maxDirSize)
+            break;
+
+        LOG_DBG("Removing persistent tile cache [" << file.second << "] of " << sizes[file.second]
+                                                   << " bytes");
+        FileUtil::removeFile(file.second);
+        total -= sizes[file.second];
+    }
+}
+} // namespace
+
+/// The keyframes of one version of a document, in an append-only file,
+/// mapped in memory to read them back. Later records of a tile supersede
+/// earlier ones, records without data erase them, and a record torn by a
+/// crash ends the file. Records are appended in memory, and written
+/// together by flush().
+class TileCache::PersistentTiles
+{
+public:
+    struct Record
+    {
+        size_t _offset; ///< Of the tile data in the file.
+        size_t _size;
+        TileWireId _wid;
+    };
+
+    PersistentTiles(std::string path, size_t maxFileSize)
+        : _path(std::move(path))
+        , _maxFileSize(maxFileSize)
+        , _fd(-1)
+        , _map(nullptr)
+        , _mapSize(0)
+        , _headerSize(0)
+        , _fileSize(0)
+        , _pendingSize(0)
+    {
+    }
+
+    ~PersistentTiles()
+    {
+        flush();
+        unmap();
+        if (_fd >= 0)
+            ::close(_fd);
+    }
+
+    PersistentTiles(const PersistentTiles&) = delete;
+    PersistentTiles& operator=(const PersistentTiles&) = delete;
+
+    /// Opens the file, starting afresh unless it is of this version of docURL.
+    bool open(const std::string& docURL, const std::string& docVersion)
+    {
+        _fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        struct stat st;
+        if (_fd < 0 || ::fstat(_fd, &st) != 0)
+        {
+            LOG_SYS("Failed to open persistent tile cache [" << _path << ']');
+            return false;
+        }
+
+        // Tiles are only reusable with the same document and the same rendering.
+        std::string header(PersistentMagic, sizeof(PersistentMagic));
+        appendString(header, Util::getCoolVersionHash());
+        appendString(header, docURL);
+        appendString(header, docVersion);
+        _headerSize = header.size();
+
+        _fileSize = st.st_size;
+        if (_fileSize >= _headerSize && map(_fileSize) &&
+            std::memcmp(_map, header.data(), _headerSize) == 0)
+        {
+            load();
+        }
+        else
+        {
+            LOG_DBG("Starting persistent tile cache [" << _path << "] afresh, for version ["
+                                                       << docVersion << ']');
+            unmap();
+            if (::ftruncate(_fd, 0) != 0 || !write(header.data(), header.size()))
+            {
+                LOG_SYS("Failed to initialize persistent tile cache [" << _path << ']');
+                return false;
+            }
+
+            _fileSize = _headerSize;
+        }
+
+        // Recently used files are the last to be pruned.
+        ::futimens(_fd, nullptr);
+        return true;
+    }
+
+    const Record* find(const std::string& state, const TileDesc& desc) const
+    {
+        const auto stateIt = _index.find(state);
+        if (stateIt == _index.end())
+            return nullptr;
+
+        const auto it = stateIt->second._records.find(key(desc));
+        return it != stateIt->second._records.end() ? &it->second : nullptr;
+    }
+
+    /// The tile data of the record, mapping the file anew if it was appended to since.
+    const char* data(const Record& record)
+    {
+        // Rare: a tile is wanted back before its record is written.
+        const size_t end = record._offset + record._size;
+        if (end > _fileSize)
+        {
+            flush();
+            if (end > _fileSize)
+                return nullptr; // Failed, and emptied.
+        }
+
+        if (record._offset + record._size > _mapSize)
+        {
+            unmap();
+            if (!map(_fileSize))
+                return nullptr;
+        }
+
+        return static_cast<const char*>(_map) + record._offset;
+    }
+
+    /// Appends the keyframe of a tile, unless the file would grow too large.
+    /// The keyframe is referenced until the next flush().
+    bool append(const std::string& state, const TileDesc& desc, TileWireId wid,
+                const Blob& keyframe)
+    {
+        // The kit's keyframe, with its type.
+        const char type = 'Z';
+        std::string record = makeRecord(state, desc, 1 + keyframe->size());
+        record += type;
+        const size_t end = _fileSize + _pendingSize;
+        if (end + record.size() + keyframe->size() > _maxFileSize)
+            return false;
+
+        const size_t dataOffset = end + record.size() - 1;
+        _pendingSize += record.size() + keyframe->size();
+        _pending.emplace_back(std::move(record), keyframe);
+
+        insertRecord(_index[state], key(desc), { dataOffset, 1 + keyframe->size(), wid });
+        return true;
+    }
+
+    /// Forget the tiles, of all views, that intersect the area. Only
+    /// the records near it are looked at.
+    void erase(int part, int mode, int x, int y, int width, int height)
+    {
+        std::string tombstones;
+        std::vector<TileDesc> erased;
+        for (auto& [state, records] : _index)
+        {
+            const auto modeIt = records._grids.find(mode);
+            if (modeIt == records._grids.end())
+                continue;
+
+            const auto eraseNear = [&](const TileGrid& grid)
+            {
+                grid.forEachNear(x, y, width, height,
+                                 [&](const TileDesc& desc)
+                                 {
+                                     if (intersectsTile(desc, part, mode, x, y, width, height, 0))
+                                         erased.push_back(desc);
+                                 });
+            };
+
+            erased.clear();
+            if (part == -1)
+            {
+                for (const auto& it : modeIt->second)
+                    eraseNear(it.second);
+            }
+            else
+            {
+                const auto gridIt = modeIt->second.find(part);
+                if (gridIt != modeIt->second.end())
+                    eraseNear(gridIt->second);
+            }
+
+            // A tile may be near the area in more than one bucket.
+            for (const TileDesc& desc : erased)
+            {
+                if (eraseRecord(records, desc))
+                    tombstones += makeRecord(state, desc, 0);
+            }
+        }
+
+        if (!tombstones.empty())
+            appendTombstones(std::move(tombstones));
+    }
+
+    size_t count() const
+    {
+        size_t count = 0;
+        for (const auto& it : _index)
+            count += it.second._records.size();
+        return count;
+    }
+
+    /// Writes the records appended since the last flush, in as few calls as we can.
+    void flush()
+    {
+        if (_pending.empty())
+            return;
+
+        std::vector<struct iovec> iov;
+        iov.reserve(2 * _pending.size());
+        for (const auto& [record, data] : _pending)
+        {
+            iov.push_back({ const_cast<char*>(record.data()), record.size() });
+            if (data)
+                iov.push_back({ data->data(), data->size() });
+        }
+
+        LOG_TRC("Writing " << _pending.size() << " records of " << _pendingSize
+                           << " bytes to persistent tile cache [" << _path << ']');
+        for (size_t first = 0; first < iov.size();)
+        {
+            const size_t count = std::min<size_t>(iov.size() - first, IOV_MAX);
+            size_t size = 0;
+            for (size_t i = first; i < first + count; ++i)
+                size += iov[i].iov_len;
+
+            // The index has the records already, and the tombstones must not be lost.
+            if (!writev(&iov[first], count, size))
+            {
+                empty();
+                return;
+            }
+
+            first += count;
+        }
+
+        _pending.clear();
+        _pendingSize = 0;
+    }
+
+    size_t size() const { return _fileSize + _pendingSize; }
+
+private:
+    /// The records of one view rendering state, and a spatial index over them.
+    struct StateRecords
+    {
+        std::unordered_map<TileDesc, Record, TileDescCacheHasher, TileDescCacheCompareEq>
+            _records;
+
+        /// By mode and then part, as _tileIndex.
+        std::unordered_map<int, std::map<int, TileGrid>> _grids;
+    };
+
+    /// The cache key of desc, without the normalized view id, which is per kit.
+    static TileDesc key(const TileDesc& desc)
+    {
+        TileDesc key(desc);
+        key.setNormalizedViewId(0);
+        return key;
+    }
+
+    static void insertRecord(StateRecords& records, const TileDesc& key, const Record& record)
+    {
+        if (records._records.insert_or_assign(key, record).second)
+            records._grids[key.getEditMode()][key.getPart()].insert(key);
+    }
+
+    static bool eraseRecord(StateRecords& records, const TileDesc& key)
+    {
+        if (records._records.erase(key) == 0)
+            return false;
+
+        const auto modeIt = records._grids.find(key.getEditMode());
+        const auto gridIt = modeIt->second.find(key.getPart());
+        gridIt->second.remove(key);
+        if (gridIt->second.empty())
+        {
+            modeIt->second.erase(gridIt);
+            if (modeIt->second.empty())
+                records._grids.erase(modeIt);
+        }
+
+        return true;
+    }
+
+    static void appendString(std::string& out, const std::string& str)
+    {
+        const uint32_t size = str.size();
+        out.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        out.append(str);
+    }
+
+    /// The record of a tile, up to its data.
+    static std::string makeRecord(const std::string& state, const TileDesc& desc,
+                                  size_t dataSize)
+    {
+        const PersistentRecord record = { desc.getPart(),
+                                          desc.getEditMode(),
+                                          desc.getWidth(),
+                                          desc.getHeight(),
+                                          desc.getTilePosX(),
+                                          desc.getTilePosY(),
+                                          desc.getTileWidth(),
+                                          desc.getTileHeight(),
+                                          static_cast<uint32_t>(state.size()),
+                                          static_cast<uint32_t>(dataSize) };
+        std::string out(reinterpret_cast<const char*>(&record), sizeof(record));
+        out += state;
+        return out;
+    }
+
+    /// Index the records, up to the end of the file or the first invalid one.
+    void load()
+    {
+        const char* base = static_cast<const char*>(_map);
+        size_t offset = _headerSize;
+        while (offset + sizeof(PersistentRecord) <= _fileSize)
+        {
+            PersistentRecord record;
+            std::memcpy(&record, base + offset, sizeof(record));
+            const size_t stateOffset = offset + sizeof(record);
+            const size_t dataOffset = stateOffset + record._stateSize;
+            if (dataOffset + record._dataSize > _fileSize ||
+                (record._dataSize > 0 &&
+                 (record._dataSize < 2 || !TileData::isKeyframe(base + dataOffset, 1))))
+                break;
+
+            try
+            {
+                const TileDesc desc(0, record._part, record._mode, record._width, record._height,
+                                    record._tilePosX, record._tilePosY, record._tileWidth,
+                                    record._tileHeight, 0, 0, -1);
+                auto& records = _index[std::string(base + stateOffset, record._stateSize)];
+                if (record._dataSize == 0)
+                    eraseRecord(records, desc);
+                else // Not rendered by this kit, so anything rendered supersedes them.
+                    insertRecord(records, desc, { dataOffset, record._dataSize, RestoredTileWireId });
+            }
+            catch (const std::exception& exc)
+            {
+                LOG_WRN("Invalid tile in persistent tile cache [" << _path << "]: " << exc.what());
+                break;
+            }
+
+            offset = dataOffset + record._dataSize;
+        }
+
+        if (offset != _fileSize)
+        {
+            LOG_WRN("Truncating persistent tile cache [" << _path << "] from " << _fileSize
+                                                         << " to " << offset << " bytes");
+            unmap();
+            if (::ftruncate(_fd, offset) != 0)
+                LOG_SYS("Failed to truncate persistent tile cache [" << _path << ']');
+            _fileSize = offset;
+        }
+
+        LOG_DBG("Loaded " << count() << " tiles from persistent tile cache [" << _path << ']');
+    }
+
+    /// Appends records erasing tiles, or else erases all of them.
+    void appendTombstones(std::string tombstones)
+    {
+        // Without the tombstones, the tiles would be back on the next load.
+        if (_fileSize + _pendingSize + tombstones.size() > _maxFileSize)
+        {
+            empty();
+            return;
+        }
+
+        _pendingSize += tombstones.size();
+        _pending.emplace_back(std::move(tombstones), Blob());
+    }
+
+    /// Erases all the tiles, written or not.
+    void empty()
+    {
+        LOG_DBG("Emptying persistent tile cache [" << _path << ']');
+        unmap();
+        _index.clear();
+        _pending.clear();
+        _pendingSize = 0;
+        if (::ftruncate(_fd, _headerSize) != 0)
+            LOG_SYS("Failed to truncate persistent tile cache [" << _path << ']');
+        _fileSize = _headerSize;
+    }
+
+    bool write(const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t written = ::write(_fd, data, size);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+
+            data += written;
+            size -= written;
+        }
+
+        return true;
+    }
+
+    /// Appends the whole of iov, or nothing.
+    bool writev(const struct iovec* iov, int count, size_t size)
+    {
+        const ssize_t written = ::writev(_fd, iov, count);
+        if (written == static_cast<ssize_t>(size))
+        {
+            _fileSize += size;
+            return true;
+        }
+
+        LOG_SYS("Failed to append to persistent tile cache [" << _path << ']');
+        // Don't leave a torn record behind.
+        if (written > 0 && ::ftruncate(_fd, _fileSize) != 0)
+            LOG_SYS("Failed to truncate persistent tile cache [" << _path << ']');
+        return false;
+    }
+
+    bool map(size_t size)
+    {
+        void* ptr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, _fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            LOG_SYS("Failed to map persistent tile cache [" << _path << ']');
+            return false;
+        }
+
+        _map = ptr;
+        _mapSize = size;
+        return true;
+    }
+
+    void unmap()
+    {
+        if (_map)
+            ::munmap(_map, _mapSize);
+        _map = nullptr;
+        _mapSize = 0;
+    }
+
+    const std::string _path;
+    const size_t _maxFileSize;
+    int _fd;
+    void* _map;
+    size_t _mapSize;
+    size_t _headerSize;
+    size_t _fileSize;
+
+    /// The records appended and not written yet, each followed by its tile
+    /// data, if any, which is indexed at the offset it will be written at.
+    std::vector<std::pair<std::string, Blob>> _pending;
+    size_t _pendingSize;
+
+    /// The records, by view rendering state.
+    std::unordered_map<std::string, StateRecords> _index;
+};
+
 TileCache::TileCache(std::string docURL, const std::chrono::system_clock::time_point& modifiedTime,
                      bool dontCache)
     : _docURL(std::move(docURL))
     , _dontCache(dontCache)
     , _cacheSize(0)
     , _maxCacheSize(1024 * 1024)
+    , _invalidationVisits(0)
 {
 #ifndef BUILDING_TESTS
     LOG_INF("TileCache ctor for uri [" << COOLWSD::anonymizeUrl(_docURL) <<
@@ -60,7 +581,17 @@ TileCache::~TileCache()
 
 void TileCache::clear()
 {
+    if (_persistent)
+    {
+        for (const auto& it : _cache)
+            demoteTile(it.first, it.second);
+
+        _persistent->flush();
+    }
+
     _cache.clear();
+    _tileIndex.clear();
+    _clock.clear();
     _cacheSize = 0;
     for (std::map<std::string, Blob>& i : _streamCache)
         i.clear();
@@ -68,6 +599,99 @@ void TileCache::clear()
     LOG_INF("Completely cleared tile cache for: " << _docURL);
 }
 
+void TileCache::initPersistentCache(const std::string& path, size_t maxFileSize,
+                                    size_t maxDirSize)
+{
+    PersistentCachePath = path;
+    PersistentCacheMaxFileSize = maxFileSize;
+    PersistentCacheMaxDirSize = maxDirSize;
+    if (!PersistentCachePath.empty())
+        prunePersistentCache(PersistentCachePath, PersistentCacheMaxDirSize);
+}
+
+void TileCache::openPersistentCache(const std::string& docVersion)
+{
+    if (_dontCache || PersistentCachePath.empty() || docVersion.empty())
+        return;
+
+    const std::string path = PersistentCachePath + '/' +
+                             Util::encodeId(SpookyHash::Hash64(_docURL.data(), _docURL.size(), 0),
+                                            16) +
+                             PersistentSuffix;
+    // Make room for a new file.
+    if (!FileUtil::Stat(path).exists())
+        prunePersistentCache(PersistentCachePath, PersistentCacheMaxDirSize);
+
+    _persistent = std::make_unique<PersistentTiles>(path, PersistentCacheMaxFileSize);
+    if (!_persistent->open(_docURL, docVersion))
+        _persistent.reset();
+}
+
+void TileCache::closePersistentCache()
+{
+    if (_persistent)
+        LOG_DBG("Closing persistent tile cache for: " << _docURL);
+
+    _persistent.reset();
+}
+
+void TileCache::flushPersistentCache()
+{
+    if (_persistent)
+        _persistent->flush();
+}
+
+void TileCache::setViewRenderState(int normalizedViewId, const std::string& state)
+{
+    _viewRenderStates[normalizedViewId] = state;
+}
+
+Tile TileCache::restoreTile(const TileDesc& desc)
+{
+    const auto stateIt = _viewRenderStates.find(desc.getNormalizedViewId());
+    if (stateIt == _viewRenderStates.end() || stateIt->second.empty())
+        return Tile();
+
+    const PersistentTiles::Record* record = _persistent->find(stateIt->second, desc);
+    const char* data = record ? _persistent->data(*record) : nullptr;
+    if (!data)
+    {
+        ++PersistentMisses;
+        return Tile();
+    }
+
+    ++PersistentHits;
+    LOG_TRC("Restored tile " << desc.serialize() << " of size " << record->_size
+                             << " from the persistent cache");
+
+    Tile tile = std::make_shared<TileData>(record->_wid, data, record->_size);
+    ensureCacheSize();
+
+    TileDesc key(desc);
+    key.setWireId(tile->_wids[0]);
+    insertTile(key, tile);
+    return tile;
+}
+
+void TileCache::demoteTile(const TileDesc& desc, const Tile& tile)
+{
+    const auto stateIt = _viewRenderStates.find(desc.getNormalizedViewId());
+    if (stateIt == _viewRenderStates.end() || stateIt->second.empty())
+        return;
+
+    // Only whole keyframes are of use to other kits. Tiles with deltas, or
+    // invalid ones, were invalidated, which erased them from the file too.
+    if (!tile->isValid() || tile->_wids.size() != 1 || !tile->_blobs[0])
+        return;
+
+    const PersistentTiles::Record* record = _persistent->find(stateIt->second, desc);
+    if (record && record->_wid == tile->_wids[0])
+        return; // Already there.
+
+    if (_persistent->append(stateIt->second, desc, tile->_wids[0], tile->_blobs[0]))
+        ++PersistentStores;
+}
+
 /// Tracks the rendering of a given tile
 /// to avoid duplication and help clock
 /// rendering latency.
@@ -173,6 +797,8 @@ Tile TileCache::lookupTile(const TileDesc& tile)
         return Tile();
 
     Tile ret = findTile(tile);
+    if (!ret && _persistent)
+        ret = restoreTile(tile);
 
     UnitWSD::get().lookupTile(tile.getPart(), tile.getEditMode(),
                               tile.getWidth(), tile.getHeight(),
@@ -193,7 +819,9 @@ void TileCache::saveTileAndNotify(const TileDesc& desc, const char *data, const
     // Ignore if we can't save the tile, things will work anyway, but slower.
     // An error indication is supposed to be sent to all users in that case.
     Tile tile = saveDataToCache(desc, data, size);
-    if (!_dontCache)
+    if (TileData::isUnchanged(data, size))
+        LOG_TRC("Unchanged cache tile: " << cacheFileName(desc) << " now at wid " << desc.getWireId());
+    else if (!_dontCache)
         LOG_TRC("Saved cache tile: " << cacheFileName(desc) << " of size " << size << " bytes");
     else
         LOG_TRC("Got (non-cached) tile: " << cacheFileName(desc));
@@ -203,16 +831,20 @@ void TileCache::saveTileAndNotify(const TileDesc& desc, const char *data, const
     {
         const size_t subscriberCount = tileBeingRendered->getSubscribers().size();
 
-        // sendTile also does enqueueSendMessage underneath ...
+        // broadcastTileNow also does enqueueSendMessage underneath ...
         if (tile && subscriberCount > 0)
         {
+            std::vector<std::shared_ptr<ClientSession>> sessions;
+            sessions.reserve(subscriberCount);
             for (size_t i = 0; i < subscriberCount; ++i)
             {
                 auto& subscriber = tileBeingRendered->getSubscribers()[i];
                 std::shared_ptr<ClientSession> session = subscriber.lock();
                 if (session)
-                    session->sendTileNow(desc, tile);
+                    sessions.push_back(std::move(session));
             }
+
+            ClientSession::broadcastTileNow(desc, tile, sessions);
         }
         else if (subscriberCount == 0)
             LOG_DBG("No subscribers for: " << cacheFileName(desc));
@@ -287,25 +919,41 @@ void TileCache::invalidateTiles(int part, int mode, int x, int y, int width, int
 
     ASSERT_CORRECT_THREAD_OWNER(_owner);
 
-    for (auto it = _cache.begin(); it != _cache.end();)
+    // The area changed for all views, including those without one now.
+    if (_persistent)
+        _persistent->erase(part, mode, x, y, width, height);
+
+    const auto indexIt = _tileIndex.find(tileGridKey(mode, normalizedViewId));
+    if (indexIt == _tileIndex.end())
+        return;
+
+    const auto invalidateNear = [&](const TileGrid& grid)
     {
-        if (intersectsTile(it->first, part, mode, x, y, width, height, normalizedViewId))
-        {
-            // FIXME: only want to keep as invalid keyframes in the view area(s)
-            it->second->invalidate();
-            ++it;
-        }
-#if 0
-        {
-            LOG_TRC("Removing tile: " << it->first.serialize());
-            _cacheSize -= itemCacheSize(it->second);
-            it = _cache.erase(it);
-        }
-#endif
-        else
-        {
-            ++it;
-        }
+        grid.forEachNear(x, y, width, height,
+                         [&](const TileDesc& desc)
+                         {
+                             ++_invalidationVisits;
+                             if (!intersectsTile(desc, part, mode, x, y, width, height,
+                                                 normalizedViewId))
+                                 return;
+
+                             const auto it = _cache.find(desc);
+                             // FIXME: only want to keep as invalid keyframes in the view area(s)
+                             if (it != _cache.end() && it->second)
+                                 it->second->invalidate();
+                         });
+    };
+
+    if (part == -1)
+    {
+        for (const auto& it : indexIt->second)
+            invalidateNear(it.second);
+    }
+    else
+    {
+        const auto gridIt = indexIt->second.find(part);
+        if (gridIt != indexIt->second.end())
+            invalidateNear(gridIt->second);
     }
 }
 
@@ -482,6 +1130,7 @@ Tile TileCache::findTile(const TileDesc &desc)
     if (it != _cache.end() && it->first.getNormalizedViewId() == desc.getNormalizedViewId())
     {
         LOG_TRC("Found cache tile: " << desc.serialize() << " of size " << it->second);
+        touchTile(it->second);
         return it->second;
     }
 
@@ -512,19 +1161,120 @@ Tile TileCache::saveDataToCache(const TileDesc &desc, const char *data, const si
         {
             LOG_TRC("new tile for " << desc.serialize() << " of size " << size);
             tile = std::make_shared<TileData>(desc.getWireId(), data, size);
-            _cache[desc] = tile;
-            _cacheSize += itemCacheSize(tile);
+            insertTile(desc, tile);
         }
     }
     else
     {
         LOG_TRC("append blob to " << desc.serialize() << " of size " << size);
         _cacheSize += tile->appendBlob(desc.getWireId(), data, size);
+        touchTile(tile);
     }
 
     return tile;
 }
 
+void TileCache::removeTile(const TileDesc& desc)
+{
+    const auto indexIt = _tileIndex.find(tileGridKey(desc.getEditMode(), desc.getNormalizedViewId()));
+    if (indexIt == _tileIndex.end())
+        return;
+
+    const auto gridIt = indexIt->second.find(desc.getPart());
+    if (gridIt == indexIt->second.end())
+        return;
+
+    gridIt->second.remove(desc);
+    if (gridIt->second.empty())
+    {
+        indexIt->second.erase(gridIt);
+        if (indexIt->second.empty())
+            _tileIndex.erase(indexIt);
+    }
+}
+
+void TileCache::TileGrid::insert(const TileDesc& desc)
+{
+    const int64_t right = static_cast<int64_t>(desc.getTilePosX()) + desc.getTileWidth();
+    const int64_t bottom = static_cast<int64_t>(desc.getTilePosY()) + desc.getTileHeight();
+
+    // Edges touching the invalidated area count as intersecting, so the
+    // tile is registered in every bucket that its closed extent touches.
+    for (int64_t bx = desc.getTilePosX() / BucketSize; bx <= right / BucketSize; ++bx)
+    {
+        for (int64_t by = desc.getTilePosY() / BucketSize; by <= bottom / BucketSize; ++by)
+            _buckets[bucketKey(bx, by)].push_back(desc);
+    }
+}
+
+void TileCache::TileGrid::remove(const TileDesc& desc)
+{
+    const int64_t right = static_cast<int64_t>(desc.getTilePosX()) + desc.getTileWidth();
+    const int64_t bottom = static_cast<int64_t>(desc.getTilePosY()) + desc.getTileHeight();
+
+    TileDescCacheCompareEq pred;
+    for (int64_t bx = desc.getTilePosX() / BucketSize; bx <= right / BucketSize; ++bx)
+    {
+        for (int64_t by = desc.getTilePosY() / BucketSize; by <= bottom / BucketSize; ++by)
+        {
+            const auto bucketIt = _buckets.find(bucketKey(bx, by));
+            if (bucketIt == _buckets.end())
+                continue;
+
+            std::vector<TileDesc>& bucket = bucketIt->second;
+            const auto it = std::find_if(bucket.begin(), bucket.end(),
+                                         [&](const TileDesc& other) { return pred(desc, other); });
+            if (it != bucket.end())
+            {
+                *it = bucket.back();
+                bucket.pop_back();
+            }
+
+            if (bucket.empty())
+                _buckets.erase(bucketIt);
+        }
+    }
+}
+
+template <typename F>
+void TileCache::TileGrid::forEachNear(int x, int y, int width, int height, F func) const
+{
+    const int64_t minX = x / BucketSize;
+    const int64_t minY = y / BucketSize;
+    const int64_t maxX = (static_cast<int64_t>(x) + width) / BucketSize;
+    const int64_t maxY = (static_cast<int64_t>(y) + height) / BucketSize;
+
+    const auto visit = [&](const std::vector<TileDesc>& bucket)
+    {
+        for (const TileDesc& desc : bucket)
+            func(desc);
+    };
+
+    // Large areas, eg. whole-document invalidations, cover more buckets
+    // than we have populated; walk the populated ones instead.
+    if ((maxX - minX + 1) * (maxY - minY + 1) > static_cast<int64_t>(_buckets.size()))
+    {
+        for (const auto& it : _buckets)
+        {
+            const int64_t bx = static_cast<int64_t>(it.first >> 32);
+            const int64_t by = static_cast<uint32_t>(it.first);
+            if (bx >= minX && bx <= maxX && by >= minY && by <= maxY)
+                visit(it.second);
+        }
+        return;
+    }
+
+    for (int64_t bx = minX; bx <= maxX; ++bx)
+    {
+        for (int64_t by = minY; by <= maxY; ++by)
+        {
+            const auto it = _buckets.find(bucketKey(bx, by));
+            if (it != _buckets.end())
+                visit(it->second);
+        }
+    }
+}
+
 size_t TileCache::itemCacheSize(const Tile &tile)
 {
     return sizeof(Tile) + sizeof(TileDesc) + tile->size();
@@ -542,6 +1292,23 @@ void TileCache::assertCacheSize()
 #endif
 }
 
+void TileCache::touchTile(const Tile& tile)
+{
+    // Deltas are cheap to re-render, keyframes of busy areas less so.
+    const unsigned cost = tile->keyframeSize() >= CostlyTileSize ? 2 : 1;
+    tile->_clockCredit = std::min(tile->_clockCredit + cost, MaxClockCredit);
+}
+
+void TileCache::insertTile(const TileDesc& desc, const Tile& tile)
+{
+    _cache[desc] = tile;
+    _cacheSize += itemCacheSize(tile);
+    _tileIndex[tileGridKey(desc.getEditMode(), desc.getNormalizedViewId())][desc.getPart()].insert(
+        desc);
+    _clock.push_back(desc);
+    touchTile(tile);
+}
+
 void TileCache::ensureCacheSize()
 {
     assertCacheSize();
@@ -552,69 +1319,65 @@ void TileCache::ensureCacheSize()
     LOG_TRC("Cleaning tile cache of size " << _cacheSize << " vs. " << _maxCacheSize <<
             " with " << _cache.size() << " entries");
 
-    struct WidSize {
-        TileWireId _wid;
-        size_t     _size;
-        WidSize(TileWireId w, size_t s) : _wid(w), _size(s) {}
-    };
-    std::vector<WidSize> wids;
-    for (const auto& it : _cache)
-        wids.emplace_back(it.first.getWireId(), itemCacheSize(it.second));
-
-    std::sort(wids.begin(), wids.end(),
-              [](const WidSize &a, const WidSize &b) { return a._wid < b._wid; });
+    // Free a quarter, so that we sweep again only after as much was added:
+    // that keeps the cost of eviction constant per tile on average.
+    const size_t targetSize = _maxCacheSize - _maxCacheSize / 4;
+
+    // A sweep of the clock takes a credit from each tile it passes, so after
+    // MaxClockCredit sweeps only tiles in view or being rendered remain. Then,
+    // if still too large, we drop tiles in view too; never those we wait on.
+    const size_t sweepSteps = _clock.size();
+    const size_t maxSteps = (MaxClockCredit + 2) * sweepSteps;
+    size_t removed = 0;
+    for (size_t steps = 0; steps < maxSteps && _cacheSize > targetSize && _cache.size() > 1 &&
+                           !_clock.empty();
+         ++steps)
+    {
+        const TileDesc desc = _clock.front();
+        _clock.pop_front();
 
-    // FIXME: should we just take a wid 25% into the list ?
-    TileWireId maxToRemove = wids.front()._wid;
+        const auto it = _cache.find(desc);
+        if (it == _cache.end())
+            continue;
 
-    // do we have (the very rare) WID wrap-around
-    if (wids.back()._wid - wids.front()._wid > 256 * 256 * 256)
-    {
-        maxToRemove = wids.back()._wid;
-        LOG_TRC("Rare wid wrap-around detected, clear tile cache");
-    }
-    else
-    {
-        // calculate which wid to start at.
-        size_t total = 0;
-        for (const auto &it : wids)
+        const Tile& tile = it->second;
+        if (_tilesBeingRendered.find(it->first) != _tilesBeingRendered.end())
         {
-            total += it._size;
-            maxToRemove = it._wid;
-            if (total > _maxCacheSize / 4)
-                break;
+            // avoid getting a delta instead of a keyframe at the bottom.
+            LOG_TRC("skip cleaning tile we are waiting on: " << it->first.serialize());
+            _clock.push_back(desc);
+            continue;
         }
-    }
-    LOG_TRC("cleaning up to wid " << maxToRemove << " between " <<
-            wids.front()._wid << " and " << wids.back()._wid);
 
-    for (auto it = _cache.begin(); it != _cache.end();)
-    {
-        if (it->first.getWireId() <= maxToRemove)
+        if (steps < (MaxClockCredit + 1) * sweepSteps)
         {
-            auto rit = _tilesBeingRendered.find(it->first);
-            if (rit != _tilesBeingRendered.end())
+            // Invalid tiles are to be rendered again anyway, unless in view
+            // where they are the base of the next delta.
+            if (tile->isValid() && tile->_clockCredit > 0)
             {
-                // avoid getting a delta instead of a keyframe at the bottom.
-                LOG_TRC("skip cleaning tile we are waiting on: " << it->first.serialize() <<
-                        " which has " << rit->second->getSubscribers().size() << " waiting");
-                ++it;
+                --tile->_clockCredit;
+                _clock.push_back(desc);
+                continue;
             }
-            else
+
+            if (_isTileVisible && _isTileVisible(it->first))
             {
-                LOG_TRC("cleaned out tile: " << it->first.serialize());
-                _cacheSize -= itemCacheSize(it->second);
-                it = _cache.erase(it);
+                _clock.push_back(desc);
+                continue;
             }
         }
-        else
-        {
-            ++it;
-        }
+
+        LOG_TRC("cleaned out tile: " << it->first.serialize());
+        if (_persistent)
+            demoteTile(it->first, tile);
+        removeTile(it->first);
+        _cacheSize -= itemCacheSize(tile);
+        _cache.erase(it);
+        ++removed;
     }
 
-    LOG_TRC("Cache is now of size " << _cacheSize << " and " <<
-            _cache.size() << " entries after cleaning");
+    LOG_TRC("Cache is now of size " << _cacheSize << " and " << _cache.size()
+                                    << " entries after cleaning " << removed);
 
     assertCacheSize();
 }
@@ -654,6 +1417,16 @@ void TileCache::dumpState(std::ostream& os)
 {
     os << "\n  TileCache:";
     os << "\n    num: " << _cache.size() << " size: " << _cacheSize << " bytes\n";
+    size_t buckets = 0;
+    for (const auto& it : _tileIndex)
+    {
+        for (const auto& grid : it.second)
+            buckets += grid.second.bucketCount();
+    }
+    os << "    index grids: " << _tileIndex.size() << " buckets: " << buckets << '\n';
+    if (_persistent)
+        os << "    persistent: " << _persistent->count() << " tiles, " << _persistent->size()
+           << " bytes\n";
     for (const auto& it : _cache)
     {
         os << "    " << std::setw(4) << it.first.getWireId()
@@ -11,7 +11,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <iosfwd>
+#include <map>
 #include <memory>
 #include <string>
 #include <thread>
@@ -66,6 +70,8 @@ struct TileDescCacheHasher final
 struct TileData
 {
     TileData(TileWireId start, const char *data, const size_t size)
+        : _size(0)
+        , _clockCredit(0)
     {
         appendBlob(start, data, size);
     }
@@ -80,8 +86,8 @@ struct TileData
         {
             LOG_TRC("received key-frame - clearing tile");
             _wids.clear();
-            _offsets.clear();
-            _deltas.clear();
+            _blobs.clear();
+            _size = 0;
         }
         else
         {
@@ -95,14 +101,12 @@ struct TileData
                 LOG_DBG("no underlying keyframe!");
         }
 
-        size_t oldSize = size();
-
         // If we have an empty delta at the end - then just
         // bump the associated wid. There is no risk to sending
         // an empty delta twice.x
-        if (dataSize == 1 && // just a 'D'
-            _offsets.size() > 1 &&
-            _offsets.back() == _deltas.size())
+        if (isUnchanged(data, dataSize) &&
+            _blobs.size() > 1 &&
+            !_blobs.back())
         {
             LOG_TRC("received empty delta - bumping wid from " << _wids.back() << " to " << id);
             _wids.back() = id;
@@ -110,12 +114,10 @@ struct TileData
         else
         {
             _wids.push_back(id);
-            _offsets.push_back(_deltas.size());
-            if (dataSize > 1)
-            {
-                _deltas.resize(oldSize + dataSize - 1);
-                std::memcpy(_deltas.data() + oldSize, data + 1, dataSize - 1);
-            }
+            // Blobs are never modified, so sockets can send them as they are.
+            _blobs.push_back(dataSize > 1 ? std::make_shared<BlobData>(data + 1, data + dataSize)
+                                          : Blob());
+            _size += dataSize - 1;
         }
 
         // FIXME: possible race - should store a seq. from the invalidation(s) ?
@@ -128,14 +130,16 @@ struct TileData
     bool tooLarge() const
     {
         // keyframe gets a free size pass
-        if (_offsets.size() <= 1)
+        if (_blobs.size() <= 1)
             return false;
-        size_t deltaSize = size() - _offsets[1];
+        size_t deltaSize = size() - (_blobs[0] ? _blobs[0]->size() : 0);
         return deltaSize > 128 * 1024; // deltas should be cumulatively small.
     }
 
-    bool isPng() const { return (_deltas.size() > 1 &&
-                                 _deltas[0] == (char)0x89); }
+    size_t keyframeSize() const { return !_blobs.empty() && _blobs[0] ? _blobs[0]->size() : 0; }
+
+    bool isPng() const { return (size() > 1 && _blobs[0] &&
+                                 (*_blobs[0])[0] == (char)0x89); }
 
     static bool isKeyframe(const char *data, size_t dataSize)
     {
@@ -143,22 +147,24 @@ struct TileData
         return dataSize > 0 && (data[0] == 'Z' || data[0] == (char)0x89);
     }
 
+    /// An empty delta: the kit found the tile unchanged since the previous wid.
+    static bool isUnchanged(const char *data, size_t dataSize)
+    {
+        return dataSize == 1 && data[0] == 'D';
+    }
+
     bool isValid() const { return _valid; }
     void invalidate() { _valid = false; }
 
     bool _valid; // not true - waiting for a new tile if in view.
     std::vector<TileWireId> _wids;
-    std::vector<size_t> _offsets; // offset of the start of data
-    BlobData _deltas; // first item is a key-frame, followed by deltas at _offsets
+    std::vector<Blob> _blobs; // for each wid: first a key-frame, then deltas, null if empty
+    size_t _size; // of all the blobs
+    unsigned _clockCredit; // sweeps of the eviction clock it survives when not in view
 
     size_t size() const
     {
-        return _deltas.size();
-    }
-
-    const BlobData &data() const
-    {
-        return _deltas;
+        return _size;
     }
 
     /// if we send changes since this seq - do we need to first send the keyframe ?
@@ -168,6 +174,18 @@ struct TileData
     }
 
     bool appendChangesSince(std::vector<char> &output, TileWireId since)
+    {
+        std::vector<Blob> blobs;
+        if (!appendChangesSince(blobs, since))
+            return false;
+
+        for (const Blob& blob : blobs)
+            output.insert(output.end(), blob->begin(), blob->end());
+        return true;
+    }
+
+    /// Append the blobs to send the changes since this seq, without copying them.
+    bool appendChangesSince(std::vector<Blob> &blobs, TileWireId since)
     {
         size_t i;
         for (i = 0; since != 0 && i < _wids.size() && _wids[i] <= since; ++i);
@@ -182,17 +200,15 @@ struct TileData
         }
         else
         {
-            size_t offset = _offsets[i];
-            if (i != _offsets.size() - 1)
-                LOG_TRC("appending from " << i << " to " << (_offsets.size() - 1) <<
-                        " from wid: " << _wids[i] << " to wid: " << since <<
-                        " from offset: " << offset << " to " << _deltas.size());
-
-            size_t extra = _deltas.size() - offset;
-            size_t dest = output.size();
-            output.resize(output.size() + extra);
+            if (i != _wids.size() - 1)
+                LOG_TRC("appending from " << i << " to " << (_wids.size() - 1) <<
+                        " from wid: " << _wids[i] << " to wid: " << since);
 
-            std::memcpy(output.data() + dest, _deltas.data() + offset, extra);
+            for (; i < _blobs.size(); ++i)
+            {
+                if (_blobs[i])
+                    blobs.push_back(_blobs[i]);
+            }
             return true;
         }
     }
@@ -205,7 +221,7 @@ struct TileData
             os << "deltas: ";
             for (size_t i = 0; i < _wids.size(); ++i)
             {
-                os << i << ": " << _wids[i] << " -> " << _offsets[i] << " ";
+                os << i << ": " << _wids[i] << " -> " << (_blobs[i] ? _blobs[i]->size() : 0) << " ";
             }
             os << (tooLarge() ? "too-large " : "");
         }
@@ -216,7 +232,10 @@ using Tile = std::shared_ptr<TileData>;
 /// Handles the caching of tiles of one document.
 class TileCache
 {
+    friend class TileCacheTests; // for unit testing
+
     struct TileBeingRendered;
+    class PersistentTiles;
 
     std::shared_ptr<TileBeingRendered> findTileBeingRendered(const TileDesc& tile);
 
@@ -228,9 +247,38 @@ public:
               bool dontCache = false);
     ~TileCache();
 
-    /// Completely clear the cache contents.
+    /// Completely clear the cache contents, keeping what the
+    /// persistent cache can reuse in it first.
     void clear();
 
+    /// Enables persistent caches of tiles in files of up to maxFileSize bytes,
+    /// one per document in the path directory, which is kept under maxDirSize bytes.
+    static void initPersistentCache(const std::string& path, size_t maxFileSize,
+                                    size_t maxDirSize);
+
+    /// Use the persistent cache of the document, as of this version in storage:
+    /// tiles are looked up there when not in memory, and kept there when evicted.
+    /// A cache of a different version is discarded.
+    void openPersistentCache(const std::string& docVersion);
+
+    /// Stop using the persistent cache, as once the document is modified.
+    void closePersistentCache();
+
+    /// Write the tiles evicted to the persistent cache, and its invalidations,
+    /// since the last flush. Best done when idle, after handling events.
+    void flushPersistentCache();
+
+    /// Set the rendering state of the views with this normalized id, which
+    /// identifies their tiles in the persistent cache. When empty, their
+    /// tiles are not persisted, eg. as they have a watermark.
+    void setViewRenderState(int normalizedViewId, const std::string& state);
+
+    /// Lookups in persistent caches, of tiles missing in memory.
+    static std::atomic<uint64_t> PersistentHits;
+    static std::atomic<uint64_t> PersistentMisses;
+    /// Tiles written to persistent caches.
+    static std::atomic<uint64_t> PersistentStores;
+
     TileCache(const TileCache&) = delete;
     TileCache& operator=(const TileCache&) = delete;
 
@@ -290,6 +338,13 @@ public:
     /// Get the current memory use.
     size_t getMemorySize() const { return _cacheSize; }
 
+    /// Set how to tell whether a tile is in the visible area of any session.
+    /// Such tiles are evicted last.
+    void setVisibilityCheck(std::function<bool(const TileDesc&)> isVisible)
+    {
+        _isTileVisible = std::move(isVisible);
+    }
+
     // Debugging bits ...
     void dumpState(std::ostream& os);
     void setThreadOwner(const std::thread::id& id) { _owner = id; }
@@ -299,11 +354,27 @@ private:
     void ensureCacheSize();
     static size_t itemCacheSize(const Tile &tile);
 
+    /// Note a use of the tile, so that it survives more sweeps of the eviction clock.
+    static void touchTile(const Tile& tile);
+
+    /// Add a new tile to the cache, the spatial index and the eviction clock.
+    void insertTile(const TileDesc& desc, const Tile& tile);
+
     void invalidateTiles(int part, int mode, int x, int y, int width, int height, int normalizedViewId);
 
+    /// Remove a tile from the cache, keeping the spatial index in sync.
+    void removeTile(const TileDesc& desc);
+
     /// Lookup tile in our cache.
     Tile findTile(const TileDesc &desc);
 
+    /// Lookup tile in the persistent cache, and bring it back in memory.
+    Tile restoreTile(const TileDesc& desc);
+
+    /// Keep the tile, about to be dropped from memory, in the persistent cache,
+    /// once it is flushed.
+    void demoteTile(const TileDesc& desc, const Tile& tile);
+
     static std::string cacheFileName(const TileDesc& tileDesc);
     static bool parseCacheFileName(const std::string& fileName, int& part, int& mode,
                                    int& width, int& height, int& tilePosX, int& tilePosY,
@@ -329,10 +400,62 @@ private:
     /// Maximum (high watermark) size of the tilecache in bytes
     size_t _maxCacheSize;
 
+    /// Tiles looked at by invalidations, to check they stay local.
+    size_t _invalidationVisits;
+
     // FIXME: should we have a tile-desc to WID map instead and a simpler lookup ?
     std::unordered_map<TileDesc, Tile,
                        TileDescCacheHasher,
                        TileDescCacheCompareEq> _cache;
+
+    /// Spatial index over _cache, so invalidation only visits tiles near the
+    /// invalidated area instead of scanning the whole cache.
+    class TileGrid
+    {
+    public:
+        /// Size of a grid bucket in twips: a few tiles at 100% zoom.
+        static constexpr int BucketSize = 4 * 3840;
+
+        void insert(const TileDesc& desc);
+        void remove(const TileDesc& desc);
+        bool empty() const { return _buckets.empty(); }
+        size_t bucketCount() const { return _buckets.size(); }
+
+        /// Calls func for every tile whose bucket overlaps the given area.
+        /// A tile spanning several buckets may be visited more than once.
+        template <typename F> void forEachNear(int x, int y, int width, int height, F func) const;
+
+    private:
+        static uint64_t bucketKey(int64_t bx, int64_t by)
+        {
+            return (static_cast<uint64_t>(bx) << 32) | static_cast<uint32_t>(by);
+        }
+
+        std::unordered_map<uint64_t, std::vector<TileDesc>> _buckets;
+    };
+
+    static uint64_t tileGridKey(int mode, int normalizedViewId)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(mode)) << 32) |
+               static_cast<uint32_t>(normalizedViewId);
+    }
+
+    /// The grids, by (mode, normalizedViewId) and then part; parts are kept
+    /// together so that all-part invalidations can find them cheaply.
+    std::unordered_map<uint64_t, std::map<int, TileGrid>> _tileIndex;
+
+    /// The eviction clock: every cached tile once, the hand at the front.
+    /// Tiles that survive a sweep go to the back.
+    std::deque<TileDesc> _clock;
+
+    /// Keyframes at least this large were costly to render, and are kept longer.
+    static constexpr size_t CostlyTileSize = 32 * 1024;
+
+    /// The most sweeps of the eviction clock a tile out of view survives.
+    static constexpr unsigned MaxClockCredit = 3;
+
+    std::function<bool(const TileDesc&)> _isTileVisible;
+
     // FIXME: TileBeingRendered contains TileDesc too ...
     std::unordered_map<TileDesc, std::shared_ptr<TileBeingRendered>,
                        TileDescCacheHasher,
@@ -340,6 +463,16 @@ private:
 
     // old-style file-name to data grab-bag.
     std::map<std::string, Blob> _streamCache[static_cast<int>(StreamType::Last)];
+
+    /// The second level of the cache, on disk, when enabled.
+    std::unique_ptr<PersistentTiles> _persistent;
+
+    /// The rendering state of views, by normalized view id.
+    std::unordered_map<int, std::string> _viewRenderStates;
+
+    static std::string PersistentCachePath;
+    static size_t PersistentCacheMaxFileSize;
+    static size_t PersistentCacheMaxDirSize;
 };
 
 /// Tracks view-port area tiles to track which we last
@@ -394,7 +527,7 @@ inline std::ostream& operator<< (std::ostream& os, const Tile& tile)
         os << "nullptr";
     else
         os << "keyframe id " << tile->_wids[0] <<
-            " size: " << tile->_deltas.size() <<
+            " size: " << tile->size() <<
             " deltas: " << (tile->_wids.size() - 1);
     return os;
 }
@@ -24,6 +24,10 @@
 #define TILE_WIRE_ID
 using TileWireId = uint32_t;
 
+/// The wire id of tiles restored from a persistent tile cache, so
+/// rendered tiles, whose wire ids are above it, always supersede them.
+constexpr TileWireId RestoredTileWireId = 1;
+
 namespace TileParse
 {
     template <typename A> struct Comp
@@ -29,7 +29,7 @@ void CheckFileInfo::checkFileInfo(int redirectLimit)
     const std::string uriAnonym = COOLWSD::anonymizeUrl(_url.toString());
 
     LOG_DBG("Getting info for wopi uri [" << uriAnonym << ']');
-    _httpSession = StorageConnectionManager::getHttpSession(_url);
+    _httpSession = StorageConnectionManager::getHttpSession(_url, *_poll);
     Authorization auth = Authorization::create(_url);
     http::Request httpRequest = StorageConnectionManager::createHttpRequest(_url, auth);
 
@@ -55,6 +55,7 @@
 
 bool StorageConnectionManager::SSLAsScheme = true;
 bool StorageConnectionManager::SSLEnabled = false;
+std::unique_ptr<http::SessionPool> StorageConnectionManager::SessionPool;
 
 namespace
 {
@@ -94,6 +95,19 @@ void initHttpRequest(Poco::Net::HTTPRequest& request, const Poco::URI& uri,
     request.set("X-COOL-WOPI-ServerId", Util::getProcessIdentifier());
 }
 
+/// Returns the given timeout, or the configured one (net.connection_timeout_secs) when 0.
+std::chrono::seconds getRequestTimeout(std::chrono::seconds timeout)
+{
+    if (timeout == std::chrono::seconds::zero())
+    {
+        CONFIG_STATIC const std::chrono::seconds defTimeout =
+            std::chrono::seconds(COOLWSD::getConfigValue<int>("net.connection_timeout_secs", 30));
+        return defTimeout;
+    }
+
+    return timeout;
+}
+
 } // namespace
 
 http::Request StorageConnectionManager::createHttpRequest(const Poco::URI& uri,
@@ -114,8 +128,7 @@ http::Request StorageConnectionManager::createHttpRequest(const Poco::URI& uri,
     return httpRequest;
 }
 
-std::shared_ptr<http::Session>
-StorageConnectionManager::getHttpSession(const Poco::URI& uri, std::chrono::seconds timeout)
+http::Session::Protocol StorageConnectionManager::getProtocol(const Poco::URI& uri)
 {
     bool useSSL = false;
     if (SSLAsScheme)
@@ -132,26 +145,46 @@ StorageConnectionManager::getHttpSession(const Poco::URI& uri, std::chrono::seco
         useSSL = SSLEnabled || COOLWSD::isSSLTermination();
     }
 
-    const auto protocol =
-        useSSL ? http::Session::Protocol::HttpSsl : http::Session::Protocol::HttpUnencrypted;
+    return useSSL ? http::Session::Protocol::HttpSsl : http::Session::Protocol::HttpUnencrypted;
+}
 
+std::shared_ptr<http::Session>
+StorageConnectionManager::getHttpSession(const Poco::URI& uri, std::chrono::seconds timeout)
+{
     // Create the session.
-    auto httpSession = http::Session::create(uri.getHost(), protocol, uri.getPort());
+    auto httpSession = http::Session::create(uri.getHost(), getProtocol(uri), uri.getPort());
 
-    if (timeout == std::chrono::seconds::zero())
-    {
-        CONFIG_STATIC const std::chrono::seconds defTimeout =
-            std::chrono::seconds(COOLWSD::getConfigValue<int>("net.connection_timeout_secs", 30));
-        timeout = defTimeout;
-    }
+    httpSession->setTimeout(getRequestTimeout(timeout));
 
-    httpSession->setTimeout(timeout);
+    return httpSession;
+}
+
+std::shared_ptr<http::Session>
+StorageConnectionManager::getHttpSession(const Poco::URI& uri, const SocketPoll& poll,
+                                         std::chrono::seconds timeout)
+{
+    if (!SessionPool)
+        return getHttpSession(uri, timeout);
+
+    std::shared_ptr<http::Session> httpSession =
+        SessionPool->get(uri.getHost(), getProtocol(uri), uri.getPort(), poll);
+    httpSession->setTimeout(getRequestTimeout(timeout));
 
     return httpSession;
 }
 
 void StorageConnectionManager::initialize()
 {
+    if (COOLWSD::getConfigValue<bool>("storage.wopi.connection_pool[@enable]", true))
+    {
+        SessionPool = std::make_unique<http::SessionPool>(
+            COOLWSD::getConfigValue<int>("storage.wopi.connection_pool.max_per_host", 8),
+            std::chrono::seconds(COOLWSD::getConfigValue<int>(
+                "storage.wopi.connection_pool.idle_timeout_secs", 4)));
+    }
+    else
+        SessionPool.reset();
+
 #if ENABLE_SSL
     // FIXME: should use our own SSL socket implementation here.
     Poco::Crypto::initializeCrypto();
@@ -46,6 +46,14 @@ public:
     getHttpSession(const Poco::URI& uri,
                    std::chrono::seconds timeout = std::chrono::seconds::zero());
 
+    /// Borrow an idle, connected http::Session to the host of the URI, or create a new one,
+    /// for an asynchronous request on the given poll. Must be called on the poll's thread.
+    /// Sessions are pooled per poll, where their sockets live, and are reused once their
+    /// request has finished, until they are idle for too long.
+    static std::shared_ptr<http::Session>
+    getHttpSession(const Poco::URI& uri, const SocketPoll& poll,
+                   std::chrono::seconds timeout = std::chrono::seconds::zero());
+
     /// Create an http::Request with the common headers.
     static http::Request createHttpRequest(const Poco::URI& uri, const Authorization& auth);
 
@@ -54,6 +62,9 @@ public:
 private:
     StorageConnectionManager() {}
 
+    /// The protocol to talk to the storage server at the URI with.
+    static http::Session::Protocol getProtocol(const Poco::URI& uri);
+
     /// Sanitize a URI by removing authorization tokens.
     Poco::URI sanitizeUri(Poco::URI uri)
     {
@@ -82,4 +93,7 @@ private:
     static bool SSLAsScheme;
     /// If true, force SSL communication with storage server
     static bool SSLEnabled;
+
+    /// The connections to storage servers to reuse, if enabled.
+    static std::unique_ptr<http::SessionPool> SessionPool;
 };
@@ -464,7 +464,7 @@ void WopiStorage::updateLockStateAsync(const Authorization& auth, LockContext& l
     const auto wopiLog = (lock == StorageBase::LockState::LOCK ? "WOPI::Lock" : "WOPI::Unlock");
     LOG_DBG(wopiLog << " requesting: " << uriAnonym);
 
-    _lockHttpSession = StorageConnectionManager::getHttpSession(uriObject);
+    _lockHttpSession = StorageConnectionManager::getHttpSession(uriObject, socketPoll);
 
     http::Request httpRequest = initHttpRequest(uriObject, auth);
     httpRequest.setVerb(http::Request::VERB_POST);
@@ -484,7 +484,7 @@ void WopiStorage::updateLockStateAsync(const Authorization& auth, LockContext& l
     httpHeader.setContentLength(0);
 
     http::Session::FinishedCallback finishedCallback =
-        [this, startTime, lockCtx, lock, wopiLog, uriAnonym, asyncLockStateCallback,
+        [this, startTime, &lockCtx, lock, wopiLog, uriAnonym, asyncLockStateCallback,
          profileZone =
              std::move(profileZone)](const std::shared_ptr<http::Session>& httpSession) mutable
     {
@@ -592,16 +592,7 @@ std::string WopiStorage::downloadStorageFileToLocal(const Authorization& auth,
     }
 
     // Try the default URL, we either don't have FileUrl, or it failed.
-    // WOPI URI to download files ends in '/contents'.
-    // Add it here to get the payload instead of file info.
-    Poco::URI uriObject(getUri());
-    uriObject.setPath(uriObject.getPath() + "/contents");
-    auth.authorizeURI(uriObject);
-
-    Poco::URI uriObjectAnonym(getUri());
-    uriObjectAnonym.setPath(COOLWSD::anonymizeUrl(uriObjectAnonym.getPath()) + "/contents");
-    const std::string uriAnonym = uriObjectAnonym.toString();
-
+    const auto [uriObject, uriAnonym] = getContentsUri(auth);
     try
     {
         LOG_INF("WOPI::GetFile using default URI: " << uriAnonym);
@@ -615,15 +606,21 @@ std::string WopiStorage::downloadStorageFileToLocal(const Authorization& auth,
     }
 }
 
-std::string WopiStorage::downloadDocument(const Poco::URI& uriObject, const std::string& uriAnonym,
-                                          const Authorization& auth, unsigned redirectLimit)
+std::pair<Poco::URI, std::string> WopiStorage::getContentsUri(const Authorization& auth) const
 {
-    const auto startTime = std::chrono::steady_clock::now();
-    std::shared_ptr<http::Session> httpSession =
-        StorageConnectionManager::getHttpSession(uriObject);
+    // WOPI URI to download files ends in '/contents'.
+    // Add it here to get the payload instead of file info.
+    Poco::URI uriObject(getUri());
+    uriObject.setPath(uriObject.getPath() + "/contents");
+    auth.authorizeURI(uriObject);
 
-    http::Request httpRequest = initHttpRequest(uriObject, auth);
+    Poco::URI uriObjectAnonym(getUri());
+    uriObjectAnonym.setPath(COOLWSD::anonymizeUrl(uriObjectAnonym.getPath()) + "/contents");
+    return { uriObject, uriObjectAnonym.toString() };
+}
 
+void WopiStorage::prepareDownload()
+{
     setRootFilePath(Poco::Path(getLocalRootPath(), getFileInfo().getFilename()).toString());
     setRootFilePathAnonym(COOLWSD::anonymizeUrl(getRootFilePath()));
 
@@ -636,6 +633,18 @@ std::string WopiStorage::downloadDocument(const Poco::URI& uriObject, const std:
     {
         throw StorageSpaceLowException("Low disk space for " + getRootFilePathAnonym());
     }
+}
+
+std::string WopiStorage::downloadDocument(const Poco::URI& uriObject, const std::string& uriAnonym,
+                                          const Authorization& auth, unsigned redirectLimit)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    std::shared_ptr<http::Session> httpSession =
+        StorageConnectionManager::getHttpSession(uriObject);
+
+    http::Request httpRequest = initHttpRequest(uriObject, auth);
+
+    prepareDownload();
 
     LOG_TRC("Downloading from [" << uriAnonym << "] to [" << getRootFilePath()
                                  << "]: " << httpRequest.header());
@@ -696,6 +705,12 @@ std::string WopiStorage::downloadDocument(const Poco::URI& uriObject, const std:
     LOG_INF("WOPI::GetFile downloaded " << filesize << " bytes from [" << uriAnonym << "] -> "
                                         << getRootFilePathAnonym() << " in " << diff);
 
+    return completeDownload(wopiCert, subjectHash);
+}
+
+std::string WopiStorage::completeDownload(const std::string& wopiCert,
+                                          const std::string& subjectHash)
+{
     if (!wopiCert.empty() && !subjectHash.empty())
     {
         // Put the wopi server cert, which has been designated valid by 'online',
@@ -731,6 +746,220 @@ std::string WopiStorage::downloadDocument(const Poco::URI& uriObject, const std:
         return Poco::Path(getJailPath(), getFileInfo().getFilename()).toString();
 }
 
+bool WopiStorage::downloadStorageFileToLocalAsync(const Authorization& auth,
+                                                  LockContext& /*lockCtx*/,
+                                                  const std::string& templateUri,
+                                                  SocketPoll& socketPoll,
+                                                  const AsyncDownloadCallback& asyncDownloadCallback)
+{
+    if (_downloadHttpSession)
+    {
+        LOG_WRN("Download is already in progress.");
+        asyncDownloadCallback(AsyncDownload(
+            AsyncDownload::State::Error,
+            DownloadResult(DownloadResult::Result::FAILED, "Already in progress.")));
+        return true;
+    }
+
+    // The URIs to try in turn, as downloadStorageFileToLocal does.
+    std::vector<std::pair<Poco::URI, std::string>> uris;
+    try
+    {
+        if (!templateUri.empty())
+        {
+            // Download the template file and load it normally.
+            // The document will get saved once loading in Core is complete.
+            uris.emplace_back(Poco::URI(templateUri), COOLWSD::anonymizeUrl(templateUri));
+        }
+        else
+        {
+            if (!_fileUrl.empty())
+                uris.emplace_back(Poco::URI(_fileUrl), COOLWSD::anonymizeUrl(_fileUrl));
+
+            uris.emplace_back(getContentsUri(auth));
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERR("Invalid WOPI::GetFile URI: " << ex.what());
+        asyncDownloadCallback(AsyncDownload(
+            AsyncDownload::State::Error,
+            DownloadResult(DownloadResult::Result::FAILED, "Invalid URI.")));
+        return true;
+    }
+
+    const Poco::URI uriObject = uris.front().first;
+    asyncDownloadDocument(std::move(uris), uriObject, auth, HTTP_REDIRECTION_LIMIT, socketPoll,
+                          asyncDownloadCallback);
+    return true;
+}
+
+void WopiStorage::asyncDownloadDocument(std::vector<std::pair<Poco::URI, std::string>> uris,
+                                        const Poco::URI& uriObject, const Authorization& auth,
+                                        unsigned redirectLimit, SocketPoll& socketPoll,
+                                        const AsyncDownloadCallback& asyncDownloadCallback)
+{
+    assert(!uris.empty() && "Expected a URI to download from");
+    const std::string uriAnonym = uris.front().second;
+    LOG_INF("WOPI::GetFile asynchronously from: " << uriAnonym);
+
+    try
+    {
+        prepareDownload();
+    }
+    catch (const StorageSpaceLowException& ex)
+    {
+        LOG_ERR("Cannot download document from [" << uriAnonym << "]: " << ex.what());
+        asyncDownloadCallback(AsyncDownload(
+            AsyncDownload::State::Error,
+            DownloadResult(DownloadResult::Result::DISKFULL, ex.what())));
+        return;
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERR("Cannot download document from [" << uriAnonym << "]: " << ex.what());
+        asyncDownloadCallback(AsyncDownload(
+            AsyncDownload::State::Error,
+            DownloadResult(DownloadResult::Result::FAILED, "Internal error.")));
+        return;
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    _downloadHttpSession = StorageConnectionManager::getHttpSession(uriObject, socketPoll);
+
+    http::Request httpRequest = initHttpRequest(uriObject, auth);
+
+    LOG_TRC("Downloading from [" << uriAnonym << "] to [" << getRootFilePath()
+                                 << "]: " << httpRequest.header());
+
+    // Report whole percents only, these go to the clients.
+    _downloadHttpSession->setProgressHandler(
+        [asyncDownloadCallback, lastPercent = int64_t(-1)](int64_t received,
+                                                           int64_t expected) mutable
+        {
+            const int64_t percent = expected > 0 ? received * 100 / expected : -1;
+            if (percent < 0 || percent == lastPercent)
+                return;
+
+            lastPercent = percent;
+            DownloadResult result(DownloadResult::Result::OK);
+            result.setProgress(received, expected);
+            asyncDownloadCallback(AsyncDownload(AsyncDownload::State::Running, result));
+        });
+
+    http::Session::FinishedCallback finishedCallback =
+        [this, uris, auth, redirectLimit, startTime, &socketPoll,
+         asyncDownloadCallback](const std::shared_ptr<http::Session>& httpSession) mutable
+    {
+        // Retire.
+        _downloadHttpSession.reset();
+
+        assert(httpSession && "Expected a valid http::Session");
+        const std::shared_ptr<const http::Response> httpResponse = httpSession->response();
+        const std::string uriAnonym = uris.front().second;
+
+        const std::chrono::milliseconds diff =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - startTime);
+
+        const http::StatusCode statusCode = httpResponse->statusLine().statusCode();
+        if (httpResponse->state() == http::Response::State::Complete &&
+            statusCode == http::StatusCode::OK)
+        {
+            // Log the response header.
+            LOG_TRC("WOPI::GetFile response header for URI [" << uriAnonym << "]:\n"
+                                                              << httpResponse->header());
+
+            const FileUtil::Stat fileStat(getRootFilePath());
+            const std::size_t filesize = (fileStat.good() ? fileStat.size() : 0);
+            LOG_INF("WOPI::GetFile downloaded " << filesize << " bytes from [" << uriAnonym
+                                                << "] -> " << getRootFilePathAnonym() << " in "
+                                                << diff);
+
+            std::string subjectHash;
+            const std::string wopiCert = httpSession->getSslCert(subjectHash);
+
+            DownloadResult result(DownloadResult::Result::OK);
+            result.setLocalPath(completeDownload(wopiCert, subjectHash));
+            asyncDownloadCallback(AsyncDownload(AsyncDownload::State::Complete, result));
+            return;
+        }
+
+        std::string reason;
+        if (httpResponse->state() != http::Response::State::Complete)
+        {
+            reason = "failed to get a response: " +
+                     std::string(http::Response::name(httpResponse->state()));
+        }
+        else if (statusCode == http::StatusCode::MovedPermanently ||
+                 statusCode == http::StatusCode::Found ||
+                 statusCode == http::StatusCode::TemporaryRedirect ||
+                 statusCode == http::StatusCode::PermanentRedirect)
+        {
+            const std::string& location = httpResponse->get("Location");
+            if (redirectLimit)
+            {
+                LOG_TRC("WOPI::GetFile redirect to URI [" << COOLWSD::anonymizeUrl(location)
+                                                          << ']');
+                try
+                {
+                    asyncDownloadDocument(uris, Poco::URI(location), auth, redirectLimit - 1,
+                                          socketPoll, asyncDownloadCallback);
+                    return;
+                }
+                catch (const std::exception& ex)
+                {
+                    reason = "invalid redirect: " + std::string(ex.what());
+                }
+            }
+            else
+                reason = "redirected too many times";
+        }
+        else
+        {
+            reason = "failed with Status Code: " + std::to_string(static_cast<int>(statusCode)) +
+                     ": " + httpResponse->getBody();
+        }
+
+        LOG_ERR("WOPI::GetFile [" << uriAnonym << "] " << reason);
+        asyncDownloadFailed(std::move(uris), auth, socketPoll, asyncDownloadCallback);
+    };
+
+    _downloadHttpSession->setFinishedHandler(std::move(finishedCallback));
+
+    _downloadHttpSession->setConnectFailHandler(
+        [this, uris, auth, &socketPoll, asyncDownloadCallback]() mutable
+        {
+            LOG_ERR("Cannot connect to download from wopi storage uri ["
+                    << uris.front().second << ']');
+            _downloadHttpSession.reset();
+            asyncDownloadFailed(std::move(uris), auth, socketPoll, asyncDownloadCallback);
+        });
+
+    // Make the request.
+    _downloadHttpSession->asyncDownload(httpRequest, getRootFilePath(), socketPoll);
+}
+
+void WopiStorage::asyncDownloadFailed(std::vector<std::pair<Poco::URI, std::string>> uris,
+                                      const Authorization& auth, SocketPoll& socketPoll,
+                                      const AsyncDownloadCallback& asyncDownloadCallback)
+{
+    // The FileUrl, if provided, is tried before the default URI.
+    uris.erase(uris.begin());
+    if (!uris.empty())
+    {
+        LOG_INF("Will use default URI [" << uris.front().second << "] for WOPI::GetFile");
+        const Poco::URI uriObject = uris.front().first;
+        asyncDownloadDocument(std::move(uris), uriObject, auth, HTTP_REDIRECTION_LIMIT,
+                              socketPoll, asyncDownloadCallback);
+        return;
+    }
+
+    asyncDownloadCallback(
+        AsyncDownload(AsyncDownload::State::Error,
+                      DownloadResult(DownloadResult::Result::FAILED, "Failed to download.")));
+}
+
 std::size_t WopiStorage::uploadLocalFileToStorageAsync(
     const Authorization& auth, LockContext& lockCtx, const std::string& saveAsPath,
     const std::string& saveAsFilename, const bool isRename, const Attributes& attribs,
@@ -784,7 +1013,7 @@ std::size_t WopiStorage::uploadLocalFileToStorageAsync(
     try
     {
         assert(!_uploadHttpSession && "Unexpected to have an upload http::session");
-        _uploadHttpSession = StorageConnectionManager::getHttpSession(uriObject);
+        _uploadHttpSession = StorageConnectionManager::getHttpSession(uriObject, socketPoll);
 
         http::Request httpRequest = initHttpRequest(uriObject, auth);
         httpRequest.setVerb(http::Request::VERB_POST);
@@ -27,6 +27,8 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 /// WOPI protocol backed storage.
 class WopiStorage : public StorageBase
@@ -182,6 +184,25 @@ public:
                 << COOLWSD::anonymizeUrl(uri.toString()) << "], legacy server: " << _legacyServer);
     }
 
+    ~WopiStorage() { WopiStorage::cancelAsyncRequests(); }
+
+    void cancelAsyncRequests() override
+    {
+        // The callbacks would outlive us, and those we call back.
+        for (std::shared_ptr<http::Session>* httpSession :
+             { &_lockHttpSession, &_uploadHttpSession, &_downloadHttpSession })
+        {
+            if (*httpSession)
+            {
+                (*httpSession)->setFinishedHandler(nullptr);
+                (*httpSession)->setConnectFailHandler(nullptr);
+                (*httpSession)->setProgressHandler(nullptr);
+                (*httpSession)->asyncShutdown();
+                httpSession->reset();
+            }
+        }
+    }
+
     /// Signifies if the server is legacy or not, based on the headers
     /// it sent us on first contact.
     bool isLegacyServer() const { return _legacyServer; }
@@ -205,6 +226,11 @@ public:
     std::string downloadStorageFileToLocal(const Authorization& auth, LockContext& lockCtx,
                                            const std::string& templateUri) override;
 
+    /// Streams the file into the jail on the given poll, without blocking it.
+    bool downloadStorageFileToLocalAsync(const Authorization& auth, LockContext& lockCtx,
+                                         const std::string& templateUri, SocketPoll& socketPoll,
+                                         const AsyncDownloadCallback& asyncDownloadCallback) override;
+
     std::size_t
     uploadLocalFileToStorageAsync(const Authorization& auth, LockContext& lockCtx,
                                   const std::string& saveAsPath, const std::string& saveAsFilename,
@@ -247,11 +273,34 @@ private:
     /// Create an http::Request with the common headers.
     http::Request initHttpRequest(const Poco::URI& uri, const Authorization& auth) const;
 
+    /// The default URI to download the document from, and its anonymized version.
+    std::pair<Poco::URI, std::string> getContentsUri(const Authorization& auth) const;
+
+    /// Sets up the local path to download the document to.
+    /// Throws StorageSpaceLowException when low on disk space.
+    void prepareDownload();
+
     /// Download the document from the given URI.
     /// Does not add authorization tokens or any other logic.
     std::string downloadDocument(const Poco::URI& uriObject, const std::string& uriAnonym,
                                  const Authorization& auth, unsigned redirectLimit);
 
+    /// Download the document asynchronously from the given URI, which is the first of uris
+    /// or a redirection from it. The rest of uris are tried in turn if that fails.
+    void asyncDownloadDocument(std::vector<std::pair<Poco::URI, std::string>> uris,
+                               const Poco::URI& uriObject, const Authorization& auth,
+                               unsigned redirectLimit, SocketPoll& socketPoll,
+                               const AsyncDownloadCallback& asyncDownloadCallback);
+
+    /// Tries the next of uris, if any, or reports the failure.
+    void asyncDownloadFailed(std::vector<std::pair<Poco::URI, std::string>> uris,
+                             const Authorization& auth, SocketPoll& socketPoll,
+                             const AsyncDownloadCallback& asyncDownloadCallback);
+
+    /// Saves the storage certificate next to the downloaded document and
+    /// marks it downloaded. Returns the path of the document to load.
+    std::string completeDownload(const std::string& wopiCert, const std::string& subjectHash);
+
 private:
     /// A URl provided by the WOPI host to use for GetFile.
     std::string _fileUrl;
@@ -265,6 +314,9 @@ private:
     /// The http::Session used for locking asynchronously.
     std::shared_ptr<http::Session> _lockHttpSession;
 
+    /// The http::Session used for downloading asynchronously.
+    std::shared_ptr<http::Session> _downloadHttpSession;
+
     /// Filename converter to UTF-7.
     Util::CharacterConverter _utf7Converter;
 